@@ -0,0 +1,801 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "font.h"
+#include "image.h"
+#include "imageConvert.h"
+#include "imageGraphics.h"
+#include "imagePalette.h"
+#include "loadpng.h"
+#include "savepng.h"
+
+#include "bcm_host.h"
+
+//-------------------------------------------------------------------------
+
+#define NDEBUG
+
+#define BENCH_MAX_SIZES 8
+
+//-------------------------------------------------------------------------
+
+const char *program = NULL;
+
+// Keeps results the compiler could otherwise throw away.
+
+volatile uint32_t sink = 0;
+
+// A temporary file holding a png of the image being benchmarked, written
+// by savePng and read back by loadPng. NULL for indexed images.
+
+static FILE *pngFile = NULL;
+
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    int32_t width;
+    int32_t height;
+} BENCH_SIZE_T;
+
+// What a benchmark runs on. scratch holds width x height RGBA8 pixels,
+// enough for any benchmark to stage a copy of the image in.
+
+typedef struct
+{
+    IMAGE_T image;
+    const IMAGE_TYPE_INFO_T *typeInfo;
+    RGBA8_T *scratch;
+    IMAGE_CONVERT_ROW_T convertRow;
+} BENCH_T;
+
+// Each pass returns the number of pixels it touched and sets bytes to the
+// memory it wrote or read, or returns 0 if it does not apply to the type.
+
+typedef int64_t (*BENCH_PASS_T)(BENCH_T *bench, int64_t *bytes);
+
+typedef struct
+{
+    const char *name;
+    BENCH_PASS_T pass;
+} BENCH_ENTRY_T;
+
+//-------------------------------------------------------------------------
+
+static int64_t
+imageBytes(
+    const IMAGE_T *image,
+    int64_t pixels)
+{
+    return (pixels * image->bitsPerPixel) / 8;
+}
+
+//-------------------------------------------------------------------------
+
+static int64_t
+nowNanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec * INT64_C(1000000000)) + now.tv_nsec;
+}
+
+//-------------------------------------------------------------------------
+
+static int64_t
+setPixelPass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    IMAGE_T *image = &(bench->image);
+    RGBA8_T rgb = { 0, 0, 0, 255 };
+
+    int32_t y;
+    for (y = 0 ; y < image->height ; y++)
+    {
+        int32_t x;
+        for (x = 0 ; x < image->width ; x++)
+        {
+            if (bench->typeInfo->isIndexed)
+            {
+                setPixelIndexed(image, x, y, (x ^ y) & 0x0F);
+            }
+            else
+            {
+                rgb.red = x;
+                rgb.green = y;
+                setPixelRGB(image, x, y, &rgb);
+            }
+        }
+    }
+
+    int64_t pixels = (int64_t)(image->width) * image->height;
+    *bytes = imageBytes(image, pixels);
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+static int64_t
+clearPass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    IMAGE_T *image = &(bench->image);
+    static RGBA8_T rgb = { 0x20, 0x40, 0x80, 0xFF };
+
+    if (bench->typeInfo->isIndexed)
+    {
+        clearImageIndexed(image, 1);
+    }
+    else
+    {
+        clearImageRGB(image, &rgb);
+    }
+
+    int64_t pixels = (int64_t)(image->width) * image->height;
+    *bytes = imageBytes(image, pixels);
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+// Lines fanning out from a corner, at every angle the image allows.
+
+static int64_t
+linePass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    IMAGE_T *image = &(bench->image);
+    static RGBA8_T rgb = { 0xFF, 0xFF, 0x00, 0xFF };
+    int32_t right = image->width - 1;
+    int32_t bottom = image->height - 1;
+    int64_t pixels = 0;
+
+    int32_t y;
+    for (y = 0 ; y < image->height ; y += 4)
+    {
+        if (bench->typeInfo->isIndexed)
+        {
+            imageLineIndexed(image, 0, 0, right, y, 2);
+        }
+        else
+        {
+            imageLineRGB(image, 0, 0, right, y, &rgb);
+        }
+
+        pixels += ((right > y) ? right : y) + 1;
+    }
+
+    int32_t x;
+    for (x = 0 ; x < image->width ; x += 4)
+    {
+        if (bench->typeInfo->isIndexed)
+        {
+            imageLineIndexed(image, 0, 0, x, bottom, 2);
+        }
+        else
+        {
+            imageLineRGB(image, 0, 0, x, bottom, &rgb);
+        }
+
+        pixels += ((x > bottom) ? x : bottom) + 1;
+    }
+
+    *bytes = imageBytes(image, pixels);
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+// Fill the image with rows of text. Every pixel of each glyph cell is
+// counted, as each is written whether it is set or not.
+
+static int64_t
+textPass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    static const char *text = "The quick brown fox jumps over the lazy dog";
+    static RGBA8_T rgb = { 0xFF, 0xFF, 0xFF, 0xFF };
+
+    IMAGE_T *image = &(bench->image);
+    int32_t columns = image->width / FONT_WIDTH;
+    int32_t length = strlen(text);
+
+    if (columns < 1 || image->height < FONT_HEIGHT)
+    {
+        return 0;
+    }
+
+    if (columns < length)
+    {
+        length = columns;
+    }
+
+    char line[length + 1];
+    memcpy(line, text, length);
+    line[length] = '\0';
+
+    int64_t pixels = 0;
+
+    int32_t y;
+    for (y = 0 ; y + FONT_HEIGHT <= image->height ; y += FONT_HEIGHT)
+    {
+        if (bench->typeInfo->isIndexed)
+        {
+            drawStringIndexed(0, y, line, 3, image);
+        }
+        else
+        {
+            drawStringRGB(0, y, line, &rgb, image);
+        }
+
+        pixels += length * FONT_WIDTH * FONT_HEIGHT;
+    }
+
+    *bytes = imageBytes(image, pixels);
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+// Convert the scratch pixels into the image a row at a time.
+
+static int64_t
+convertRowPass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    IMAGE_T *image = &(bench->image);
+
+    if (bench->convertRow == NULL)
+    {
+        return 0;
+    }
+
+    int32_t y;
+    for (y = 0 ; y < image->height ; y++)
+    {
+        bench->convertRow((uint8_t *)(image->buffer) + (y * image->pitch),
+                          bench->scratch + (y * image->width),
+                          0,
+                          y,
+                          image->width);
+    }
+
+    int64_t pixels = (int64_t)(image->width) * image->height;
+    *bytes = pixels * sizeof(RGBA8_T) + imageBytes(image, pixels);
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+// Pack the scratch pixels into 16 and 32 bit palette entries and back.
+// This does not depend on the image type, so it only runs for RGBA32.
+
+static int64_t
+palettePass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    IMAGE_T *image = &(bench->image);
+
+    if (image->type != VC_IMAGE_RGBA32)
+    {
+        return 0;
+    }
+
+    int64_t pixels = (int64_t)(image->width) * image->height;
+    uint32_t total = 0;
+    RGBA8_T rgba;
+
+    int64_t i;
+    for (i = 0 ; i < pixels ; i++)
+    {
+        uint16_t entry16 = rgbToPalette16Entry(&(bench->scratch[i]));
+        palette16EntryToRgb(entry16, &rgba);
+        total += rgba.red;
+
+        uint32_t entry32 = rgbaToPalette32Entry(&(bench->scratch[i]));
+        palette32EntryToRgba(entry32, &rgba);
+        total += rgba.alpha;
+    }
+
+    sink += total;
+    *bytes = pixels * 2 * (sizeof(uint16_t) + sizeof(uint32_t));
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+static int64_t
+savePngPass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    IMAGE_T *image = &(bench->image);
+
+    if (pngFile == NULL)
+    {
+        return 0;
+    }
+
+    rewind(pngFile);
+
+    if ((ftruncate(fileno(pngFile), 0) != 0) ||
+        (savePngFile(image, pngFile) == false))
+    {
+        return 0;
+    }
+
+    fflush(pngFile);
+
+    int64_t pixels = (int64_t)(image->width) * image->height;
+    *bytes = imageBytes(image, pixels);
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+static int64_t
+loadPngPass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    IMAGE_T loaded;
+
+    if (pngFile == NULL)
+    {
+        return 0;
+    }
+
+    rewind(pngFile);
+
+    if (loadPngFile(&loaded, pngFile) == false)
+    {
+        return 0;
+    }
+
+    int64_t pixels = (int64_t)(loaded.width) * loaded.height;
+    *bytes = imageBytes(&loaded, pixels);
+    sink += *(uint8_t *)(loaded.buffer);
+
+    destroyImage(&loaded);
+
+    (void)bench;
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+// Load the png back into an image of the type being timed, which converts
+// it in the pool as it is decoded.
+
+static int64_t
+loadPngAsPass(
+    BENCH_T *bench,
+    int64_t *bytes)
+{
+    IMAGE_T loaded;
+
+    if ((pngFile == NULL) || (bench->image.convertRow == NULL))
+    {
+        return 0;
+    }
+
+    rewind(pngFile);
+
+    if (loadPngFileAs(&loaded,
+                      pngFile,
+                      bench->image.type,
+                      false) == false)
+    {
+        return 0;
+    }
+
+    int64_t pixels = (int64_t)(loaded.width) * loaded.height;
+    *bytes = imageBytes(&loaded, pixels);
+    sink += *(uint8_t *)(loaded.buffer);
+
+    destroyImage(&loaded);
+
+    return pixels;
+}
+
+//-------------------------------------------------------------------------
+
+static BENCH_ENTRY_T benchmarks[] =
+{
+    { "setPixel", setPixelPass },
+    { "clear", clearPass },
+    { "line", linePass },
+    { "text", textPass },
+    { "convertRow", convertRowPass },
+    { "palette", palettePass },
+    { "savePng", savePngPass },
+    { "loadPng", loadPngPass },
+    { "loadPngAs", loadPngAsPass },
+};
+
+static size_t numberOfBenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+//-------------------------------------------------------------------------
+
+// Repeat the pass until at least minimumNanos have gone by, then print a
+// line of results. Returns false if the pass does not apply.
+
+static bool
+runBenchmark(
+    FILE *output,
+    BENCH_T *bench,
+    const BENCH_ENTRY_T *entry,
+    int64_t minimumNanos)
+{
+    int64_t bytes = 0;
+    int64_t pixels = 0;
+    int64_t totalBytes = 0;
+    int64_t totalPixels = 0;
+    int32_t iterations = 0;
+
+    // One untimed pass, to warm the caches and see if it applies at all.
+
+    if (entry->pass(bench, &bytes) == 0)
+    {
+        return false;
+    }
+
+    int64_t start = nowNanos();
+    int64_t elapsed = 0;
+
+    do
+    {
+        pixels = entry->pass(bench, &bytes);
+        totalPixels += pixels;
+        totalBytes += bytes;
+        ++iterations;
+        elapsed = nowNanos() - start;
+    }
+    while (elapsed < minimumNanos);
+
+    double nsPerPixel = (double)elapsed / (double)totalPixels;
+    double mbPerSecond = ((double)totalBytes / (1024.0 * 1024.0))
+                       / ((double)elapsed / 1.0e9);
+
+    fprintf(output,
+            "%s,%s,%d,%d,%d,%lld,%lld,%.3f,%.1f\n",
+            entry->name,
+            bench->typeInfo->name,
+            bench->image.width,
+            bench->image.height,
+            iterations,
+            (long long)totalPixels,
+            (long long)elapsed,
+            nsPerPixel,
+            mbPerSecond);
+
+    fflush(output);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+fillScratch(
+    RGBA8_T *scratch,
+    int32_t width,
+    int32_t height)
+{
+    int32_t y;
+    for (y = 0 ; y < height ; y++)
+    {
+        int32_t x;
+        for (x = 0 ; x < width ; x++)
+        {
+            RGBA8_T *pixel = scratch + (y * width) + x;
+
+            pixel->red = (x * 255) / width;
+            pixel->green = (y * 255) / height;
+            pixel->blue = (x ^ y) & 0xFF;
+            pixel->alpha = 255 - ((x + y) & 0x7F);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+runSize(
+    FILE *output,
+    const IMAGE_TYPE_INFO_T *typeInfo,
+    const BENCH_SIZE_T *size,
+    const char *only,
+    int64_t minimumNanos)
+{
+    BENCH_T bench;
+
+    bench.typeInfo = typeInfo;
+    bench.convertRow = findRowConverter(typeInfo->type, false);
+
+    if (initImage(&(bench.image),
+                  typeInfo->type,
+                  size->width,
+                  size->height,
+                  false) == false)
+    {
+        fprintf(stderr,
+                "%s: unable to create %s image %dx%d\n",
+                program,
+                typeInfo->name,
+                size->width,
+                size->height);
+
+        return;
+    }
+
+    bench.scratch = malloc((size_t)(size->width)
+                           * size->height
+                           * sizeof(RGBA8_T));
+
+    if (bench.scratch == NULL)
+    {
+        fprintf(stderr, "%s: memory exhausted\n", program);
+        exit(EXIT_FAILURE);
+    }
+
+    fillScratch(bench.scratch, size->width, size->height);
+
+    if (bench.convertRow != NULL)
+    {
+        convertRowPass(&bench, &(int64_t){0});
+    }
+
+    //---------------------------------------------------------------------
+
+    if (typeInfo->isIndexed == false)
+    {
+        pngFile = tmpfile();
+
+        if ((pngFile != NULL) &&
+            (savePngFile(&(bench.image), pngFile) == false))
+        {
+            fclose(pngFile);
+            pngFile = NULL;
+        }
+    }
+
+    size_t i;
+    for (i = 0 ; i < numberOfBenchmarks ; i++)
+    {
+        if ((only == NULL) || (strcasecmp(only, benchmarks[i].name) == 0))
+        {
+            runBenchmark(output, &bench, &(benchmarks[i]), minimumNanos);
+        }
+    }
+
+    if (pngFile != NULL)
+    {
+        fclose(pngFile);
+        pngFile = NULL;
+    }
+
+    free(bench.scratch);
+    destroyImage(&(bench.image));
+}
+
+//-------------------------------------------------------------------------
+
+static const char *typeNames[] =
+{
+    "4BPP",
+    "8BPP",
+    "RGB565",
+    "RGB888",
+    "RGBA16",
+    "RGBA32"
+};
+
+static size_t numberOfTypeNames = sizeof(typeNames) / sizeof(typeNames[0]);
+
+//-------------------------------------------------------------------------
+
+void usage(void)
+{
+    fprintf(stderr, "Usage: %s ", program);
+    fprintf(stderr, "[-b <benchmark>] [-m <milliseconds>] [-o <file>] ");
+    fprintf(stderr, "[-s <width>x<height>] [-t <type>]\n");
+    fprintf(stderr, "    -b - run only this benchmark, one of:");
+
+    size_t i;
+    for (i = 0 ; i < numberOfBenchmarks ; i++)
+    {
+        fprintf(stderr, " %s", benchmarks[i].name);
+    }
+
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -m - minimum time for each result (default 250)\n");
+    fprintf(stderr, "    -o - write results to a file instead of stdout\n");
+    fprintf(stderr, "    -s - image size, may be repeated ");
+    fprintf(stderr, "(default 64x64, 320x240 and 1920x1080)\n");
+    fprintf(stderr, "    -t - run only this image type, one of:");
+    printImageTypes(stderr, " ", "", IMAGE_TYPES_ALL);
+    fprintf(stderr, "\n");
+
+    exit(EXIT_FAILURE);
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    int opt = 0;
+
+    const char *only = NULL;
+    const char *typeName = NULL;
+    const char *outputPath = NULL;
+    int64_t minimumNanos = 250 * INT64_C(1000000);
+    BENCH_SIZE_T sizes[BENCH_MAX_SIZES];
+    int32_t numberOfSizes = 0;
+
+    program = basename(argv[0]);
+
+    //---------------------------------------------------------------------
+
+    while ((opt = getopt(argc, argv, "b:m:o:s:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+
+            only = optarg;
+            break;
+
+        case 'm':
+
+            minimumNanos = strtol(optarg, NULL, 10) * INT64_C(1000000);
+            break;
+
+        case 'o':
+
+            outputPath = optarg;
+            break;
+
+        case 's':
+
+            if ((numberOfSizes == BENCH_MAX_SIZES) ||
+                (sscanf(optarg,
+                        "%dx%d",
+                        &(sizes[numberOfSizes].width),
+                        &(sizes[numberOfSizes].height)) != 2) ||
+                (sizes[numberOfSizes].width < 1) ||
+                (sizes[numberOfSizes].height < 1))
+            {
+                usage();
+            }
+
+            ++numberOfSizes;
+            break;
+
+        case 't':
+
+            typeName = optarg;
+            break;
+
+        default:
+
+            usage();
+            break;
+        }
+    }
+
+    if (numberOfSizes == 0)
+    {
+        sizes[numberOfSizes++] = (BENCH_SIZE_T){ 64, 64 };
+        sizes[numberOfSizes++] = (BENCH_SIZE_T){ 320, 240 };
+        sizes[numberOfSizes++] = (BENCH_SIZE_T){ 1920, 1080 };
+    }
+
+    //---------------------------------------------------------------------
+
+    FILE *output = stdout;
+
+    if (outputPath != NULL)
+    {
+        output = fopen(outputPath, "w");
+
+        if (output == NULL)
+        {
+            fprintf(stderr,
+                    "%s: unable to open %s\n",
+                    program,
+                    outputPath);
+
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    fprintf(output,
+            "benchmark,type,width,height,iterations,pixels,"
+            "nanoseconds,ns_per_pixel,mb_per_second\n");
+
+    //---------------------------------------------------------------------
+
+    bool found = false;
+
+    size_t t;
+    for (t = 0 ; t < numberOfTypeNames ; t++)
+    {
+        IMAGE_TYPE_INFO_T typeInfo;
+
+        if (((typeName == NULL) || (strcasecmp(typeName, typeNames[t]) == 0))
+            && findImageType(&typeInfo, typeNames[t], IMAGE_TYPES_ALL))
+        {
+            found = true;
+
+            int32_t s;
+            for (s = 0 ; s < numberOfSizes ; s++)
+            {
+                runSize(output, &typeInfo, &(sizes[s]), only, minimumNanos);
+            }
+        }
+    }
+
+    if (found == false)
+    {
+        fprintf(stderr, "%s: unknown image type %s\n", program, typeName);
+        exit(EXIT_FAILURE);
+    }
+
+    if (output != stdout)
+    {
+        fclose(output);
+    }
+
+    return 0;
+}
@@ -0,0 +1,271 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "image.h"
+
+#include "bcm_host.h"
+
+//-------------------------------------------------------------------------
+
+#define NDEBUG
+
+//-------------------------------------------------------------------------
+
+const char *program = NULL;
+
+volatile bool run = true;
+
+//-------------------------------------------------------------------------
+
+static void
+signalHandler(
+    int signalNumber)
+{
+    switch (signalNumber)
+    {
+    case SIGINT:
+    case SIGTERM:
+
+        run = false;
+        break;
+    };
+}
+
+//-------------------------------------------------------------------------
+
+void usage(void)
+{
+    fprintf(stderr, "Usage: %s ", program);
+    fprintf(stderr, "[-d <number>] [-i <interval>] [-n <frames>] ");
+    fprintf(stderr, "[-t <type>] [-w <width>] [-h <height>] [-r] ");
+    fprintf(stderr, "<output>\n");
+    fprintf(stderr, "    -d - Raspberry Pi display number\n");
+    fprintf(stderr, "    -i - milliseconds between frames (default 1000)\n");
+    fprintf(stderr, "    -n - stop after this many frames\n");
+    fprintf(stderr, "    -t - image type (default RGB888)\n");
+    fprintf(stderr, "    -w - width to scale to (default display width)\n");
+    fprintf(stderr, "    -h - height to scale to (default display height)\n");
+    fprintf(stderr, "    -r - write raw frames rather than pngs\n");
+    fprintf(stderr, "    <output> - a file, - for stdout, or a pattern\n");
+    fprintf(stderr, "               with %%u in it for a png per frame,\n");
+    fprintf(stderr, "               e.g. frame%%05u.png\n");
+
+    exit(EXIT_FAILURE);
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    uint32_t displayNumber = 0;
+    uint32_t interval = 1000;
+    uint32_t frames = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    bool raw = false;
+    IMAGE_TYPE_INFO_T typeInfo = { "RGB888", VC_IMAGE_RGB888, false, false };
+
+    program = basename(argv[0]);
+
+    //---------------------------------------------------------------------
+
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "d:i:n:t:w:h:r")) != -1)
+    {
+        switch(opt)
+        {
+        case 'd':
+
+            displayNumber = atoi(optarg);
+            break;
+
+        case 'i':
+
+            interval = atoi(optarg);
+            break;
+
+        case 'n':
+
+            frames = atoi(optarg);
+            break;
+
+        case 't':
+
+            if ((findImageType(&typeInfo,
+                               optarg,
+                               IMAGE_TYPES_ALL_DIRECT_COLOUR) == false) ||
+                (typeInfo.type == VC_IMAGE_RGBA16))
+            {
+                fprintf(stderr, "%s: unsupported type %s, use one of",
+                        program,
+                        optarg);
+                fprintf(stderr, " RGB565 RGB888 RGBA32\n");
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
+        case 'w':
+
+            width = atoi(optarg);
+            break;
+
+        case 'h':
+
+            height = atoi(optarg);
+            break;
+
+        case 'r':
+
+            raw = true;
+            break;
+
+        default:
+
+            usage();
+            break;
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    if (optind >= argc)
+    {
+        usage();
+    }
+
+    const char *output = argv[optind];
+    bool files = (strchr(output, '%') != NULL);
+
+    if (files && (validCapturePattern(output) == false))
+    {
+        fprintf(stderr,
+                "%s: %s needs exactly one %%u or %%0Nu, and no other %%\n",
+                program,
+                output);
+        exit(EXIT_FAILURE);
+    }
+
+    if (files && raw)
+    {
+        fprintf(stderr, "%s: raw frames go to a single stream\n", program);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *file = NULL;
+
+    if (files == false)
+    {
+        file = (strcmp(output, "-") == 0) ? stdout : fopen(output, "wb");
+
+        if (file == NULL)
+        {
+            perror(output);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    if ((signal(SIGINT, signalHandler) == SIG_ERR) ||
+        (signal(SIGTERM, signalHandler) == SIG_ERR))
+    {
+        perror("installing signal handlers");
+        exit(EXIT_FAILURE);
+    }
+
+    // A reader that goes away shows up as a failed write instead.
+
+    signal(SIGPIPE, SIG_IGN);
+
+    //---------------------------------------------------------------------
+
+    bcm_host_init();
+
+    DISPMANX_DISPLAY_HANDLE_T display
+        = vc_dispmanx_display_open(displayNumber);
+    assert(display != 0);
+
+    //---------------------------------------------------------------------
+
+    CAPTURE_T capture;
+    initCapture(&capture, display, typeInfo.type, width, height, interval);
+    setMaxFramesCapture(&capture, frames);
+
+    if (files)
+    {
+        startFilesCapture(&capture, output);
+    }
+    else
+    {
+        startStreamCapture(&capture,
+                           raw ? CAPTURE_FORMAT_RAW : CAPTURE_FORMAT_PNG,
+                           file);
+    }
+
+    while (run && runningCapture(&capture))
+    {
+        usleep(100000);
+    }
+
+    bool result = stopCapture(&capture);
+
+    fprintf(stderr,
+            "%s: %u frames captured, %u written, %u dropped\n",
+            program,
+            capture.captured,
+            capture.encoded,
+            capture.dropped);
+
+    destroyCapture(&capture);
+
+    //---------------------------------------------------------------------
+
+    if ((file != NULL) && (file != stdout))
+    {
+        fclose(file);
+    }
+
+    int status = vc_dispmanx_display_close(display);
+    assert(status == 0);
+
+    //---------------------------------------------------------------------
+
+    return result ? 0 : 1;
+}
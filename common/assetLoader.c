@@ -0,0 +1,276 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "assetLoader.h"
+#include "imageCache.h"
+#include "memoryAccount.h"
+
+//-------------------------------------------------------------------------
+
+#define ASSET_LOADER_ACCOUNT "assetLoader"
+
+//-------------------------------------------------------------------------
+
+static void
+freeBufferView(
+    IMAGE_T *image)
+{
+}
+
+//-------------------------------------------------------------------------
+
+static void
+loadTask(
+    void *arg,
+    int32_t start,
+    int32_t end)
+{
+    ASSET_LOADER_T *loader = arg;
+
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(ASSET_LOADER_ACCOUNT));
+
+    int32_t i;
+    for (i = start ; i < end ; i++)
+    {
+        ASSET_T *asset = &(loader->assets[i]);
+        ASSET_STATE_T state = ASSET_FAILED;
+
+        if (loadPngCached(&(asset->layer.image), asset->path))
+        {
+            if (asset->createResource)
+            {
+                createResourceImageLayer(&(asset->layer),
+                                         asset->layer.layer);
+            }
+
+            state = ASSET_READY;
+        }
+
+        __atomic_store_n(&(asset->state), state, __ATOMIC_RELEASE);
+    }
+
+    leaveMemoryAccount(previous);
+}
+
+//-------------------------------------------------------------------------
+
+void
+initAssetLoader(
+    ASSET_LOADER_T *loader)
+{
+    loader->assets = NULL;
+    loader->numberOfAssets = 0;
+    loader->capacity = 0;
+    loader->started = false;
+}
+
+//-------------------------------------------------------------------------
+
+static int32_t
+addAssetLoader(
+    ASSET_LOADER_T *loader,
+    const char *path,
+    bool createResource,
+    int32_t layer)
+{
+    assert(loader->started == false);
+
+    if (loader->numberOfAssets == loader->capacity)
+    {
+        loader->capacity = (loader->capacity == 0) ? 8 : loader->capacity * 2;
+
+        ASSET_T *assets = realloc(loader->assets,
+                                  loader->capacity * sizeof(ASSET_T));
+
+        if (assets == NULL)
+        {
+            fprintf(stderr, "assetLoader: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+
+        loader->assets = assets;
+    }
+
+    ASSET_T *asset = &(loader->assets[loader->numberOfAssets]);
+
+    asset->path = path;
+    asset->createResource = createResource;
+    asset->layer.layer = layer;
+    asset->layer.image.buffer = NULL;
+    asset->state = ASSET_LOADING;
+
+    return loader->numberOfAssets++;
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+addImageAssetLoader(
+    ASSET_LOADER_T *loader,
+    const char *path)
+{
+    return addAssetLoader(loader, path, false, 0);
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+addLayerAssetLoader(
+    ASSET_LOADER_T *loader,
+    const char *path,
+    int32_t layer)
+{
+    return addAssetLoader(loader, path, true, layer);
+}
+
+//-------------------------------------------------------------------------
+
+void
+startAssetLoader(
+    ASSET_LOADER_T *loader)
+{
+    assert(loader->started == false);
+
+    initThreadPool(&(loader->pool), 0);
+    loader->started = true;
+
+    startForThreadPool(&(loader->pool),
+                       loader->numberOfAssets,
+                       1,
+                       loadTask,
+                       loader);
+}
+
+//-------------------------------------------------------------------------
+
+ASSET_STATE_T
+stateAssetLoader(
+    ASSET_LOADER_T *loader,
+    int32_t index)
+{
+    return __atomic_load_n(&(loader->assets[index].state), __ATOMIC_ACQUIRE);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+waitAssetLoader(
+    ASSET_LOADER_T *loader)
+{
+    if (loader->started)
+    {
+        waitThreadPool(&(loader->pool));
+    }
+
+    bool ready = true;
+
+    int32_t i;
+    for (i = 0 ; i < loader->numberOfAssets ; i++)
+    {
+        if (stateAssetLoader(loader, i) != ASSET_READY)
+        {
+            ready = false;
+        }
+    }
+
+    return ready;
+}
+
+//-------------------------------------------------------------------------
+
+void
+viewImageAssetLoader(
+    ASSET_LOADER_T *loader,
+    int32_t index,
+    IMAGE_T *image)
+{
+    assert(stateAssetLoader(loader, index) == ASSET_READY);
+
+    *image = loader->assets[index].layer.image;
+    image->dirty = NULL;
+    image->freeBuffer = freeBufferView;
+}
+
+//-------------------------------------------------------------------------
+
+IMAGE_LAYER_T *
+layerAssetLoader(
+    ASSET_LOADER_T *loader,
+    int32_t index)
+{
+    ASSET_T *asset = &(loader->assets[index]);
+
+    assert(asset->createResource);
+    assert(stateAssetLoader(loader, index) == ASSET_READY);
+
+    return &(asset->layer);
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyAssetLoader(
+    ASSET_LOADER_T *loader)
+{
+    if (loader->started)
+    {
+        waitThreadPool(&(loader->pool));
+        destroyThreadPool(&(loader->pool));
+        loader->started = false;
+    }
+
+    int32_t i;
+    for (i = 0 ; i < loader->numberOfAssets ; i++)
+    {
+        ASSET_T *asset = &(loader->assets[i]);
+
+        if (asset->state != ASSET_READY)
+        {
+            continue;
+        }
+
+        if (asset->createResource)
+        {
+            destroyImageLayer(&(asset->layer));
+        }
+        else
+        {
+            destroyImage(&(asset->layer.image));
+        }
+    }
+
+    free(loader->assets);
+    loader->assets = NULL;
+    loader->numberOfAssets = 0;
+    loader->capacity = 0;
+}
+
@@ -0,0 +1,147 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "imageLayer.h"
+#include "threadPool.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// An asset loader decodes a list of pngs on threads of its own, so that a
+// program can put its first frame on the screen straight away and bring
+// each image in as it arrives. The pngs go through the image cache (see
+// imageCache.h). An asset added as a layer also has its resource created
+// and written on the loader thread, ready to be shown.
+//
+// Each asset is either loading, ready or failed. Once an asset is ready
+// it does not change until the loader is destroyed, so any thread that
+// has seen it ready can use it.
+
+typedef enum
+{
+    ASSET_LOADING,
+    ASSET_READY,
+    ASSET_FAILED
+} ASSET_STATE_T;
+
+typedef struct
+{
+    const char *path;
+    bool createResource;
+    IMAGE_LAYER_T layer;
+    ASSET_STATE_T state;
+} ASSET_T;
+
+typedef struct
+{
+    ASSET_T *assets;
+    int32_t numberOfAssets;
+    int32_t capacity;
+    bool started;
+    THREAD_POOL_T pool;
+} ASSET_LOADER_T;
+
+//-------------------------------------------------------------------------
+
+void
+initAssetLoader(
+    ASSET_LOADER_T *loader);
+
+// Add a png to be decoded, before the loader is started. path must stay
+// valid until the loader is destroyed. Returns the index of the asset.
+
+int32_t
+addImageAssetLoader(
+    ASSET_LOADER_T *loader,
+    const char *path);
+
+// As addImageAssetLoader(), and create a resource for the image as the
+// given layer.
+
+int32_t
+addLayerAssetLoader(
+    ASSET_LOADER_T *loader,
+    const char *path,
+    int32_t layer);
+
+// Start decoding, on one thread per core, in the order the assets were
+// added, and return straight away.
+
+void
+startAssetLoader(
+    ASSET_LOADER_T *loader);
+
+ASSET_STATE_T
+stateAssetLoader(
+    ASSET_LOADER_T *loader,
+    int32_t index);
+
+// Wait for every asset to be ready or to have failed. Returns true if
+// they are all ready.
+
+bool
+waitAssetLoader(
+    ASSET_LOADER_T *loader);
+
+// Fill in image as a copy of a ready asset that shares its pixels, for a
+// layer that takes an image of its own (see initSpriteLayerImage()).
+// Destroying the copy leaves the pixels alone; the asset must outlive it.
+
+void
+viewImageAssetLoader(
+    ASSET_LOADER_T *loader,
+    int32_t index,
+    IMAGE_T *image);
+
+// The layer of a ready asset that was added with addLayerAssetLoader().
+// Show it on a display through shareImageLayer().
+
+IMAGE_LAYER_T *
+layerAssetLoader(
+    ASSET_LOADER_T *loader,
+    int32_t index);
+
+// Waits for the loader to finish, then destroys every asset.
+
+void
+destroyAssetLoader(
+    ASSET_LOADER_T *loader);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
+
@@ -26,38 +26,216 @@
 //-------------------------------------------------------------------------
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "backgroundLayer.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
 
 //-------------------------------------------------------------------------
 
-void
-initBackgroundLayer(
-    BACKGROUND_LAYER_T *bg,
-    uint16_t colour,
-    int32_t layer)
+typedef struct
 {
-    int result = 0;
-    VC_IMAGE_TYPE_T type = VC_IMAGE_RGBA16;
-    uint32_t vc_image_ptr;
+    uint16_t colour;
+    int32_t users;
+    DISPMANX_RESOURCE_HANDLE_T resource;
+    DISPMANX_UPDATE_HANDLE_T releasedIn;
+} BACKGROUND_COLOUR_T;
 
-    bg->resource = vc_dispmanx_resource_create(type, 1, 1, &vc_image_ptr);
-    assert(bg->resource != 0);
+static pthread_mutex_t coloursMutex = PTHREAD_MUTEX_INITIALIZER;
 
-    //---------------------------------------------------------------------
+static BACKGROUND_COLOUR_T *colours = NULL;
+static int32_t numberOfColours = 0;
+static int32_t coloursCapacity = 0;
+
+//-------------------------------------------------------------------------
+
+static DISPMANX_RESOURCE_HANDLE_T
+createColourResource(
+    uint16_t colour)
+{
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount("backgroundLayer"));
+
+    DISPMANX_RESOURCE_HANDLE_T resource =
+        acquireResourcePool(VC_IMAGE_RGBA16, 1, 1, 0, 0);
+    assert(resource != 0);
+
+    leaveMemoryAccount(previous);
 
     VC_RECT_T dst_rect;
     vc_dispmanx_rect_set(&dst_rect, 0, 0, 1, 1);
 
-    bg->layer = layer;
-
-    result = vc_dispmanx_resource_write_data(bg->resource,
-                                             type,
-                                             sizeof(colour),
-                                             &colour,
-                                             &dst_rect);
+    int result = vc_dispmanx_resource_write_data(resource,
+                                                 VC_IMAGE_RGBA16,
+                                                 sizeof(colour),
+                                                 &colour,
+                                                 &dst_rect);
     assert(result == 0);
+
+    return resource;
+}
+
+//-------------------------------------------------------------------------
+
+// The slot for a new colour: a free one if the cache is not full, else
+// the first colour no longer in use, else a new slot at the end. A colour
+// whose last user let go of it in update may still be shown until update
+// is submitted, so its resource is not reused for another colour in it.
+
+static BACKGROUND_COLOUR_T *
+newColourSlot(
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    if (numberOfColours >= BACKGROUND_LAYER_MAX_COLOURS)
+    {
+        int32_t i;
+        for (i = 0 ; i < numberOfColours ; i++)
+        {
+            if ((colours[i].users == 0) &&
+                ((update == 0) || (colours[i].releasedIn != update)))
+            {
+                releaseResourcePool(colours[i].resource);
+                return &(colours[i]);
+            }
+        }
+    }
+
+    if (numberOfColours == coloursCapacity)
+    {
+        coloursCapacity = (coloursCapacity == 0)
+                        ? BACKGROUND_LAYER_MAX_COLOURS
+                        : coloursCapacity * 2;
+
+        BACKGROUND_COLOUR_T *entries =
+            realloc(colours, coloursCapacity * sizeof(BACKGROUND_COLOUR_T));
+
+        if (entries == NULL)
+        {
+            fprintf(stderr, "backgroundLayer: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+
+        colours = entries;
+    }
+
+    return &(colours[numberOfColours++]);
+}
+
+//-------------------------------------------------------------------------
+
+static DISPMANX_RESOURCE_HANDLE_T
+acquireColour(
+    uint16_t colour,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    pthread_mutex_lock(&coloursMutex);
+
+    BACKGROUND_COLOUR_T *entry = NULL;
+
+    int32_t i;
+    for (i = 0 ; i < numberOfColours ; i++)
+    {
+        if (colours[i].colour == colour)
+        {
+            entry = &(colours[i]);
+            break;
+        }
+    }
+
+    if (entry == NULL)
+    {
+        entry = newColourSlot(update);
+        entry->colour = colour;
+        entry->users = 0;
+        entry->releasedIn = 0;
+        entry->resource = createColourResource(colour);
+    }
+
+    entry->users++;
+
+    DISPMANX_RESOURCE_HANDLE_T resource = entry->resource;
+
+    pthread_mutex_unlock(&coloursMutex);
+
+    return resource;
+}
+
+//-------------------------------------------------------------------------
+
+// update is the one in which the resource stops being shown, or 0 if it
+// is no longer on screen.
+
+static void
+releaseColour(
+    DISPMANX_RESOURCE_HANDLE_T resource,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    pthread_mutex_lock(&coloursMutex);
+
+    int32_t i;
+    for (i = 0 ; i < numberOfColours ; i++)
+    {
+        if (colours[i].resource == resource)
+        {
+            assert(colours[i].users > 0);
+            colours[i].users--;
+            colours[i].releasedIn = update;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&coloursMutex);
+}
+
+//-------------------------------------------------------------------------
+
+// Once no background shows any colour, the cache is emptied, so that a
+// program that has destroyed all its backgrounds holds no resources.
+
+static void
+emptyUnusedColours(void)
+{
+    pthread_mutex_lock(&coloursMutex);
+
+    int32_t i;
+    for (i = 0 ; i < numberOfColours ; i++)
+    {
+        if (colours[i].users > 0)
+        {
+            pthread_mutex_unlock(&coloursMutex);
+            return;
+        }
+    }
+
+    for (i = 0 ; i < numberOfColours ; i++)
+    {
+        releaseResourcePool(colours[i].resource);
+    }
+
+    free(colours);
+    colours = NULL;
+    numberOfColours = 0;
+    coloursCapacity = 0;
+
+    pthread_mutex_unlock(&coloursMutex);
+}
+
+//-------------------------------------------------------------------------
+
+void
+initBackgroundLayer(
+    BACKGROUND_LAYER_T *bg,
+    uint16_t colour,
+    int32_t layer)
+{
+    bg->layer = layer;
+    bg->colour = colour;
+    bg->resource = 0;
+    bg->element = 0;
 }
 
 //-------------------------------------------------------------------------
@@ -77,6 +255,11 @@ addElementBackgroundLayer(
 
     //---------------------------------------------------------------------
 
+    if (bg->resource == 0)
+    {
+        bg->resource = acquireColour(bg->colour, update);
+    }
+
     VC_RECT_T src_rect;
     vc_dispmanx_rect_set(&src_rect, 0, 0, 1, 1);
 
@@ -99,22 +282,74 @@ addElementBackgroundLayer(
 
 //-------------------------------------------------------------------------
 
+void
+setColourBackgroundLayer(
+    BACKGROUND_LAYER_T *bg,
+    uint16_t colour,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    if (colour == bg->colour)
+    {
+        return;
+    }
+
+    bg->colour = colour;
+
+    if (bg->resource == 0)
+    {
+        return;
+    }
+
+    DISPMANX_RESOURCE_HANDLE_T previous = bg->resource;
+    bg->resource = acquireColour(colour, update);
+
+    if (bg->element != 0)
+    {
+        int result = vc_dispmanx_element_change_source(update,
+                                                       bg->element,
+                                                       bg->resource);
+        assert(result == 0);
+    }
+
+    releaseColour(previous, update);
+}
+
+//-------------------------------------------------------------------------
+
+void
+removeElementBackgroundLayer(
+    BACKGROUND_LAYER_T *bg,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int result = vc_dispmanx_element_remove(update, bg->element);
+    assert(result == 0);
+
+    bg->element = 0;
+}
+
+//-------------------------------------------------------------------------
+
 void
 destroyBackgroundLayer(
     BACKGROUND_LAYER_T *bg)
 {
     int result = 0;
 
-    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
-    assert(update != 0);
-
-    result = vc_dispmanx_element_remove(update, bg->element);
-    assert(result == 0);
+    if (bg->element != 0)
+    {
+        DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+        assert(update != 0);
+        removeElementBackgroundLayer(bg, update);
+        result = vc_dispmanx_update_submit_sync(update);
+        assert(result == 0);
+    }
 
-    result = vc_dispmanx_update_submit_sync(update);
-    assert(result == 0);
+    if (bg->resource != 0)
+    {
+        releaseColour(bg->resource, 0);
+        bg->resource = 0;
 
-    result = vc_dispmanx_resource_delete(bg->resource);
-    assert(result == 0);
+        emptyUnusedColours();
+    }
 }
 
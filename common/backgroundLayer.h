@@ -32,17 +32,35 @@
 
 #include "bcm_host.h"
 
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
+// A background is a 1x1 resource stretched over the whole display. Every
+// background of the same colour shows the same resource, which is created
+// the first time the colour is added to a display. The resources are kept
+// in a process wide cache of up to BACKGROUND_LAYER_MAX_COLOURS colours; a
+// colour no longer in use stays cached until its slot is wanted for
+// another one in a later update. Beyond that many colours in use at once,
+// or let go of in the update being built, the cache grows. The cache is
+// emptied when the last background showing a colour is destroyed. Nothing
+// is sent to Dispmanx until the element is added, and then only as part
+// of the caller's update.
+
+#define BACKGROUND_LAYER_MAX_COLOURS 16
+
 typedef struct
 {
     int32_t layer;
+    uint16_t colour;
     DISPMANX_RESOURCE_HANDLE_T resource;
     DISPMANX_ELEMENT_HANDLE_T element;
 } BACKGROUND_LAYER_T;
 
 //-------------------------------------------------------------------------
 
+// colour is 16 bit RGBA (RGBA4444).
+
 void
 initBackgroundLayer(
     BACKGROUND_LAYER_T *bg,
@@ -55,10 +73,30 @@ addElementBackgroundLayer(
     DISPMANX_DISPLAY_HANDLE_T display,
     DISPMANX_UPDATE_HANDLE_T update);
 
-void destroyBackgroundLayer(BACKGROUND_LAYER_T *bg);
+// Show the resource for another colour, as part of update. If the element
+// has not been added yet, it is added in the new colour when it is.
+
+void
+setColourBackgroundLayer(
+    BACKGROUND_LAYER_T *bg,
+    uint16_t colour,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+void
+removeElementBackgroundLayer(
+    BACKGROUND_LAYER_T *bg,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+// If the element has not been removed, it is removed with an update of
+// its own.
 
+void
+destroyBackgroundLayer(
+    BACKGROUND_LAYER_T *bg);
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
 
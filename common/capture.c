@@ -0,0 +1,593 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
+#include "savepng.h"
+
+//-------------------------------------------------------------------------
+
+#define CAPTURE_MAX_PATH 4096
+
+//-------------------------------------------------------------------------
+
+void
+initCapture(
+    CAPTURE_T *capture,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height,
+    uint32_t intervalMilliseconds)
+{
+    if ((width == 0) || (height == 0))
+    {
+        DISPMANX_MODEINFO_T info;
+        int result = vc_dispmanx_display_get_info(display, &info);
+        assert(result == 0);
+
+        width = info.width;
+        height = info.height;
+    }
+
+    // The images are taken from the resource pool once, here, and passed
+    // between the two threads from then on.
+
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount("capture"));
+
+    int32_t i;
+    for (i = 0 ; i < CAPTURE_BUFFERS ; i++)
+    {
+        if (initImage(&(capture->images[i]), type, width, height, false)
+            == false)
+        {
+            fprintf(stderr, "capture: unsupported image type\n");
+            exit(EXIT_FAILURE);
+        }
+
+        capture->freeImages[i] = i;
+    }
+
+    IMAGE_T *image = &(capture->images[0]);
+
+    capture->display = display;
+    capture->resource = acquireResourcePool(type,
+                                            width,
+                                            height,
+                                            image->pitch,
+                                            image->alignedHeight);
+
+    leaveMemoryAccount(previous);
+
+    vc_dispmanx_rect_set(&(capture->rect), 0, 0, width, height);
+
+    capture->interval = intervalMilliseconds * INT64_C(1000);
+    capture->maxFrames = 0;
+    capture->numberOfFreeImages = CAPTURE_BUFFERS;
+    capture->queueStart = 0;
+    capture->queueLength = 0;
+    capture->file = NULL;
+    capture->pattern = NULL;
+    capture->running = false;
+    capture->quit = false;
+    capture->failed = false;
+    capture->captured = 0;
+    capture->dropped = 0;
+    capture->encoded = 0;
+
+    // The capture thread waits on the condition until its next snapshot
+    // is due, against the same clock that it schedules them with.
+
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&(capture->mutex), NULL);
+    pthread_cond_init(&(capture->condition), &attributes);
+
+    pthread_condattr_destroy(&attributes);
+}
+
+//-------------------------------------------------------------------------
+
+void
+setMaxFramesCapture(
+    CAPTURE_T *capture,
+    uint32_t maxFrames)
+{
+    capture->maxFrames = maxFrames;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+addMicroseconds(
+    struct timespec *time,
+    int64_t microseconds)
+{
+    int64_t nanoseconds = time->tv_nsec + (microseconds * 1000);
+
+    time->tv_sec += nanoseconds / 1000000000;
+    time->tv_nsec = nanoseconds % 1000000000;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+lessThan(
+    const struct timespec *a,
+    const struct timespec *b)
+{
+    return (a->tv_sec < b->tv_sec) ||
+           ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+//-------------------------------------------------------------------------
+
+static void *
+captureThread(
+    void *arg)
+{
+    CAPTURE_T *capture = arg;
+
+    struct timespec due;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+
+    while (true)
+    {
+        pthread_mutex_lock(&(capture->mutex));
+
+        bool quit = capture->quit;
+        int32_t index = -1;
+
+        if (quit == false)
+        {
+            if (capture->numberOfFreeImages > 0)
+            {
+                index = capture->freeImages[--(capture->numberOfFreeImages)];
+            }
+            else
+            {
+                ++(capture->dropped);
+            }
+        }
+
+        pthread_mutex_unlock(&(capture->mutex));
+
+        if (quit)
+        {
+            break;
+        }
+
+        //-----------------------------------------------------------------
+
+        if (index != -1)
+        {
+            IMAGE_T *image = &(capture->images[index]);
+
+            int result = vc_dispmanx_snapshot(capture->display,
+                                              capture->resource,
+                                              DISPMANX_NO_ROTATE);
+            assert(result == 0);
+
+            result = vc_dispmanx_resource_read_data(capture->resource,
+                                                    &(capture->rect),
+                                                    image->buffer,
+                                                    image->pitch);
+            assert(result == 0);
+
+            pthread_mutex_lock(&(capture->mutex));
+
+            if (capture->quit)
+            {
+                capture->freeImages[capture->numberOfFreeImages++] = index;
+            }
+            else
+            {
+                int32_t end = (capture->queueStart + capture->queueLength)
+                            % CAPTURE_BUFFERS;
+                capture->queue[end] = index;
+                ++(capture->queueLength);
+                ++(capture->captured);
+
+                pthread_cond_broadcast(&(capture->condition));
+            }
+
+            pthread_mutex_unlock(&(capture->mutex));
+        }
+
+        //-----------------------------------------------------------------
+
+        // A snapshot that was late (the system was busy) is not made up
+        // for with a burst of snapshots; the next is due an interval on.
+        // The wait is on the condition, so that stopCapture() does not
+        // have to wait out the interval.
+
+        addMicroseconds(&due, capture->interval);
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        if (lessThan(&due, &now))
+        {
+            due = now;
+        }
+        else
+        {
+            pthread_mutex_lock(&(capture->mutex));
+
+            while ((capture->quit == false) &&
+                   (pthread_cond_timedwait(&(capture->condition),
+                                           &(capture->mutex),
+                                           &due) != ETIMEDOUT))
+            {
+                ;
+            }
+
+            pthread_mutex_unlock(&(capture->mutex));
+        }
+    }
+
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+writeRawCapture(
+    CAPTURE_T *capture,
+    const IMAGE_T *image)
+{
+    size_t rowBytes = (image->width * image->bitsPerPixel) / 8;
+    const uint8_t *row = image->buffer;
+
+    int32_t j;
+    for (j = 0 ; j < image->height ; j++)
+    {
+        if (fwrite(row, 1, rowBytes, capture->file) != rowBytes)
+        {
+            return false;
+        }
+
+        row += image->pitch;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// Put the frame number in place of the pattern's one %u or %0Nu, and %%
+// becomes %. The pattern is never handed to printf, so anything else in it
+// is rejected rather than being undefined. With no path, just check it.
+
+#define CAPTURE_MAX_WIDTH 20
+
+static bool
+formatCapturePath(
+    const char *pattern,
+    uint32_t frame,
+    char *path,
+    size_t size)
+{
+    char number[16];
+    snprintf(number, sizeof(number), "%u", frame);
+    size_t digits = strlen(number);
+
+    size_t length = 0;
+    int32_t conversions = 0;
+
+    const char *p;
+    for (p = pattern ; *p != '\0' ; p++)
+    {
+        if ((*p != '%') || (*(p + 1) == '%'))
+        {
+            if (*p == '%')
+            {
+                ++p;
+            }
+
+            if (path != NULL)
+            {
+                if (length + 1 >= size)
+                {
+                    return false;
+                }
+
+                path[length] = *p;
+            }
+
+            ++length;
+            continue;
+        }
+
+        ++p;
+
+        size_t width = 0;
+
+        if (*p == '0')
+        {
+            ++p;
+
+            if ((*p < '1') || (*p > '9'))
+            {
+                return false;
+            }
+
+            while ((*p >= '0') && (*p <= '9'))
+            {
+                width = (width * 10) + (*p - '0');
+                ++p;
+
+                if (width > CAPTURE_MAX_WIDTH)
+                {
+                    return false;
+                }
+            }
+        }
+
+        if ((*p != 'u') || (++conversions > 1))
+        {
+            return false;
+        }
+
+        size_t padding = (width > digits) ? (width - digits) : 0;
+
+        if (path != NULL)
+        {
+            if (length + padding + digits >= size)
+            {
+                return false;
+            }
+
+            memset(path + length, '0', padding);
+            memcpy(path + length + padding, number, digits);
+        }
+
+        length += padding + digits;
+    }
+
+    if (path != NULL)
+    {
+        path[length] = '\0';
+    }
+
+    return (conversions == 1);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+validCapturePattern(
+    const char *pattern)
+{
+    return formatCapturePath(pattern, 0, NULL, 0);
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+writeCapture(
+    CAPTURE_T *capture,
+    const IMAGE_T *image,
+    uint32_t frame)
+{
+    if (capture->pattern != NULL)
+    {
+        char path[CAPTURE_MAX_PATH];
+
+        if (formatCapturePath(capture->pattern, frame, path, sizeof(path))
+            == false)
+        {
+            return false;
+        }
+
+        FILE *file = fopen(path, "wb");
+
+        if (file == NULL)
+        {
+            return false;
+        }
+
+        bool result = savePngFile(image, file);
+
+        return (fclose(file) == 0) && result;
+    }
+
+    bool result = (capture->format == CAPTURE_FORMAT_RAW)
+                ? writeRawCapture(capture, image)
+                : savePngFile(image, capture->file);
+
+    return result && (fflush(capture->file) == 0);
+}
+
+//-------------------------------------------------------------------------
+
+static void *
+encodeThread(
+    void *arg)
+{
+    CAPTURE_T *capture = arg;
+
+    pthread_mutex_lock(&(capture->mutex));
+
+    while (true)
+    {
+        while ((capture->queueLength == 0) && (capture->quit == false))
+        {
+            pthread_cond_wait(&(capture->condition), &(capture->mutex));
+        }
+
+        if (capture->queueLength == 0)
+        {
+            break;
+        }
+
+        int32_t index = capture->queue[capture->queueStart];
+        capture->queueStart = (capture->queueStart + 1) % CAPTURE_BUFFERS;
+        --(capture->queueLength);
+
+        uint32_t frame = capture->encoded;
+
+        pthread_mutex_unlock(&(capture->mutex));
+
+        bool result = writeCapture(capture, &(capture->images[index]), frame);
+
+        pthread_mutex_lock(&(capture->mutex));
+
+        capture->freeImages[capture->numberOfFreeImages++] = index;
+
+        if (result == false)
+        {
+            capture->failed = true;
+            capture->quit = true;
+        }
+        else
+        {
+            ++(capture->encoded);
+
+            if ((capture->maxFrames != 0) &&
+                (capture->encoded + capture->queueLength
+                 >= capture->maxFrames))
+            {
+                // The frames still queued are written, no more are taken.
+
+                capture->quit = true;
+            }
+        }
+
+        pthread_cond_broadcast(&(capture->condition));
+    }
+
+    capture->running = false;
+
+    pthread_mutex_unlock(&(capture->mutex));
+
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+startCapture(
+    CAPTURE_T *capture)
+{
+    capture->running = true;
+    capture->quit = false;
+
+    pthread_create(&(capture->encodeThread), NULL, encodeThread, capture);
+    pthread_create(&(capture->captureThread), NULL, captureThread, capture);
+}
+
+//-------------------------------------------------------------------------
+
+void
+startStreamCapture(
+    CAPTURE_T *capture,
+    CAPTURE_FORMAT_T format,
+    FILE *file)
+{
+    capture->format = format;
+    capture->file = file;
+    capture->pattern = NULL;
+
+    startCapture(capture);
+}
+
+//-------------------------------------------------------------------------
+
+void
+startFilesCapture(
+    CAPTURE_T *capture,
+    const char *pattern)
+{
+    capture->format = CAPTURE_FORMAT_PNG;
+    capture->file = NULL;
+    capture->pattern = pattern;
+
+    startCapture(capture);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+runningCapture(
+    CAPTURE_T *capture)
+{
+    pthread_mutex_lock(&(capture->mutex));
+    bool running = capture->running;
+    pthread_mutex_unlock(&(capture->mutex));
+
+    return running;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+stopCapture(
+    CAPTURE_T *capture)
+{
+    pthread_mutex_lock(&(capture->mutex));
+    capture->quit = true;
+    pthread_cond_broadcast(&(capture->condition));
+    pthread_mutex_unlock(&(capture->mutex));
+
+    pthread_join(capture->captureThread, NULL);
+    pthread_join(capture->encodeThread, NULL);
+
+    return (capture->failed == false);
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyCapture(
+    CAPTURE_T *capture)
+{
+    releaseResourcePool(capture->resource);
+    capture->resource = 0;
+
+    int32_t i;
+    for (i = 0 ; i < CAPTURE_BUFFERS ; i++)
+    {
+        destroyImage(&(capture->images[i]));
+    }
+
+    pthread_cond_destroy(&(capture->condition));
+    pthread_mutex_destroy(&(capture->mutex));
+}
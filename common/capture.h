@@ -0,0 +1,154 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "image.h"
+
+#include "bcm_host.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Captures what a display shows, every interval milliseconds, and writes
+// it out, entirely on threads of its own so that the program drawing the
+// display never waits for it. A capture thread snapshots the display into
+// a resource and reads it back into one of CAPTURE_BUFFERS images; an
+// encoder thread writes the images out in order. If the encoder falls
+// behind and there is no free image when a snapshot is due, that frame is
+// dropped rather than queued, so a capture never holds more than
+// CAPTURE_BUFFERS frames in memory.
+//
+// Frames go either to a stream, as pngs one after the other or as raw
+// frames (rows with no padding, as pngview -r reads them), or to one png
+// file per frame named by a pattern such as "frame%05u.png".
+
+#define CAPTURE_BUFFERS 3
+
+typedef enum
+{
+    CAPTURE_FORMAT_PNG,
+    CAPTURE_FORMAT_RAW
+} CAPTURE_FORMAT_T;
+
+typedef struct
+{
+    DISPMANX_DISPLAY_HANDLE_T display;
+    DISPMANX_RESOURCE_HANDLE_T resource;
+    VC_RECT_T rect;
+    int64_t interval;
+    uint32_t maxFrames;
+    CAPTURE_FORMAT_T format;
+    FILE *file;
+    const char *pattern;
+    IMAGE_T images[CAPTURE_BUFFERS];
+    int32_t freeImages[CAPTURE_BUFFERS];
+    int32_t numberOfFreeImages;
+    int32_t queue[CAPTURE_BUFFERS];
+    int32_t queueStart;
+    int32_t queueLength;
+    pthread_t captureThread;
+    pthread_t encodeThread;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    bool running;
+    bool quit;
+    bool failed;
+    uint32_t captured;
+    uint32_t dropped;
+    uint32_t encoded;
+} CAPTURE_T;
+
+//-------------------------------------------------------------------------
+
+// Capture as type (RGB888, RGBA32 or RGB565), scaled to width x height,
+// or the size of the display if they are zero.
+
+void
+initCapture(
+    CAPTURE_T *capture,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height,
+    uint32_t intervalMilliseconds);
+
+// Stop by itself after maxFrames frames have been written, if it is not 0.
+
+void
+setMaxFramesCapture(
+    CAPTURE_T *capture,
+    uint32_t maxFrames);
+
+void
+startStreamCapture(
+    CAPTURE_T *capture,
+    CAPTURE_FORMAT_T format,
+    FILE *file);
+
+// The pattern must have exactly one %u or %0Nu in it for the frame
+// number, and no other % except %%.
+
+bool
+validCapturePattern(
+    const char *pattern);
+
+void
+startFilesCapture(
+    CAPTURE_T *capture,
+    const char *pattern);
+
+// True until the capture has stopped by itself, because it has written
+// maxFrames frames or could not write one.
+
+bool
+runningCapture(
+    CAPTURE_T *capture);
+
+// Stop snapshotting, write out the frames already captured and wait for
+// the threads to finish. Returns false if a frame could not be written.
+
+bool
+stopCapture(
+    CAPTURE_T *capture);
+
+void
+destroyCapture(
+    CAPTURE_T *capture);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
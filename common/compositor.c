@@ -0,0 +1,183 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <assert.h>
+
+#include "compositor.h"
+
+//-------------------------------------------------------------------------
+
+static void
+addSprite(
+    void *data,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    SPRITE_LAYER_T *s = data;
+
+    addElementSpriteLayerOffset(s,
+                                s->dstRect.x,
+                                s->dstRect.y,
+                                display,
+                                update);
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+dueSprite(
+    void *data)
+{
+    return frameDueSpriteLayer(data);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+updateSprite(
+    void *data,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    animateSpriteLayer(data, update);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+removeSprite(
+    void *data,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    removeElementSpriteLayer(data, update);
+}
+
+//-------------------------------------------------------------------------
+
+void
+initCompositor(
+    COMPOSITOR_T *compositor,
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height)
+{
+    initImageLayer(&(compositor->target), width, height, type);
+    createEmptyResourceImageLayer(&(compositor->target), 0);
+
+    compositor->display =
+        vc_dispmanx_display_open_offscreen(compositor->target.resource,
+                                           DISPMANX_NO_ROTATE);
+    assert(compositor->display != 0);
+
+    // With no frame loop, each update is waited for, so the target is
+    // finished when composeCompositor() returns.
+
+    initScene(&(compositor->scene), compositor->display, NULL);
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+addImageLayerCompositor(
+    COMPOSITOR_T *compositor,
+    IMAGE_LAYER_T *il,
+    int32_t x,
+    int32_t y)
+{
+    return addImageLayerScene(&(compositor->scene), il, x, y);
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+addSpriteLayerCompositor(
+    COMPOSITOR_T *compositor,
+    SPRITE_LAYER_T *s,
+    int32_t x,
+    int32_t y)
+{
+    static const SCENE_CALLBACKS_T spriteCallbacks =
+    {
+        addSprite, dueSprite, updateSprite, removeSprite
+    };
+
+    vc_dispmanx_rect_set(&(s->dstRect), x, y, s->width, s->height);
+
+    return addCallbackScene(&(compositor->scene), s, &spriteCallbacks);
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+composeCompositor(
+    COMPOSITOR_T *compositor)
+{
+    return updateScene(&(compositor->scene));
+}
+
+//-------------------------------------------------------------------------
+
+IMAGE_T *
+readCompositor(
+    COMPOSITOR_T *compositor)
+{
+    IMAGE_LAYER_T *target = &(compositor->target);
+
+    int result = vc_dispmanx_resource_read_data(target->resource,
+                                                &(target->bmpRect),
+                                                target->image.buffer,
+                                                target->image.pitch);
+    assert(result == 0);
+
+    return &(target->image);
+}
+
+//-------------------------------------------------------------------------
+
+void
+shareCompositor(
+    COMPOSITOR_T *compositor,
+    IMAGE_LAYER_T *il,
+    int32_t layer)
+{
+    shareImageLayer(il, &(compositor->target));
+    il->layer = layer;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyCompositor(
+    COMPOSITOR_T *compositor)
+{
+    destroyScene(&(compositor->scene));
+
+    int result = vc_dispmanx_display_close(compositor->display);
+    assert(result == 0);
+
+    destroyImageLayer(&(compositor->target));
+}
+
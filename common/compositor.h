@@ -0,0 +1,131 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "imageLayer.h"
+#include "scene.h"
+#include "spriteLayer.h"
+
+#include "bcm_host.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// A compositor has the display hardware draw a stack of layers into a
+// resource of its own, through an offscreen display, rather than onto the
+// screen. The result can then be shown as a single element (see
+// shareCompositor()) or read back (see readCompositor()), for instance to
+// flatten a user interface that rarely changes into one layer.
+//
+// The offscreen display and the elements on it are kept between
+// compositions. The layers are held in a scene, so composeCompositor()
+// sends only what changed since the last composition, and nothing at all
+// if nothing did. Layers are moved, faded and marked as changed with the
+// scene functions on compositor->scene.
+//
+// The target must be of a type an offscreen display can draw into, such
+// as VC_IMAGE_RGBA32, VC_IMAGE_RGB888 or VC_IMAGE_RGB565, and ideally a
+// multiple of 16 pixels wide.
+
+typedef struct
+{
+    IMAGE_LAYER_T target;
+    DISPMANX_DISPLAY_HANDLE_T display;
+    SCENE_T scene;
+} COMPOSITOR_T;
+
+//-------------------------------------------------------------------------
+
+void
+initCompositor(
+    COMPOSITOR_T *compositor,
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height);
+
+// Add a layer, whose resource has been created, with its top left corner
+// at (x, y) in the target. Returns the index of its node in the scene.
+
+int32_t
+addImageLayerCompositor(
+    COMPOSITOR_T *compositor,
+    IMAGE_LAYER_T *il,
+    int32_t x,
+    int32_t y);
+
+// As addImageLayerCompositor(), for a sprite layer. A sprite that is
+// animated is drawn in the frame due when each composition is made.
+
+int32_t
+addSpriteLayerCompositor(
+    COMPOSITOR_T *compositor,
+    SPRITE_LAYER_T *s,
+    int32_t x,
+    int32_t y);
+
+// Draw whatever has changed into the target and wait for it to be done.
+// Returns the number of layers sent, zero if the target is unchanged.
+
+int32_t
+composeCompositor(
+    COMPOSITOR_T *compositor);
+
+// Read the target back into compositor->target.image, which is returned.
+
+IMAGE_T *
+readCompositor(
+    COMPOSITOR_T *compositor);
+
+// Make il a view of the target, to be shown on a display at the given
+// layer like any other image layer (see shareImageLayer()). A
+// composition made while il is on screen may be seen half drawn.
+
+void
+shareCompositor(
+    COMPOSITOR_T *compositor,
+    IMAGE_LAYER_T *il,
+    int32_t layer);
+
+// The layers that were added are removed, but not destroyed.
+
+void
+destroyCompositor(
+    COMPOSITOR_T *compositor);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
+
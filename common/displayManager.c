@@ -0,0 +1,290 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "displayManager.h"
+#include "imageCache.h"
+#include "loadpng.h"
+
+//-------------------------------------------------------------------------
+
+void
+initDisplayManager(
+    DISPLAY_MANAGER_T *dm)
+{
+    dm->numberOfDisplays = 0;
+    dm->quit = false;
+    dm->numberOfImages = 0;
+
+    pthread_mutex_init(&(dm->mutex), NULL);
+}
+
+//-------------------------------------------------------------------------
+
+DISPLAY_T *
+openDisplayManager(
+    DISPLAY_MANAGER_T *dm,
+    uint32_t number,
+    DISPLAY_FRAME_T frame,
+    void *arg)
+{
+    if (dm->numberOfDisplays == DISPLAY_MANAGER_MAX_DISPLAYS)
+    {
+        return NULL;
+    }
+
+    DISPLAY_T *display = &(dm->displays[dm->numberOfDisplays]);
+
+    display->handle = vc_dispmanx_display_open(number);
+
+    if (display->handle == 0)
+    {
+        return NULL;
+    }
+
+    if (vc_dispmanx_display_get_info(display->handle, &(display->info)) != 0)
+    {
+        vc_dispmanx_display_close(display->handle);
+        return NULL;
+    }
+
+    display->manager = dm;
+    display->number = number;
+    display->frame = frame;
+    display->arg = arg;
+    display->started = false;
+    display->running = false;
+
+    initFrameLoop(&(display->loop), display->handle);
+    initScene(&(display->scene), display->handle, &(display->loop));
+
+    ++(dm->numberOfDisplays);
+
+    return display;
+}
+
+//-------------------------------------------------------------------------
+
+// Nothing that is on screen is written to until the last update has been
+// applied, and a frame with nothing to send waits for the next vsync
+// rather than go straight round again.
+
+static void *
+displayThread(
+    void *arg)
+{
+    DISPLAY_T *display = arg;
+
+    while (__atomic_load_n(&(display->manager->quit), __ATOMIC_ACQUIRE)
+           == false)
+    {
+        waitForUpdateFrameLoop(&(display->loop));
+
+        if (display->frame(display, display->arg) == false)
+        {
+            break;
+        }
+
+        if (updateScene(&(display->scene)) == 0)
+        {
+            waitForVsyncFrameLoop(&(display->loop));
+        }
+    }
+
+    waitForUpdateFrameLoop(&(display->loop));
+    __atomic_store_n(&(display->running), false, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+
+void
+startDisplayManager(
+    DISPLAY_MANAGER_T *dm)
+{
+    __atomic_store_n(&(dm->quit), false, __ATOMIC_RELEASE);
+
+    int32_t i;
+    for (i = 0 ; i < dm->numberOfDisplays ; i++)
+    {
+        DISPLAY_T *display = &(dm->displays[i]);
+
+        if (display->started)
+        {
+            continue;
+        }
+
+        __atomic_store_n(&(display->running), true, __ATOMIC_RELEASE);
+
+        if (pthread_create(&(display->thread),
+                           NULL,
+                           displayThread,
+                           display) != 0)
+        {
+            fprintf(stderr, "displayManager: cannot start display thread\n");
+            exit(EXIT_FAILURE);
+        }
+
+        display->started = true;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+runningDisplayManager(
+    DISPLAY_MANAGER_T *dm)
+{
+    int32_t running = 0;
+
+    int32_t i;
+    for (i = 0 ; i < dm->numberOfDisplays ; i++)
+    {
+        if (__atomic_load_n(&(dm->displays[i].running), __ATOMIC_ACQUIRE))
+        {
+            ++running;
+        }
+    }
+
+    return running;
+}
+
+//-------------------------------------------------------------------------
+
+void
+stopDisplayManager(
+    DISPLAY_MANAGER_T *dm)
+{
+    __atomic_store_n(&(dm->quit), true, __ATOMIC_RELEASE);
+
+    int32_t i;
+    for (i = 0 ; i < dm->numberOfDisplays ; i++)
+    {
+        DISPLAY_T *display = &(dm->displays[i]);
+
+        // A display that has finished has still to be joined, but one
+        // that was never started has no thread to join.
+
+        if (display->started)
+        {
+            pthread_join(display->thread, NULL);
+            display->started = false;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Images are loaded with the lock held, so that a second thread asking
+// for the same one waits for it rather than decoding it again.
+
+IMAGE_LAYER_T *
+loadImageDisplayManager(
+    DISPLAY_MANAGER_T *dm,
+    const char *path,
+    int32_t layer)
+{
+    IMAGE_LAYER_T *il = NULL;
+
+    pthread_mutex_lock(&(dm->mutex));
+
+    int32_t i;
+    for (i = 0 ; i < dm->numberOfImages ; i++)
+    {
+        if (strcmp(dm->images[i].path, path) == 0)
+        {
+            il = &(dm->images[i].layer);
+            break;
+        }
+    }
+
+    if ((il == NULL) && (dm->numberOfImages < DISPLAY_MANAGER_MAX_IMAGES))
+    {
+        DISPLAY_MANAGER_IMAGE_T *image = &(dm->images[dm->numberOfImages]);
+
+        if (loadPngImageLayerCached(&(image->layer),
+                                    path,
+                                    layer,
+                                    LOADPNG_STRIP_HEIGHT))
+        {
+            image->path = strdup(path);
+
+            if (image->path == NULL)
+            {
+                fprintf(stderr, "displayManager: memory exhausted\n");
+                exit(EXIT_FAILURE);
+            }
+
+            il = &(image->layer);
+            ++(dm->numberOfImages);
+        }
+    }
+
+    pthread_mutex_unlock(&(dm->mutex));
+
+    return il;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyDisplayManager(
+    DISPLAY_MANAGER_T *dm)
+{
+    stopDisplayManager(dm);
+
+    int32_t i;
+    for (i = 0 ; i < dm->numberOfDisplays ; i++)
+    {
+        DISPLAY_T *display = &(dm->displays[i]);
+
+        destroyScene(&(display->scene));
+        destroyFrameLoop(&(display->loop));
+
+        int result = vc_dispmanx_display_close(display->handle);
+        assert(result == 0);
+    }
+
+    dm->numberOfDisplays = 0;
+
+    //---------------------------------------------------------------------
+
+    for (i = 0 ; i < dm->numberOfImages ; i++)
+    {
+        destroyImageLayer(&(dm->images[i].layer));
+        free(dm->images[i].path);
+    }
+
+    dm->numberOfImages = 0;
+
+    pthread_mutex_destroy(&(dm->mutex));
+}
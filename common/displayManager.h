@@ -0,0 +1,158 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef DISPLAY_MANAGER_H
+#define DISPLAY_MANAGER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frameLoop.h"
+#include "imageLayer.h"
+#include "scene.h"
+
+#include "bcm_host.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// A display manager drives several displays from one program, such as
+// both HDMI ports of a Pi 4 (displays 2 and 7) or HDMI and the DSI panel
+// (display 0). Each display has a scene for its layers and a frame loop,
+// and runs on a thread of its own, so that each is paced by its own
+// refresh rate. Every frame the display thread calls frame(), which makes
+// its changes to the scene, and then sends them with updateScene().
+//
+// Dispmanx resources are not tied to a display, so an image loaded with
+// loadImageDisplayManager() is decoded and uploaded once, and each
+// display shows it through a layer of its own made by shareImageLayer().
+
+#define DISPLAY_MANAGER_MAX_DISPLAYS 4
+#define DISPLAY_MANAGER_MAX_IMAGES 32
+
+typedef struct DISPLAY_MANAGER_T_ DISPLAY_MANAGER_T;
+typedef struct DISPLAY_T_ DISPLAY_T;
+
+// Called on the display thread. Return false to stop the display.
+
+typedef bool (*DISPLAY_FRAME_T)(DISPLAY_T *display, void *arg);
+
+// running and quit are shared between the display threads and the thread
+// that started them, and are only read and written with __atomic
+// builtins. started is true from the thread being created until it has
+// been joined.
+
+struct DISPLAY_T_
+{
+    DISPLAY_MANAGER_T *manager;
+    uint32_t number;
+    DISPMANX_DISPLAY_HANDLE_T handle;
+    DISPMANX_MODEINFO_T info;
+    FRAME_LOOP_T loop;
+    SCENE_T scene;
+    DISPLAY_FRAME_T frame;
+    void *arg;
+    pthread_t thread;
+    bool started;
+    bool running;
+};
+
+typedef struct
+{
+    char *path;
+    IMAGE_LAYER_T layer;
+} DISPLAY_MANAGER_IMAGE_T;
+
+struct DISPLAY_MANAGER_T_
+{
+    DISPLAY_T displays[DISPLAY_MANAGER_MAX_DISPLAYS];
+    int32_t numberOfDisplays;
+    bool quit;
+    pthread_mutex_t mutex;
+    DISPLAY_MANAGER_IMAGE_T images[DISPLAY_MANAGER_MAX_IMAGES];
+    int32_t numberOfImages;
+};
+
+//-------------------------------------------------------------------------
+
+void
+initDisplayManager(
+    DISPLAY_MANAGER_T *dm);
+
+// Open display number, with frame to be called on its thread with arg.
+// Returns NULL if the display cannot be opened or there are already
+// DISPLAY_MANAGER_MAX_DISPLAYS open. Layers can then be added to the
+// scene of the display before the threads are started.
+
+DISPLAY_T *
+openDisplayManager(
+    DISPLAY_MANAGER_T *dm,
+    uint32_t number,
+    DISPLAY_FRAME_T frame,
+    void *arg);
+
+void
+startDisplayManager(
+    DISPLAY_MANAGER_T *dm);
+
+// The number of displays whose frame() has not yet returned false.
+
+int32_t
+runningDisplayManager(
+    DISPLAY_MANAGER_T *dm);
+
+// Stop every display thread and wait for them to finish.
+
+void
+stopDisplayManager(
+    DISPLAY_MANAGER_T *dm);
+
+// Load a png into an image layer given layer number layer, once for
+// however many displays and threads ask for it, and return it, or NULL if
+// it cannot be loaded. Safe to call from the display threads. The layer
+// belongs to the manager; show it through shareImageLayer().
+
+IMAGE_LAYER_T *
+loadImageDisplayManager(
+    DISPLAY_MANAGER_T *dm,
+    const char *path,
+    int32_t layer);
+
+// Stop the threads, remove everything that is left in the scenes, close
+// the displays and destroy the loaded images.
+
+void
+destroyDisplayManager(
+    DISPLAY_MANAGER_T *dm);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,137 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <math.h>
+
+#include "dynamicResolution.h"
+
+//-------------------------------------------------------------------------
+
+static bool
+setScaleDynamicResolution(
+    DYNAMIC_RESOLUTION_T *dr,
+    int32_t scale)
+{
+    if (scale < dr->minimumScale)
+    {
+        scale = dr->minimumScale;
+    }
+
+    if (scale > DYNAMIC_RESOLUTION_ONE)
+    {
+        scale = DYNAMIC_RESOLUTION_ONE;
+    }
+
+    int32_t width = ((dr->fullWidth * scale) + (DYNAMIC_RESOLUTION_ONE / 2))
+                  / DYNAMIC_RESOLUTION_ONE;
+    int32_t height = ((dr->fullHeight * scale) + (DYNAMIC_RESOLUTION_ONE / 2))
+                   / DYNAMIC_RESOLUTION_ONE;
+
+    if (width < 1)
+    {
+        width = 1;
+    }
+
+    if (height < 1)
+    {
+        height = 1;
+    }
+
+    dr->scale = scale;
+
+    bool changed = (width != dr->width) || (height != dr->height);
+
+    dr->width = width;
+    dr->height = height;
+
+    return changed;
+}
+
+//-------------------------------------------------------------------------
+
+void
+initDynamicResolution(
+    DYNAMIC_RESOLUTION_T *dr,
+    int32_t fullWidth,
+    int32_t fullHeight,
+    int64_t budgetMicroseconds,
+    int32_t minimumScale)
+{
+    dr->fullWidth = fullWidth;
+    dr->fullHeight = fullHeight;
+    dr->width = fullWidth;
+    dr->height = fullHeight;
+    dr->scale = DYNAMIC_RESOLUTION_ONE;
+    dr->minimumScale = minimumScale;
+    dr->budgetMicroseconds = budgetMicroseconds;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+frameTimeDynamicResolution(
+    DYNAMIC_RESOLUTION_T *dr,
+    int64_t microseconds)
+{
+    if (microseconds <= 0)
+    {
+        return false;
+    }
+
+    // The time to draw a frame goes with the number of pixels, which is
+    // the square of the scale.
+
+    double ratio = sqrt((DYNAMIC_RESOLUTION_TARGET * dr->budgetMicroseconds)
+                        / microseconds);
+
+    if (microseconds > dr->budgetMicroseconds)
+    {
+        return setScaleDynamicResolution(dr, floor(dr->scale * ratio));
+    }
+
+    if ((microseconds < (dr->budgetMicroseconds / 2)) &&
+        (dr->scale < DYNAMIC_RESOLUTION_ONE))
+    {
+        if (ratio > DYNAMIC_RESOLUTION_MAX_GROWTH)
+        {
+            ratio = DYNAMIC_RESOLUTION_MAX_GROWTH;
+        }
+
+        return setScaleDynamicResolution(dr, ceil(dr->scale * ratio));
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+resetDynamicResolution(
+    DYNAMIC_RESOLUTION_T *dr)
+{
+    return setScaleDynamicResolution(dr, DYNAMIC_RESOLUTION_ONE);
+}
@@ -0,0 +1,92 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Scales are fractions of DYNAMIC_RESOLUTION_ONE. The resolution is
+// dropped straight away when a frame goes over budget, but only raised a
+// little at a time while frames come in well under it, so that it does
+// not hunt up and down.
+
+#define DYNAMIC_RESOLUTION_ONE 256
+#define DYNAMIC_RESOLUTION_TARGET 0.8
+#define DYNAMIC_RESOLUTION_MAX_GROWTH 1.25
+
+//-------------------------------------------------------------------------
+
+// Picks the size to render at to keep frames within budgetMicroseconds.
+// width x height is the current render size, which an image layer can
+// show scaled up to its full size with setSourceSizeImageLayer().
+
+typedef struct
+{
+    int32_t fullWidth;
+    int32_t fullHeight;
+    int32_t width;
+    int32_t height;
+    int32_t scale;
+    int32_t minimumScale;
+    int64_t budgetMicroseconds;
+} DYNAMIC_RESOLUTION_T;
+
+//-------------------------------------------------------------------------
+
+void
+initDynamicResolution(
+    DYNAMIC_RESOLUTION_T *dr,
+    int32_t fullWidth,
+    int32_t fullHeight,
+    int64_t budgetMicroseconds,
+    int32_t minimumScale);
+
+// Record that a frame at width x height took microseconds to draw.
+// Returns true if the render size has changed.
+
+bool
+frameTimeDynamicResolution(
+    DYNAMIC_RESOLUTION_T *dr,
+    int64_t microseconds);
+
+// Go back to full resolution. Returns true if the render size has changed.
+
+bool
+resetDynamicResolution(
+    DYNAMIC_RESOLUTION_T *dr);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -26,6 +26,11 @@
 //
 //-------------------------------------------------------------------------
 
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "bits.h"
 #include "font.h"
 
@@ -4703,67 +4708,404 @@ drawCharRGB(
 
 //-------------------------------------------------------------------------
 
-void
-drawStringIndexed(
-    int x,
-    int y,
+// Text is drawn a glyph row at a time with word stores. A glyph row of
+// the font is one byte, so for each colour (and pixel size) there are
+// only 256 different rows of pixels; these are expanded once into a mask
+// and the colour under that mask, and kept in a small cache so that the
+// colours in use are not expanded again. Each thread that draws text has
+// a cache of its own, allocated when it first does, so text can be drawn
+// from any number of threads at once.
+//
+// On a dithered image the packed colour depends on where the pixel is in
+// the dither matrix. A glyph is as wide as the matrix, so each row of it
+// covers every column of the matrix, and each row of the matrix needs a
+// set of rows of its own.
+
+#define FONT_GLYPH_CACHE_SIZE 16
+#define FONT_MAX_ROW_WORDS 4
+#define FONT_DITHER_ROWS 8
+
+typedef struct
+{
+    bool used;
+    int16_t bytesPerPixel;
+    uint8_t colour[FONT_MAX_ROW_WORDS * sizeof(uint64_t)];
+    uint32_t lastUsed;
+    uint64_t mask[256][FONT_MAX_ROW_WORDS];
+    uint64_t tile[256][FONT_MAX_ROW_WORDS];
+} FONT_GLYPH_ROWS_T;
+
+typedef struct
+{
+    uint32_t clock;
+    FONT_GLYPH_ROWS_T rows[FONT_GLYPH_CACHE_SIZE];
+} FONT_GLYPH_CACHE_T;
+
+static pthread_once_t glyphCacheOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t glyphCacheKey;
+static __thread FONT_GLYPH_CACHE_T *glyphCache = NULL;
+
+//-------------------------------------------------------------------------
+
+static void
+createGlyphCacheKey(void)
+{
+    pthread_key_create(&glyphCacheKey, free);
+}
+
+//-------------------------------------------------------------------------
+
+// The calling thread's cache, freed when the thread exits, or NULL if
+// there is no memory for it, when text is drawn a pixel at a time.
+
+static FONT_GLYPH_CACHE_T *
+threadGlyphCache(void)
+{
+    if (glyphCache == NULL)
+    {
+        pthread_once(&glyphCacheOnce, createGlyphCacheKey);
+
+        glyphCache = calloc(1, sizeof(FONT_GLYPH_CACHE_T));
+
+        if (glyphCache != NULL)
+        {
+            pthread_setspecific(glyphCacheKey, glyphCache);
+        }
+    }
+
+    return glyphCache;
+}
+
+//-------------------------------------------------------------------------
+
+// colour is one glyph row of pixels, packed in the image format.
+
+static const FONT_GLYPH_ROWS_T *
+findGlyphRows(
+    FONT_GLYPH_CACHE_T *cache,
+    int16_t bytesPerPixel,
+    const uint8_t *colour)
+{
+    size_t rowBytes = FONT_WIDTH * bytesPerPixel;
+    FONT_GLYPH_ROWS_T *entry = &(cache->rows[0]);
+
+    ++(cache->clock);
+
+    int i;
+    for (i = 0 ; i < FONT_GLYPH_CACHE_SIZE ; i++)
+    {
+        FONT_GLYPH_ROWS_T *rows = &(cache->rows[i]);
+
+        if (rows->used &&
+            (rows->bytesPerPixel == bytesPerPixel) &&
+            (memcmp(rows->colour, colour, rowBytes) == 0))
+        {
+            rows->lastUsed = cache->clock;
+            return rows;
+        }
+
+        if ((rows->used == false) || (rows->lastUsed < entry->lastUsed))
+        {
+            entry = rows;
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    memset(entry, 0, sizeof(*entry));
+    entry->used = true;
+    entry->bytesPerPixel = bytesPerPixel;
+    entry->lastUsed = cache->clock;
+    memcpy(entry->colour, colour, rowBytes);
+
+    int byte;
+    for (byte = 0 ; byte < 256 ; byte++)
+    {
+        uint8_t *mask = (uint8_t *)(entry->mask[byte]);
+        uint8_t *tile = (uint8_t *)(entry->tile[byte]);
+
+        for (i = 0 ; i < FONT_WIDTH ; i++)
+        {
+            if ((byte >> (FONT_WIDTH - i - 1)) & 1)
+            {
+                memset(mask + (i * bytesPerPixel), 0xFF, bytesPerPixel);
+                memcpy(tile + (i * bytesPerPixel),
+                       colour + (i * bytesPerPixel),
+                       bytesPerPixel);
+            }
+        }
+    }
+
+    return entry;
+}
+
+//-------------------------------------------------------------------------
+
+// Draw the part of glyph c, at (x, y), that falls in rect: the glyph cell
+// clipped to the image. Rows that are whole glyph rows are drawn with
+// word stores, and clipped rows byte by byte.
+
+static void
+drawGlyph(
+    const IMAGE_RECT_T *rect,
+    int32_t x,
+    int32_t y,
+    uint8_t c,
+    const FONT_GLYPH_ROWS_T *const *ditherRows)
+{
+    int32_t bytesPerPixel = ditherRows[0]->bytesPerPixel;
+    int32_t words = (FONT_WIDTH * bytesPerPixel) / sizeof(uint64_t);
+    int32_t skipBytes = (rect->x - x) * bytesPerPixel;
+    int32_t rowBytes = rect->width * bytesPerPixel;
+    int32_t skipRows = rect->y - y;
+
+    int32_t j;
+    for (j = 0 ; j < rect->height ; j++)
+    {
+        uint8_t byte = font[c][skipRows + j];
+
+        if (byte == 0)
+        {
+            continue;
+        }
+
+        const FONT_GLYPH_ROWS_T *rows =
+            ditherRows[(rect->y + j) & (FONT_DITHER_ROWS - 1)];
+        uint8_t *line = rowImageRect(rect, j);
+
+        if (rect->width == FONT_WIDTH)
+        {
+            const uint64_t *mask = rows->mask[byte];
+            const uint64_t *tile = rows->tile[byte];
+
+            int32_t i;
+            for (i = 0 ; i < words ; i++)
+            {
+                uint64_t pixels;
+
+                memcpy(&pixels, line + (i * sizeof(uint64_t)), sizeof(pixels));
+                pixels = (pixels & ~mask[i]) | tile[i];
+                memcpy(line + (i * sizeof(uint64_t)), &pixels, sizeof(pixels));
+            }
+        }
+        else
+        {
+            const uint8_t *mask = (const uint8_t *)(rows->mask[byte])
+                                + skipBytes;
+            const uint8_t *tile = (const uint8_t *)(rows->tile[byte])
+                                + skipBytes;
+
+            int32_t i;
+            for (i = 0 ; i < rowBytes ; i++)
+            {
+                line[i] = (line[i] & ~mask[i]) | tile[i];
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Draw the string with glyphs drawn from rows, one set for each row of
+// the dither matrix, clipped to the image, or a pixel at a time if there
+// are no rows for the image type. Returns the area drawn, clipped to the
+// image.
+
+static VC_RECT_T
+drawText(
+    int32_t x,
+    int32_t y,
     const char *string,
+    const RGBA8_T *rgb,
     int8_t index,
+    const FONT_GLYPH_ROWS_T *const *rows,
     IMAGE_T *image)
 {
+    VC_RECT_T rect = { 0, 0, 0, 0 };
+
     if (string == NULL)
     {
-        return;
+        return rect;
     }
 
-    int x_first = x;
+    int32_t x_first = x;
+    int32_t x_max = x;
+    int32_t y_first = y;
 
     while (*string != '\0')
     {
-        if (*string == '\n')
+        uint8_t c = *string;
+
+        if (c == '\n')
         {
             x = x_first;
             y += FONT_HEIGHT;
         }
         else
         {
-            drawCharIndexed(x, y, *string, index, image);
+            IMAGE_RECT_T cell;
+
+            if (getRectImage(image, x, y, FONT_WIDTH, FONT_HEIGHT, &cell))
+            {
+                if (rows != NULL)
+                {
+                    drawGlyph(&cell, x, y, c, rows);
+                }
+                else if (rgb != NULL)
+                {
+                    drawCharRGB(x, y, c, rgb, image);
+                }
+                else
+                {
+                    drawCharIndexed(x, y, c, index, image);
+                }
+            }
+
             x += FONT_WIDTH;
+
+            if (x > x_max)
+            {
+                x_max = x;
+            }
         }
         ++string;
     }
+
+    //---------------------------------------------------------------------
+
+    int32_t x1 = (x_first < 0) ? 0 : x_first;
+    int32_t y1 = (y_first < 0) ? 0 : y_first;
+    int32_t x2 = (x_max > image->width) ? image->width : x_max;
+    int32_t y2 = y + FONT_HEIGHT;
+
+    if (y2 > image->height)
+    {
+        y2 = image->height;
+    }
+
+    if ((x2 > x1) && (y2 > y1))
+    {
+        vc_dispmanx_rect_set(&rect, x1, y1, x2 - x1, y2 - y1);
+        markDirtyImage(image, x1, y1, x2 - x1, y2 - y1);
+    }
+
+    return rect;
 }
 
 //-------------------------------------------------------------------------
 
-void
-drawStringRGB(
+VC_RECT_T
+drawTextIndexed(
+    int x,
+    int y,
+    const char *string,
+    int8_t index,
+    IMAGE_T *image)
+{
+    const FONT_GLYPH_ROWS_T *rows[FONT_DITHER_ROWS];
+    FONT_GLYPH_CACHE_T *cache = NULL;
+
+    if (image->bitsPerPixel == 8)
+    {
+        cache = threadGlyphCache();
+    }
+
+    if (cache == NULL)
+    {
+        return drawText(x, y, string, NULL, index, NULL, image);
+    }
+
+    uint8_t colour[FONT_WIDTH];
+    memset(colour, (uint8_t)index, sizeof(colour));
+
+    rows[0] = findGlyphRows(cache, 1, colour);
+
+    int i;
+    for (i = 1 ; i < FONT_DITHER_ROWS ; i++)
+    {
+        rows[i] = rows[0];
+    }
+
+    return drawText(x, y, string, NULL, index, rows, image);
+}
+
+//-------------------------------------------------------------------------
+
+VC_RECT_T
+drawTextRGB(
     int x,
     int y,
     const char *string,
     const RGBA8_T *rgb,
     IMAGE_T *image)
 {
-    if (string == NULL)
+    const FONT_GLYPH_ROWS_T *rows[FONT_DITHER_ROWS];
+    FONT_GLYPH_CACHE_T *cache = NULL;
+
+    if (image->convertRow != NULL)
     {
-        return;
+        cache = threadGlyphCache();
     }
 
-    int x_first = x;
+    if (cache == NULL)
+    {
+        return drawText(x, y, string, rgb, 0, NULL, image);
+    }
 
-    while (*string != '\0')
+    RGBA8_T pixels[FONT_WIDTH];
+    uint8_t colour[FONT_MAX_ROW_WORDS * sizeof(uint64_t)];
+
+    int i;
+    for (i = 0 ; i < FONT_WIDTH ; i++)
+    {
+        pixels[i] = *rgb;
+    }
+
+    // Every glyph of the string starts at the same column of the matrix,
+    // as glyphs are as wide as it is.
+
+    int16_t bytesPerPixel = image->bitsPerPixel / 8;
+    int ditherRows = (image->dither) ? FONT_DITHER_ROWS : 1;
+
+    for (i = 0 ; i < FONT_DITHER_ROWS ; i++)
     {
-        if (*string == '\n')
+        if (i < ditherRows)
         {
-            x = x_first;
-            y += FONT_HEIGHT;
+            image->convertRow(colour, pixels, x, i, FONT_WIDTH);
+            rows[i] = findGlyphRows(cache, bytesPerPixel, colour);
         }
         else
         {
-            drawCharRGB(x, y, *string, rgb, image);
-            x += FONT_WIDTH;
+            rows[i] = rows[0];
         }
-        ++string;
     }
+
+    return drawText(x, y, string, rgb, 0, rows, image);
+}
+
+//-------------------------------------------------------------------------
+
+void
+drawStringIndexed(
+    int x,
+    int y,
+    const char *string,
+    int8_t index,
+    IMAGE_T *image)
+{
+    drawTextIndexed(x, y, string, index, image);
+}
+
+//-------------------------------------------------------------------------
+
+void
+drawStringRGB(
+    int x,
+    int y,
+    const char *string,
+    const RGBA8_T *rgb,
+    IMAGE_T *image)
+{
+    drawTextRGB(x, y, string, rgb, image);
 }
 
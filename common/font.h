@@ -33,6 +33,8 @@
 
 #include "image.h"
 
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
 #define FONT_WIDTH 8
@@ -56,6 +58,27 @@ drawCharRGB(
     const RGBA8_T *rgb,
     IMAGE_T *image);
 
+// As drawStringIndexed() and drawStringRGB(), but returns the area of the
+// image that was drawn on, clipped to the image. Each glyph that fits in
+// the image is drawn with a row of word stores per line, from rows of
+// pixels that are cached for the last few colours.
+
+VC_RECT_T
+drawTextIndexed(
+    int x,
+    int y,
+    const char *string,
+    int8_t index,
+    IMAGE_T *image);
+
+VC_RECT_T
+drawTextRGB(
+    int x,
+    int y,
+    const char *string,
+    const RGBA8_T *rgb,
+    IMAGE_T *image);
+
 void
 drawStringIndexed(
     int x,
@@ -74,4 +97,6 @@ drawStringRGB(
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
@@ -0,0 +1,700 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fontAtlas.h"
+#include "imageBlendKernel.h"
+#include "loadpng.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
+
+//-------------------------------------------------------------------------
+
+#define FONT_ATLAS_ACCOUNT "fontAtlas"
+
+//-------------------------------------------------------------------------
+
+static void
+measureGlyphs(
+    FONT_ATLAS_T *atlas,
+    bool proportional)
+{
+    int32_t spacing = (atlas->cellWidth + 7) / 8;
+
+    int32_t c;
+    for (c = 0 ; c < FONT_ATLAS_GLYPHS ; c++)
+    {
+        const uint8_t *cell = atlas->coverage
+                            + ((c / FONT_ATLAS_COLUMNS)
+                               * atlas->cellHeight
+                               * atlas->pitch)
+                            + ((c % FONT_ATLAS_COLUMNS) * atlas->cellWidth);
+
+        int32_t first = atlas->cellWidth;
+        int32_t last = -1;
+
+        int32_t j;
+        for (j = 0 ; j < atlas->cellHeight ; j++)
+        {
+            const uint8_t *row = cell + (j * atlas->pitch);
+
+            int32_t i;
+            for (i = 0 ; i < atlas->cellWidth ; i++)
+            {
+                if (row[i] != 0)
+                {
+                    if (i < first)
+                    {
+                        first = i;
+                    }
+
+                    if (i > last)
+                    {
+                        last = i;
+                    }
+                }
+            }
+        }
+
+        atlas->blank[c] = (last < 0);
+        atlas->left[c] = 0;
+        atlas->advance[c] = atlas->cellWidth;
+
+        if (proportional)
+        {
+            if (atlas->blank[c])
+            {
+                atlas->advance[c] = atlas->cellWidth / 2;
+            }
+            else
+            {
+                atlas->left[c] = first;
+                atlas->advance[c] = last - first + 1 + spacing;
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+bool
+initFontAtlas(
+    FONT_ATLAS_T *atlas,
+    const char *file,
+    bool proportional)
+{
+    IMAGE_T image;
+
+    if (loadPng(&image, file) == false)
+    {
+        return false;
+    }
+
+    if ((image.width < FONT_ATLAS_COLUMNS) || (image.height < FONT_ATLAS_ROWS))
+    {
+        fprintf(stderr, "fontAtlas: %s is too small for an atlas\n", file);
+        destroyImage(&image);
+        return false;
+    }
+
+    atlas->cellWidth = image.width / FONT_ATLAS_COLUMNS;
+    atlas->cellHeight = image.height / FONT_ATLAS_ROWS;
+    atlas->pitch = atlas->cellWidth * FONT_ATLAS_COLUMNS;
+    atlas->coverage = malloc(atlas->pitch
+                             * atlas->cellHeight
+                             * FONT_ATLAS_ROWS);
+    atlas->resource = 0;
+
+    if (atlas->coverage == NULL)
+    {
+        fprintf(stderr, "fontAtlas: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    //---------------------------------------------------------------------
+
+    int32_t j;
+    for (j = 0 ; j < atlas->cellHeight * FONT_ATLAS_ROWS ; j++)
+    {
+        const uint8_t *src = (uint8_t *)(image.buffer) + (j * image.pitch);
+        uint8_t *dst = atlas->coverage + (j * atlas->pitch);
+
+        int32_t i;
+        for (i = 0 ; i < atlas->pitch ; i++)
+        {
+            if (image.type == VC_IMAGE_RGBA32)
+            {
+                dst[i] = src[(4 * i) + 3];
+            }
+            else
+            {
+                const uint8_t *rgb = src + (3 * i);
+
+                dst[i] = ((77 * rgb[0]) + (150 * rgb[1]) + (29 * rgb[2])) >> 8;
+            }
+        }
+    }
+
+    destroyImage(&image);
+
+    measureGlyphs(atlas, proportional);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+textWidthFontAtlas(
+    const FONT_ATLAS_T *atlas,
+    const char *string)
+{
+    int32_t width = 0;
+    int32_t maxWidth = 0;
+
+    for ( ; *string != '\0' ; string++)
+    {
+        if (*string == '\n')
+        {
+            width = 0;
+        }
+        else
+        {
+            width += atlas->advance[(uint8_t)*string];
+
+            if (width > maxWidth)
+            {
+                maxWidth = width;
+            }
+        }
+    }
+
+    return maxWidth;
+}
+
+//-------------------------------------------------------------------------
+
+static inline uint8_t
+blendChannel(
+    uint32_t dst,
+    uint32_t src,
+    uint32_t alpha)
+{
+    return div255((src * alpha) + (dst * (255 - alpha)));
+}
+
+//-------------------------------------------------------------------------
+
+static inline uint8_t
+blendAlpha(
+    uint32_t dst,
+    uint32_t alpha)
+{
+    return div255((255 * alpha) + (dst * (255 - alpha)));
+}
+
+//-------------------------------------------------------------------------
+
+// Blend two pixels at a time, as blendImageRect() does, skipping pairs
+// that the glyph does not cover at all. The colour lanes hold the text
+// colour with its alpha lanes set to 255, so the same sum gives the
+// destination alpha as well.
+
+static void
+blendRowRGBA32(
+    uint8_t *dst,
+    const uint8_t *coverage,
+    int32_t width,
+    const RGBA8_T *rgba)
+{
+    const IMAGE_BLEND_UINT16X8_T sv =
+    {
+        rgba->red, rgba->green, rgba->blue, 255,
+        rgba->red, rgba->green, rgba->blue, 255
+    };
+
+    int32_t x = 0;
+
+    for ( ; x + 2 <= width ; x += 2)
+    {
+        const uint8_t *c = coverage + x;
+
+        if ((c[0] | c[1]) == 0)
+        {
+            continue;
+        }
+
+        uint8_t *d = dst + (4 * x);
+
+        uint32_t a0 = div255(c[0] * rgba->alpha);
+        uint32_t a1 = div255(c[1] * rgba->alpha);
+
+        IMAGE_BLEND_UINT16X8_T av = { a0, a0, a0, a0, a1, a1, a1, a1 };
+        IMAGE_BLEND_UINT16X8_T dv =
+            { d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7] };
+
+        IMAGE_BLEND_UINT16X8_T out = div255x8((sv * av) + (dv * (255 - av)));
+
+        int32_t i;
+        for (i = 0 ; i < 8 ; i++)
+        {
+            d[i] = out[i];
+        }
+    }
+
+    for ( ; x < width ; x++)
+    {
+        if (coverage[x] == 0)
+        {
+            continue;
+        }
+
+        uint32_t a = div255(coverage[x] * rgba->alpha);
+        uint8_t *d = dst + (4 * x);
+
+        d[0] = blendChannel(d[0], rgba->red, a);
+        d[1] = blendChannel(d[1], rgba->green, a);
+        d[2] = blendChannel(d[2], rgba->blue, a);
+        d[3] = blendAlpha(d[3], a);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+blendRowRGBA16(
+    uint16_t *dst,
+    const uint8_t *coverage,
+    int32_t width,
+    const RGBA8_T *rgba)
+{
+    int32_t x;
+    for (x = 0 ; x < width ; x++)
+    {
+        if (coverage[x] == 0)
+        {
+            continue;
+        }
+
+        uint32_t a = div255(coverage[x] * rgba->alpha);
+        uint16_t p = dst[x];
+
+        uint8_t r = blendChannel(((p >> 12) & 0xF) * 0x11, rgba->red, a);
+        uint8_t g = blendChannel(((p >> 8) & 0xF) * 0x11, rgba->green, a);
+        uint8_t b = blendChannel(((p >> 4) & 0xF) * 0x11, rgba->blue, a);
+        uint8_t da = blendAlpha((p & 0xF) * 0x11, a);
+
+        dst[x] = ((r >> 4) << 12)
+               | ((g >> 4) << 8)
+               | ((b >> 4) << 4)
+               | (da >> 4);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+blendRowDirect(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    const uint8_t *coverage,
+    int32_t width,
+    const RGBA8_T *rgba)
+{
+    int32_t i;
+    for (i = 0 ; i < width ; i++)
+    {
+        if (coverage[i] == 0)
+        {
+            continue;
+        }
+
+        uint32_t a = div255(coverage[i] * rgba->alpha);
+
+        RGBA8_T pixel;
+        image->getPixelDirect(image, x + i, y, &pixel);
+
+        pixel.red = blendChannel(pixel.red, rgba->red, a);
+        pixel.green = blendChannel(pixel.green, rgba->green, a);
+        pixel.blue = blendChannel(pixel.blue, rgba->blue, a);
+        pixel.alpha = blendAlpha(pixel.alpha, a);
+
+        image->setPixelDirect(image, x + i, y, &pixel);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+drawGlyphFontAtlas(
+    const FONT_ATLAS_T *atlas,
+    int32_t x,
+    int32_t y,
+    uint8_t c,
+    const RGBA8_T *rgba,
+    IMAGE_T *image)
+{
+    int32_t sx = ((c % FONT_ATLAS_COLUMNS) * atlas->cellWidth) + atlas->left[c];
+    int32_t sy = (c / FONT_ATLAS_COLUMNS) * atlas->cellHeight;
+    int32_t width = atlas->cellWidth - atlas->left[c];
+    int32_t height = atlas->cellHeight;
+
+    if (width > atlas->advance[c])
+    {
+        width = atlas->advance[c];
+    }
+
+    //---------------------------------------------------------------------
+
+    if (x < 0)
+    {
+        sx -= x;
+        width += x;
+        x = 0;
+    }
+
+    if (y < 0)
+    {
+        sy -= y;
+        height += y;
+        y = 0;
+    }
+
+    if (x + width > image->width)
+    {
+        width = image->width - x;
+    }
+
+    if (y + height > image->height)
+    {
+        height = image->height - y;
+    }
+
+    //---------------------------------------------------------------------
+
+    int32_t j;
+    for (j = 0 ; j < height ; j++)
+    {
+        const uint8_t *coverage = atlas->coverage
+                                + ((sy + j) * atlas->pitch)
+                                + sx;
+
+        uint8_t *line = (uint8_t *)(image->buffer) + ((y + j) * image->pitch);
+
+        switch (image->type)
+        {
+        case VC_IMAGE_RGBA32:
+
+            blendRowRGBA32(line + (4 * x), coverage, width, rgba);
+            break;
+
+        case VC_IMAGE_RGBA16:
+
+            blendRowRGBA16((uint16_t *)line + x, coverage, width, rgba);
+            break;
+
+        default:
+
+            blendRowDirect(image, x, y + j, coverage, width, rgba);
+            break;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+VC_RECT_T
+drawTextFontAtlas(
+    const FONT_ATLAS_T *atlas,
+    int32_t x,
+    int32_t y,
+    const char *string,
+    const RGBA8_T *rgba,
+    IMAGE_T *image)
+{
+    VC_RECT_T rect = { 0, 0, 0, 0 };
+
+    if ((string == NULL) || (image->getPixelDirect == NULL))
+    {
+        return rect;
+    }
+
+    int32_t x_first = x;
+    int32_t x_max = x;
+    int32_t y_first = y;
+
+    for ( ; *string != '\0' ; string++)
+    {
+        uint8_t c = *string;
+
+        if (c == '\n')
+        {
+            x = x_first;
+            y += atlas->cellHeight;
+        }
+        else
+        {
+            if (atlas->blank[c] == false)
+            {
+                drawGlyphFontAtlas(atlas, x, y, c, rgba, image);
+            }
+
+            x += atlas->advance[c];
+
+            if (x > x_max)
+            {
+                x_max = x;
+            }
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    int32_t x1 = (x_first < 0) ? 0 : x_first;
+    int32_t y1 = (y_first < 0) ? 0 : y_first;
+    int32_t x2 = (x_max > image->width) ? image->width : x_max;
+    int32_t y2 = y + atlas->cellHeight;
+
+    if (y2 > image->height)
+    {
+        y2 = image->height;
+    }
+
+    if ((x2 > x1) && (y2 > y1))
+    {
+        vc_dispmanx_rect_set(&rect, x1, y1, x2 - x1, y2 - y1);
+        markDirtyImage(image, x1, y1, x2 - x1, y2 - y1);
+    }
+
+    return rect;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+createResourceFontAtlas(
+    FONT_ATLAS_T *atlas,
+    const RGBA8_T *rgba)
+{
+    int result = 0;
+
+    IMAGE_T image;
+    initImage(&image,
+              VC_IMAGE_RGBA32,
+              atlas->pitch,
+              atlas->cellHeight * FONT_ATLAS_ROWS,
+              false);
+
+    int32_t j;
+    for (j = 0 ; j < image.height ; j++)
+    {
+        const uint8_t *coverage = atlas->coverage + (j * atlas->pitch);
+        uint8_t *line = (uint8_t *)(image.buffer) + (j * image.pitch);
+
+        int32_t i;
+        for (i = 0 ; i < image.width ; i++)
+        {
+            line[4 * i] = rgba->red;
+            line[(4 * i) + 1] = rgba->green;
+            line[(4 * i) + 2] = rgba->blue;
+            line[(4 * i) + 3] = div255(coverage[i] * rgba->alpha);
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    releaseResourcePool(atlas->resource);
+
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(FONT_ATLAS_ACCOUNT));
+
+    atlas->resource = acquireResourcePool(image.type,
+                                          image.width,
+                                          image.height,
+                                          image.pitch,
+                                          image.alignedHeight);
+
+    leaveMemoryAccount(previous);
+
+    if (atlas->resource == 0)
+    {
+        destroyImage(&image);
+        return false;
+    }
+
+    VC_RECT_T rect;
+    vc_dispmanx_rect_set(&rect, 0, 0, image.width, image.height);
+
+    result = vc_dispmanx_resource_write_data(atlas->resource,
+                                             image.type,
+                                             image.pitch,
+                                             image.buffer,
+                                             &rect);
+    assert(result == 0);
+
+    destroyImage(&image);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+addTextElementsFontAtlas(
+    const FONT_ATLAS_T *atlas,
+    FONT_ATLAS_TEXT_T *text,
+    int32_t x,
+    int32_t y,
+    int32_t height,
+    const char *string,
+    int32_t layer,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    text->elements = NULL;
+    text->numberOfElements = 0;
+
+    if ((atlas->resource == 0) || (string == NULL) || (height <= 0))
+    {
+        return false;
+    }
+
+    text->elements = malloc((strlen(string) + 1)
+                            * sizeof(DISPMANX_ELEMENT_HANDLE_T));
+
+    if (text->elements == NULL)
+    {
+        fprintf(stderr, "fontAtlas: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    VC_DISPMANX_ALPHA_T alpha =
+    {
+        DISPMANX_FLAGS_ALPHA_FROM_SOURCE,
+        255,
+        0
+    };
+
+    // pen is in atlas pixels along the line, and is scaled to the display
+    // at both edges of each glyph, so that glyphs meet without gaps.
+
+    int32_t pen = 0;
+
+    for ( ; *string != '\0' ; string++)
+    {
+        uint8_t c = *string;
+
+        if (c == '\n')
+        {
+            pen = 0;
+            y += height;
+            continue;
+        }
+
+        int32_t width = atlas->cellWidth - atlas->left[c];
+
+        if (width > atlas->advance[c])
+        {
+            width = atlas->advance[c];
+        }
+
+        if (atlas->blank[c] == false)
+        {
+            int32_t x0 = x + ((pen * height) / atlas->cellHeight);
+            int32_t x1 = x + (((pen + width) * height) / atlas->cellHeight);
+
+            VC_RECT_T srcRect;
+            vc_dispmanx_rect_set(&srcRect,
+                                 (((c % FONT_ATLAS_COLUMNS) * atlas->cellWidth)
+                                  + atlas->left[c]) << 16,
+                                 ((c / FONT_ATLAS_COLUMNS) * atlas->cellHeight)
+                                 << 16,
+                                 width << 16,
+                                 atlas->cellHeight << 16);
+
+            VC_RECT_T dstRect;
+            vc_dispmanx_rect_set(&dstRect, x0, y, x1 - x0, height);
+
+            DISPMANX_ELEMENT_HANDLE_T element =
+                vc_dispmanx_element_add(update,
+                                        display,
+                                        layer,
+                                        &dstRect,
+                                        atlas->resource,
+                                        &srcRect,
+                                        DISPMANX_PROTECTION_NONE,
+                                        &alpha,
+                                        NULL,
+                                        DISPMANX_NO_ROTATE);
+            assert(element != 0);
+
+            text->elements[(text->numberOfElements)++] = element;
+        }
+
+        pen += atlas->advance[c];
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void
+removeTextElementsFontAtlas(
+    FONT_ATLAS_TEXT_T *text,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int32_t i;
+    for (i = 0 ; i < text->numberOfElements ; i++)
+    {
+        int result = vc_dispmanx_element_remove(update, text->elements[i]);
+        assert(result == 0);
+    }
+
+    free(text->elements);
+    text->elements = NULL;
+    text->numberOfElements = 0;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyFontAtlas(
+    FONT_ATLAS_T *atlas)
+{
+    releaseResourcePool(atlas->resource);
+    atlas->resource = 0;
+
+    free(atlas->coverage);
+    atlas->coverage = NULL;
+}
+
@@ -0,0 +1,142 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef FONT_ATLAS_H
+#define FONT_ATLAS_H
+
+//-------------------------------------------------------------------------
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bcm_host.h"
+
+#include "image.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// A font atlas is a png holding the 256 characters of a font as a grid of
+// 16 x 16 equal cells, character c in column c % 16 and row c / 16. The
+// alpha of each pixel (or its brightness, if the png has no alpha) is how
+// much of the pixel the glyph covers. Text can be blended into an image,
+// or the atlas can be uploaded once as a resource and each glyph shown as
+// an element of its own, so that the GPU scales it.
+
+#define FONT_ATLAS_COLUMNS 16
+#define FONT_ATLAS_ROWS 16
+#define FONT_ATLAS_GLYPHS (FONT_ATLAS_COLUMNS * FONT_ATLAS_ROWS)
+
+typedef struct
+{
+    int32_t cellWidth;
+    int32_t cellHeight;
+    int32_t pitch;
+    uint8_t *coverage;
+    int16_t left[FONT_ATLAS_GLYPHS];
+    int16_t advance[FONT_ATLAS_GLYPHS];
+    bool blank[FONT_ATLAS_GLYPHS];
+    DISPMANX_RESOURCE_HANDLE_T resource;
+} FONT_ATLAS_T;
+
+typedef struct
+{
+    DISPMANX_ELEMENT_HANDLE_T *elements;
+    int32_t numberOfElements;
+} FONT_ATLAS_TEXT_T;
+
+//-------------------------------------------------------------------------
+
+// If proportional is true each glyph is trimmed to the columns it covers
+// and advances by its own width, otherwise every glyph advances by the
+// width of a cell.
+
+bool
+initFontAtlas(
+    FONT_ATLAS_T *atlas,
+    const char *file,
+    bool proportional);
+
+// The width of the widest line of string, in atlas pixels.
+
+int32_t
+textWidthFontAtlas(
+    const FONT_ATLAS_T *atlas,
+    const char *string);
+
+// Blend string into the image with its top left corner at (x, y). RGBA32
+// images are blended two pixels at a time; other direct colour images a
+// pixel at a time. Returns the area drawn, clipped to the image.
+
+VC_RECT_T
+drawTextFontAtlas(
+    const FONT_ATLAS_T *atlas,
+    int32_t x,
+    int32_t y,
+    const char *string,
+    const RGBA8_T *rgba,
+    IMAGE_T *image);
+
+// Upload the atlas as an RGBA32 resource in the colour rgba, replacing any
+// resource it had.
+
+bool
+createResourceFontAtlas(
+    FONT_ATLAS_T *atlas,
+    const RGBA8_T *rgba);
+
+// Add an element for each visible glyph of string, scaled from the atlas
+// by the GPU so that a line is height pixels high. Each glyph is one
+// element, so this is meant for short strings of large text.
+
+bool
+addTextElementsFontAtlas(
+    const FONT_ATLAS_T *atlas,
+    FONT_ATLAS_TEXT_T *text,
+    int32_t x,
+    int32_t y,
+    int32_t height,
+    const char *string,
+    int32_t layer,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+void
+removeTextElementsFontAtlas(
+    FONT_ATLAS_TEXT_T *text,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+void
+destroyFontAtlas(
+    FONT_ATLAS_T *atlas);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
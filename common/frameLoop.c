@@ -0,0 +1,302 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <assert.h>
+#include <stdbool.h>
+
+#include "frameLoop.h"
+
+//-------------------------------------------------------------------------
+
+// The running average moves 1/FRAME_LOOP_AVERAGE_WEIGHT of the way to each
+// new frame interval.
+
+#define FRAME_LOOP_AVERAGE_WEIGHT 8
+
+//-------------------------------------------------------------------------
+
+static int64_t
+elapsedMicros(
+    const struct timespec *start,
+    const struct timespec *end)
+{
+    return ((end->tv_sec - start->tv_sec) * INT64_C(1000000))
+         + ((end->tv_nsec - start->tv_nsec) / 1000);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+vsyncCallbackFrameLoop(
+    DISPMANX_UPDATE_HANDLE_T update,
+    void *arg)
+{
+    FRAME_LOOP_T *loop = arg;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&(loop->mutex));
+
+    if ((loop->stats != NULL) && (loop->vsyncs > 0))
+    {
+        recordFrameStats(loop->stats,
+                         FRAME_STATS_VSYNC,
+                         elapsedMicros(&(loop->lastVsyncTime), &now));
+    }
+
+    loop->lastVsyncTime = now;
+    ++(loop->vsyncs);
+    pthread_cond_broadcast(&(loop->condition));
+    pthread_mutex_unlock(&(loop->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+static void
+updateCallbackFrameLoop(
+    DISPMANX_UPDATE_HANDLE_T update,
+    void *arg)
+{
+    FRAME_LOOP_T *loop = arg;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&(loop->mutex));
+
+    if (loop->stats != NULL)
+    {
+        recordFrameStats(loop->stats,
+                         FRAME_STATS_SUBMIT,
+                         elapsedMicros(&(loop->submitTime), &now));
+    }
+
+    if (loop->frames > 0)
+    {
+        int64_t interval = elapsedMicros(&(loop->lastFrameTime), &now);
+
+        loop->frameInterval = interval;
+
+        if (loop->frames == 1)
+        {
+            loop->averageFrameInterval = interval;
+        }
+        else
+        {
+            loop->averageFrameInterval +=
+                (interval - loop->averageFrameInterval)
+                / FRAME_LOOP_AVERAGE_WEIGHT;
+        }
+    }
+
+    loop->lastFrameTime = now;
+    ++(loop->frames);
+
+    loop->updatePending = false;
+    pthread_cond_broadcast(&(loop->condition));
+    pthread_mutex_unlock(&(loop->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+void
+initFrameLoop(
+    FRAME_LOOP_T *loop,
+    DISPMANX_DISPLAY_HANDLE_T display)
+{
+    loop->display = display;
+    loop->vsyncs = 0;
+    loop->updatePending = false;
+    loop->frames = 0;
+    loop->frameInterval = 0;
+    loop->averageFrameInterval = 0;
+    loop->stats = NULL;
+
+    pthread_mutex_init(&(loop->mutex), NULL);
+
+    // Use the monotonic clock for timed waits, so waitForVsyncFrameLoop()
+    // still returns if the firmware does not deliver vsync callbacks.
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&(loop->condition), &attr);
+    pthread_condattr_destroy(&attr);
+
+    int result = vc_dispmanx_vsync_callback(display,
+                                            vsyncCallbackFrameLoop,
+                                            loop);
+    loop->vsyncEnabled = (result == 0);
+}
+
+//-------------------------------------------------------------------------
+
+void
+setStatsFrameLoop(
+    FRAME_LOOP_T *loop,
+    FRAME_STATS_T *stats)
+{
+    pthread_mutex_lock(&(loop->mutex));
+    loop->stats = stats;
+    pthread_mutex_unlock(&(loop->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+void
+waitForVsyncFrameLoop(
+    FRAME_LOOP_T *loop)
+{
+    // At 60Hz a vsync is due within 17ms; wait a little longer than a
+    // frame in case one is missed.
+
+    struct timespec timeout;
+    clock_gettime(CLOCK_MONOTONIC, &timeout);
+    timeout.tv_nsec += 20 * 1000 * 1000;
+
+    if (timeout.tv_nsec >= 1000 * 1000 * 1000)
+    {
+        timeout.tv_nsec -= 1000 * 1000 * 1000;
+        ++(timeout.tv_sec);
+    }
+
+    pthread_mutex_lock(&(loop->mutex));
+
+    uint32_t vsyncs = loop->vsyncs;
+
+    while (vsyncs == loop->vsyncs)
+    {
+        if (pthread_cond_timedwait(&(loop->condition),
+                                   &(loop->mutex),
+                                   &timeout) != 0)
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&(loop->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+void
+waitForUpdateFrameLoop(
+    FRAME_LOOP_T *loop)
+{
+    pthread_mutex_lock(&(loop->mutex));
+
+    while (loop->updatePending)
+    {
+        pthread_cond_wait(&(loop->condition), &(loop->mutex));
+    }
+
+    pthread_mutex_unlock(&(loop->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+void
+submitUpdateFrameLoop(
+    FRAME_LOOP_T *loop,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    waitForUpdateFrameLoop(loop);
+
+    pthread_mutex_lock(&(loop->mutex));
+    loop->updatePending = true;
+    clock_gettime(CLOCK_MONOTONIC, &(loop->submitTime));
+    pthread_mutex_unlock(&(loop->mutex));
+
+    int result = vc_dispmanx_update_submit(update,
+                                           updateCallbackFrameLoop,
+                                           loop);
+    assert(result == 0);
+}
+
+//-------------------------------------------------------------------------
+
+int64_t
+frameIntervalFrameLoop(
+    FRAME_LOOP_T *loop,
+    bool average)
+{
+    pthread_mutex_lock(&(loop->mutex));
+
+    int64_t interval = (average)
+                     ? loop->averageFrameInterval
+                     : loop->frameInterval;
+
+    pthread_mutex_unlock(&(loop->mutex));
+
+    return interval;
+}
+
+//-------------------------------------------------------------------------
+
+double
+framesPerSecondFrameLoop(
+    FRAME_LOOP_T *loop)
+{
+    int64_t interval = frameIntervalFrameLoop(loop, true);
+
+    if (interval <= 0)
+    {
+        return 0.0;
+    }
+
+    return 1.0e6 / interval;
+}
+
+//-------------------------------------------------------------------------
+
+int64_t
+nowMicrosecondsFrameLoop(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec * INT64_C(1000000)) + (now.tv_nsec / 1000);
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyFrameLoop(
+    FRAME_LOOP_T *loop)
+{
+    waitForUpdateFrameLoop(loop);
+
+    if (loop->vsyncEnabled)
+    {
+        vc_dispmanx_vsync_callback(loop->display, NULL, NULL);
+        loop->vsyncEnabled = false;
+    }
+
+    pthread_cond_destroy(&(loop->condition));
+    pthread_mutex_destroy(&(loop->mutex));
+}
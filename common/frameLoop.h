@@ -0,0 +1,128 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef FRAME_LOOP_H
+#define FRAME_LOOP_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bcm_host.h"
+
+#include "frameStats.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// A frame loop paces a render loop from the display instead of blocking in
+// vc_dispmanx_update_submit_sync(). Updates are submitted asynchronously
+// with at most one in flight, so the next frame can be drawn while the
+// last one is being composed. Resources that are (or may still be) on
+// screen must not be written until waitForUpdateFrameLoop() returns.
+
+typedef struct
+{
+    DISPMANX_DISPLAY_HANDLE_T display;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    bool vsyncEnabled;
+    uint32_t vsyncs;
+    bool updatePending;
+    uint32_t frames;
+    struct timespec lastFrameTime;
+    int64_t frameInterval;
+    int64_t averageFrameInterval;
+    struct timespec submitTime;
+    struct timespec lastVsyncTime;
+    FRAME_STATS_T *stats;
+} FRAME_LOOP_T;
+
+//-------------------------------------------------------------------------
+
+void
+initFrameLoop(
+    FRAME_LOOP_T *loop,
+    DISPMANX_DISPLAY_HANDLE_T display);
+
+// If stats is not NULL, the submit latency of each update and the interval
+// between vsyncs are recorded in it.
+
+void
+setStatsFrameLoop(
+    FRAME_LOOP_T *loop,
+    FRAME_STATS_T *stats);
+
+// Block until the next vertical sync of the display.
+
+void
+waitForVsyncFrameLoop(
+    FRAME_LOOP_T *loop);
+
+// Block until the last submitted update has been applied.
+
+void
+waitForUpdateFrameLoop(
+    FRAME_LOOP_T *loop);
+
+// Wait for the previous update to be applied, then submit this one and
+// return without waiting for it.
+
+void
+submitUpdateFrameLoop(
+    FRAME_LOOP_T *loop,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+// Microseconds between the last two updates that were applied and a
+// running average, or zero until two updates have completed.
+
+int64_t
+frameIntervalFrameLoop(
+    FRAME_LOOP_T *loop,
+    bool average);
+
+double
+framesPerSecondFrameLoop(
+    FRAME_LOOP_T *loop);
+
+// Microseconds on the monotonic clock that frames are timed against, for
+// animation that should run at the same speed whatever the frame rate.
+
+int64_t
+nowMicrosecondsFrameLoop(void);
+
+void
+destroyFrameLoop(
+    FRAME_LOOP_T *loop);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,330 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "font.h"
+#include "frameStats.h"
+#include "image.h"
+
+//-------------------------------------------------------------------------
+
+#define FRAME_STATS_LEFT_PADDING 4
+#define FRAME_STATS_TOP_PADDING 4
+
+//-------------------------------------------------------------------------
+
+static int32_t
+elapsedMicros(
+    const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((now.tv_sec - start->tv_sec) * 1000000)
+         + ((now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+//-------------------------------------------------------------------------
+
+void
+initFrameStats(
+    FRAME_STATS_T *stats)
+{
+    stats->frames = 0;
+
+    int32_t counter;
+    for (counter = 0 ; counter < FRAME_STATS_COUNTERS ; counter++)
+    {
+        stats->pending[counter] = -1;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+startFrameStats(
+    FRAME_STATS_T *stats,
+    FRAME_STATS_COUNTER_T counter)
+{
+    clock_gettime(CLOCK_MONOTONIC, &(stats->start[counter]));
+}
+
+//-------------------------------------------------------------------------
+
+void
+stopFrameStats(
+    FRAME_STATS_T *stats,
+    FRAME_STATS_COUNTER_T counter)
+{
+    recordFrameStats(stats, counter, elapsedMicros(&(stats->start[counter])));
+}
+
+//-------------------------------------------------------------------------
+
+void
+recordFrameStats(
+    FRAME_STATS_T *stats,
+    FRAME_STATS_COUNTER_T counter,
+    int32_t micros)
+{
+    __sync_lock_test_and_set(&(stats->pending[counter]), micros);
+}
+
+//-------------------------------------------------------------------------
+
+void
+endFrameStats(
+    FRAME_STATS_T *stats)
+{
+    uint32_t frame = stats->frames;
+    FRAME_STATS_SAMPLE_T *sample =
+        &(stats->samples[frame % FRAME_STATS_SAMPLES]);
+
+    sample->frame = frame;
+
+    int32_t counter;
+    for (counter = 0 ; counter < FRAME_STATS_COUNTERS ; counter++)
+    {
+        sample->micros[counter] =
+            __sync_lock_test_and_set(&(stats->pending[counter]), -1);
+    }
+
+    // publish the sample before the new frame count
+
+    __sync_synchronize();
+    stats->frames = frame + 1;
+}
+
+//-------------------------------------------------------------------------
+
+void
+summariseFrameStats(
+    FRAME_STATS_T *stats,
+    FRAME_STATS_COUNTER_T counter,
+    FRAME_STATS_SUMMARY_T *summary)
+{
+    uint32_t frames = stats->frames;
+    uint32_t count = (frames < FRAME_STATS_SAMPLES)
+                   ? frames
+                   : FRAME_STATS_SAMPLES;
+
+    int64_t total = 0;
+
+    summary->minimum = 0;
+    summary->maximum = 0;
+    summary->mean = 0;
+    summary->samples = 0;
+
+    uint32_t i;
+    for (i = 0 ; i < count ; i++)
+    {
+        int32_t micros = stats->samples[i].micros[counter];
+
+        if (micros < 0)
+        {
+            continue;
+        }
+
+        if ((summary->samples == 0) || (micros < summary->minimum))
+        {
+            summary->minimum = micros;
+        }
+
+        if (micros > summary->maximum)
+        {
+            summary->maximum = micros;
+        }
+
+        total += micros;
+        ++(summary->samples);
+    }
+
+    if (summary->samples > 0)
+    {
+        summary->mean = total / summary->samples;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+const char *
+frameStatsCounterName(
+    FRAME_STATS_COUNTER_T counter)
+{
+    switch (counter)
+    {
+    case FRAME_STATS_RENDER:
+
+        return "render";
+
+    case FRAME_STATS_UPLOAD:
+
+        return "upload";
+
+    case FRAME_STATS_SUBMIT:
+
+        return "submit";
+
+    case FRAME_STATS_VSYNC:
+
+        return "vsync";
+
+    default:
+
+        break;
+    }
+
+    return "unknown";
+}
+
+//-------------------------------------------------------------------------
+
+void
+drawFrameStats(
+    FRAME_STATS_T *stats,
+    IMAGE_LAYER_T *imageLayer)
+{
+    static RGBA8_T backgroundColour = { 0, 0, 0, 160 };
+    static RGBA8_T textColour = { 255, 255, 255, 255 };
+
+    IMAGE_T *image = &(imageLayer->image);
+
+    clearImageRGB(image, &backgroundColour);
+
+    int32_t x = FRAME_STATS_LEFT_PADDING;
+    int32_t y = FRAME_STATS_TOP_PADDING;
+
+    char buffer[64];
+
+    snprintf(buffer, sizeof(buffer), "ms      mean    max");
+    drawStringRGB(x, y, buffer, &textColour, image);
+
+    int32_t counter;
+    for (counter = 0 ; counter < FRAME_STATS_COUNTERS ; counter++)
+    {
+        FRAME_STATS_SUMMARY_T summary;
+        summariseFrameStats(stats, counter, &summary);
+
+        y += FONT_HEIGHT;
+
+        if (summary.samples == 0)
+        {
+            snprintf(buffer,
+                     sizeof(buffer),
+                     "%-6s      --     --",
+                     frameStatsCounterName(counter));
+        }
+        else
+        {
+            snprintf(buffer,
+                     sizeof(buffer),
+                     "%-6s %7.2f %6.2f",
+                     frameStatsCounterName(counter),
+                     summary.mean / 1000.0,
+                     summary.maximum / 1000.0);
+        }
+
+        drawStringRGB(x, y, buffer, &textColour, image);
+    }
+
+    //---------------------------------------------------------------------
+
+    // Vsync jitter is the spread of the intervals between vsyncs.
+
+    FRAME_STATS_SUMMARY_T vsync;
+    summariseFrameStats(stats, FRAME_STATS_VSYNC, &vsync);
+
+    y += FONT_HEIGHT;
+
+    snprintf(buffer,
+             sizeof(buffer),
+             "jitter %7.2f",
+             (vsync.maximum - vsync.minimum) / 1000.0);
+    drawStringRGB(x, y, buffer, &textColour, image);
+
+    changeSourceAndUpdateImageLayer(imageLayer);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+writeCsvFrameStats(
+    FRAME_STATS_T *stats,
+    const char *path)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    fprintf(fp, "frame");
+
+    int32_t counter;
+    for (counter = 0 ; counter < FRAME_STATS_COUNTERS ; counter++)
+    {
+        fprintf(fp, ",%s_us", frameStatsCounterName(counter));
+    }
+
+    fprintf(fp, "\n");
+
+    //---------------------------------------------------------------------
+
+    uint32_t frames = stats->frames;
+    uint32_t first = (frames < FRAME_STATS_SAMPLES)
+                   ? 0
+                   : frames - FRAME_STATS_SAMPLES;
+
+    uint32_t frame;
+    for (frame = first ; frame < frames ; frame++)
+    {
+        const FRAME_STATS_SAMPLE_T *sample =
+            &(stats->samples[frame % FRAME_STATS_SAMPLES]);
+
+        fprintf(fp, "%"PRIu32, sample->frame);
+
+        for (counter = 0 ; counter < FRAME_STATS_COUNTERS ; counter++)
+        {
+            if (sample->micros[counter] < 0)
+            {
+                fprintf(fp, ",");
+            }
+            else
+            {
+                fprintf(fp, ",%"PRId32, sample->micros[counter]);
+            }
+        }
+
+        fprintf(fp, "\n");
+    }
+
+    return fclose(fp) == 0;
+}
@@ -0,0 +1,144 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "imageLayer.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+#define FRAME_STATS_SAMPLES 256
+
+//-------------------------------------------------------------------------
+
+typedef enum
+{
+    FRAME_STATS_RENDER,
+    FRAME_STATS_UPLOAD,
+    FRAME_STATS_SUBMIT,
+    FRAME_STATS_VSYNC,
+    FRAME_STATS_COUNTERS
+} FRAME_STATS_COUNTER_T;
+
+//-------------------------------------------------------------------------
+
+// Times are in microseconds. A counter that was not recorded during a
+// frame is -1.
+
+typedef struct
+{
+    uint32_t frame;
+    int32_t micros[FRAME_STATS_COUNTERS];
+} FRAME_STATS_SAMPLE_T;
+
+typedef struct
+{
+    int32_t minimum;
+    int32_t maximum;
+    int32_t mean;
+    int32_t samples;
+} FRAME_STATS_SUMMARY_T;
+
+//-------------------------------------------------------------------------
+
+// The render thread times the render and upload counters and calls
+// endFrameStats() once per frame, which publishes the frame into a ring
+// of the last FRAME_STATS_SAMPLES frames. The submit and vsync counters
+// may be recorded from the Dispmanx callback threads, and land in the
+// frame being drawn when they arrive. No locks are taken, so the counters
+// can be left in release builds.
+
+typedef struct
+{
+    FRAME_STATS_SAMPLE_T samples[FRAME_STATS_SAMPLES];
+    volatile uint32_t frames;
+    volatile int32_t pending[FRAME_STATS_COUNTERS];
+    struct timespec start[FRAME_STATS_COUNTERS];
+} FRAME_STATS_T;
+
+//-------------------------------------------------------------------------
+
+void
+initFrameStats(
+    FRAME_STATS_T *stats);
+
+void
+startFrameStats(
+    FRAME_STATS_T *stats,
+    FRAME_STATS_COUNTER_T counter);
+
+void
+stopFrameStats(
+    FRAME_STATS_T *stats,
+    FRAME_STATS_COUNTER_T counter);
+
+void
+recordFrameStats(
+    FRAME_STATS_T *stats,
+    FRAME_STATS_COUNTER_T counter,
+    int32_t micros);
+
+void
+endFrameStats(
+    FRAME_STATS_T *stats);
+
+void
+summariseFrameStats(
+    FRAME_STATS_T *stats,
+    FRAME_STATS_COUNTER_T counter,
+    FRAME_STATS_SUMMARY_T *summary);
+
+const char *
+frameStatsCounterName(
+    FRAME_STATS_COUNTER_T counter);
+
+// Draw a summary of each counter into the image layer and update it.
+
+void
+drawFrameStats(
+    FRAME_STATS_T *stats,
+    IMAGE_LAYER_T *imageLayer);
+
+// Write the frames still in the ring to a CSV file, oldest first.
+
+bool
+writeCsvFrameStats(
+    FRAME_STATS_T *stats,
+    const char *path);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
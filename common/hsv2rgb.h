@@ -32,10 +32,14 @@
 
 #include "image.h"
     
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
 void hsv2rgb(int16_t hue, int16_t saturation, int16_t value, RGBA8_T *rgb);
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
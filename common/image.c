@@ -30,6 +30,9 @@
 #include <string.h>
 
 #include "image.h"
+#include "imageConvert.h"
+#include "imagePixel.h"
+#include "resourcePool.h"
 
 //-------------------------------------------------------------------------
 
@@ -37,6 +40,10 @@
 #define ALIGN_TO_16(x)  ((x + 15) & ~15)
 #endif
 
+// Pixels converted at a time by copyImageRect() between image types.
+
+#define IMAGE_COPY_CHUNK 64
+
 //-------------------------------------------------------------------------
 
 void setPixel4BPP(IMAGE_T *image, int32_t x, int32_t y, int8_t index);
@@ -55,9 +62,111 @@ void getPixelRGB888(IMAGE_T *image, int32_t x, int32_t y, RGBA8_T *rgba);
 void getPixelRGBA16(IMAGE_T *image, int32_t x, int32_t y, RGBA8_T *rgba);
 void getPixelRGBA32(IMAGE_T *image, int32_t x, int32_t y, RGBA8_T *rgba);
 
+void
+setSpan4BPP(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    int8_t index);
+
+void
+setSpan8BPP(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    int8_t index);
+
+void
+setSpanRGB565(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba);
+
+void
+setSpanDitheredRGB565(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba);
+
+void
+setSpanRGB888(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba);
+
+void
+setSpanRGBA16(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba);
+
+void
+setSpanDitheredRGBA16(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba);
+
+void
+setSpanRGBA32(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba);
+
 //-------------------------------------------------------------------------
 
-bool initImage(
+static inline void
+fillSpan16(
+    uint16_t *line,
+    int32_t length,
+    uint16_t pixel)
+{
+    if ((pixel & 0xFF) == (pixel >> 8))
+    {
+        memset(line, pixel & 0xFF, length * sizeof(uint16_t));
+    }
+    else
+    {
+        int32_t i;
+        for (i = 0 ; i < length ; i++)
+        {
+            line[i] = pixel;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static inline void
+fillSpanPattern16(
+    uint16_t *line,
+    int32_t x,
+    int32_t length,
+    const uint16_t pattern[8])
+{
+    int32_t i;
+    for (i = 0 ; i < length ; i++)
+    {
+        line[i] = pattern[(x + i) & 7];
+    }
+}
+
+//-------------------------------------------------------------------------
+
+bool initImageHeader(
     IMAGE_T *image,
     VC_IMAGE_TYPE_T type,
     int32_t width,
@@ -73,6 +182,8 @@ bool initImage(
         image->getPixelDirect = NULL;
         image->setPixelIndexed = setPixel4BPP;
         image->getPixelIndexed = getPixel4BPP;
+        image->setSpanDirect = NULL;
+        image->setSpanIndexed = setSpan4BPP;
 
         break;
 
@@ -83,6 +194,8 @@ bool initImage(
         image->getPixelDirect = NULL;
         image->setPixelIndexed = setPixel8BPP;
         image->getPixelIndexed = getPixel8BPP;
+        image->setSpanDirect = NULL;
+        image->setSpanIndexed = setSpan8BPP;
 
         break;
 
@@ -93,14 +206,17 @@ bool initImage(
         if (dither)
         {
             image->setPixelDirect = setPixelDitheredRGB565;
+            image->setSpanDirect = setSpanDitheredRGB565;
         }
         else
         {
             image->setPixelDirect = setPixelRGB565;
+            image->setSpanDirect = setSpanRGB565;
         }
         image->getPixelDirect = getPixelRGB565;
         image->setPixelIndexed = NULL;
         image->getPixelIndexed = NULL;
+        image->setSpanIndexed = NULL;
 
         break;
 
@@ -111,6 +227,8 @@ bool initImage(
         image->getPixelDirect = getPixelRGB888;
         image->setPixelIndexed = NULL;
         image->getPixelIndexed = NULL;
+        image->setSpanDirect = setSpanRGB888;
+        image->setSpanIndexed = NULL;
 
         break;
 
@@ -120,14 +238,17 @@ bool initImage(
         if (dither)
         {
             image->setPixelDirect = setPixelDitheredRGBA16;
+            image->setSpanDirect = setSpanDitheredRGBA16;
         }
         else
         {
             image->setPixelDirect = setPixelRGBA16;
+            image->setSpanDirect = setSpanRGBA16;
         }
         image->getPixelDirect = getPixelRGBA16;
         image->setPixelIndexed = NULL;
         image->getPixelIndexed = NULL;
+        image->setSpanIndexed = NULL;
 
         break;
 
@@ -138,6 +259,8 @@ bool initImage(
         image->getPixelDirect = getPixelRGBA32;
         image->setPixelIndexed = NULL;
         image->getPixelIndexed = NULL;
+        image->setSpanDirect = setSpanRGBA32;
+        image->setSpanIndexed = NULL;
 
         break;
 
@@ -156,14 +279,44 @@ bool initImage(
     image->alignedHeight = ALIGN_TO_16(height);
     image->size = image->pitch * image->alignedHeight;
 
-    image->buffer = calloc(1, image->size);
+    image->dither = dither;
+    image->convertRow = findRowConverter(type, dither);
+    image->buffer = NULL;
+    image->dirty = NULL;
+    image->freeBuffer = NULL;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+releaseBufferImage(
+    IMAGE_T *image)
+{
+    releaseBufferPool(image->buffer, image->size);
+}
+
+//-------------------------------------------------------------------------
 
-    if (image->buffer == NULL)
+bool initImage(
+    IMAGE_T *image,
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height,
+    bool dither)
+{
+    if (initImageHeader(image, type, width, height, dither) == false)
     {
-        fprintf(stderr, "image: memory exhausted\n");
-        exit(EXIT_FAILURE);
+        return false;
     }
 
+    // The buffer comes from the resource pool, cleared, so an image that
+    // is loaded again and again reuses the same memory.
+
+    image->buffer = acquireBufferPool(image->size);
+    image->freeBuffer = releaseBufferImage;
+
     return true;
 }
 
@@ -174,17 +327,15 @@ clearImageIndexed(
     IMAGE_T *image,
     int8_t index)
 {
-    if (image->setPixelIndexed != NULL)
+    if (image->setSpanIndexed != NULL)
     {
         int j;
         for (j = 0 ; j < image->height ; j++)
         {
-            int i;
-            for (i = 0 ; i < image->width ; i++)
-            {
-                image->setPixelIndexed(image, i, j, index);
-            }
+            image->setSpanIndexed(image, 0, j, image->width, index);
         }
+
+        markDirtyImage(image, 0, 0, image->width, image->height);
     }
 }
 
@@ -195,17 +346,15 @@ clearImageRGB(
     IMAGE_T *image,
     const RGBA8_T *rgb)
 {
-    if (image->setPixelDirect != NULL)
+    if (image->setSpanDirect != NULL)
     {
         int j;
         for (j = 0 ; j < image->height ; j++)
         {
-            int i;
-            for (i = 0 ; i < image->width ; i++)
-            {
-                image->setPixelDirect(image, i, j, rgb);
-            }
+            image->setSpanDirect(image, 0, j, image->width, rgb);
         }
+
+        markDirtyImage(image, 0, 0, image->width, image->height);
     }
 }
 
@@ -226,6 +375,7 @@ setPixelIndexed(
     {
         result = true;
         image->setPixelIndexed(image, x, y, index);
+        markDirtyImage(image, x, y, 1, 1);
     }
 
     return result;
@@ -248,6 +398,7 @@ setPixelRGB(
     {
         result = true;
         image->setPixelDirect(image, x, y, rgb);
+        markDirtyImage(image, x, y, 1, 1);
     }
 
     return result;
@@ -299,246 +450,662 @@ getPixelRGB(
 
 //-------------------------------------------------------------------------
 
-void
-destroyImage(
-    IMAGE_T *image)
+static bool
+clipSpan(
+    IMAGE_T *image,
+    int32_t *x,
+    int32_t y,
+    int32_t *length)
 {
-    if (image->buffer)
+    if ((y < 0) || (y >= image->height))
     {
-        free(image->buffer);
+        return false;
     }
 
-    image->type = VC_IMAGE_MIN;
-    image->width = 0;
-    image->height = 0;
-    image->pitch = 0;
-    image->alignedHeight = 0;
-    image->bitsPerPixel = 0;
-    image->size = 0;
-    image->buffer = NULL;
-    image->setPixelDirect = NULL;
-    image->getPixelDirect = NULL;
-    image->setPixelIndexed = NULL;
-    image->getPixelIndexed = NULL;
+    int32_t start = (*x < 0) ? 0 : *x;
+    int32_t end = *x + *length;
+
+    if (end > image->width)
+    {
+        end = image->width;
+    }
+
+    *x = start;
+    *length = end - start;
+
+    return (*length > 0);
 }
 
-//-----------------------------------------------------------------------
+//-------------------------------------------------------------------------
 
-void
-setPixel4BPP(
+bool
+setSpanIndexed(
     IMAGE_T *image,
     int32_t x,
     int32_t y,
+    int32_t length,
     int8_t index)
 {
-    index &= 0x0F;
-
-    uint8_t *value = (uint8_t*)(image->buffer + (x/2) + (y *image->pitch));
+    bool result = false;
 
-    if (x % 2)
-    {
-        *value = (*value & 0xF0) | (index);
-    }
-    else
+    if ((image->setSpanIndexed != NULL) &&
+        clipSpan(image, &x, y, &length))
     {
-        *value = (*value & 0x0F) | (index << 4);
+        result = true;
+        image->setSpanIndexed(image, x, y, length, index);
+        markDirtyImage(image, x, y, length, 1);
     }
+
+    return result;
 }
 
-//-----------------------------------------------------------------------
+//-------------------------------------------------------------------------
 
-void
-setPixel8BPP(
+bool
+setSpanRGB(
     IMAGE_T *image,
     int32_t x,
     int32_t y,
-    int8_t index)
+    int32_t length,
+    const RGBA8_T *rgb)
 {
-    *(uint8_t*)(image->buffer + x + (y * image->pitch)) = index;
+    bool result = false;
+
+    if ((image->setSpanDirect != NULL) &&
+        clipSpan(image, &x, y, &length))
+    {
+        result = true;
+        image->setSpanDirect(image, x, y, length, rgb);
+        markDirtyImage(image, x, y, length, 1);
+    }
+
+    return result;
 }
 
-//-----------------------------------------------------------------------
+//-------------------------------------------------------------------------
 
-void
-setPixelRGB565(
+bool
+setRowRGB(
     IMAGE_T *image,
     int32_t x,
     int32_t y,
-    const RGBA8_T *rgba)
+    int32_t length,
+    const RGBA8_T *row)
 {
-    uint8_t r5 = rgba->red >> 3;
-    uint8_t g6 = rgba->green >> 2;
-    uint8_t b5 = rgba->blue >> 3;
+    int32_t start = x;
+
+    if ((image->convertRow == NULL) ||
+        (clipSpan(image, &x, y, &length) == false))
+    {
+        return false;
+    }
+
+    uint8_t *line = (uint8_t *)(image->buffer)
+                  + (y * image->pitch)
+                  + ((x * image->bitsPerPixel) / 8);
+
+    image->convertRow(line, row + (x - start), x, y, length);
+    markDirtyImage(image, x, y, length, 1);
 
-    uint16_t pixel = (r5 << 11) | (g6 << 5) | b5;
-    *(uint16_t*)(image->buffer + (x * 2) + (y *image->pitch)) = pixel;
+    return true;
 }
 
-//-----------------------------------------------------------------------
+//-------------------------------------------------------------------------
 
-void
-setPixelDitheredRGB565(
+static bool
+clipRect(
     IMAGE_T *image,
-    int32_t x,
-    int32_t y,
-    const RGBA8_T *rgba)
+    int32_t *x,
+    int32_t *y,
+    int32_t *width,
+    int32_t *height)
 {
-    static int16_t dither8[64] =
-    {
-        1, 6, 2, 7, 1, 6, 2, 7,
-        4, 2, 5, 4, 4, 3, 6, 4,
-        1, 7, 1, 6, 2, 7, 1, 7,
-        5, 3, 5, 3, 5, 4, 5, 3,
-        1, 6, 2, 7, 1, 6, 2, 7,
-        4, 3, 6, 4, 4, 2, 6, 4,
-        2, 7, 1, 7, 2, 7, 1, 6,
-        5, 3, 5, 3, 5, 3, 5, 3,
-    };
+    int32_t y1 = (*y < 0) ? 0 : *y;
+    int32_t y2 = *y + *height;
 
-    static int16_t dither4[64] =
+    if (y2 > image->height)
     {
-        1, 3, 1, 3, 1, 3, 1, 3,
-        2, 1, 3, 2, 2, 1, 3, 2,
-        1, 3, 1, 3, 1, 3, 1, 3,
-        2, 2, 2, 1, 3, 2, 2, 2,
-        1, 3, 1, 3, 1, 3, 1, 3,
-        2, 1, 3, 2, 2, 1, 3, 2,
-        1, 3, 1, 3, 1, 3, 1, 3,
-        3, 2, 2, 2, 2, 2, 2, 2,
-    };
+        y2 = image->height;
+    }
 
-    int32_t index = (x & 7) | ((y & 7) << 3);
+    *y = y1;
+    *height = y2 - y1;
 
-    int16_t r = rgba->red + dither8[index];
+    return (*height > 0) && clipSpan(image, x, y1, width);
+}
 
-    if (r > 255)
-    {
-        r = 255;
-    }
+//-------------------------------------------------------------------------
 
-    int16_t g = rgba->green + dither4[index];
+bool
+setRectIndexed(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height,
+    int8_t index)
+{
+    bool result = false;
 
-    if (g > 255)
+    if ((image->setSpanIndexed != NULL) &&
+        clipRect(image, &x, &y, &width, &height))
     {
-        g = 255;
-    }
+        result = true;
 
-    int16_t b = rgba->blue + dither8[index];
+        int32_t j;
+        for (j = y ; j < y + height ; j++)
+        {
+            image->setSpanIndexed(image, x, j, width, index);
+        }
 
-    if (b > 255)
-    {
-        b = 255;
+        markDirtyImage(image, x, y, width, height);
     }
 
-    RGBA8_T dithered = { r, g, b, rgba->alpha };
-
-    setPixelRGB565(image, x, y, &dithered);
+    return result;
 }
 
 //-------------------------------------------------------------------------
 
-void
-setPixelRGB888(
+bool
+setRectRGB(
     IMAGE_T *image,
     int32_t x,
     int32_t y,
-    const RGBA8_T *rgba)
+    int32_t width,
+    int32_t height,
+    const RGBA8_T *rgb)
 {
-    uint8_t *line = (uint8_t *)(image->buffer) + (y*image->pitch) + (3*x);
-    line[0] = rgba->red;
-    line[1] = rgba->green;
-    line[2] = rgba->blue;
+    bool result = false;
+
+    if ((image->setSpanDirect != NULL) &&
+        clipRect(image, &x, &y, &width, &height))
+    {
+        result = true;
+
+        int32_t j;
+        for (j = y ; j < y + height ; j++)
+        {
+            image->setSpanDirect(image, x, j, width, rgb);
+        }
+
+        markDirtyImage(image, x, y, width, height);
+    }
+
+    return result;
 }
 
-//-----------------------------------------------------------------------
+//-------------------------------------------------------------------------
 
-void
-setPixelRGBA16(
+bool
+getRectImage(
     IMAGE_T *image,
     int32_t x,
     int32_t y,
-    const RGBA8_T *rgba)
+    int32_t width,
+    int32_t height,
+    IMAGE_RECT_T *rect)
 {
-    uint8_t r4 = rgba->red  >> 4;
-    uint8_t g4 = rgba->green >> 4;
-    uint8_t b4 = rgba->blue >> 4;
-    uint8_t a4 = rgba->alpha >> 4;
+    if (clipRect(image, &x, &y, &width, &height) == false)
+    {
+        return false;
+    }
+
+    int32_t startBit = x * image->bitsPerPixel;
+    int32_t endBit = (x + width) * image->bitsPerPixel;
 
-    uint16_t pixel = (r4 << 12) | (g4 << 8) | (b4 << 4) | a4;
-    *(uint16_t*)(image->buffer + (x * 2) + (y *image->pitch)) = pixel;
+    rect->first = (uint8_t *)(image->buffer)
+                + (y * image->pitch)
+                + (startBit / 8);
+    rect->pitch = image->pitch;
+    rect->x = x;
+    rect->y = y;
+    rect->width = width;
+    rect->height = height;
+    rect->rowBytes = ((endBit + 7) / 8) - (startBit / 8);
+
+    return true;
 }
 
-//-----------------------------------------------------------------------
+//-------------------------------------------------------------------------
 
-void
-setPixelDitheredRGBA16(
+bool
+getSpanImage(
     IMAGE_T *image,
     int32_t x,
     int32_t y,
-    const RGBA8_T *rgba)
+    int32_t length,
+    IMAGE_RECT_T *span)
 {
-    static int16_t dither16[64] =
-    {
-         1,  12,   4,  15,   1,  13,   4,  15,
-         8,   4,  11,   7,   9,   5,  12,   8,
-         3,  14,   2,  13,   3,  15,   2,  14,
-        10,   6,   9,   5,  11,   7,  10,   6,
-         1,  12,   4,  15,   1,  12,   4,  15,
-         9,   5,  12,   8,   8,   5,  11,   8,
-         3,  14,   2,  13,   3,  14,   2,  13,
-        11,   7,  10,   6,  10,   7,   9,   6,
-    };
+    return getRectImage(image, x, y, length, 1, span);
+}
 
-    int32_t index = (x & 7) | ((y & 7) << 3);
+//-------------------------------------------------------------------------
 
-    int16_t r = rgba->red + dither16[index];
+bool
+clipImageRects(
+    const IMAGE_T *dst,
+    int32_t *dx,
+    int32_t *dy,
+    const IMAGE_T *src,
+    int32_t *sx,
+    int32_t *sy,
+    int32_t *width,
+    int32_t *height)
+{
+    // clip against the source, then the destination
 
-    if (r > 255)
+    if (*sx < 0)
     {
-        r = 255;
+        *dx -= *sx;
+        *width += *sx;
+        *sx = 0;
     }
 
-    int16_t g = rgba->green + dither16[index];
+    if (*sy < 0)
+    {
+        *dy -= *sy;
+        *height += *sy;
+        *sy = 0;
+    }
 
-    if (g > 255)
+    if (*dx < 0)
     {
-        g = 255;
+        *sx -= *dx;
+        *width += *dx;
+        *dx = 0;
     }
 
-    int16_t b = rgba->blue + dither16[index];
+    if (*dy < 0)
+    {
+        *sy -= *dy;
+        *height += *dy;
+        *dy = 0;
+    }
 
-    if (b > 255)
+    if (*sx + *width > src->width)
     {
-        b = 255;
+        *width = src->width - *sx;
     }
 
-    int16_t a = rgba->alpha + dither16[index];
+    if (*sy + *height > src->height)
+    {
+        *height = src->height - *sy;
+    }
 
-    if (b > 255)
+    if (*dx + *width > dst->width)
     {
-        b = 255;
+        *width = dst->width - *dx;
     }
 
-    RGBA8_T dithered = { r, g, b, a };
+    if (*dy + *height > dst->height)
+    {
+        *height = dst->height - *dy;
+    }
 
-    setPixelRGBA16(image, x, y, &dithered);
+    return (*width > 0) && (*height > 0);
 }
 
-//-----------------------------------------------------------------------
+//-------------------------------------------------------------------------
 
-void
-setPixelRGBA32(
-    IMAGE_T *image,
-    int32_t x,
-    int32_t y,
-    const RGBA8_T *rgba)
+bool
+copyImageRect(
+    IMAGE_T *dst,
+    int32_t dx,
+    int32_t dy,
+    IMAGE_T *src,
+    int32_t sx,
+    int32_t sy,
+    int32_t width,
+    int32_t height)
 {
-    uint8_t *line = (uint8_t *)(image->buffer) + (y*image->pitch) + (4*x);
-
-    line[0] = rgba->red;
-    line[1] = rgba->green;
-    line[2] = rgba->blue;
-    line[3] = rgba->alpha;
+    if (clipImageRects(dst, &dx, &dy, src, &sx, &sy, &width, &height) == false)
+    {
+        return false;
+    }
+
+    //---------------------------------------------------------------------
+
+    if ((src->type == dst->type) &&
+        ((src->bitsPerPixel >= 8) || (((sx | dx | width) & 1) == 0)))
+    {
+        int32_t bytes = (width * src->bitsPerPixel) / 8;
+        int32_t srcOffset = (sx * src->bitsPerPixel) / 8;
+        int32_t dstOffset = (dx * dst->bitsPerPixel) / 8;
+
+        int32_t j;
+        for (j = 0 ; j < height ; j++)
+        {
+            memmove(dst->buffer + dstOffset + ((dy + j) * dst->pitch),
+                    src->buffer + srcOffset + ((sy + j) * src->pitch),
+                    bytes);
+        }
+    }
+    else if ((src->getPixelDirect != NULL) && (dst->convertRow != NULL))
+    {
+        // Convert through a row of RGBA8, a chunk at a time. Rows of
+        // RGBA32 are RGBA8 already, so they are converted in place.
+
+        RGBA8_T rgba[IMAGE_COPY_CHUNK];
+
+        int32_t j;
+        for (j = 0 ; j < height ; j++)
+        {
+            uint8_t *line = (uint8_t *)(dst->buffer)
+                          + ((dy + j) * dst->pitch)
+                          + ((dx * dst->bitsPerPixel) / 8);
+
+            int32_t i;
+            for (i = 0 ; i < width ; i += IMAGE_COPY_CHUNK)
+            {
+                int32_t length = width - i;
+
+                if (length > IMAGE_COPY_CHUNK)
+                {
+                    length = IMAGE_COPY_CHUNK;
+                }
+
+                const RGBA8_T *from = rgba;
+
+                if (src->type == VC_IMAGE_RGBA32)
+                {
+                    from = (const RGBA8_T *)((uint8_t *)(src->buffer)
+                                             + ((sy + j) * src->pitch))
+                         + sx + i;
+                }
+                else
+                {
+                    int32_t k;
+                    for (k = 0 ; k < length ; k++)
+                    {
+                        src->getPixelDirect(src,
+                                            sx + i + k,
+                                            sy + j,
+                                            &(rgba[k]));
+                    }
+                }
+
+                dst->convertRow(line + ((i * dst->bitsPerPixel) / 8),
+                                from,
+                                dx + i,
+                                dy + j,
+                                length);
+            }
+        }
+    }
+    else if ((src->getPixelIndexed != NULL) && (dst->setPixelIndexed != NULL))
+    {
+        int8_t index;
+
+        int32_t j;
+        for (j = 0 ; j < height ; j++)
+        {
+            int32_t i;
+            for (i = 0 ; i < width ; i++)
+            {
+                src->getPixelIndexed(src, sx + i, sy + j, &index);
+                dst->setPixelIndexed(dst, dx + i, dy + j, index);
+            }
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    markDirtyImage(dst, dx, dy, width, height);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void
+markDirtyImage(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height)
+{
+    IMAGE_DIRTY_T *dirty = image->dirty;
+
+    if ((dirty == NULL) || (clipRect(image, &x, &y, &width, &height) == false))
+    {
+        return;
+    }
+
+    //---------------------------------------------------------------------
+    // Drawing tends to move down the image, so the last rectangle is the
+    // most likely to be extended. Try it first.
+
+    VC_RECT_T *rect = NULL;
+
+    int32_t i;
+    for (i = dirty->numberOfRects - 1 ; i >= 0 ; i--)
+    {
+        VC_RECT_T *r = &(dirty->rects[i]);
+
+        if ((y <= r->y + r->height) && (r->y <= y + height))
+        {
+            rect = r;
+            break;
+        }
+    }
+
+    if ((rect == NULL) && (dirty->numberOfRects < IMAGE_DIRTY_MAX_RECTS))
+    {
+        rect = &(dirty->rects[dirty->numberOfRects++]);
+        vc_dispmanx_rect_set(rect, x, y, width, height);
+
+        return;
+    }
+
+    if (rect == NULL)
+    {
+        rect = &(dirty->rects[dirty->numberOfRects - 1]);
+    }
+
+    int32_t x1 = (x < rect->x) ? x : rect->x;
+    int32_t y1 = (y < rect->y) ? y : rect->y;
+    int32_t x2 = rect->x + rect->width;
+    int32_t y2 = rect->y + rect->height;
+
+    if (x + width > x2)
+    {
+        x2 = x + width;
+    }
+
+    if (y + height > y2)
+    {
+        y2 = y + height;
+    }
+
+    vc_dispmanx_rect_set(rect, x1, y1, x2 - x1, y2 - y1);
+}
+
+//-------------------------------------------------------------------------
+
+void
+clearDirtyImage(
+    IMAGE_T *image)
+{
+    if (image->dirty != NULL)
+    {
+        image->dirty->numberOfRects = 0;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyImage(
+    IMAGE_T *image)
+{
+    if (image->buffer)
+    {
+        if (image->freeBuffer != NULL)
+        {
+            image->freeBuffer(image);
+        }
+        else
+        {
+            free(image->buffer);
+        }
+    }
+
+    image->type = VC_IMAGE_MIN;
+    image->width = 0;
+    image->height = 0;
+    image->pitch = 0;
+    image->alignedHeight = 0;
+    image->bitsPerPixel = 0;
+    image->size = 0;
+    image->buffer = NULL;
+    image->setPixelDirect = NULL;
+    image->getPixelDirect = NULL;
+    image->setPixelIndexed = NULL;
+    image->getPixelIndexed = NULL;
+    image->setSpanDirect = NULL;
+    image->setSpanIndexed = NULL;
+    image->dirty = NULL;
+    image->freeBuffer = NULL;
+}
+
+//-----------------------------------------------------------------------
+
+void
+setPixel4BPP(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int8_t index)
+{
+    index &= 0x0F;
+
+    uint8_t *value = (uint8_t*)(image->buffer + (x/2) + (y *image->pitch));
+
+    if (x % 2)
+    {
+        *value = (*value & 0xF0) | (index);
+    }
+    else
+    {
+        *value = (*value & 0x0F) | (index << 4);
+    }
+}
+
+//-----------------------------------------------------------------------
+
+void
+setPixel8BPP(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int8_t index)
+{
+    *(uint8_t*)(image->buffer + x + (y * image->pitch)) = index;
+}
+
+//-----------------------------------------------------------------------
+
+void
+setPixelRGB565(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    const RGBA8_T *rgba)
+{
+    imagePixelPut(IMAGE_PIXEL_RGB565,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
+}
+
+//-----------------------------------------------------------------------
+
+void
+setPixelDitheredRGB565(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    const RGBA8_T *rgba)
+{
+    imagePixelPut(IMAGE_PIXEL_DITHERED_RGB565,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
+}
+
+//-------------------------------------------------------------------------
+
+void
+setPixelRGB888(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    const RGBA8_T *rgba)
+{
+    imagePixelPut(IMAGE_PIXEL_RGB888,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
+}
+
+//-----------------------------------------------------------------------
+
+void
+setPixelRGBA16(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    const RGBA8_T *rgba)
+{
+    imagePixelPut(IMAGE_PIXEL_RGBA16,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
+}
+
+//-----------------------------------------------------------------------
+
+void
+setPixelDitheredRGBA16(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    const RGBA8_T *rgba)
+{
+    imagePixelPut(IMAGE_PIXEL_DITHERED_RGBA16,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
+}
+
+//-----------------------------------------------------------------------
+
+void
+setPixelRGBA32(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    const RGBA8_T *rgba)
+{
+    imagePixelPut(IMAGE_PIXEL_RGBA32,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
 }
 
 //-----------------------------------------------------------------------
@@ -583,16 +1150,12 @@ getPixelRGB565(
     int32_t y,
     RGBA8_T *rgba)
 {
-    uint16_t pixel = *(uint16_t*)(image->buffer + (x * 2) + (y * image->pitch));
-
-    uint8_t r5 = (pixel >> 11) & 0x1F;
-    uint8_t g6 = (pixel >> 5) & 0x3F;
-    uint8_t b5 = pixel & 0x1F;
-
-    rgba->red = (r5 << 3) | (r5 >> 2);
-    rgba->green = (g6 << 2) | (g6 >> 4);
-    rgba->blue = (b5 << 3) | (b5 >> 2);
-    rgba->alpha = 255;
+    imagePixelGet(IMAGE_PIXEL_RGB565,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
 }
 
 //-------------------------------------------------------------------------
@@ -604,11 +1167,12 @@ getPixelRGB888(
     int32_t y,
     RGBA8_T *rgba)
 {
-    uint8_t *line = (uint8_t *)(image->buffer) + (y*image->pitch) + (3*x);
-    rgba->red = line[0];
-    rgba->green = line[1];
-    rgba->blue = line[2];
-    rgba->alpha = 255;
+    imagePixelGet(IMAGE_PIXEL_RGB888,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
 }
 
 //-----------------------------------------------------------------------
@@ -620,16 +1184,12 @@ getPixelRGBA16(
     int32_t y,
     RGBA8_T *rgba)
 {
-    uint16_t pixel = *(uint16_t*)(image->buffer+(x*2)+(y*image->pitch));
-    uint8_t r4 = (pixel >> 12) & 0xF;
-    uint8_t g4 = (pixel >> 8) & 0xF;
-    uint8_t b4 = (pixel >> 4) & 0xF;
-    uint8_t a4 = (pixel & 0xF);
-
-    rgba->red = (r4 << 4) | r4;
-    rgba->green = (g4 << 4) | g4;
-    rgba->blue = (b4 << 4) | b4;
-    rgba->alpha = (a4 << 4) | a4;
+    imagePixelGet(IMAGE_PIXEL_RGBA16,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
 }
 
 //-----------------------------------------------------------------------
@@ -641,12 +1201,198 @@ getPixelRGBA32(
     int32_t y,
     RGBA8_T *rgba)
 {
-    uint8_t *line = (uint8_t *)(image->buffer) + (y*image->pitch) + (4*x);
+    imagePixelGet(IMAGE_PIXEL_RGBA32,
+                  image,
+                  imagePixelRow(image, y),
+                  x,
+                  y,
+                  rgba);
+}
+
+//-----------------------------------------------------------------------
+
+void
+setSpan4BPP(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    int8_t index)
+{
+    uint8_t nibble = index & 0x0F;
+    uint8_t *line = (uint8_t*)(image->buffer) + (y * image->pitch);
+    int32_t end = x + length;
+
+    if ((x % 2) && (x < end))
+    {
+        line[x/2] = (line[x/2] & 0xF0) | nibble;
+        ++x;
+    }
+
+    if ((end % 2) && (x < end))
+    {
+        --end;
+        line[end/2] = (line[end/2] & 0x0F) | (nibble << 4);
+    }
+
+    if (x < end)
+    {
+        memset(line + (x/2), (nibble << 4) | nibble, (end - x) / 2);
+    }
+}
+
+//-----------------------------------------------------------------------
+
+void
+setSpan8BPP(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    int8_t index)
+{
+    memset(image->buffer + x + (y * image->pitch), (uint8_t)index, length);
+}
+
+//-----------------------------------------------------------------------
 
-    rgba->red = line[0];
-    rgba->green = line[1];
-    rgba->blue = line[2];
-    rgba->alpha = line[3];
+void
+setSpanRGB565(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba)
+{
+    uint16_t *line = (uint16_t*)(image->buffer + (y * image->pitch)) + x;
+    fillSpan16(line, length, imagePixelPackRGB565(rgba));
+}
+
+//-----------------------------------------------------------------------
+
+void
+setSpanDitheredRGB565(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba)
+{
+    uint16_t pattern[8];
+
+    int32_t i;
+    for (i = 0 ; i < 8 ; i++)
+    {
+        pattern[i] = imagePixelPackDitheredRGB565(rgba, i, y);
+    }
+
+    uint16_t *line = (uint16_t*)(image->buffer + (y * image->pitch)) + x;
+    fillSpanPattern16(line, x, length, pattern);
+}
+
+//-----------------------------------------------------------------------
+
+void
+setSpanRGB888(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba)
+{
+    uint8_t *line = (uint8_t *)(image->buffer) + (y*image->pitch) + (3*x);
+
+    if ((rgba->red == rgba->green) && (rgba->red == rgba->blue))
+    {
+        memset(line, rgba->red, 3 * length);
+        return;
+    }
+
+    //---------------------------------------------------------------------
+    // Write one pixel, then keep doubling the filled part of the span.
+
+    line[0] = rgba->red;
+    line[1] = rgba->green;
+    line[2] = rgba->blue;
+
+    int32_t filled = 3;
+    int32_t total = 3 * length;
+
+    while (filled < total)
+    {
+        int32_t chunk = (filled < (total - filled)) ? filled : (total - filled);
+        memcpy(line + filled, line, chunk);
+        filled += chunk;
+    }
+}
+
+//-----------------------------------------------------------------------
+
+void
+setSpanRGBA16(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba)
+{
+    uint16_t *line = (uint16_t*)(image->buffer + (y * image->pitch)) + x;
+    fillSpan16(line, length, imagePixelPackRGBA16(rgba));
+}
+
+//-----------------------------------------------------------------------
+
+void
+setSpanDitheredRGBA16(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba)
+{
+    uint16_t pattern[8];
+
+    int32_t i;
+    for (i = 0 ; i < 8 ; i++)
+    {
+        pattern[i] = imagePixelPackDitheredRGBA16(rgba, i, y);
+    }
+
+    uint16_t *line = (uint16_t*)(image->buffer + (y * image->pitch)) + x;
+    fillSpanPattern16(line, x, length, pattern);
+}
+
+//-----------------------------------------------------------------------
+
+void
+setSpanRGBA32(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgba)
+{
+    uint32_t *line = (uint32_t*)(image->buffer + (y * image->pitch)) + x;
+
+    if ((rgba->red == rgba->green) &&
+        (rgba->red == rgba->blue) &&
+        (rgba->red == rgba->alpha))
+    {
+        memset(line, rgba->red, 4 * length);
+    }
+    else
+    {
+        // RGBA8_T has the same byte order as an RGBA32 pixel
+
+        uint32_t pixel;
+        memcpy(&pixel, rgba, sizeof(pixel));
+
+        int32_t i;
+        for (i = 0 ; i < length ; i++)
+        {
+            line[i] = pixel;
+        }
+    }
 }
 
 //-----------------------------------------------------------------------
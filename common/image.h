@@ -36,6 +36,8 @@
 
 #include "bcm_host.h"
     
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
 typedef struct
@@ -48,6 +50,26 @@ typedef struct
 
 //-------------------------------------------------------------------------
 
+// An optional list of the areas of an image that have been drawn on
+// since the list was last cleared. Rectangles whose rows overlap or touch
+// are merged, as a resource upload is always whole rows anyway.
+
+#define IMAGE_DIRTY_MAX_RECTS 16
+
+typedef struct
+{
+    int32_t numberOfRects;
+    VC_RECT_T rects[IMAGE_DIRTY_MAX_RECTS];
+} IMAGE_DIRTY_T;
+
+//-------------------------------------------------------------------------
+
+// convertRow packs a row of RGBA8 pixels in the format of the image, see
+// imageConvert.h, dithered if dither is true. destroyImage() calls
+// freeBuffer, if it is set, to release the buffer: initImage() sets it to
+// hand the buffer back to the resource pool, and a mapped cache file sets
+// it to unmap. A buffer with no freeBuffer is released with free().
+
 typedef struct IMAGE_T_ IMAGE_T;
 
 struct IMAGE_T_
@@ -59,11 +81,17 @@ struct IMAGE_T_
     int32_t alignedHeight;
     uint16_t bitsPerPixel;
     uint32_t size;
+    bool dither;
     void *buffer;
     void (*setPixelDirect)(IMAGE_T*, int32_t, int32_t, const RGBA8_T*);
     void (*getPixelDirect)(IMAGE_T*, int32_t, int32_t, RGBA8_T*);
     void (*setPixelIndexed)(IMAGE_T*, int32_t, int32_t, int8_t);
     void (*getPixelIndexed)(IMAGE_T*, int32_t, int32_t, int8_t*);
+    void (*setSpanDirect)(IMAGE_T*, int32_t, int32_t, int32_t, const RGBA8_T*);
+    void (*setSpanIndexed)(IMAGE_T*, int32_t, int32_t, int32_t, int8_t);
+    void (*convertRow)(void*, const RGBA8_T*, int32_t, int32_t, int32_t);
+    IMAGE_DIRTY_T *dirty;
+    void (*freeBuffer)(IMAGE_T*);
 };
 
 //-------------------------------------------------------------------------
@@ -96,6 +124,37 @@ typedef enum
 
 //-------------------------------------------------------------------------
 
+// A rectangle of an image, clipped to the image once so that its pixels
+// can then be walked without any checks. Row j of the rectangle starts at
+// rowImageRect(rect, j), which points at pixel x of row y + j: cast it to
+// uint16_t * or uint32_t * for 16 and 32 bit images. For a 4BPP image it
+// points at the byte holding pixel x, which is the high nibble if x is
+// even. rowBytes is the number of bytes each row of the rectangle touches.
+
+typedef struct
+{
+    uint8_t *first;
+    int32_t pitch;
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    int32_t rowBytes;
+} IMAGE_RECT_T;
+
+//-------------------------------------------------------------------------
+
+// As initImage(), but the buffer is left NULL. For an image that is never
+// held in memory as a whole, such as one streamed into a resource.
+
+bool
+initImageHeader(
+    IMAGE_T *image,
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height,
+    bool dither);
+
 bool
 initImage(
     IMAGE_T *image,
@@ -142,6 +201,154 @@ getPixelRGB(
     int32_t y,
     RGBA8_T *rgb);
 
+// Set a horizontal run of length pixels starting at (x, y). The span is
+// clipped to the image and the colour is packed once for the whole run.
+// Returns false if nothing was written.
+
+bool
+setSpanIndexed(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    int8_t index);
+
+bool
+setSpanRGB(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *rgb);
+
+// Set length pixels starting at (x, y) from row, clipped to the image.
+// The row is converted in one go with a converter for the image type.
+// Returns false if nothing was written or the image is indexed.
+
+bool
+setRowRGB(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    const RGBA8_T *row);
+
+// Fill the rectangle with its top left corner at (x, y), clipped to the
+// image, one span per row.
+
+bool
+setRectIndexed(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height,
+    int8_t index);
+
+bool
+setRectRGB(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height,
+    const RGBA8_T *rgb);
+
+// Clip a width x height rectangle at (sx, sy) in src, to be put at
+// (dx, dy) in dst, against both images. Returns false if nothing is left.
+
+bool
+clipImageRects(
+    const IMAGE_T *dst,
+    int32_t *dx,
+    int32_t *dy,
+    const IMAGE_T *src,
+    int32_t *sx,
+    int32_t *sy,
+    int32_t *width,
+    int32_t *height);
+
+// Clip the width x height rectangle at (x, y) to the image, and fill in
+// rect for walking its rows. As with the drawing functions, nothing is
+// marked dirty. Returns false if nothing is left.
+
+bool
+getRectImage(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height,
+    IMAGE_RECT_T *rect);
+
+// As getRectImage(), for length pixels of row y starting at x.
+
+bool
+getSpanImage(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t length,
+    IMAGE_RECT_T *span);
+
+static inline void *
+rowImageRect(
+    const IMAGE_RECT_T *rect,
+    int32_t j)
+{
+    return rect->first + (j * rect->pitch);
+}
+
+// Row y of the image, or NULL if y is outside it.
+
+static inline void *
+rowImage(
+    const IMAGE_T *image,
+    int32_t y)
+{
+    if ((y < 0) || (y >= image->height))
+    {
+        return NULL;
+    }
+
+    return (uint8_t *)(image->buffer) + (y * image->pitch);
+}
+
+// Copy a width x height rectangle from (sx, sy) in src to (dx, dy) in dst,
+// clipped to both images. Images of the same type are copied a row at a
+// time. A direct colour source is read into rows of RGBA8, RGBA32 rows in
+// place, and packed into dst by its table driven row converter. Indexed
+// images of different depths are copied a pixel at a time. Returns false
+// if nothing is copied.
+
+bool
+copyImageRect(
+    IMAGE_T *dst,
+    int32_t dx,
+    int32_t dy,
+    IMAGE_T *src,
+    int32_t sx,
+    int32_t sy,
+    int32_t width,
+    int32_t height);
+
+// Record that the rectangle with its top left corner at (x, y) has
+// changed. This does nothing unless the image has a dirty list. The
+// drawing functions above call it themselves; code that writes to the
+// buffer directly should call it too.
+
+void
+markDirtyImage(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height);
+
+void
+clearDirtyImage(
+    IMAGE_T *image);
+
 void
 destroyImage(
     IMAGE_T *image);
@@ -163,4 +370,6 @@ printImageTypes(
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
@@ -0,0 +1,368 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <string.h>
+
+#include "imageBlend.h"
+#include "imageBlendKernel.h"
+
+//-------------------------------------------------------------------------
+
+static inline void
+blendPixel(
+    RGBA8_T *dst,
+    const RGBA8_T *src,
+    IMAGE_BLEND_MODE_T mode,
+    uint8_t opacity)
+{
+    uint32_t sa = div255(src->alpha * opacity);
+
+    if (mode == IMAGE_BLEND_SRC_OVER)
+    {
+        uint32_t na = 255 - sa;
+
+        dst->red = div255((src->red * sa) + (dst->red * na));
+        dst->green = div255((src->green * sa) + (dst->green * na));
+        dst->blue = div255((src->blue * sa) + (dst->blue * na));
+        dst->alpha = div255((255 * sa) + (dst->alpha * na));
+    }
+    else
+    {
+        uint32_t red = dst->red + div255(src->red * sa);
+        uint32_t green = dst->green + div255(src->green * sa);
+        uint32_t blue = dst->blue + div255(src->blue * sa);
+        uint32_t alpha = dst->alpha + sa;
+
+        dst->red = (red > 255) ? 255 : red;
+        dst->green = (green > 255) ? 255 : green;
+        dst->blue = (blue > 255) ? 255 : blue;
+        dst->alpha = (alpha > 255) ? 255 : alpha;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Two pixels at a time. The alpha of each source pixel is copied across
+// its four lanes, and the source alpha lanes are set to 255 so that the
+// same sum gives the destination alpha as well as the colours.
+
+static void
+blendRowRGBA32(
+    uint8_t *dst,
+    const uint8_t *src,
+    int32_t width,
+    IMAGE_BLEND_MODE_T mode,
+    uint8_t opacity)
+{
+    static const IMAGE_BLEND_UINT16X8_T alphaLanes =
+        { 3, 3, 3, 3, 7, 7, 7, 7 };
+    static const IMAGE_BLEND_UINT16X8_T alphaMask =
+        { 0, 0, 0, 255, 0, 0, 0, 255 };
+
+    int32_t x = 0;
+
+    for ( ; x + 2 <= width ; x += 2)
+    {
+        const uint8_t *s = src + (4 * x);
+        uint8_t *d = dst + (4 * x);
+
+        if ((s[3] | s[7]) == 0)
+        {
+            continue;
+        }
+
+        if ((mode == IMAGE_BLEND_SRC_OVER) &&
+            (opacity == 255) &&
+            ((s[3] & s[7]) == 255))
+        {
+            memcpy(d, s, 8);
+            continue;
+        }
+
+        IMAGE_BLEND_UINT16X8_T sv =
+            { s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7] };
+        IMAGE_BLEND_UINT16X8_T dv =
+            { d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7] };
+
+        IMAGE_BLEND_UINT16X8_T av = __builtin_shuffle(sv, alphaLanes);
+
+        if (opacity != 255)
+        {
+            av = div255x8(av * opacity);
+        }
+
+        sv |= alphaMask;
+
+        IMAGE_BLEND_UINT16X8_T out;
+
+        if (mode == IMAGE_BLEND_SRC_OVER)
+        {
+            out = div255x8((sv * av) + (dv * (255 - av)));
+        }
+        else
+        {
+            out = saturate255x8(dv + div255x8(sv * av));
+        }
+
+        int32_t i;
+        for (i = 0 ; i < 8 ; i++)
+        {
+            d[i] = out[i];
+        }
+    }
+
+    for ( ; x < width ; x++)
+    {
+        blendPixel((RGBA8_T *)(dst + (4 * x)),
+                   (const RGBA8_T *)(src + (4 * x)),
+                   mode,
+                   opacity);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static inline void
+unpackRGBA16(
+    uint16_t pixel,
+    RGBA8_T *rgba)
+{
+    rgba->red = ((pixel >> 12) & 0xF) * 0x11;
+    rgba->green = ((pixel >> 8) & 0xF) * 0x11;
+    rgba->blue = ((pixel >> 4) & 0xF) * 0x11;
+    rgba->alpha = (pixel & 0xF) * 0x11;
+}
+
+static inline uint16_t
+packRGBA16(
+    const RGBA8_T *rgba)
+{
+    return ((rgba->red >> 4) << 12) | ((rgba->green >> 4) << 8) |
+           ((rgba->blue >> 4) << 4) | (rgba->alpha >> 4);
+}
+
+//-------------------------------------------------------------------------
+
+// Eight pixels at a time, one channel of each in a lane.
+
+static void
+blendRowRGBA16(
+    uint16_t *dst,
+    const uint16_t *src,
+    int32_t width,
+    IMAGE_BLEND_MODE_T mode,
+    uint8_t opacity)
+{
+    int32_t x = 0;
+
+    for ( ; x + 8 <= width ; x += 8)
+    {
+        IMAGE_BLEND_UINT16X8_T sv;
+        IMAGE_BLEND_UINT16X8_T dv;
+
+        memcpy(&sv, src + x, sizeof(sv));
+
+        IMAGE_BLEND_UINT16X8_T sa = sv & 0xF;
+
+        uint64_t covered[2];
+        memcpy(covered, &sa, sizeof(covered));
+
+        if ((covered[0] | covered[1]) == 0)
+        {
+            continue;
+        }
+
+        memcpy(&dv, dst + x, sizeof(dv));
+
+        sa *= 0x11;
+
+        if (opacity != 255)
+        {
+            sa = div255x8(sa * opacity);
+        }
+
+        IMAGE_BLEND_UINT16X8_T sr = ((sv >> 12) & 0xF) * 0x11;
+        IMAGE_BLEND_UINT16X8_T sg = ((sv >> 8) & 0xF) * 0x11;
+        IMAGE_BLEND_UINT16X8_T sb = ((sv >> 4) & 0xF) * 0x11;
+
+        IMAGE_BLEND_UINT16X8_T dr = ((dv >> 12) & 0xF) * 0x11;
+        IMAGE_BLEND_UINT16X8_T dg = ((dv >> 8) & 0xF) * 0x11;
+        IMAGE_BLEND_UINT16X8_T db = ((dv >> 4) & 0xF) * 0x11;
+        IMAGE_BLEND_UINT16X8_T da = (dv & 0xF) * 0x11;
+
+        if (mode == IMAGE_BLEND_SRC_OVER)
+        {
+            IMAGE_BLEND_UINT16X8_T na = 255 - sa;
+
+            dr = div255x8((sr * sa) + (dr * na));
+            dg = div255x8((sg * sa) + (dg * na));
+            db = div255x8((sb * sa) + (db * na));
+            da = div255x8((255 * sa) + (da * na));
+        }
+        else
+        {
+            dr = saturate255x8(dr + div255x8(sr * sa));
+            dg = saturate255x8(dg + div255x8(sg * sa));
+            db = saturate255x8(db + div255x8(sb * sa));
+            da = saturate255x8(da + sa);
+        }
+
+        dv = ((dr >> 4) << 12)
+           | ((dg >> 4) << 8)
+           | ((db >> 4) << 4)
+           | (da >> 4);
+
+        memcpy(dst + x, &dv, sizeof(dv));
+    }
+
+    for ( ; x < width ; x++)
+    {
+        RGBA8_T s;
+        RGBA8_T d;
+
+        unpackRGBA16(src[x], &s);
+        unpackRGBA16(dst[x], &d);
+        blendPixel(&d, &s, mode, opacity);
+        dst[x] = packRGBA16(&d);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+bool
+blendImageRect(
+    IMAGE_T *dst,
+    int32_t dx,
+    int32_t dy,
+    IMAGE_T *src,
+    int32_t sx,
+    int32_t sy,
+    int32_t width,
+    int32_t height,
+    IMAGE_BLEND_MODE_T mode,
+    uint8_t opacity)
+{
+    if ((src->getPixelDirect == NULL) ||
+        (dst->getPixelDirect == NULL) ||
+        (clipImageRects(dst, &dx, &dy, src, &sx, &sy, &width, &height)
+         == false))
+    {
+        return false;
+    }
+
+    //---------------------------------------------------------------------
+
+    int32_t j;
+    for (j = 0 ; j < height ; j++)
+    {
+        uint8_t *dstLine = (uint8_t *)(dst->buffer) + ((dy + j) * dst->pitch);
+        uint8_t *srcLine = (uint8_t *)(src->buffer) + ((sy + j) * src->pitch);
+
+        if ((src->type == VC_IMAGE_RGBA32) && (dst->type == VC_IMAGE_RGBA32))
+        {
+            blendRowRGBA32(dstLine + (4 * dx),
+                           srcLine + (4 * sx),
+                           width,
+                           mode,
+                           opacity);
+        }
+        else if ((src->type == VC_IMAGE_RGBA16) &&
+                 (dst->type == VC_IMAGE_RGBA16))
+        {
+            blendRowRGBA16((uint16_t *)dstLine + dx,
+                           (uint16_t *)srcLine + sx,
+                           width,
+                           mode,
+                           opacity);
+        }
+        else
+        {
+            int32_t i;
+            for (i = 0 ; i < width ; i++)
+            {
+                RGBA8_T s;
+                RGBA8_T d;
+
+                src->getPixelDirect(src, sx + i, sy + j, &s);
+                dst->getPixelDirect(dst, dx + i, dy + j, &d);
+                blendPixel(&d, &s, mode, opacity);
+                dst->setPixelDirect(dst, dx + i, dy + j, &d);
+            }
+        }
+    }
+
+    markDirtyImage(dst, dx, dy, width, height);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+blendRectRGB(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height,
+    const RGBA8_T *rgba,
+    IMAGE_BLEND_MODE_T mode)
+{
+    if (image->getPixelDirect == NULL)
+    {
+        return false;
+    }
+
+    // The colour is packed into a one row image and blended from there,
+    // so the same kernels do the work.
+
+    IMAGE_T row;
+    VC_IMAGE_TYPE_T type = image->type;
+
+    if ((type != VC_IMAGE_RGBA32) && (type != VC_IMAGE_RGBA16))
+    {
+        type = VC_IMAGE_RGBA32;
+    }
+
+    if (initImage(&row, type, (width > 0) ? width : 1, 1, false) == false)
+    {
+        return false;
+    }
+
+    setSpanRGB(&row, 0, 0, row.width, rgba);
+
+    int32_t j;
+    for (j = 0 ; j < height ; j++)
+    {
+        blendImageRect(image, x, y + j, &row, 0, 0, width, 1, mode, 255);
+    }
+
+    destroyImage(&row);
+
+    return true;
+}
+
@@ -0,0 +1,90 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef IMAGE_BLEND_H
+#define IMAGE_BLEND_H
+
+//-------------------------------------------------------------------------
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Blend images on the CPU, so that several pieces can be flattened into
+// one image (and one layer) before it is uploaded. copyImageRect() is the
+// plain blit; these combine the source with what is already there.
+//
+// IMAGE_BLEND_SRC_OVER puts the source over the destination using the
+// alpha of the source. IMAGE_BLEND_ADD adds the source, weighted by its
+// alpha, and saturates. In both, the alpha of the source is scaled by
+// opacity first. RGBA32 and RGBA16 images of the same type are blended
+// several pixels at a time; any other direct colour pair a pixel at a
+// time.
+
+typedef enum
+{
+    IMAGE_BLEND_SRC_OVER,
+    IMAGE_BLEND_ADD
+} IMAGE_BLEND_MODE_T;
+
+//-------------------------------------------------------------------------
+
+bool
+blendImageRect(
+    IMAGE_T *dst,
+    int32_t dx,
+    int32_t dy,
+    IMAGE_T *src,
+    int32_t sx,
+    int32_t sy,
+    int32_t width,
+    int32_t height,
+    IMAGE_BLEND_MODE_T mode,
+    uint8_t opacity);
+
+// Blend a rectangle of a single colour into the image, clipped to it.
+
+bool
+blendRectRGB(
+    IMAGE_T *image,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height,
+    const RGBA8_T *rgba,
+    IMAGE_BLEND_MODE_T mode);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,80 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef IMAGE_BLEND_KERNEL_H
+#define IMAGE_BLEND_KERNEL_H
+
+//-------------------------------------------------------------------------
+
+#include <stdint.h>
+
+//-------------------------------------------------------------------------
+
+// The arithmetic shared by the blending kernels in imageBlend.c and the
+// glyph blending in fontAtlas.c, so that both round the same way.
+//
+// IMAGE_BLEND_UINT16X8_T holds two RGBA32 pixels, or eight channels of
+// RGBA16 pixels, in 16 bit lanes. Every product fed to div255x8() is a
+// channel times an alpha, or two of them that add up to at most
+// 255 * 255, so nothing overflows a lane.
+
+typedef uint16_t IMAGE_BLEND_UINT16X8_T __attribute__ ((vector_size (16)));
+
+//-------------------------------------------------------------------------
+
+// x / 255, rounded, for x up to 255 * 255.
+
+static inline uint32_t
+div255(
+    uint32_t x)
+{
+    x += 128;
+
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline IMAGE_BLEND_UINT16X8_T
+div255x8(
+    IMAGE_BLEND_UINT16X8_T x)
+{
+    x += 128;
+
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline IMAGE_BLEND_UINT16X8_T
+saturate255x8(
+    IMAGE_BLEND_UINT16X8_T x)
+{
+    IMAGE_BLEND_UINT16X8_T over = (IMAGE_BLEND_UINT16X8_T)(x > 255);
+
+    return (x & ~over) | (over & 255);
+}
+
+//-------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,495 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "imageCache.h"
+#include "loadpng.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
+
+//-------------------------------------------------------------------------
+
+// Room for the cache path, a '.' and the process id.
+
+#define IMAGE_CACHE_MAX_TEMPORARY_PATH (PATH_MAX + 16)
+
+typedef struct
+{
+    int fd;
+    bool ok;
+    char temporaryPath[IMAGE_CACHE_MAX_TEMPORARY_PATH];
+    char cachePath[PATH_MAX];
+    IMAGE_CACHE_HEADER_T header;
+} IMAGE_CACHE_WRITER_T;
+
+//-------------------------------------------------------------------------
+
+static uint32_t
+pixelOffset(void)
+{
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    if (pageSize <= 0)
+    {
+        pageSize = 4096;
+    }
+
+    return ((sizeof(IMAGE_CACHE_HEADER_T) + pageSize - 1) / pageSize)
+           * pageSize;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+makeDirectory(
+    const char *path)
+{
+    return (mkdir(path, 0755) == 0) || (errno == EEXIST);
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+cacheDirectory(
+    char *directory,
+    size_t size)
+{
+    const char *dir = getenv("RASPIDMX_CACHE_DIR");
+
+    if ((dir != NULL) && (*dir != '\0'))
+    {
+        snprintf(directory, size, "%s", dir);
+        return makeDirectory(directory);
+    }
+
+    const char *base = getenv("XDG_CACHE_HOME");
+
+    if ((base != NULL) && (*base != '\0'))
+    {
+        snprintf(directory, size, "%s", base);
+    }
+    else
+    {
+        const char *home = getenv("HOME");
+
+        if ((home == NULL) || (*home == '\0'))
+        {
+            return false;
+        }
+
+        snprintf(directory, size, "%s/.cache", home);
+    }
+
+    if (makeDirectory(directory) == false)
+    {
+        return false;
+    }
+
+    size_t length = strlen(directory);
+    snprintf(directory + length, size - length, "/raspidmx");
+
+    return makeDirectory(directory);
+}
+
+//-------------------------------------------------------------------------
+
+// Fill in the source fields of key for the png at path and work out the
+// name of its cache file.
+
+static bool
+cacheKey(
+    const char *path,
+    IMAGE_CACHE_HEADER_T *key,
+    char *cachePath,
+    size_t size)
+{
+    char realPath[PATH_MAX];
+    struct stat st;
+
+    if ((realpath(path, realPath) == NULL) ||
+        (stat(realPath, &st) != 0) ||
+        (strlen(realPath) >= IMAGE_CACHE_MAX_PATH))
+    {
+        return false;
+    }
+
+    char directory[PATH_MAX];
+
+    if (cacheDirectory(directory, sizeof(directory)) == false)
+    {
+        return false;
+    }
+
+    memset(key, 0, sizeof(*key));
+    memcpy(key->magic, IMAGE_CACHE_MAGIC, sizeof(IMAGE_CACHE_MAGIC));
+    key->version = IMAGE_CACHE_VERSION;
+    key->sourceSize = st.st_size;
+    key->sourceModifiedSeconds = st.st_mtim.tv_sec;
+    key->sourceModifiedNanoseconds = st.st_mtim.tv_nsec;
+    strcpy(key->path, realPath);
+
+    // 64 bit FNV-1a of the real path
+
+    uint64_t hash = UINT64_C(14695981039346656037);
+    const char *c;
+    for (c = realPath ; *c != '\0' ; c++)
+    {
+        hash = (hash ^ (uint8_t)(*c)) * UINT64_C(1099511628211);
+    }
+
+    int length = snprintf(cachePath,
+                          size,
+                          "%s/%016" PRIx64 ".raw",
+                          directory,
+                          hash);
+
+    return (length > 0) && ((size_t)length < size);
+}
+
+//-------------------------------------------------------------------------
+
+// Mapped images are charged to the cache's own account, as the pages
+// are the cache file's rather than the pool's.
+
+static void
+unmapImageBuffer(
+    IMAGE_T *image)
+{
+    munmap(image->buffer, image->size);
+
+    chargeCpuMemoryAccount(findMemoryAccount("imageCache"),
+                           -(int64_t)(image->size),
+                           -1);
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+openCached(
+    const IMAGE_CACHE_HEADER_T *key,
+    const char *cachePath,
+    IMAGE_T *image)
+{
+    int fd = open(cachePath, O_RDONLY);
+
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    IMAGE_CACHE_HEADER_T header;
+    struct stat st;
+
+    bool valid =
+        (pread(fd, &header, sizeof(header), 0) == sizeof(header)) &&
+        (fstat(fd, &st) == 0) &&
+        (memcmp(header.magic, key->magic, sizeof(header.magic)) == 0) &&
+        (header.version == key->version) &&
+        (header.sourceSize == key->sourceSize) &&
+        (header.sourceModifiedSeconds == key->sourceModifiedSeconds) &&
+        (header.sourceModifiedNanoseconds == key->sourceModifiedNanoseconds) &&
+        (strncmp(header.path, key->path, sizeof(header.path)) == 0) &&
+        (header.pixelOffset == pixelOffset()) &&
+        (st.st_size >= (off_t)header.pixelOffset + header.size) &&
+        initImageHeader(image,
+                        header.type,
+                        header.width,
+                        header.height,
+                        false);
+
+    // The layout must be exactly what initImage() would have made.
+
+    valid = valid &&
+            (image->pitch == header.pitch) &&
+            (image->alignedHeight == header.alignedHeight) &&
+            (image->size == header.size);
+
+    void *buffer = MAP_FAILED;
+
+    if (valid)
+    {
+        buffer = mmap(NULL,
+                      header.size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE,
+                      fd,
+                      header.pixelOffset);
+    }
+
+    close(fd);
+
+    if (buffer == MAP_FAILED)
+    {
+        return false;
+    }
+
+    image->buffer = buffer;
+    image->freeBuffer = unmapImageBuffer;
+
+    chargeCpuMemoryAccount(findMemoryAccount("imageCache"), image->size, 1);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// Cache files are written under a temporary name and renamed into place
+// once complete, so a reader never sees half a file.
+
+static void
+startCacheWriter(
+    IMAGE_CACHE_WRITER_T *writer,
+    const IMAGE_CACHE_HEADER_T *key,
+    const char *cachePath)
+{
+    writer->header = *key;
+    snprintf(writer->cachePath, sizeof(writer->cachePath), "%s", cachePath);
+    snprintf(writer->temporaryPath,
+             sizeof(writer->temporaryPath),
+             "%s.%d",
+             cachePath,
+             (int)getpid());
+
+    writer->fd = open(writer->temporaryPath,
+                      O_WRONLY | O_CREAT | O_TRUNC,
+                      0644);
+    writer->ok = (writer->fd != -1);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+writeRowsCacheWriter(
+    IMAGE_CACHE_WRITER_T *writer,
+    const IMAGE_T *image,
+    const void *rows,
+    int32_t y,
+    int32_t numberOfRows)
+{
+    if (writer->ok)
+    {
+        size_t length = numberOfRows * image->pitch;
+        off_t offset = pixelOffset() + (y * image->pitch);
+
+        writer->ok = (pwrite(writer->fd, rows, length, offset)
+                      == (ssize_t)length);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+finishCacheWriter(
+    IMAGE_CACHE_WRITER_T *writer,
+    const IMAGE_T *image,
+    bool loaded)
+{
+    if (writer->fd == -1)
+    {
+        return;
+    }
+
+    writer->ok = writer->ok && loaded;
+
+    if (writer->ok)
+    {
+        IMAGE_CACHE_HEADER_T *header = &(writer->header);
+
+        header->pixelOffset = pixelOffset();
+        header->type = image->type;
+        header->width = image->width;
+        header->height = image->height;
+        header->pitch = image->pitch;
+        header->alignedHeight = image->alignedHeight;
+        header->size = image->size;
+
+        writer->ok = (ftruncate(writer->fd,
+                                header->pixelOffset + header->size) == 0) &&
+                     (pwrite(writer->fd, header, sizeof(*header), 0)
+                      == sizeof(*header));
+    }
+
+    if ((close(writer->fd) == 0) && writer->ok)
+    {
+        rename(writer->temporaryPath, writer->cachePath);
+    }
+    else
+    {
+        unlink(writer->temporaryPath);
+    }
+
+    writer->fd = -1;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+loadPngCached(
+    IMAGE_T *image,
+    const char *path)
+{
+    IMAGE_CACHE_HEADER_T key;
+    char cachePath[PATH_MAX];
+
+    bool cacheable = cacheKey(path, &key, cachePath, sizeof(cachePath));
+
+    if (cacheable && openCached(&key, cachePath, image))
+    {
+        return true;
+    }
+
+    if (loadPng(image, path) == false)
+    {
+        return false;
+    }
+
+    if (cacheable)
+    {
+        IMAGE_CACHE_WRITER_T writer;
+        startCacheWriter(&writer, &key, cachePath);
+        writeRowsCacheWriter(&writer, image, image->buffer, 0, image->height);
+        finishCacheWriter(&writer, image, true);
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    IMAGE_LAYER_T *il;
+    int32_t layer;
+    bool created;
+    IMAGE_CACHE_WRITER_T writer;
+} IMAGE_CACHE_LOAD_T;
+
+static void
+stripToImageLayerAndCache(
+    IMAGE_T *image,
+    const uint8_t *strip,
+    int32_t y,
+    int32_t rows,
+    void *arg)
+{
+    IMAGE_CACHE_LOAD_T *load = arg;
+
+    if (load->created == false)
+    {
+        createEmptyResourceImageLayer(load->il, load->layer);
+        load->created = true;
+    }
+
+    writeRowsImageLayer(load->il, strip, y, rows);
+    writeRowsCacheWriter(&(load->writer), image, strip, y, rows);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+loadPngImageLayerCached(
+    IMAGE_LAYER_T *il,
+    const char *path,
+    int32_t layer,
+    int32_t stripHeight)
+{
+    IMAGE_CACHE_HEADER_T key;
+    char cachePath[PATH_MAX];
+
+    if (cacheKey(path, &key, cachePath, sizeof(cachePath)) == false)
+    {
+        return loadPngImageLayer(il, path, layer, stripHeight);
+    }
+
+    //---------------------------------------------------------------------
+    // On a hit the pixels are written to the resource straight from the
+    // mapping, which is then dropped, as loadPngImageLayer() would leave
+    // the image without a buffer too.
+
+    if (openCached(&key, cachePath, &(il->image)))
+    {
+        createResourceImageLayer(il, layer);
+
+        il->image.freeBuffer(&(il->image));
+        il->image.buffer = NULL;
+        il->image.freeBuffer = NULL;
+
+        return true;
+    }
+
+    //---------------------------------------------------------------------
+
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "imageCache: can't open file for reading\n");
+        return false;
+    }
+
+    IMAGE_CACHE_LOAD_T load;
+    load.il = il;
+    load.layer = layer;
+    load.created = false;
+    startCacheWriter(&(load.writer), &key, cachePath);
+
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(IMAGE_LAYER_ACCOUNT));
+
+    bool result = loadPngFileStrips(&(il->image),
+                                    file,
+                                    stripHeight,
+                                    stripToImageLayerAndCache,
+                                    &load);
+
+    fclose(file);
+
+    finishCacheWriter(&(load.writer), &(il->image), result);
+
+    if ((result == false) && load.created)
+    {
+        releaseResourcePool(il->resource);
+    }
+
+    leaveMemoryAccount(previous);
+
+    return result;
+}
@@ -0,0 +1,95 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "imageLayer.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Decoded pngs are kept as raw, pitch aligned pixel files that can be
+// mapped straight into an IMAGE_T. A cache file is keyed by the real path
+// of the png together with its size and modification time, so an edited
+// png is decoded again. The cache lives in $RASPIDMX_CACHE_DIR, or else
+// raspidmx under $XDG_CACHE_HOME or ~/.cache. If there is nowhere to put
+// it, the png is simply decoded.
+
+#define IMAGE_CACHE_MAGIC "RDMXIMG"
+#define IMAGE_CACHE_VERSION 1
+#define IMAGE_CACHE_MAX_PATH 3072
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t pixelOffset;
+    int32_t type;
+    int32_t width;
+    int32_t height;
+    int32_t pitch;
+    int32_t alignedHeight;
+    uint32_t size;
+    int64_t sourceSize;
+    int64_t sourceModifiedSeconds;
+    int64_t sourceModifiedNanoseconds;
+    char path[IMAGE_CACHE_MAX_PATH];
+} IMAGE_CACHE_HEADER_T;
+
+//-------------------------------------------------------------------------
+
+// As loadPng(), but a cached copy is mapped into image->buffer when there
+// is one. The mapping is private, so drawing into the image does not
+// change the cache. destroyImage() unmaps it.
+
+bool
+loadPngCached(
+    IMAGE_T *image,
+    const char *path);
+
+// As loadPngImageLayer(). On a miss the png is streamed into the resource
+// and the cache file at the same time.
+
+bool
+loadPngImageLayerCached(
+    IMAGE_LAYER_T *il,
+    const char *path,
+    int32_t layer,
+    int32_t stripHeight);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,550 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <string.h>
+
+#include "imageConvert.h"
+
+//-------------------------------------------------------------------------
+
+typedef uint32_t IMAGE_CONVERT_UINT4_T __attribute__ ((vector_size (16)));
+
+//-------------------------------------------------------------------------
+
+const uint8_t imageConvertDither8[64] =
+{
+    1, 6, 2, 7, 1, 6, 2, 7,
+    4, 2, 5, 4, 4, 3, 6, 4,
+    1, 7, 1, 6, 2, 7, 1, 7,
+    5, 3, 5, 3, 5, 4, 5, 3,
+    1, 6, 2, 7, 1, 6, 2, 7,
+    4, 3, 6, 4, 4, 2, 6, 4,
+    2, 7, 1, 7, 2, 7, 1, 6,
+    5, 3, 5, 3, 5, 3, 5, 3,
+};
+
+const uint8_t imageConvertDither4[64] =
+{
+    1, 3, 1, 3, 1, 3, 1, 3,
+    2, 1, 3, 2, 2, 1, 3, 2,
+    1, 3, 1, 3, 1, 3, 1, 3,
+    2, 2, 2, 1, 3, 2, 2, 2,
+    1, 3, 1, 3, 1, 3, 1, 3,
+    2, 1, 3, 2, 2, 1, 3, 2,
+    1, 3, 1, 3, 1, 3, 1, 3,
+    3, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t imageConvertDither16[64] =
+{
+     1,  12,   4,  15,   1,  13,   4,  15,
+     8,   4,  11,   7,   9,   5,  12,   8,
+     3,  14,   2,  13,   3,  15,   2,  14,
+    10,   6,   9,   5,  11,   7,  10,   6,
+     1,  12,   4,  15,   1,  12,   4,  15,
+     9,   5,  12,   8,   8,   5,  11,   8,
+     3,  14,   2,  13,   3,  14,   2,  13,
+    11,   7,  10,   6,  10,   7,   9,   6,
+};
+
+//-------------------------------------------------------------------------
+
+// The tables are built by the preprocessor, a row of 256 values at a time.
+
+#define TOP(d, v, bits) \
+    ((((v) + (d)) > 255) \
+     ? (255 >> (8 - (bits))) \
+     : (((v) + (d)) >> (8 - (bits))))
+
+#define TOP_4(d, v, bits) \
+    TOP(d, v, bits), TOP(d, v + 1, bits), \
+    TOP(d, v + 2, bits), TOP(d, v + 3, bits)
+
+#define TOP_16(d, v, bits) \
+    TOP_4(d, v, bits), TOP_4(d, v + 4, bits), \
+    TOP_4(d, v + 8, bits), TOP_4(d, v + 12, bits)
+
+#define TOP_64(d, v, bits) \
+    TOP_16(d, v, bits), TOP_16(d, v + 16, bits), \
+    TOP_16(d, v + 32, bits), TOP_16(d, v + 48, bits)
+
+#define TOP_256(d, bits) \
+    { TOP_64(d, 0, bits), TOP_64(d, 64, bits), \
+      TOP_64(d, 128, bits), TOP_64(d, 192, bits) }
+
+const uint8_t imageConvertTop5[8][256] =
+{
+    TOP_256(0, 5), TOP_256(1, 5), TOP_256(2, 5), TOP_256(3, 5),
+    TOP_256(4, 5), TOP_256(5, 5), TOP_256(6, 5), TOP_256(7, 5)
+};
+
+const uint8_t imageConvertTop6[4][256] =
+{
+    TOP_256(0, 6), TOP_256(1, 6), TOP_256(2, 6), TOP_256(3, 6)
+};
+
+const uint8_t imageConvertTop4[16][256] =
+{
+    TOP_256(0, 4), TOP_256(1, 4), TOP_256(2, 4), TOP_256(3, 4),
+    TOP_256(4, 4), TOP_256(5, 4), TOP_256(6, 4), TOP_256(7, 4),
+    TOP_256(8, 4), TOP_256(9, 4), TOP_256(10, 4), TOP_256(11, 4),
+    TOP_256(12, 4), TOP_256(13, 4), TOP_256(14, 4), TOP_256(15, 4)
+};
+
+#undef TOP_256
+#undef TOP_64
+#undef TOP_16
+#undef TOP_4
+#undef TOP
+
+//-------------------------------------------------------------------------
+
+#define EXPAND5(v) (((v) << 3) | ((v) >> 2))
+#define EXPAND6(v) (((v) << 2) | ((v) >> 4))
+
+#define EXPAND5_8(v) \
+    EXPAND5(v), EXPAND5(v + 1), EXPAND5(v + 2), EXPAND5(v + 3), \
+    EXPAND5(v + 4), EXPAND5(v + 5), EXPAND5(v + 6), EXPAND5(v + 7)
+
+#define EXPAND6_8(v) \
+    EXPAND6(v), EXPAND6(v + 1), EXPAND6(v + 2), EXPAND6(v + 3), \
+    EXPAND6(v + 4), EXPAND6(v + 5), EXPAND6(v + 6), EXPAND6(v + 7)
+
+const uint8_t imageConvertExpand5[32] =
+{
+    EXPAND5_8(0), EXPAND5_8(8), EXPAND5_8(16), EXPAND5_8(24)
+};
+
+const uint8_t imageConvertExpand6[64] =
+{
+    EXPAND6_8(0), EXPAND6_8(8), EXPAND6_8(16), EXPAND6_8(24),
+    EXPAND6_8(32), EXPAND6_8(40), EXPAND6_8(48), EXPAND6_8(56)
+};
+
+#undef EXPAND6_8
+#undef EXPAND5_8
+#undef EXPAND6
+#undef EXPAND5
+
+//-------------------------------------------------------------------------
+
+// Add a dither offset to each channel value and clamp the sum to 255, the
+// same as the imageConvertTop tables do before they take the top bits.
+
+static inline IMAGE_CONVERT_UINT4_T
+ditherConvert(
+    IMAGE_CONVERT_UINT4_T value,
+    IMAGE_CONVERT_UINT4_T offset)
+{
+    IMAGE_CONVERT_UINT4_T sum = value + offset;
+    IMAGE_CONVERT_UINT4_T over = (IMAGE_CONVERT_UINT4_T)(sum > 255);
+
+    return (sum & ~over) | (over & 255);
+}
+
+//-------------------------------------------------------------------------
+
+// One body for each packed type, with dither a constant in each caller,
+// so the compiler turns out a separate loop for each case. Four pixels
+// are packed at a time, and any left over one at a time from the tables.
+
+static inline void
+convertRow565(
+    uint16_t *dst,
+    const RGBA8_T *src,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    const bool dither)
+{
+    const uint8_t *d8 = &(imageConvertDither8[(y & 7) << 3]);
+    const uint8_t *d4 = &(imageConvertDither4[(y & 7) << 3]);
+
+    int32_t i = 0;
+
+    for ( ; i + 4 <= width ; i += 4)
+    {
+        const RGBA8_T *p = &(src[i]);
+
+        IMAGE_CONVERT_UINT4_T r = { p[0].red, p[1].red, p[2].red, p[3].red };
+        IMAGE_CONVERT_UINT4_T g = { p[0].green,
+                                    p[1].green,
+                                    p[2].green,
+                                    p[3].green };
+        IMAGE_CONVERT_UINT4_T b = { p[0].blue,
+                                    p[1].blue,
+                                    p[2].blue,
+                                    p[3].blue };
+
+        if (dither)
+        {
+            int32_t phase = x + i;
+
+            IMAGE_CONVERT_UINT4_T o8 = { d8[phase & 7],
+                                         d8[(phase + 1) & 7],
+                                         d8[(phase + 2) & 7],
+                                         d8[(phase + 3) & 7] };
+            IMAGE_CONVERT_UINT4_T o4 = { d4[phase & 7],
+                                         d4[(phase + 1) & 7],
+                                         d4[(phase + 2) & 7],
+                                         d4[(phase + 3) & 7] };
+
+            r = ditherConvert(r, o8);
+            g = ditherConvert(g, o4);
+            b = ditherConvert(b, o8);
+        }
+
+        IMAGE_CONVERT_UINT4_T packed = ((r >> 3) << 11)
+                                     | ((g >> 2) << 5)
+                                     | (b >> 3);
+
+        dst[i] = packed[0];
+        dst[i + 1] = packed[1];
+        dst[i + 2] = packed[2];
+        dst[i + 3] = packed[3];
+    }
+
+    for ( ; i < width ; i++)
+    {
+        const RGBA8_T *rgba = &(src[i]);
+
+        if (dither)
+        {
+            int32_t phase = (x + i) & 7;
+            const uint8_t *top5 = imageConvertTop5[d8[phase]];
+            const uint8_t *top6 = imageConvertTop6[d4[phase]];
+
+            dst[i] = (top5[rgba->red] << 11)
+                   | (top6[rgba->green] << 5)
+                   | top5[rgba->blue];
+        }
+        else
+        {
+            dst[i] = ((rgba->red >> 3) << 11)
+                   | ((rgba->green >> 2) << 5)
+                   | (rgba->blue >> 3);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static inline void
+convertRow4444(
+    uint16_t *dst,
+    const RGBA8_T *src,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    const bool dither)
+{
+    const uint8_t *d16 = &(imageConvertDither16[(y & 7) << 3]);
+
+    int32_t i = 0;
+
+    for ( ; i + 4 <= width ; i += 4)
+    {
+        const RGBA8_T *p = &(src[i]);
+
+        IMAGE_CONVERT_UINT4_T r = { p[0].red, p[1].red, p[2].red, p[3].red };
+        IMAGE_CONVERT_UINT4_T g = { p[0].green,
+                                    p[1].green,
+                                    p[2].green,
+                                    p[3].green };
+        IMAGE_CONVERT_UINT4_T b = { p[0].blue,
+                                    p[1].blue,
+                                    p[2].blue,
+                                    p[3].blue };
+        IMAGE_CONVERT_UINT4_T a = { p[0].alpha,
+                                    p[1].alpha,
+                                    p[2].alpha,
+                                    p[3].alpha };
+
+        if (dither)
+        {
+            int32_t phase = x + i;
+
+            IMAGE_CONVERT_UINT4_T o16 = { d16[phase & 7],
+                                          d16[(phase + 1) & 7],
+                                          d16[(phase + 2) & 7],
+                                          d16[(phase + 3) & 7] };
+
+            r = ditherConvert(r, o16);
+            g = ditherConvert(g, o16);
+            b = ditherConvert(b, o16);
+            a = ditherConvert(a, o16);
+        }
+
+        IMAGE_CONVERT_UINT4_T packed = ((r >> 4) << 12)
+                                     | ((g >> 4) << 8)
+                                     | ((b >> 4) << 4)
+                                     | (a >> 4);
+
+        dst[i] = packed[0];
+        dst[i + 1] = packed[1];
+        dst[i + 2] = packed[2];
+        dst[i + 3] = packed[3];
+    }
+
+    for ( ; i < width ; i++)
+    {
+        const RGBA8_T *rgba = &(src[i]);
+
+        if (dither)
+        {
+            const uint8_t *top4 = imageConvertTop4[d16[(x + i) & 7]];
+
+            dst[i] = (top4[rgba->red] << 12)
+                   | (top4[rgba->green] << 8)
+                   | (top4[rgba->blue] << 4)
+                   | top4[rgba->alpha];
+        }
+        else
+        {
+            dst[i] = ((rgba->red >> 4) << 12)
+                   | ((rgba->green >> 4) << 8)
+                   | ((rgba->blue >> 4) << 4)
+                   | (rgba->alpha >> 4);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+convertRowRGB565(
+    void *dst,
+    const RGBA8_T *src,
+    int32_t x,
+    int32_t y,
+    int32_t width)
+{
+    convertRow565(dst, src, x, y, width, false);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+convertRowDitheredRGB565(
+    void *dst,
+    const RGBA8_T *src,
+    int32_t x,
+    int32_t y,
+    int32_t width)
+{
+    convertRow565(dst, src, x, y, width, true);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+convertRowRGBA16(
+    void *dst,
+    const RGBA8_T *src,
+    int32_t x,
+    int32_t y,
+    int32_t width)
+{
+    convertRow4444(dst, src, x, y, width, false);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+convertRowDitheredRGBA16(
+    void *dst,
+    const RGBA8_T *src,
+    int32_t x,
+    int32_t y,
+    int32_t width)
+{
+    convertRow4444(dst, src, x, y, width, true);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+convertRowRGB888(
+    void *dst,
+    const RGBA8_T *src,
+    int32_t x,
+    int32_t y,
+    int32_t width)
+{
+    uint8_t *line = dst;
+
+    int32_t i;
+    for (i = 0 ; i < width ; i++)
+    {
+        line[3 * i] = src[i].red;
+        line[(3 * i) + 1] = src[i].green;
+        line[(3 * i) + 2] = src[i].blue;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// RGBA32 is stored in the same byte order as RGBA8_T.
+
+static void
+convertRowRGBA32(
+    void *dst,
+    const RGBA8_T *src,
+    int32_t x,
+    int32_t y,
+    int32_t width)
+{
+    memcpy(dst, src, width * sizeof(RGBA8_T));
+}
+
+//-------------------------------------------------------------------------
+
+IMAGE_CONVERT_ROW_T
+findRowConverter(
+    VC_IMAGE_TYPE_T type,
+    bool dither)
+{
+    switch (type)
+    {
+    case VC_IMAGE_RGB565:
+
+        return (dither) ? convertRowDitheredRGB565 : convertRowRGB565;
+
+    case VC_IMAGE_RGBA16:
+
+        return (dither) ? convertRowDitheredRGBA16 : convertRowRGBA16;
+
+    case VC_IMAGE_RGB888:
+
+        return convertRowRGB888;
+
+    case VC_IMAGE_RGBA32:
+
+        return convertRowRGBA32;
+
+    default:
+
+        return NULL;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Expand RGB565 to RGB888, four pixels at a time. Each channel is widened
+// by replicating its top bits into the new low bits.
+
+void
+expandRowRGB565(
+    const uint16_t *src,
+    uint8_t *dst,
+    int32_t width)
+{
+    int32_t x = 0;
+
+    for ( ; x + 4 <= width ; x += 4)
+    {
+        IMAGE_CONVERT_UINT4_T p =
+            { src[x], src[x + 1], src[x + 2], src[x + 3] };
+
+        IMAGE_CONVERT_UINT4_T r5 = (p >> 11) & 0x1F;
+        IMAGE_CONVERT_UINT4_T g6 = (p >> 5) & 0x3F;
+        IMAGE_CONVERT_UINT4_T b5 = p & 0x1F;
+
+        IMAGE_CONVERT_UINT4_T r = (r5 << 3) | (r5 >> 2);
+        IMAGE_CONVERT_UINT4_T g = (g6 << 2) | (g6 >> 4);
+        IMAGE_CONVERT_UINT4_T b = (b5 << 3) | (b5 >> 2);
+
+        uint8_t *d = dst + (3 * x);
+
+        int32_t i;
+        for (i = 0 ; i < 4 ; i++)
+        {
+            d[3 * i] = r[i];
+            d[(3 * i) + 1] = g[i];
+            d[(3 * i) + 2] = b[i];
+        }
+    }
+
+    for ( ; x < width ; x++)
+    {
+        uint16_t p = src[x];
+
+        dst[3 * x] = imageConvertExpand5[(p >> 11) & 0x1F];
+        dst[(3 * x) + 1] = imageConvertExpand6[(p >> 5) & 0x3F];
+        dst[(3 * x) + 2] = imageConvertExpand5[p & 0x1F];
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Expand RGBA4444 to RGBA8888, four pixels at a time. The nibbles are
+// spread one to a byte, so a single multiply by 0x11 widens all four
+// channels of a pixel at once.
+
+void
+expandRowRGBA16(
+    const uint16_t *src,
+    uint8_t *dst,
+    int32_t width)
+{
+    int32_t x = 0;
+
+    for ( ; x + 4 <= width ; x += 4)
+    {
+        IMAGE_CONVERT_UINT4_T p =
+            { src[x], src[x + 1], src[x + 2], src[x + 3] };
+
+        IMAGE_CONVERT_UINT4_T spread = ((p >> 12) & 0xF)
+                                     | (((p >> 8) & 0xF) << 8)
+                                     | (((p >> 4) & 0xF) << 16)
+                                     | ((p & 0xF) << 24);
+
+        spread *= 0x11;
+
+        uint8_t *d = dst + (4 * x);
+
+        int32_t i;
+        for (i = 0 ; i < 4 ; i++)
+        {
+            d[4 * i] = spread[i];
+            d[(4 * i) + 1] = spread[i] >> 8;
+            d[(4 * i) + 2] = spread[i] >> 16;
+            d[(4 * i) + 3] = spread[i] >> 24;
+        }
+    }
+
+    for ( ; x < width ; x++)
+    {
+        uint16_t p = src[x];
+
+        dst[4 * x] = ((p >> 12) & 0xF) * 0x11;
+        dst[(4 * x) + 1] = ((p >> 8) & 0xF) * 0x11;
+        dst[(4 * x) + 2] = ((p >> 4) & 0xF) * 0x11;
+        dst[(4 * x) + 3] = (p & 0xF) * 0x11;
+    }
+}
+
@@ -0,0 +1,131 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef IMAGE_CONVERT_H
+#define IMAGE_CONVERT_H
+
+//-------------------------------------------------------------------------
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Ordered dither offsets for each position of an 8x8 block; the pixel at
+// (x, y) uses element IMAGE_CONVERT_DITHER_INDEX(x, y). dither8 is for 5
+// bit channels, dither4 for 6 bit channels and dither16 for 4 bit ones.
+
+#define IMAGE_CONVERT_DITHER_INDEX(x, y) ((((y) & 7) << 3) | ((x) & 7))
+
+extern const uint8_t imageConvertDither8[64];
+extern const uint8_t imageConvertDither4[64];
+extern const uint8_t imageConvertDither16[64];
+
+// The top bits of an 8 bit channel after a dither offset has been added
+// and the sum clamped, indexed by [offset][value]. Offset 0 is plain
+// truncation. Each dither matrix above only holds offsets that index the
+// table for its channel width.
+
+extern const uint8_t imageConvertTop5[8][256];
+extern const uint8_t imageConvertTop6[4][256];
+extern const uint8_t imageConvertTop4[16][256];
+
+// 5 and 6 bit channels widened back to 8 bits.
+
+extern const uint8_t imageConvertExpand5[32];
+extern const uint8_t imageConvertExpand6[64];
+
+//-------------------------------------------------------------------------
+
+static inline uint16_t
+packRGB565Convert(
+    const RGBA8_T *rgba,
+    int32_t ditherIndex)
+{
+    uint8_t d8 = imageConvertDither8[ditherIndex];
+    uint8_t d4 = imageConvertDither4[ditherIndex];
+
+    return (imageConvertTop5[d8][rgba->red] << 11)
+         | (imageConvertTop6[d4][rgba->green] << 5)
+         | imageConvertTop5[d8][rgba->blue];
+}
+
+static inline uint16_t
+packRGBA16Convert(
+    const RGBA8_T *rgba,
+    int32_t ditherIndex)
+{
+    const uint8_t *top = imageConvertTop4[imageConvertDither16[ditherIndex]];
+
+    return (top[rgba->red] << 12)
+         | (top[rgba->green] << 8)
+         | (top[rgba->blue] << 4)
+         | top[rgba->alpha];
+}
+
+//-------------------------------------------------------------------------
+
+// Convert width RGBA8 pixels from src into packed pixels at dst. (x, y)
+// is where the first pixel lands in the image, which sets the phase of
+// the dither.
+
+typedef void (*IMAGE_CONVERT_ROW_T)(void *dst,
+                                    const RGBA8_T *src,
+                                    int32_t x,
+                                    int32_t y,
+                                    int32_t width);
+
+// Returns the converter for a direct colour image type, or NULL.
+
+IMAGE_CONVERT_ROW_T
+findRowConverter(
+    VC_IMAGE_TYPE_T type,
+    bool dither);
+
+// Widen a row of RGB565 to RGB888, or of RGBA16 to RGBA32.
+
+void
+expandRowRGB565(
+    const uint16_t *src,
+    uint8_t *dst,
+    int32_t width);
+
+void
+expandRowRGBA16(
+    const uint16_t *src,
+    uint8_t *dst,
+    int32_t width);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -26,9 +26,12 @@
 //-------------------------------------------------------------------------
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "image.h"
 #include "imageGraphics.h"
+#include "imagePixel.h"
+#include "threadPool.h"
 
 //-------------------------------------------------------------------------
 
@@ -75,16 +78,10 @@ imageBoxFilledIndexed(
     int32_t y2,
     int8_t index)
 {
-    int32_t sign_y = (y1 <= y2) ? 1 : -1;
-    int32_t y = y1;
-
-    imageHorizontalLineIndexed(image, x1, x2, y, index);
+    int32_t x = (x1 <= x2) ? x1 : x2;
+    int32_t y = (y1 <= y2) ? y1 : y2;
 
-    while (y != y2)
-    {
-        y += sign_y;
-        imageHorizontalLineIndexed(image, x1, x2, y, index);
-    }
+    setRectIndexed(image, x, y, abs(x2 - x1) + 1, abs(y2 - y1) + 1, index);
 }
 
 //-------------------------------------------------------------------------
@@ -98,96 +95,383 @@ imageBoxFilledRGB(
     int32_t y2,
     const RGBA8_T *rgb)
 {
-    int32_t sign_y = (y1 <= y2) ? 1 : -1;
-    int32_t y = y1;
+    int32_t x = (x1 <= x2) ? x1 : x2;
+    int32_t y = (y1 <= y2) ? y1 : y2;
+
+    setRectRGB(image, x, y, abs(x2 - x1) + 1, abs(y2 - y1) + 1, rgb);
+}
 
-    imageHorizontalLineRGB(image, x1, x2, y, rgb);
+//-------------------------------------------------------------------------
+
+// What a line is drawn with: a colour, or an index if rgb is NULL.
+
+typedef struct
+{
+    IMAGE_T *image;
+    const RGBA8_T *rgb;
+    int8_t index;
+} IMAGE_PEN_T;
+
+//-------------------------------------------------------------------------
 
-    while (y != y2)
+static inline void
+penSpan(
+    const IMAGE_PEN_T *pen,
+    int32_t x,
+    int32_t y,
+    int32_t length)
+{
+    if (pen->rgb != NULL)
+    {
+        pen->image->setSpanDirect(pen->image, x, y, length, pen->rgb);
+    }
+    else
     {
-        y += sign_y;
-        imageHorizontalLineRGB(image, x1, x2, y, rgb);
+        pen->image->setSpanIndexed(pen->image, x, y, length, pen->index);
     }
 }
 
 //-------------------------------------------------------------------------
 
-void
-imageLineIndexed(
-    IMAGE_T *image,
+static inline bool
+penUsable(
+    const IMAGE_PEN_T *pen)
+{
+    if (pen->rgb != NULL)
+    {
+        return pen->image->setSpanDirect != NULL;
+    }
+
+    return pen->image->setSpanIndexed != NULL;
+}
+
+//-------------------------------------------------------------------------
+
+// Division rounding towards minus infinity, for b > 0.
+
+static inline int64_t
+floorDiv(
+    int64_t a,
+    int64_t b)
+{
+    int64_t q = a / b;
+
+    return ((a % b) != 0 && (a < 0)) ? q - 1 : q;
+}
+
+//-------------------------------------------------------------------------
+
+// Narrow [*low, *high] to the steps s for which start + sign * s lies in
+// [0, limit).
+
+static inline void
+clipSteps(
+    int32_t start,
+    int32_t sign,
+    int32_t limit,
+    int64_t *low,
+    int64_t *high)
+{
+    int64_t first = (sign > 0) ? -(int64_t)start : (int64_t)start - limit + 1;
+    int64_t last = (sign > 0) ? (int64_t)limit - 1 - start : start;
+
+    if (first > *low)
+    {
+        *low = first;
+    }
+
+    if (last < *high)
+    {
+        *high = last;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+addToBounds(
+    VC_RECT_T *bounds,
+    int32_t x1,
+    int32_t y1,
+    int32_t x2,
+    int32_t y2)
+{
+    int32_t left = (x1 < x2) ? x1 : x2;
+    int32_t top = (y1 < y2) ? y1 : y2;
+    int32_t right = ((x1 > x2) ? x1 : x2) + 1;
+    int32_t bottom = ((y1 > y2) ? y1 : y2) + 1;
+
+    if ((bounds->width > 0) && (bounds->height > 0))
+    {
+        int32_t boundsRight = bounds->x + bounds->width;
+        int32_t boundsBottom = bounds->y + bounds->height;
+
+        left = (bounds->x < left) ? bounds->x : left;
+        top = (bounds->y < top) ? bounds->y : top;
+        right = (boundsRight > right) ? boundsRight : right;
+        bottom = (boundsBottom > bottom) ? boundsBottom : bottom;
+    }
+
+    vc_dispmanx_rect_set(bounds, left, top, right - left, bottom - top);
+}
+
+//-------------------------------------------------------------------------
+
+// Draw the part of the line from (x1, y1) to (x2, y2) that is inside the
+// image, exactly the pixels a Bresenham walk of the whole line would set
+// there. Instead of walking the line pixel by pixel from its start, the
+// first and last steps inside the image are solved for up front, and the
+// walk starts at the first. The number of minor axis steps taken after t
+// major axis steps is ceil((2 * minor * t - major) / (2 * major)), which
+// gives both the clipped range and the error term to start the walk
+// with. Runs of pixels along x are written as spans. The area drawn is
+// added to bounds, which nothing is marked dirty in.
+
+static void
+drawClippedLine(
+    const IMAGE_PEN_T *pen,
     int32_t x1,
     int32_t y1,
     int32_t x2,
     int32_t y2,
-    int8_t index)
+    VC_RECT_T *bounds)
 {
-    if (y1 == y2)
+    IMAGE_T *image = pen->image;
+
+    int32_t dx = abs(x2 - x1);
+    int32_t dy = abs(y2 - y1);
+
+    int32_t sign_x = (x1 <= x2) ? 1 : -1;
+    int32_t sign_y = (y1 <= y2) ? 1 : -1;
+
+    bool xMajor = (dx > dy);
+
+    int64_t major = (xMajor) ? dx : dy;
+    int64_t minor = (xMajor) ? dy : dx;
+    int32_t majorStart = (xMajor) ? x1 : y1;
+    int32_t minorStart = (xMajor) ? y1 : x1;
+    int32_t majorSign = (xMajor) ? sign_x : sign_y;
+    int32_t minorSign = (xMajor) ? sign_y : sign_x;
+    int32_t majorLimit = (xMajor) ? image->width : image->height;
+    int32_t minorLimit = (xMajor) ? image->height : image->width;
+
+    //---------------------------------------------------------------------
+    // the steps along the major axis that are inside the image
+
+    int64_t first = 0;
+    int64_t last = major;
+
+    clipSteps(majorStart, majorSign, majorLimit, &first, &last);
+
+    int64_t minorLow = 0;
+    int64_t minorHigh = minor;
+
+    clipSteps(minorStart, minorSign, minorLimit, &minorLow, &minorHigh);
+
+    if (minorLow > minorHigh)
     {
-        imageHorizontalLineIndexed(image, x1, x2, y1, index);
+        return;
     }
-    else if (x1 == x2)
+
+    if (minor > 0)
     {
-        imageVerticalLineIndexed(image, x1, y1, y2, index);
+        if (minorLow > 0)
+        {
+            int64_t t = floorDiv((2 * major * (minorLow - 1)) + major,
+                                 2 * minor) + 1;
+
+            first = (t > first) ? t : first;
+        }
+
+        int64_t t = floorDiv((2 * major * minorHigh) + major, 2 * minor);
+
+        last = (t < last) ? t : last;
     }
-    else
+
+    if (first > last)
     {
-        int32_t dx = abs(x2 - x1);
-        int32_t dy = abs(y2 - y1);
+        return;
+    }
+
+    //---------------------------------------------------------------------
+
+    int64_t k = -floorDiv(major - (2 * minor * first), 2 * major);
+    int64_t d = (2 * minor * (first + 1)) - major - (2 * major * k);
 
-        int32_t sign_x = (x1 <= x2) ? 1 : -1;
-        int32_t sign_y = (y1 <= y2) ? 1 : -1;
+    int32_t m = majorStart + (majorSign * first);
+    int32_t n = minorStart + (minorSign * k);
+    int32_t firstM = m;
+    int32_t firstN = n;
+    int32_t runStart = m;
 
-        int32_t x = x1;
-        int32_t y = y1;
+    int64_t t;
+    for (t = first ; t <= last ; t++)
+    {
+        bool minorStep = (d > 0);
 
-        setPixelIndexed(image, x, y, index);
+        if (xMajor == false)
+        {
+            penSpan(pen, n, m, 1);
+        }
+        else if (minorStep || (t == last))
+        {
+            int32_t x = (majorSign > 0) ? runStart : m;
+            penSpan(pen, x, n, abs(m - runStart) + 1);
+        }
 
-        if (dx > dy)
+        if (t == last)
         {
-            int32_t d = 2 * dy - dx;
-            int32_t incrE = 2 * dy;
-            int32_t incrNE = 2 * (dy - dx);
+            break;
+        }
 
-            while (x != x2)
-            {
-                x += sign_x;
-
-                if (d <= 0)
-                {
-                    d += incrE;
-                }
-                else
-                {
-                    d += incrNE;
-                    y += sign_y;
-                }
-
-                setPixelIndexed(image, x, y, index);
-            }
+        if (minorStep)
+        {
+            d += 2 * (minor - major);
+            n += minorSign;
+            runStart = m + majorSign;
         }
         else
         {
-            int32_t d = 2 * dx - dy;
-            int32_t incrN = 2 * dx;
-            int32_t incrNE = 2 * (dx - dy);
-
-            while (y != y2)
-            {
-                y += sign_y;
-
-                if (d <= 0)
-                {
-                    d += incrN;
-                }
-                else
-                {
-                    d += incrNE;
-                    x += sign_x;
-                }
-
-                setPixelIndexed(image, x, y, index);
-            }
+            d += 2 * minor;
         }
+
+        m += majorSign;
+    }
+
+    if (xMajor)
+    {
+        addToBounds(bounds, firstM, firstN, m, n);
+    }
+    else
+    {
+        addToBounds(bounds, firstN, firstM, n, m);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+drawLine(
+    const IMAGE_PEN_T *pen,
+    int32_t x1,
+    int32_t y1,
+    int32_t x2,
+    int32_t y2)
+{
+    VC_RECT_T bounds = { 0, 0, 0, 0 };
+
+    if (penUsable(pen) == false)
+    {
+        return;
+    }
+
+    drawClippedLine(pen, x1, y1, x2, y2, &bounds);
+
+    if ((bounds.width > 0) && (bounds.height > 0))
+    {
+        markDirtyImage(pen->image,
+                       bounds.x,
+                       bounds.y,
+                       bounds.width,
+                       bounds.height);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+drawLines(
+    const IMAGE_PEN_T *pen,
+    const IMAGE_LINE_T *lines,
+    size_t numberOfLines)
+{
+    VC_RECT_T bounds = { 0, 0, 0, 0 };
+
+    if (penUsable(pen) == false)
+    {
+        return;
+    }
+
+    size_t i;
+    for (i = 0 ; i < numberOfLines ; i++)
+    {
+        drawClippedLine(pen,
+                        lines[i].x1,
+                        lines[i].y1,
+                        lines[i].x2,
+                        lines[i].y2,
+                        &bounds);
+    }
+
+    if ((bounds.width > 0) && (bounds.height > 0))
+    {
+        markDirtyImage(pen->image,
+                       bounds.x,
+                       bounds.y,
+                       bounds.width,
+                       bounds.height);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+drawPolyline(
+    const IMAGE_PEN_T *pen,
+    const IMAGE_POINT_T *points,
+    size_t numberOfPoints)
+{
+    VC_RECT_T bounds = { 0, 0, 0, 0 };
+
+    if (penUsable(pen) == false)
+    {
+        return;
+    }
+
+    size_t i;
+    for (i = 1 ; i < numberOfPoints ; i++)
+    {
+        drawClippedLine(pen,
+                        points[i - 1].x,
+                        points[i - 1].y,
+                        points[i].x,
+                        points[i].y,
+                        &bounds);
+    }
+
+    if ((bounds.width > 0) && (bounds.height > 0))
+    {
+        markDirtyImage(pen->image,
+                       bounds.x,
+                       bounds.y,
+                       bounds.width,
+                       bounds.height);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+imageLineIndexed(
+    IMAGE_T *image,
+    int32_t x1,
+    int32_t y1,
+    int32_t x2,
+    int32_t y2,
+    int8_t index)
+{
+    if (y1 == y2)
+    {
+        imageHorizontalLineIndexed(image, x1, x2, y1, index);
+    }
+    else if (x1 == x2)
+    {
+        imageVerticalLineIndexed(image, x1, y1, y2, index);
+    }
+    else
+    {
+        IMAGE_PEN_T pen = { image, NULL, index };
+        drawLine(&pen, x1, y1, x2, y2);
     }
 }
 
@@ -212,64 +496,61 @@ imageLineRGB(
     }
     else
     {
-        int32_t dx = abs(x2 - x1);
-        int32_t dy = abs(y2 - y1);
+        IMAGE_PEN_T pen = { image, rgb, 0 };
+        drawLine(&pen, x1, y1, x2, y2);
+    }
+}
 
-        int32_t sign_x = (x1 <= x2) ? 1 : -1;
-        int32_t sign_y = (y1 <= y2) ? 1 : -1;
+//-------------------------------------------------------------------------
 
-        int32_t x = x1;
-        int32_t y = y1;
+void
+imageLinesIndexed(
+    IMAGE_T *image,
+    const IMAGE_LINE_T *lines,
+    size_t numberOfLines,
+    int8_t index)
+{
+    IMAGE_PEN_T pen = { image, NULL, index };
+    drawLines(&pen, lines, numberOfLines);
+}
 
-        setPixelRGB(image, x, y, rgb);
+//-------------------------------------------------------------------------
 
-        if (dx > dy)
-        {
-            int32_t d = 2 * dy - dx;
-            int32_t incrE = 2 * dy;
-            int32_t incrNE = 2 * (dy - dx);
+void
+imageLinesRGB(
+    IMAGE_T *image,
+    const IMAGE_LINE_T *lines,
+    size_t numberOfLines,
+    const RGBA8_T *rgb)
+{
+    IMAGE_PEN_T pen = { image, rgb, 0 };
+    drawLines(&pen, lines, numberOfLines);
+}
 
-            while (x != x2)
-            {
-                x += sign_x;
-
-                if (d <= 0)
-                {
-                    d += incrE;
-                }
-                else
-                {
-                    d += incrNE;
-                    y += sign_y;
-                }
-
-                setPixelRGB(image, x, y, rgb);
-            }
-        }
-        else
-        {
-            int32_t d = 2 * dx - dy;
-            int32_t incrN = 2 * dx;
-            int32_t incrNE = 2 * (dx - dy);
+//-------------------------------------------------------------------------
 
-            while (y != y2)
-            {
-                y += sign_y;
-
-                if (d <= 0)
-                {
-                    d += incrN;
-                }
-                else
-                {
-                    d += incrNE;
-                    x += sign_x;
-                }
-
-                setPixelRGB(image, x, y, rgb);
-            }
-        }
-    }
+void
+imagePolylineIndexed(
+    IMAGE_T *image,
+    const IMAGE_POINT_T *points,
+    size_t numberOfPoints,
+    int8_t index)
+{
+    IMAGE_PEN_T pen = { image, NULL, index };
+    drawPolyline(&pen, points, numberOfPoints);
+}
+
+//-------------------------------------------------------------------------
+
+void
+imagePolylineRGB(
+    IMAGE_T *image,
+    const IMAGE_POINT_T *points,
+    size_t numberOfPoints,
+    const RGBA8_T *rgb)
+{
+    IMAGE_PEN_T pen = { image, rgb, 0 };
+    drawPolyline(&pen, points, numberOfPoints);
 }
 
 //-------------------------------------------------------------------------
@@ -282,16 +563,9 @@ imageHorizontalLineIndexed(
     int32_t y,
     int8_t index)
 {
-    int32_t sign_x = (x1 <= x2) ? 1 : -1;
-    int32_t x = x1;
+    int32_t x = (x1 <= x2) ? x1 : x2;
 
-    setPixelIndexed(image, x, y, index);
-
-    while (x != x2)
-    {
-        x += sign_x;
-        setPixelIndexed(image, x, y, index);
-    }
+    setSpanIndexed(image, x, y, abs(x2 - x1) + 1, index);
 }
 
 //-------------------------------------------------------------------------
@@ -304,16 +578,9 @@ imageHorizontalLineRGB(
     int32_t y,
     const RGBA8_T *rgb)
 {
-    int32_t sign_x = (x1 <= x2) ? 1 : -1;
-    int32_t x = x1;
-
-    setPixelRGB(image, x, y, rgb);
+    int32_t x = (x1 <= x2) ? x1 : x2;
 
-    while (x != x2)
-    {
-        x += sign_x;
-        setPixelRGB(image, x, y, rgb);
-    }
+    setSpanRGB(image, x, y, abs(x2 - x1) + 1, rgb);
 }
 
 //-------------------------------------------------------------------------
@@ -326,16 +593,32 @@ imageVerticalLineIndexed(
     int32_t y2,
     int8_t index)
 {
-    int32_t sign_y = (y1 <= y2) ? 1 : -1;
-    int32_t y = y1;
+    IMAGE_RECT_T rect;
+    int32_t y = (y1 <= y2) ? y1 : y2;
+
+    if ((image->setPixelIndexed == NULL) ||
+        (getRectImage(image, x, y, 1, abs(y2 - y1) + 1, &rect) == false))
+    {
+        return;
+    }
 
-    setPixelIndexed(image, x, y, index);
+    uint8_t mask = 0xFF;
+    uint8_t value = index;
 
-    while (y != y2)
+    if (image->bitsPerPixel == 4)
     {
-        y += sign_y;
-        setPixelIndexed(image, x, y, index);
+        mask = (rect.x & 1) ? 0x0F : 0xF0;
+        value = (rect.x & 1) ? (index & 0x0F) : (index << 4);
     }
+
+    int32_t j;
+    for (j = 0 ; j < rect.height ; j++)
+    {
+        uint8_t *pixel = rowImageRect(&rect, j);
+        *pixel = (*pixel & ~mask) | value;
+    }
+
+    markDirtyImage(image, rect.x, rect.y, 1, rect.height);
 }
 
 //-------------------------------------------------------------------------
@@ -348,15 +631,400 @@ imageVerticalLineRGB(
     int32_t y2,
     const RGBA8_T *rgb)
 {
-    int32_t sign_y = (y1 <= y2) ? 1 : -1;
-    int32_t y = y1;
+    IMAGE_RECT_T rect;
+    int32_t y = (y1 <= y2) ? y1 : y2;
+
+    if ((image->convertRow == NULL) ||
+        (getRectImage(image, x, y, 1, abs(y2 - y1) + 1, &rect) == false))
+    {
+        return;
+    }
+
+    // The colour is packed once for each row of the dither pattern, which
+    // repeats every eight rows.
+
+    uint32_t packed[8];
+
+    int32_t j;
+    for (j = 0 ; (j < 8) && (j < rect.height) ; j++)
+    {
+        image->convertRow(&(packed[j]), rgb, rect.x, rect.y + j, 1);
+    }
+
+    for (j = 0 ; j < rect.height ; j++)
+    {
+        uint8_t *pixel = rowImageRect(&rect, j);
+
+        switch (rect.rowBytes)
+        {
+        case 2:
+
+            *(uint16_t *)pixel = packed[j & 7];
+            break;
+
+        case 4:
+
+            *(uint32_t *)pixel = packed[j & 7];
+            break;
+
+        default:
+
+            memcpy(pixel, &(packed[j & 7]), rect.rowBytes);
+            break;
+        }
+    }
+
+    markDirtyImage(image, rect.x, rect.y, 1, rect.height);
+}
+
+//-------------------------------------------------------------------------
+
+// Triangles are rasterised a row at a time. In each row the span of pixel
+// centres inside all three edges is solved for directly from the edge
+// functions, and the colour is stepped across it in 16.16 fixed point,
+// all four channels with one vector add. Pixels on an edge belong to the
+// triangle if the edge is a top or a left one, so triangles that share an
+// edge never both draw it. Large triangles are split into bands of rows
+// drawn by the common thread pool.
+
+#define IMAGE_TRIANGLE_MIN_THREAD_PIXELS 65536
+
+typedef int32_t IMAGE_TRIANGLE_INT4_T __attribute__((vector_size(16)));
+
+// Edge function of the edge from a to b, doubled so that it can be taken
+// at pixel centres in integers: e(x, y) = c + (a * x) + (b * y). bias is 0
+// for a top or left edge, on which e == 0 is inside, and 1 otherwise.
+
+typedef struct
+{
+    int64_t a;
+    int64_t b;
+    int64_t c;
+    int64_t bias;
+} IMAGE_TRIANGLE_EDGE_T;
+
+typedef struct
+{
+    IMAGE_T *image;
+    IMAGE_TRIANGLE_EDGE_T edges[3];
+    double colours[3][4];
+    double area;
+    int32_t left;
+    int32_t right;
+    int32_t top;
+} IMAGE_TRIANGLE_T;
+
+//-------------------------------------------------------------------------
+
+static void
+initTriangleEdge(
+    IMAGE_TRIANGLE_EDGE_T *edge,
+    const IMAGE_VERTEX_T *from,
+    const IMAGE_VERTEX_T *to)
+{
+    int64_t dx = to->x - from->x;
+    int64_t dy = to->y - from->y;
+
+    // (dx * (2y + 1 - 2 * from->y)) - (dy * (2x + 1 - 2 * from->x))
+
+    edge->a = -2 * dy;
+    edge->b = 2 * dx;
+    edge->c = (dx * (1 - (2 * (int64_t)(from->y))))
+            - (dy * (1 - (2 * (int64_t)(from->x))));
+
+    // With y down and the vertices in positive order the inside is below
+    // a top edge, which runs towards +x, and right of a left edge, which
+    // runs towards -y.
+
+    bool top = (dy == 0) && (dx > 0);
+    bool left = (dy < 0);
+
+    edge->bias = (top || left) ? 0 : 1;
+}
+
+//-------------------------------------------------------------------------
+
+// Narrow [*left, *right] to the pixels of row y on the inside of edge.
+
+static inline void
+clipSpanToEdge(
+    const IMAGE_TRIANGLE_EDGE_T *edge,
+    int32_t y,
+    int32_t *left,
+    int32_t *right)
+{
+    // inside where c + (b * y) + (a * x) >= bias
+
+    int64_t c = edge->c + (edge->b * y) - edge->bias;
+
+    if (edge->a > 0)
+    {
+        int64_t x = -floorDiv(c, edge->a);
+
+        if (x > *left)
+        {
+            *left = x;
+        }
+    }
+    else if (edge->a < 0)
+    {
+        int64_t x = floorDiv(c, -(edge->a));
+
+        if (x < *right)
+        {
+            *right = x;
+        }
+    }
+    else if (c < 0)
+    {
+        *right = *left - 1;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static inline uint8_t
+triangleChannel(
+    int32_t value)
+{
+    value >>= 16;
+
+    if (value < 0)
+    {
+        return 0;
+    }
+
+    return (value > 255) ? 255 : value;
+}
 
-    setPixelRGB(image, x, y, rgb);
+//-------------------------------------------------------------------------
+
+static IMAGE_PIXEL_INLINE void
+drawTriangleRows(
+    IMAGE_PIXEL_FORMAT_T format,
+    const IMAGE_TRIANGLE_T *triangle,
+    int32_t top,
+    int32_t bottom)
+{
+    IMAGE_T *image = triangle->image;
 
-    while (y != y2)
+    // d(colour)/dx is the same in every row
+
+    double scale = 65536.0 / triangle->area;
+    IMAGE_TRIANGLE_INT4_T step;
+
+    int32_t channel;
+    for (channel = 0 ; channel < 4 ; channel++)
     {
-        y += sign_y;
-        setPixelRGB(image, x, y, rgb);
+        double d = 0.0;
+
+        int32_t e;
+        for (e = 0 ; e < 3 ; e++)
+        {
+            d += triangle->edges[e].a * triangle->colours[e][channel];
+        }
+
+        step[channel] = (int32_t)(d * scale);
+    }
+
+    int32_t y;
+    for (y = top ; y < bottom ; y++)
+    {
+        int32_t left = triangle->left;
+        int32_t right = triangle->right;
+
+        int32_t e;
+        for (e = 0 ; e < 3 ; e++)
+        {
+            clipSpanToEdge(&(triangle->edges[e]), y, &left, &right);
+        }
+
+        if (left > right)
+        {
+            continue;
+        }
+
+        // the colour at the centre of the first pixel, rounded
+
+        IMAGE_TRIANGLE_INT4_T colour;
+
+        for (channel = 0 ; channel < 4 ; channel++)
+        {
+            double value = 0.0;
+
+            for (e = 0 ; e < 3 ; e++)
+            {
+                const IMAGE_TRIANGLE_EDGE_T *edge = &(triangle->edges[e]);
+
+                value += (edge->c + (edge->b * y) + (edge->a * left))
+                       * triangle->colours[e][channel];
+            }
+
+            colour[channel] = (int32_t)((value * scale) + 32768.0);
+        }
+
+        uint8_t *row = imagePixelRow(image, y);
+
+        int32_t x;
+        for (x = left ; x <= right ; x++)
+        {
+            RGBA8_T rgba =
+            {
+                triangleChannel(colour[0]),
+                triangleChannel(colour[1]),
+                triangleChannel(colour[2]),
+                triangleChannel(colour[3])
+            };
+
+            imagePixelPut(format, image, row, x, y, &rgba);
+            colour += step;
+        }
     }
 }
 
+//-------------------------------------------------------------------------
+
+// Draw the rows [start, end) of the triangle, counted from its top row.
+
+static void
+drawTriangleBand(
+    void *arg,
+    int32_t start,
+    int32_t end)
+{
+    const IMAGE_TRIANGLE_T *triangle = arg;
+
+    IMAGE_PIXEL_DISPATCH(imagePixelFormat(triangle->image),
+                         drawTriangleRows,
+                         triangle,
+                         triangle->top + start,
+                         triangle->top + end);
+}
+
+//-------------------------------------------------------------------------
+
+void
+imageTriangleRGB(
+    IMAGE_T *image,
+    const IMAGE_VERTEX_T *v0,
+    const IMAGE_VERTEX_T *v1,
+    const IMAGE_VERTEX_T *v2)
+{
+    if (image->convertRow == NULL)
+    {
+        return;
+    }
+
+    int64_t area = ((int64_t)(v1->x - v0->x) * (v2->y - v0->y))
+                 - ((int64_t)(v1->y - v0->y) * (v2->x - v0->x));
+
+    if (area == 0)
+    {
+        return;
+    }
+
+    // Wind the triangle so that the inside of every edge is positive.
+
+    if (area < 0)
+    {
+        const IMAGE_VERTEX_T *swap = v1;
+        v1 = v2;
+        v2 = swap;
+        area = -area;
+    }
+
+    //---------------------------------------------------------------------
+
+    int32_t left = v0->x;
+    int32_t right = v0->x;
+    int32_t top = v0->y;
+    int32_t bottom = v0->y;
+
+    const IMAGE_VERTEX_T *vertices[3] = { v0, v1, v2 };
+
+    int32_t i;
+    for (i = 1 ; i < 3 ; i++)
+    {
+        left = (vertices[i]->x < left) ? vertices[i]->x : left;
+        right = (vertices[i]->x > right) ? vertices[i]->x : right;
+        top = (vertices[i]->y < top) ? vertices[i]->y : top;
+        bottom = (vertices[i]->y > bottom) ? vertices[i]->y : bottom;
+    }
+
+    // vertices are on pixel corners, so the pixels covered are [left, right)
+
+    left = (left < 0) ? 0 : left;
+    top = (top < 0) ? 0 : top;
+    right = (right > image->width) ? image->width : right;
+    bottom = (bottom > image->height) ? image->height : bottom;
+
+    if ((left >= right) || (top >= bottom))
+    {
+        return;
+    }
+
+    //---------------------------------------------------------------------
+
+    // Edge i is the one opposite vertex i, so its edge function weights
+    // the colour of vertex i.
+
+    IMAGE_TRIANGLE_T triangle;
+
+    triangle.image = image;
+    triangle.area = 2.0 * area;
+    triangle.left = left;
+    triangle.right = right - 1;
+    triangle.top = top;
+
+    for (i = 0 ; i < 3 ; i++)
+    {
+        initTriangleEdge(&(triangle.edges[i]),
+                         vertices[(i + 1) % 3],
+                         vertices[(i + 2) % 3]);
+
+        triangle.colours[i][0] = vertices[i]->rgba.red;
+        triangle.colours[i][1] = vertices[i]->rgba.green;
+        triangle.colours[i][2] = vertices[i]->rgba.blue;
+        triangle.colours[i][3] = vertices[i]->rgba.alpha;
+    }
+
+    //---------------------------------------------------------------------
+
+    int64_t pixels = (int64_t)(right - left) * (bottom - top);
+    int32_t rows = bottom - top;
+
+    if (pixels >= 2 * IMAGE_TRIANGLE_MIN_THREAD_PIXELS)
+    {
+        int32_t grain = IMAGE_TRIANGLE_MIN_THREAD_PIXELS / (right - left);
+
+        forThreadPool(defaultThreadPool(),
+                      rows,
+                      (grain < 1) ? 1 : grain,
+                      drawTriangleBand,
+                      &triangle);
+    }
+    else
+    {
+        drawTriangleBand(&triangle, 0, rows);
+    }
+
+    markDirtyImage(image, left, top, right - left, bottom - top);
+}
+
+//-------------------------------------------------------------------------
+
+void
+imagePolygonRGB(
+    IMAGE_T *image,
+    const IMAGE_VERTEX_T *vertices,
+    size_t numberOfVertices)
+{
+    size_t i;
+    for (i = 2 ; i < numberOfVertices ; i++)
+    {
+        imageTriangleRGB(image,
+                         &(vertices[0]),
+                         &(vertices[i - 1]),
+                         &(vertices[i]));
+    }
+}
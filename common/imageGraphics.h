@@ -28,8 +28,38 @@
 #ifndef IMAGE_GRAPHICS_H
 #define IMAGE_GRAPHICS_H
 
+#include <stddef.h>
+
 #include "image.h"
 
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    int32_t x;
+    int32_t y;
+} IMAGE_POINT_T;
+
+typedef struct
+{
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+} IMAGE_LINE_T;
+
+// A vertex of a shaded triangle. Vertices are on the corners of pixels,
+// so the triangle (0, 0), (4, 0), (0, 4) covers the centres of 10 pixels.
+
+typedef struct
+{
+    int32_t x;
+    int32_t y;
+    RGBA8_T rgba;
+} IMAGE_VERTEX_T;
+
 //-------------------------------------------------------------------------
 
 void
@@ -68,6 +98,9 @@ imageBoxFilledRGB(
     int32_t y2,
     const RGBA8_T *rgb);
 
+// Lines are clipped to the image before they are drawn, so the cost of a
+// line depends only on how much of it is in the image.
+
 void
 imageLineIndexed(
     IMAGE_T *image,
@@ -86,6 +119,38 @@ imageLineRGB(
     int32_t y2,
     const RGBA8_T *rgb);
 
+// Draw many lines, or a line through each of the points in turn, in one
+// call. Each line is clipped to the image before it is drawn, and the
+// area drawn is marked dirty once for the whole call.
+
+void
+imageLinesIndexed(
+    IMAGE_T *image,
+    const IMAGE_LINE_T *lines,
+    size_t numberOfLines,
+    int8_t index);
+
+void
+imageLinesRGB(
+    IMAGE_T *image,
+    const IMAGE_LINE_T *lines,
+    size_t numberOfLines,
+    const RGBA8_T *rgb);
+
+void
+imagePolylineIndexed(
+    IMAGE_T *image,
+    const IMAGE_POINT_T *points,
+    size_t numberOfPoints,
+    int8_t index);
+
+void
+imagePolylineRGB(
+    IMAGE_T *image,
+    const IMAGE_POINT_T *points,
+    size_t numberOfPoints,
+    const RGBA8_T *rgb);
+
 void
 imageHorizontalLineIndexed(
     IMAGE_T *image,
@@ -118,6 +183,29 @@ imageVerticalLineRGB(
     int32_t y2,
     const RGBA8_T *rgb);
 
+// Fill the triangle, clipped to the image, with the colour of each vertex
+// blended linearly across it (Gouraud shading); give all three vertices
+// the same colour for a flat fill. Each row is written with an inlined
+// loop for the image format. Large triangles are drawn on several
+// threads. Does nothing for indexed images.
+
+void
+imageTriangleRGB(
+    IMAGE_T *image,
+    const IMAGE_VERTEX_T *v0,
+    const IMAGE_VERTEX_T *v1,
+    const IMAGE_VERTEX_T *v2);
+
+// Fill a convex polygon as a fan of triangles from its first vertex.
+
+void
+imagePolygonRGB(
+    IMAGE_T *image,
+    const IMAGE_VERTEX_T *vertices,
+    size_t numberOfVertices);
+
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
@@ -32,6 +32,8 @@
 
 #include "imageLayer.h"
 
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
 typedef struct
@@ -52,4 +54,6 @@ drawKey(
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
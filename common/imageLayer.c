@@ -27,10 +27,30 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "element_change.h"
 #include "image.h"
 #include "imageLayer.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
+
+#include "interface/vcsm/user-vcsm.h"
+
+//-------------------------------------------------------------------------
+
+// The vcsm cache operation that writes dirty lines back to memory.
+
+#define IMAGE_LAYER_VCSM_CLEAN 2
+
+// The low bits of a DISPMANX_TRANSFORM_T are the rotation, the rest flips.
+
+#define IMAGE_LAYER_ROTATION_MASK 3
+
+static pthread_once_t sharedMemoryOnce = PTHREAD_ONCE_INIT;
+static bool sharedMemoryAvailable = false;
 
 //-------------------------------------------------------------------------
 
@@ -41,30 +61,339 @@ initImageLayer(
     int32_t height,
     VC_IMAGE_TYPE_T type)
 {
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(IMAGE_LAYER_ACCOUNT));
+
     initImage(&(il->image), type, width, height, false);
+    il->dirty.numberOfRects = 0;
+
+    leaveMemoryAccount(previous);
 }
 
 //-------------------------------------------------------------------------
 
 void
-createResourceImageLayer(
+enableDirtyImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    il->dirty.numberOfRects = 0;
+    il->image.dirty = &(il->dirty);
+}
+
+//-------------------------------------------------------------------------
+
+static int
+compareDirtyRects(
+    const void *a,
+    const void *b)
+{
+    const VC_RECT_T *ra = a;
+    const VC_RECT_T *rb = b;
+
+    return ra->y - rb->y;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+addDirtyRect(
+    IMAGE_DIRTY_T *dirty,
+    const VC_RECT_T *rect)
+{
+    if (dirty->numberOfRects < IMAGE_DIRTY_MAX_RECTS)
+    {
+        dirty->rects[dirty->numberOfRects++] = *rect;
+    }
+    else
+    {
+        VC_RECT_T *last = &(dirty->rects[IMAGE_DIRTY_MAX_RECTS - 1]);
+
+        int32_t x1 = (rect->x < last->x) ? rect->x : last->x;
+        int32_t y1 = (rect->y < last->y) ? rect->y : last->y;
+        int32_t x2 = last->x + last->width;
+        int32_t y2 = last->y + last->height;
+
+        if (rect->x + rect->width > x2)
+        {
+            x2 = rect->x + rect->width;
+        }
+
+        if (rect->y + rect->height > y2)
+        {
+            y2 = rect->y + rect->height;
+        }
+
+        vc_dispmanx_rect_set(last, x1, y1, x2 - x1, y2 - y1);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Move the rows that have changed since the last call into dirty. If the
+// image does not keep a dirty list, that is all of them.
+
+static void
+takeDirtyImageLayer(
     IMAGE_LAYER_T *il,
-    int32_t layer)
+    IMAGE_DIRTY_T *dirty)
 {
-    uint32_t vc_image_ptr;
-    int result = 0;
+    if (il->image.dirty == NULL)
+    {
+        dirty->numberOfRects = 1;
+        dirty->rects[0] = il->bmpRect;
+    }
+    else
+    {
+        *dirty = *(il->image.dirty);
+        clearDirtyImage(&(il->image));
+    }
+}
 
-    il->layer = layer;
+//-------------------------------------------------------------------------
 
-    il->resource =
-        vc_dispmanx_resource_create(
-            il->image.type,
-            il->image.width | (il->image.pitch << 16),
-            il->image.height | (il->image.alignedHeight << 16),
-            &vc_image_ptr);
-    assert(il->resource != 0);
+// Write rows y to y + numberOfRows of the shared memory buffer of the
+// layer to resource. The rows are cleaned from the CPU cache first, so
+// that the VideoCore sees what was drawn. As with write_data, the rows
+// are read from the row of the buffer given by the y of the rectangle,
+// so the offset into the shared memory is 0, not that of row y.
 
-    //---------------------------------------------------------------------
+static void
+writeSharedRowsImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_RESOURCE_HANDLE_T resource,
+    int32_t y,
+    int32_t numberOfRows)
+{
+    uint8_t *rows = (uint8_t *)(il->image.buffer) + (y * il->image.pitch);
+
+    struct vcsm_user_clean_invalid_s clean;
+    memset(&clean, 0, sizeof(clean));
+
+    clean.s[0].cmd = IMAGE_LAYER_VCSM_CLEAN;
+    clean.s[0].handle = il->sharedMemory;
+    clean.s[0].addr = (uintptr_t)rows;
+    clean.s[0].size = numberOfRows * il->image.pitch;
+
+    int result = vcsm_clean_invalid(&clean);
+    assert(result == 0);
+
+    VC_RECT_T rect;
+    vc_dispmanx_rect_set(&rect, 0, y, il->image.width, numberOfRows);
+
+    result = vc_dispmanx_resource_write_data_handle(
+                 resource,
+                 il->image.type,
+                 il->image.pitch,
+                 vcsm_vc_hdl_from_hdl(il->sharedMemory),
+                 0,
+                 &rect);
+    assert(result == 0);
+}
+
+//-------------------------------------------------------------------------
+
+// Write the rows in dirty (and lastDirty if it is not NULL) from buffer
+// to resource. write_data ignores the x offset of the rectangle and reads
+// from the row given by its y offset, so each band is written as whole
+// rows from the start of the buffer.
+
+static void
+writeDirtyImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_RESOURCE_HANDLE_T resource,
+    void *buffer,
+    const IMAGE_DIRTY_T *dirty,
+    const IMAGE_DIRTY_T *lastDirty)
+{
+    VC_RECT_T rects[2 * IMAGE_DIRTY_MAX_RECTS];
+    int32_t numberOfRects = dirty->numberOfRects;
+
+    memcpy(rects, dirty->rects, numberOfRects * sizeof(rects[0]));
+
+    if (lastDirty != NULL)
+    {
+        memcpy(rects + numberOfRects,
+               lastDirty->rects,
+               lastDirty->numberOfRects * sizeof(rects[0]));
+        numberOfRects += lastDirty->numberOfRects;
+    }
+
+    qsort(rects, numberOfRects, sizeof(rects[0]), compareDirtyRects);
+
+    int32_t i = 0;
+    while (i < numberOfRects)
+    {
+        int32_t y1 = rects[i].y;
+        int32_t y2 = y1 + rects[i].height;
+        i++;
+
+        while ((i < numberOfRects) && (rects[i].y <= y2))
+        {
+            if (rects[i].y + rects[i].height > y2)
+            {
+                y2 = rects[i].y + rects[i].height;
+            }
+            i++;
+        }
+
+        if ((il->sharedMemory != 0) && (buffer == il->image.buffer))
+        {
+            writeSharedRowsImageLayer(il, resource, y1, y2 - y1);
+            continue;
+        }
+
+        VC_RECT_T rect;
+        vc_dispmanx_rect_set(&rect, 0, y1, il->image.width, y2 - y1);
+
+        int result = vc_dispmanx_resource_write_data(resource,
+                                                     il->image.type,
+                                                     il->image.pitch,
+                                                     buffer,
+                                                     &rect);
+        assert(result == 0);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+changeRectsImageLayer(
+    DISPMANX_ELEMENT_HANDLE_T element,
+    uint32_t changeFlags,
+    const VC_RECT_T *srcRect,
+    const VC_RECT_T *dstRect,
+    DISPMANX_TRANSFORM_T transform,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int result =
+    vc_dispmanx_element_change_attributes(update,
+                                          element,
+                                          changeFlags,
+                                          0,
+                                          255,
+                                          dstRect,
+                                          srcRect,
+                                          0,
+                                          transform);
+    assert(result == 0);
+}
+
+//-------------------------------------------------------------------------
+
+// Change the source of the element, along with the source rectangle if
+// setSourceSizeImageLayer() has changed it since the last time.
+
+static void
+changeSourceRectImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int result = vc_dispmanx_element_change_source(update,
+                                                   il->element,
+                                                   il->resource);
+    assert(result == 0);
+
+    if (il->srcRectChanged)
+    {
+        changeRectsImageLayer(il->element,
+                              ELEMENT_CHANGE_SRC_RECT,
+                              &(il->srcRect),
+                              &(il->dstRect),
+                              il->transform,
+                              update);
+
+        il->srcRectChanged = false;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Write the changed rows to the resource that is not on screen (the only
+// resource if the layer is single buffered) and make it il->resource.
+
+static void
+writeDataImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    IMAGE_DIRTY_T dirty;
+    takeDirtyImageLayer(il, &dirty);
+
+    if (il->backResource == 0)
+    {
+        writeDirtyImageLayer(il, il->resource, il->image.buffer, &dirty, NULL);
+
+        return;
+    }
+
+    writeDirtyImageLayer(il,
+                         il->backResource,
+                         il->image.buffer,
+                         &dirty,
+                         &(il->lastDirty));
+    il->lastDirty = dirty;
+
+    DISPMANX_RESOURCE_HANDLE_T tmp = il->resource;
+    il->resource = il->backResource;
+    il->backResource = tmp;
+}
+
+//-------------------------------------------------------------------------
+
+static DISPMANX_RESOURCE_HANDLE_T
+createResource(
+    IMAGE_LAYER_T *il)
+{
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(IMAGE_LAYER_ACCOUNT));
+
+    DISPMANX_RESOURCE_HANDLE_T resource =
+        acquireResourcePool(il->image.type,
+                            il->image.width,
+                            il->image.height,
+                            il->image.pitch,
+                            il->image.alignedHeight);
+
+    leaveMemoryAccount(previous);
+
+    return resource;
+}
+
+//-------------------------------------------------------------------------
+
+static DISPMANX_RESOURCE_HANDLE_T
+createAndWriteResourceImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    DISPMANX_RESOURCE_HANDLE_T resource = createResource(il);
+
+    int result = vc_dispmanx_resource_write_data(resource,
+                                                 il->image.type,
+                                                 il->image.pitch,
+                                                 il->image.buffer,
+                                                 &(il->bmpRect));
+    assert(result == 0);
+
+    return resource;
+}
+
+//-------------------------------------------------------------------------
+
+void
+createEmptyResourceImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t layer)
+{
+    il->layer = layer;
+    il->backResource = 0;
+    il->element = 0;
+    il->lastDirty.numberOfRects = 0;
+    il->upload = NULL;
+    il->sharedMemory = 0;
+    il->transform = DISPMANX_NO_ROTATE;
+    il->destWidth = 0;
+    il->destHeight = 0;
+    il->srcRectChanged = false;
+    il->sharedResource = false;
 
     vc_dispmanx_rect_set(&(il->bmpRect),
                          0,
@@ -72,16 +401,463 @@ createResourceImageLayer(
                          il->image.width,
                          il->image.height);
 
-    result = vc_dispmanx_resource_write_data(il->resource,
-                                             il->image.type,
-                                             il->image.pitch,
-                                             il->image.buffer,
-                                             &(il->bmpRect));
+    il->dstRect = il->bmpRect;
+
+    il->resource = createResource(il);
+}
+
+//-------------------------------------------------------------------------
+
+void
+createResourceImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t layer)
+{
+    createEmptyResourceImageLayer(il, layer);
+
+    int result = vc_dispmanx_resource_write_data(il->resource,
+                                                 il->image.type,
+                                                 il->image.pitch,
+                                                 il->image.buffer,
+                                                 &(il->bmpRect));
+    assert(result == 0);
+
+    clearDirtyImage(&(il->image));
+}
+
+//-------------------------------------------------------------------------
+
+void
+writeRowsImageLayer(
+    IMAGE_LAYER_T *il,
+    const void *rows,
+    int32_t y,
+    int32_t numberOfRows)
+{
+    // write_data reads the rows of the rectangle from the source address
+    // plus y * pitch, so the rows are passed offset back by y.
+
+    VC_RECT_T rect;
+    vc_dispmanx_rect_set(&rect, 0, y, il->image.width, numberOfRows);
+
+    DISPMANX_RESOURCE_HANDLE_T resource = il->resource;
+
+    if (il->backResource != 0)
+    {
+        resource = il->backResource;
+    }
+
+    int result =
+        vc_dispmanx_resource_write_data(resource,
+                                        il->image.type,
+                                        il->image.pitch,
+                                        (uint8_t *)rows - (y * il->image.pitch),
+                                        &rect);
+    assert(result == 0);
+}
+
+//-------------------------------------------------------------------------
+
+void
+createDoubleBufferedResourceImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t layer)
+{
+    createResourceImageLayer(il, layer);
+    il->backResource = createAndWriteResourceImageLayer(il);
+}
+
+//-------------------------------------------------------------------------
+
+void
+createBackResourceImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    il->backResource = createResource(il);
+}
+
+//-------------------------------------------------------------------------
+
+void
+swapResourceImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    assert(il->backResource != 0);
+
+    DISPMANX_RESOURCE_HANDLE_T tmp = il->resource;
+    il->resource = il->backResource;
+    il->backResource = tmp;
+
+    changeSourceRectImageLayer(il, update);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+initSharedMemory(void)
+{
+    sharedMemoryAvailable = (vcsm_init() == 0);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+freeSharedMemoryImage(
+    IMAGE_T *image)
+{
+    unsigned int handle = vcsm_usr_handle(image->buffer);
+
+    vcsm_unlock_hdl(handle);
+    vcsm_free(handle);
+
+    chargeGpuMemoryAccount(findMemoryAccount(IMAGE_LAYER_ACCOUNT),
+                           -(int64_t)(image->size),
+                           0);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+enableSharedMemoryImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    pthread_once(&sharedMemoryOnce, initSharedMemory);
+
+    if ((sharedMemoryAvailable == false) ||
+        (il->image.buffer == NULL) ||
+        (il->sharedMemory != 0))
+    {
+        return false;
+    }
+
+    unsigned int handle = vcsm_malloc_cache(il->image.size,
+                                            VCSM_CACHE_TYPE_HOST,
+                                            "raspidmx");
+
+    if (handle == 0)
+    {
+        return false;
+    }
+
+    void *buffer = vcsm_lock(handle);
+
+    if (buffer == NULL)
+    {
+        vcsm_free(handle);
+        return false;
+    }
+
+    memcpy(buffer, il->image.buffer, il->image.size);
+
+    if (il->image.freeBuffer != NULL)
+    {
+        il->image.freeBuffer(&(il->image));
+    }
+    else
+    {
+        free(il->image.buffer);
+    }
+
+    il->image.buffer = buffer;
+    il->image.freeBuffer = freeSharedMemoryImage;
+    il->sharedMemory = handle;
+
+    chargeGpuMemoryAccount(findMemoryAccount(IMAGE_LAYER_ACCOUNT),
+                           il->image.size,
+                           0);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+updateCallbackImageLayer(
+    DISPMANX_UPDATE_HANDLE_T update,
+    void *arg)
+{
+    IMAGE_LAYER_UPLOAD_T *upload = arg;
+
+    pthread_mutex_lock(&(upload->mutex));
+    upload->updatePending = false;
+    pthread_cond_broadcast(&(upload->condition));
+    pthread_mutex_unlock(&(upload->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+static void *
+uploadThreadImageLayer(
+    void *arg)
+{
+    IMAGE_LAYER_T *il = arg;
+    IMAGE_LAYER_UPLOAD_T *upload = il->upload;
+
+    pthread_mutex_lock(&(upload->mutex));
+
+    for (;;)
+    {
+        while ((upload->queued == false) && (upload->quit == false))
+        {
+            pthread_cond_wait(&(upload->condition), &(upload->mutex));
+        }
+
+        if (upload->queued == false)
+        {
+            break;
+        }
+
+        // The back resource is on screen until the last update has been
+        // applied. More rows may be queued in the meantime.
+
+        while (upload->updatePending)
+        {
+            pthread_cond_wait(&(upload->condition), &(upload->mutex));
+        }
+
+        IMAGE_DIRTY_T dirty = upload->dirty;
+        VC_RECT_T srcRect = upload->srcRect;
+        VC_RECT_T dstRect = upload->dstRect;
+        DISPMANX_TRANSFORM_T transform = upload->transform;
+        bool srcRectChanged = upload->srcRectChanged;
+        upload->queued = false;
+        upload->srcRectChanged = false;
+        upload->writing = true;
+
+        pthread_mutex_unlock(&(upload->mutex));
+
+        //-----------------------------------------------------------------
+
+        writeDirtyImageLayer(il,
+                             il->backResource,
+                             upload->buffer,
+                             &dirty,
+                             &(upload->lastDirty));
+        upload->lastDirty = dirty;
+
+        DISPMANX_RESOURCE_HANDLE_T tmp = il->resource;
+        il->resource = il->backResource;
+        il->backResource = tmp;
+
+        DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+        assert(update != 0);
+
+        int result = vc_dispmanx_element_change_source(update,
+                                                       il->element,
+                                                       il->resource);
+        assert(result == 0);
+
+        if (srcRectChanged)
+        {
+            changeRectsImageLayer(il->element,
+                                  ELEMENT_CHANGE_SRC_RECT,
+                                  &srcRect,
+                                  &dstRect,
+                                  transform,
+                                  update);
+        }
+
+        //-----------------------------------------------------------------
+
+        pthread_mutex_lock(&(upload->mutex));
+        upload->writing = false;
+        upload->updatePending = true;
+        pthread_cond_broadcast(&(upload->condition));
+        pthread_mutex_unlock(&(upload->mutex));
+
+        result = vc_dispmanx_update_submit(update,
+                                           updateCallbackImageLayer,
+                                           upload);
+        assert(result == 0);
+
+        pthread_mutex_lock(&(upload->mutex));
+    }
+
+    while (upload->updatePending)
+    {
+        pthread_cond_wait(&(upload->condition), &(upload->mutex));
+    }
+
+    pthread_mutex_unlock(&(upload->mutex));
+
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+
+void
+startUploadThreadImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    if (il->backResource == 0)
+    {
+        il->backResource = createAndWriteResourceImageLayer(il);
+        il->lastDirty.numberOfRects = 0;
+    }
+
+    IMAGE_LAYER_UPLOAD_T *upload = calloc(1, sizeof(IMAGE_LAYER_UPLOAD_T));
+
+    if (upload != NULL)
+    {
+        upload->buffer = malloc(il->image.size);
+    }
+
+    if ((upload == NULL) || (upload->buffer == NULL))
+    {
+        fprintf(stderr, "imageLayer: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(upload->buffer, il->image.buffer, il->image.size);
+    upload->lastDirty = il->lastDirty;
+
+    pthread_mutex_init(&(upload->mutex), NULL);
+    pthread_cond_init(&(upload->condition), NULL);
+
+    il->upload = upload;
+
+    int result = pthread_create(&(upload->thread),
+                                NULL,
+                                uploadThreadImageLayer,
+                                il);
     assert(result == 0);
 }
 
 //-------------------------------------------------------------------------
 
+static void
+queueUploadImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    IMAGE_LAYER_UPLOAD_T *upload = il->upload;
+
+    IMAGE_DIRTY_T dirty;
+    takeDirtyImageLayer(il, &dirty);
+
+    pthread_mutex_lock(&(upload->mutex));
+
+    while (upload->writing)
+    {
+        pthread_cond_wait(&(upload->condition), &(upload->mutex));
+    }
+
+    if (upload->queued == false)
+    {
+        upload->dirty.numberOfRects = 0;
+    }
+
+    int32_t i;
+    for (i = 0 ; i < dirty.numberOfRects ; i++)
+    {
+        VC_RECT_T *rect = &(dirty.rects[i]);
+        size_t offset = rect->y * il->image.pitch;
+
+        memcpy((uint8_t *)(upload->buffer) + offset,
+               (uint8_t *)(il->image.buffer) + offset,
+               rect->height * il->image.pitch);
+
+        addDirtyRect(&(upload->dirty), rect);
+    }
+
+    if (il->srcRectChanged)
+    {
+        upload->srcRect = il->srcRect;
+        upload->dstRect = il->dstRect;
+        upload->transform = il->transform;
+        upload->srcRectChanged = true;
+        il->srcRectChanged = false;
+    }
+
+    upload->queued = true;
+    pthread_cond_broadcast(&(upload->condition));
+    pthread_mutex_unlock(&(upload->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+void
+waitForUploadImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    IMAGE_LAYER_UPLOAD_T *upload = il->upload;
+
+    if (upload == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&(upload->mutex));
+
+    while (upload->queued || upload->writing || upload->updatePending)
+    {
+        pthread_cond_wait(&(upload->condition), &(upload->mutex));
+    }
+
+    pthread_mutex_unlock(&(upload->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+static void
+stopUploadThreadImageLayer(
+    IMAGE_LAYER_T *il)
+{
+    IMAGE_LAYER_UPLOAD_T *upload = il->upload;
+
+    pthread_mutex_lock(&(upload->mutex));
+    upload->quit = true;
+    pthread_cond_broadcast(&(upload->condition));
+    pthread_mutex_unlock(&(upload->mutex));
+
+    pthread_join(upload->thread, NULL);
+
+    pthread_cond_destroy(&(upload->condition));
+    pthread_mutex_destroy(&(upload->mutex));
+
+    free(upload->buffer);
+    free(upload);
+
+    il->upload = NULL;
+}
+
+//-------------------------------------------------------------------------
+
+// Set dstRect to the destination size at (x, y). With no destination
+// size set, that is the size of the image, turned on its side by a 90 or
+// 270 degree rotation.
+
+static void
+setDestRectImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t x,
+    int32_t y)
+{
+    int32_t width = il->destWidth;
+    int32_t height = il->destHeight;
+
+    if ((width <= 0) || (height <= 0))
+    {
+        int32_t rotation = il->transform & IMAGE_LAYER_ROTATION_MASK;
+
+        if ((rotation == DISPMANX_ROTATE_90) ||
+            (rotation == DISPMANX_ROTATE_270))
+        {
+            width = il->image.height;
+            height = il->image.width;
+        }
+        else
+        {
+            width = il->image.width;
+            height = il->image.height;
+        }
+    }
+
+    vc_dispmanx_rect_set(&(il->dstRect), x, y, width, height);
+}
+
+//-------------------------------------------------------------------------
+
 void
 addElementImageLayerOffset(
     IMAGE_LAYER_T *il,
@@ -96,11 +872,7 @@ addElementImageLayerOffset(
                          il->image.width << 16,
                          il->image.height << 16);
 
-    vc_dispmanx_rect_set(&(il->dstRect),
-                         xOffset,
-                         yOffset,
-                         il->image.width,
-                         il->image.height);
+    setDestRectImageLayer(il, xOffset, yOffset);
 
     addElementImageLayer(il, display, update);
 }
@@ -120,11 +892,10 @@ addElementImageLayerCentered(
                          il->image.width << 16,
                          il->image.height << 16);
 
-    vc_dispmanx_rect_set(&(il->dstRect),
-                         (info->width - il->image.width) / 2,
-                         (info->height - il->image.height) / 2,
-                         il->image.width,
-                         il->image.height);
+    setDestRectImageLayer(il, 0, 0);
+
+    il->dstRect.x = (info->width - il->dstRect.width) / 2;
+    il->dstRect.y = (info->height - il->dstRect.height) / 2;
 
     addElementImageLayer(il, display, update);
 }
@@ -154,7 +925,7 @@ addElementImageLayer(
                                 DISPMANX_PROTECTION_NONE,
                                 &alpha,
                                 NULL, // clamp
-                                DISPMANX_NO_ROTATE);
+                                il->transform);
     assert(il->element != 0);
 }
 
@@ -165,18 +936,10 @@ changeSourceImageLayer(
     IMAGE_LAYER_T *il,
     DISPMANX_UPDATE_HANDLE_T update)
 {
-    int result = vc_dispmanx_resource_write_data(il->resource,
-                                                 il->image.type,
-                                                 il->image.pitch,
-                                                 il->image.buffer,
-                                                 &(il->bmpRect));
-    assert(result == 0);
-
-    result = vc_dispmanx_element_change_source(update,
-                                               il->element,
-                                               il->resource);
-    assert(result == 0);
+    assert(il->upload == NULL);
 
+    writeDataImageLayer(il);
+    changeSourceRectImageLayer(il, update);
 }
 
 //-------------------------------------------------------------------------
@@ -185,24 +948,47 @@ void
 changeSourceAndUpdateImageLayer(
     IMAGE_LAYER_T *il)
 {
-    int result = vc_dispmanx_resource_write_data(il->resource,
-                                                 il->image.type,
-                                                 il->image.pitch,
-                                                 il->image.buffer,
-                                                 &(il->bmpRect));
-    assert(result == 0);
+    if (il->upload != NULL)
+    {
+        queueUploadImageLayer(il);
+
+        return;
+    }
+
+    writeDataImageLayer(il);
 
     DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
     assert(update != 0);
 
-    result = vc_dispmanx_element_change_source(update,
-                                               il->element,
-                                               il->resource);
-    assert(result == 0);
+    changeSourceRectImageLayer(il, update);
 
-    result = vc_dispmanx_update_submit_sync(update);
+    int result = vc_dispmanx_update_submit_sync(update);
     assert(result == 0);
+}
+
+//-------------------------------------------------------------------------
+
+// Send the destination rectangle and transform to the element, if it has
+// been added. The opacity and layer are left alone as they are not in
+// changeFlags.
+
+static void
+changeDestinationImageLayer(
+    IMAGE_LAYER_T *il,
+    uint32_t changeFlags,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    if (il->element == 0)
+    {
+        return;
+    }
 
+    changeRectsImageLayer(il->element,
+                          changeFlags,
+                          &(il->srcRect),
+                          &(il->dstRect),
+                          il->transform,
+                          update);
 }
 
 //-------------------------------------------------------------------------
@@ -214,23 +1000,99 @@ moveImageLayer(
     int32_t yOffset,
     DISPMANX_UPDATE_HANDLE_T update)
 {
-    vc_dispmanx_rect_set(&(il->dstRect),
-                         xOffset,
-                         yOffset,
-                         il->image.width,
-                         il->image.height);
+    il->dstRect.x = xOffset;
+    il->dstRect.y = yOffset;
 
-    int result =
-    vc_dispmanx_element_change_attributes(update,
-                                          il->element,
-                                          ELEMENT_CHANGE_DEST_RECT,
-                                          0,
-                                          255,
-                                          &(il->dstRect),
-                                          &(il->srcRect),
-                                          0,
-                                          DISPMANX_NO_ROTATE);
+    changeDestinationImageLayer(il, ELEMENT_CHANGE_DEST_RECT, update);
+}
+
+//-------------------------------------------------------------------------
+
+void
+setDestinationImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t xOffset,
+    int32_t yOffset,
+    int32_t width,
+    int32_t height,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    il->destWidth = width;
+    il->destHeight = height;
+
+    setDestRectImageLayer(il, xOffset, yOffset);
+
+    changeDestinationImageLayer(il, ELEMENT_CHANGE_DEST_RECT, update);
+}
+
+//-------------------------------------------------------------------------
+
+void
+setSourceSizeImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t width,
+    int32_t height)
+{
+    vc_dispmanx_rect_set(&(il->srcRect),
+                         0 << 16,
+                         0 << 16,
+                         width << 16,
+                         height << 16);
+
+    il->srcRectChanged = true;
+}
+
+//-------------------------------------------------------------------------
+
+void
+setTransformImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_TRANSFORM_T transform,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    il->transform = transform;
+
+    setDestRectImageLayer(il, il->dstRect.x, il->dstRect.y);
+
+    changeDestinationImageLayer(il,
+                                ELEMENT_CHANGE_DEST_RECT |
+                                ELEMENT_CHANGE_TRANSFORM,
+                                update);
+}
+
+//-------------------------------------------------------------------------
+
+void
+removeElementImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int result = vc_dispmanx_element_remove(update, il->element);
     assert(result == 0);
+
+    il->element = 0;
+}
+
+//-------------------------------------------------------------------------
+
+void
+shareImageLayer(
+    IMAGE_LAYER_T *il,
+    const IMAGE_LAYER_T *source)
+{
+    *il = *source;
+
+    il->image.buffer = NULL;
+    il->image.dirty = NULL;
+    il->image.freeBuffer = NULL;
+    il->dirty.numberOfRects = 0;
+    il->lastDirty.numberOfRects = 0;
+    il->backResource = 0;
+    il->element = 0;
+    il->upload = NULL;
+    il->sharedMemory = 0;
+    il->srcRectChanged = false;
+    il->sharedResource = true;
 }
 
 //-------------------------------------------------------------------------
@@ -241,17 +1103,34 @@ destroyImageLayer(
 {
     int result = 0;
 
-    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
-    assert(update != 0);
-    result = vc_dispmanx_element_remove(update, il->element);
-    assert(result == 0);
-    result = vc_dispmanx_update_submit_sync(update);
-    assert(result == 0);
+    if (il->upload != NULL)
+    {
+        stopUploadThreadImageLayer(il);
+    }
+
+    if (il->element != 0)
+    {
+        DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+        assert(update != 0);
+        removeElementImageLayer(il, update);
+        result = vc_dispmanx_update_submit_sync(update);
+        assert(result == 0);
+    }
 
     //---------------------------------------------------------------------
 
-    result = vc_dispmanx_resource_delete(il->resource);
-    assert(result == 0);
+    if (il->sharedResource)
+    {
+        il->resource = 0;
+        return;
+    }
+
+    releaseResourcePool(il->resource);
+
+    if (il->backResource != 0)
+    {
+        releaseResourcePool(il->backResource);
+    }
 
     //---------------------------------------------------------------------
 
@@ -28,21 +28,79 @@
 #ifndef IMAGE_LAYER_H
 #define IMAGE_LAYER_H
 
+#include <pthread.h>
+#include <stdbool.h>
+
 #include "image.h"
 
 #include "bcm_host.h"
 
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// The memory account that image layers charge their buffers and
+// resources to.
+
+#define IMAGE_LAYER_ACCOUNT "imageLayer"
+
 //-------------------------------------------------------------------------
 
+// State shared between the rendering thread and the upload thread. The
+// rendering thread copies the rows it has changed into buffer; the upload
+// thread writes them to the back resource and makes it the source.
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    void *buffer;
+    IMAGE_DIRTY_T dirty;
+    IMAGE_DIRTY_T lastDirty;
+    bool queued;
+    bool writing;
+    bool updatePending;
+    bool quit;
+    VC_RECT_T srcRect;
+    VC_RECT_T dstRect;
+    DISPMANX_TRANSFORM_T transform;
+    bool srcRectChanged;
+} IMAGE_LAYER_UPLOAD_T;
+
+//-------------------------------------------------------------------------
+
+// resource is the resource that is (or is about to be) on screen. If the
+// layer is double buffered, updates are written to backResource, which is
+// then swapped with resource. lastDirty holds the rows of the previous
+// update, as the back resource has not seen those yet. sharedMemory is the
+// VideoCore shared memory handle of the image buffer, or 0. The element
+// is drawn with transform, at destWidth x destHeight if they are set and
+// at the size of the image otherwise, so that the display scales, turns
+// and flips the image rather than the CPU. srcRectChanged is set when
+// srcRect is waiting to go out with the next change of source.
+// sharedResource is set for a layer that shows the resource of another
+// (see shareImageLayer()), which it neither draws into nor releases.
+
 typedef struct
 {
     IMAGE_T image;
+    IMAGE_DIRTY_T dirty;
+    IMAGE_DIRTY_T lastDirty;
     VC_RECT_T bmpRect;
     VC_RECT_T srcRect;
     VC_RECT_T dstRect;
     int32_t layer;
     DISPMANX_RESOURCE_HANDLE_T resource;
+    DISPMANX_RESOURCE_HANDLE_T backResource;
     DISPMANX_ELEMENT_HANDLE_T element;
+    IMAGE_LAYER_UPLOAD_T *upload;
+    unsigned int sharedMemory;
+    DISPMANX_TRANSFORM_T transform;
+    int32_t destWidth;
+    int32_t destHeight;
+    bool srcRectChanged;
+    bool sharedResource;
 } IMAGE_LAYER_T;
 
 //-------------------------------------------------------------------------
@@ -54,11 +112,88 @@ initImageLayer(
     int32_t height,
     VC_IMAGE_TYPE_T type);
 
+// Keep a list of the rows drawn on since the last upload, so that
+// changing the source only writes those rows to the resource. Code that
+// writes to image.buffer directly must call markDirtyImage() itself.
+
+void
+enableDirtyImageLayer(
+    IMAGE_LAYER_T *il);
+
 void
 createResourceImageLayer(
     IMAGE_LAYER_T *il,
     int32_t layer);
 
+// As createResourceImageLayer(), but nothing is written to the resource.
+// The image may have no buffer; the caller fills the resource in.
+
+void
+createEmptyResourceImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t layer);
+
+// Write numberOfRows rows of pixels, laid out with the pitch of the
+// image, to the resource starting at row y. If the layer has a back
+// resource the rows are written there instead.
+
+void
+writeRowsImageLayer(
+    IMAGE_LAYER_T *il,
+    const void *rows,
+    int32_t y,
+    int32_t numberOfRows);
+
+// As createResourceImageLayer(), but with a second resource so that an
+// update never writes to the resource that is on screen.
+
+void
+createDoubleBufferedResourceImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t layer);
+
+// Give a layer a second resource, left empty, for a caller that fills
+// each new image in with writeRowsImageLayer() and then puts it on
+// screen with swapResourceImageLayer(). The image need not have a buffer.
+
+void
+createBackResourceImageLayer(
+    IMAGE_LAYER_T *il);
+
+// Swap the back resource with the one on screen and make it the source
+// of the element as part of update.
+
+void
+swapResourceImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+// Move the image into VideoCore shared memory, which the CPU draws into
+// as before. Changed rows are then flushed from the CPU cache and copied
+// into the resource by the VideoCore, rather than being sent across to
+// it. Call after the resource has been created. Returns false, leaving
+// the layer as it was, if there is no shared memory (no vcsm driver).
+
+bool
+enableSharedMemoryImageLayer(
+    IMAGE_LAYER_T *il);
+
+// Hand uploads to a background thread. Once started, the layer is double
+// buffered and changeSourceAndUpdateImageLayer() copies the changed rows
+// to a staging buffer and returns without waiting for the resource write
+// or the update. Updates queued faster than the display applies them are
+// merged. Call after the element has been added.
+
+void
+startUploadThreadImageLayer(
+    IMAGE_LAYER_T *il);
+
+// Block until everything queued for the upload thread is on screen.
+
+void
+waitForUploadImageLayer(
+    IMAGE_LAYER_T *il);
+
 void
 addElementImageLayerOffset(
     IMAGE_LAYER_T *il,
@@ -80,6 +215,9 @@ addElementImageLayer(
     DISPMANX_DISPLAY_HANDLE_T display,
     DISPMANX_UPDATE_HANDLE_T update);
 
+// Write the image to the resource and change the source of the element
+// as part of update. Not for use with an upload thread.
+
 void
 changeSourceImageLayer(
     IMAGE_LAYER_T *il,
@@ -89,6 +227,8 @@ void
 changeSourceAndUpdateImageLayer(
     IMAGE_LAYER_T *il);
 
+// Move the element, keeping its size on screen.
+
 void
 moveImageLayer(
     IMAGE_LAYER_T *il,
@@ -96,9 +236,71 @@ moveImageLayer(
     int32_t yOffset,
     DISPMANX_UPDATE_HANDLE_T update);
 
+// Show the image scaled to width x height with its top left corner at
+// (xOffset, yOffset). A width or height of 0 goes back to the size of the
+// image. Can be called before the element is added, with an update of 0,
+// to set the size that it is added at; addElementImageLayerOffset() and
+// addElementImageLayerCentered() then only choose the position.
+
+void
+setDestinationImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t xOffset,
+    int32_t yOffset,
+    int32_t width,
+    int32_t height,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+// Show only the top left width x height of the image, scaled up to fill
+// the destination rectangle, which stays as it is. This lets a program
+// draw at a lower resolution when it is short of time and have the
+// display scale it up. The new source rectangle goes out with the next
+// change of source, so that it always matches the pixels on screen. Call
+// after the element has been added.
+
+void
+setSourceSizeImageLayer(
+    IMAGE_LAYER_T *il,
+    int32_t width,
+    int32_t height);
+
+// Rotate the image by DISPMANX_ROTATE_90, _180 or _270, or'ed with
+// DISPMANX_FLIP_HRIZ and DISPMANX_FLIP_VERT as wanted, keeping its top
+// left corner where it is. With no destination size set, a quarter turn
+// swaps the width and height on screen. As with setDestinationImageLayer(),
+// this can be called before the element is added.
+
+void
+setTransformImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_TRANSFORM_T transform,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+// Remove the element as part of update. Once the update has been applied,
+// destroyImageLayer() has no element left to remove and does not need an
+// update of its own.
+
+void
+removeElementImageLayer(
+    IMAGE_LAYER_T *il,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+// Make il a second view of the resource of source, so that an image is
+// decoded and held in GPU memory once however many displays it is shown
+// on. il has the size and geometry of source, but no image buffer and no
+// element until one is added. source must not change its resource while
+// il is shown, and must outlive it; destroyImageLayer() leaves the
+// resource alone.
+
+void
+shareImageLayer(
+    IMAGE_LAYER_T *il,
+    const IMAGE_LAYER_T *source);
 
 void destroyImageLayer(IMAGE_LAYER_T *il);
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
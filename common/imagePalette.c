@@ -27,7 +27,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "frameLoop.h"
+#include "imageConvert.h"
 #include "imagePalette.h"
 
 //-------------------------------------------------------------------------
@@ -36,6 +39,10 @@
 #define ALIGN_TO_16(x)  ((x + 15) & ~15)
 #endif
 
+// Runs of changed entries closer than this are uploaded together.
+
+#define PALETTE_ANIMATION_GAP 16
+
 //-------------------------------------------------------------------------
 
 bool
@@ -100,13 +107,9 @@ palette16EntryToRgb(
     uint16_t entry,
     RGBA8_T *rgb)
 {
-    uint8_t r5 = (entry >> 11) & 0x1F;
-    uint8_t g6 = (entry >> 5) & 0x3F;
-    uint8_t b5 = entry & 0x1F;
-
-    rgb->red = (r5 << 3) | (r5 >> 2);
-    rgb->green = (g6 << 2) | (g6 >> 4);
-    rgb->blue = (b5 << 3) | (b5 >> 2);
+    rgb->red = imageConvertExpand5[(entry >> 11) & 0x1F];
+    rgb->green = imageConvertExpand6[(entry >> 5) & 0x3F];
+    rgb->blue = imageConvertExpand5[entry & 0x1F];
     rgb->alpha = 255;
 }
 
@@ -282,3 +285,418 @@ destroyImagePalette32(
 }
 
 //-------------------------------------------------------------------------
+
+bool
+initPaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t length,
+    int16_t bitsPerEntry)
+{
+    if ((length <= 0) || ((bitsPerEntry != 16) && (bitsPerEntry != 32)))
+    {
+        return false;
+    }
+
+    animation->length = length;
+    animation->bitsPerEntry = bitsPerEntry;
+    animation->colours = calloc(length, sizeof(RGBA8_T));
+    animation->entries = calloc(length, bitsPerEntry / 8);
+    animation->uploaded = calloc(length, bitsPerEntry / 8);
+    animation->uploadedValid = false;
+    animation->numberOfCycles = 0;
+    animation->numberOfFades = 0;
+
+    if ((animation->colours == NULL) ||
+        (animation->entries == NULL) ||
+        (animation->uploaded == NULL))
+    {
+        fprintf(stderr, "paletteAnimation: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+setEntryPaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t index,
+    const RGBA8_T *rgba)
+{
+    bool result = false;
+
+    if ((index >= 0) && (index < animation->length))
+    {
+        animation->colours[index] = *rgba;
+        result = true;
+    }
+
+    return result;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+addCyclePaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t first,
+    int16_t length,
+    int16_t step,
+    int32_t stepDuration)
+{
+    if ((animation->numberOfCycles == PALETTE_ANIMATION_MAX_CYCLES) ||
+        (first < 0) ||
+        (length <= 0) ||
+        (first + length > animation->length) ||
+        (stepDuration < 0))
+    {
+        return false;
+    }
+
+    PALETTE_CYCLE_T *cycle = &(animation->cycles[animation->numberOfCycles]);
+
+    cycle->first = first;
+    cycle->length = length;
+    cycle->step = step;
+    cycle->stepDuration = stepDuration;
+    cycle->start = nowMicrosecondsFrameLoop();
+    cycle->updates = 0;
+
+    ++(animation->numberOfCycles);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+addFadePaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t first,
+    int16_t length,
+    const RGBA8_T *to,
+    int32_t duration)
+{
+    if ((animation->numberOfFades == PALETTE_ANIMATION_MAX_FADES) ||
+        (first < 0) ||
+        (length <= 0) ||
+        (first + length > animation->length) ||
+        (duration < 0))
+    {
+        return false;
+    }
+
+    PALETTE_FADE_T *fade = &(animation->fades[animation->numberOfFades]);
+
+    fade->first = first;
+    fade->length = length;
+    fade->from = malloc(length * sizeof(RGBA8_T));
+    fade->to = malloc(length * sizeof(RGBA8_T));
+    fade->duration = duration;
+    fade->start = nowMicrosecondsFrameLoop();
+
+    if ((fade->from == NULL) || (fade->to == NULL))
+    {
+        fprintf(stderr, "paletteAnimation: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(fade->from, &(animation->colours[first]), length * sizeof(RGBA8_T));
+    memcpy(fade->to, to, length * sizeof(RGBA8_T));
+
+    ++(animation->numberOfFades);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+removeFadePaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t index)
+{
+    PALETTE_FADE_T *fade = &(animation->fades[index]);
+
+    free(fade->from);
+    free(fade->to);
+
+    --(animation->numberOfFades);
+    *fade = animation->fades[animation->numberOfFades];
+}
+
+//-------------------------------------------------------------------------
+
+void
+stopPaletteAnimation(
+    PALETTE_ANIMATION_T *animation)
+{
+    while (animation->numberOfFades > 0)
+    {
+        removeFadePaletteAnimation(animation, animation->numberOfFades - 1);
+    }
+
+    animation->numberOfCycles = 0;
+}
+
+//-------------------------------------------------------------------------
+
+static uint8_t
+blendChannelPaletteAnimation(
+    uint8_t from,
+    uint8_t to,
+    int32_t numerator,
+    int32_t denominator)
+{
+    return from + ((((int32_t)to - from) * numerator) / denominator);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+fadePaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int64_t now)
+{
+    int16_t f = 0;
+    while (f < animation->numberOfFades)
+    {
+        PALETTE_FADE_T *fade = &(animation->fades[f]);
+        int64_t elapsed = (now - fade->start) / 1000;
+        RGBA8_T *colours = &(animation->colours[fade->first]);
+
+        if (elapsed >= fade->duration)
+        {
+            memcpy(colours, fade->to, fade->length * sizeof(RGBA8_T));
+            removeFadePaletteAnimation(animation, f);
+
+            continue;
+        }
+
+        int32_t numerator = elapsed;
+        int32_t denominator = fade->duration;
+
+        int16_t i;
+        for (i = 0 ; i < fade->length ; i++)
+        {
+            const RGBA8_T *from = &(fade->from[i]);
+            const RGBA8_T *to = &(fade->to[i]);
+
+            colours[i].red = blendChannelPaletteAnimation(from->red,
+                                                          to->red,
+                                                          numerator,
+                                                          denominator);
+            colours[i].green = blendChannelPaletteAnimation(from->green,
+                                                            to->green,
+                                                            numerator,
+                                                            denominator);
+            colours[i].blue = blendChannelPaletteAnimation(from->blue,
+                                                           to->blue,
+                                                           numerator,
+                                                           denominator);
+            colours[i].alpha = blendChannelPaletteAnimation(from->alpha,
+                                                            to->alpha,
+                                                            numerator,
+                                                            denominator);
+        }
+
+        ++f;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// The colour shown by entry index is the colour in the ring that the
+// first cycle covering index has rotated into it.
+
+static const RGBA8_T *
+colourPaletteAnimation(
+    const PALETTE_ANIMATION_T *animation,
+    const int32_t *offsets,
+    int16_t index)
+{
+    int16_t c;
+    for (c = 0 ; c < animation->numberOfCycles ; c++)
+    {
+        const PALETTE_CYCLE_T *cycle = &(animation->cycles[c]);
+        int32_t i = index - cycle->first;
+
+        if ((i >= 0) && (i < cycle->length))
+        {
+            i = (i - offsets[c]) % cycle->length;
+
+            if (i < 0)
+            {
+                i += cycle->length;
+            }
+
+            return &(animation->colours[cycle->first + i]);
+        }
+    }
+
+    return &(animation->colours[index]);
+}
+
+//-------------------------------------------------------------------------
+
+static int16_t
+uploadPaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    DISPMANX_RESOURCE_HANDLE_T resource,
+    int16_t first,
+    int16_t last)
+{
+    int16_t bytesPerEntry = animation->bitsPerEntry / 8;
+    int16_t length = last - first + 1;
+    uint8_t *src = (uint8_t *)(animation->entries) + (first * bytesPerEntry);
+
+    int result = vc_dispmanx_resource_set_palette(resource,
+                                                  src,
+                                                  first * bytesPerEntry,
+                                                  length * bytesPerEntry);
+    if (result != 0)
+    {
+        return 0;
+    }
+
+    memcpy((uint8_t *)(animation->uploaded) + (first * bytesPerEntry),
+           src,
+           length * bytesPerEntry);
+
+    return length;
+}
+
+//-------------------------------------------------------------------------
+
+int16_t
+updatePaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    DISPMANX_RESOURCE_HANDLE_T resource)
+{
+    int64_t now = nowMicrosecondsFrameLoop();
+
+    fadePaletteAnimation(animation, now);
+
+    int32_t offsets[PALETTE_ANIMATION_MAX_CYCLES];
+
+    int16_t c;
+    for (c = 0 ; c < animation->numberOfCycles ; c++)
+    {
+        PALETTE_CYCLE_T *cycle = &(animation->cycles[c]);
+        int64_t steps = cycle->updates;
+
+        if (cycle->stepDuration > 0)
+        {
+            steps = (now - cycle->start)
+                  / (cycle->stepDuration * INT64_C(1000));
+        }
+        else
+        {
+            ++(cycle->updates);
+        }
+
+        offsets[c] = (steps * cycle->step) % cycle->length;
+    }
+
+    //---------------------------------------------------------------------
+
+    uint16_t *entries16 = animation->entries;
+    uint32_t *entries32 = animation->entries;
+
+    int16_t i;
+    for (i = 0 ; i < animation->length ; i++)
+    {
+        const RGBA8_T *rgba = colourPaletteAnimation(animation, offsets, i);
+
+        if (animation->bitsPerEntry == 16)
+        {
+            entries16[i] = rgbToPalette16Entry(rgba);
+        }
+        else
+        {
+            entries32[i] = rgbaToPalette32Entry(rgba);
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    int16_t bytesPerEntry = animation->bitsPerEntry / 8;
+    int16_t uploads = 0;
+
+    if (animation->uploadedValid == false)
+    {
+        uploads = uploadPaletteAnimation(animation,
+                                         resource,
+                                         0,
+                                         animation->length - 1);
+        animation->uploadedValid = (uploads > 0);
+
+        return uploads;
+    }
+
+    // Upload each run of changed entries, joining runs that are close, as
+    // every upload is a round trip to the GPU.
+
+    const uint8_t *entries = animation->entries;
+    const uint8_t *uploaded = animation->uploaded;
+
+    int16_t first = -1;
+    int16_t last = -1;
+
+    for (i = 0 ; i <= animation->length ; i++)
+    {
+        bool changed = (i < animation->length) &&
+                       (memcmp(entries + (i * bytesPerEntry),
+                               uploaded + (i * bytesPerEntry),
+                               bytesPerEntry) != 0);
+
+        if (changed)
+        {
+            if ((first >= 0) && (i - last > PALETTE_ANIMATION_GAP))
+            {
+                uploads += uploadPaletteAnimation(animation,
+                                                  resource,
+                                                  first,
+                                                  last);
+                first = -1;
+            }
+
+            if (first < 0)
+            {
+                first = i;
+            }
+
+            last = i;
+        }
+    }
+
+    if (first >= 0)
+    {
+        uploads += uploadPaletteAnimation(animation, resource, first, last);
+    }
+
+    return uploads;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyPaletteAnimation(
+    PALETTE_ANIMATION_T *animation)
+{
+    stopPaletteAnimation(animation);
+
+    free(animation->colours);
+    animation->colours = NULL;
+    free(animation->entries);
+    animation->entries = NULL;
+    free(animation->uploaded);
+    animation->uploaded = NULL;
+
+    animation->length = 0;
+}
+
+//-------------------------------------------------------------------------
+
@@ -37,6 +37,8 @@
 
 #include "image.h"
 
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
 typedef struct 
@@ -133,4 +135,112 @@ destroyImagePalette32(
 
 //-------------------------------------------------------------------------
 
+// A palette animation holds the colours of a palette once, as a ring, and
+// works out what each entry of the resource palette should show from the
+// cycles and fades running on it. A cycle rotates a range of entries by
+// moving an offset into the ring, so no colours are moved. Fades blend a
+// range of colours towards new ones over time. updatePaletteAnimation()
+// is meant to be called once a frame; it uploads only the runs of entries
+// that differ from the last upload.
+
+#define PALETTE_ANIMATION_MAX_CYCLES 4
+#define PALETTE_ANIMATION_MAX_FADES 4
+
+typedef struct
+{
+    int16_t first;
+    int16_t length;
+    int16_t step;
+    int32_t stepDuration;
+    int64_t start;
+    int32_t updates;
+} PALETTE_CYCLE_T;
+
+typedef struct
+{
+    int16_t first;
+    int16_t length;
+    RGBA8_T *from;
+    RGBA8_T *to;
+    int32_t duration;
+    int64_t start;
+} PALETTE_FADE_T;
+
+typedef struct
+{
+    int16_t length;
+    int16_t bitsPerEntry;
+    RGBA8_T *colours;
+    void *entries;
+    void *uploaded;
+    bool uploadedValid;
+    PALETTE_CYCLE_T cycles[PALETTE_ANIMATION_MAX_CYCLES];
+    int16_t numberOfCycles;
+    PALETTE_FADE_T fades[PALETTE_ANIMATION_MAX_FADES];
+    int16_t numberOfFades;
+} PALETTE_ANIMATION_T;
+
+//-------------------------------------------------------------------------
+
+// bitsPerEntry is 16 for an RGB565 resource palette, or 32 for RGBA.
+
+bool
+initPaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t length,
+    int16_t bitsPerEntry);
+
+bool
+setEntryPaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t index,
+    const RGBA8_T *rgba);
+
+// Rotate the length entries from first by step entries (towards higher
+// indices if step is positive) every stepDuration milliseconds, or on
+// every call to updatePaletteAnimation() if stepDuration is zero.
+
+bool
+addCyclePaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t first,
+    int16_t length,
+    int16_t step,
+    int32_t stepDuration);
+
+// Blend the length colours from first towards the colours in to over
+// duration milliseconds. The colours are set to to at the end.
+
+bool
+addFadePaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    int16_t first,
+    int16_t length,
+    const RGBA8_T *to,
+    int32_t duration);
+
+// Remove all the cycles and fades. The colours are left as far as the
+// fades had got, but the cycled ranges go back to their unrotated order.
+
+void
+stopPaletteAnimation(
+    PALETTE_ANIMATION_T *animation);
+
+// Bring the cycles and fades up to date and upload the entries that have
+// changed to the palette of resource. Returns the number of entries
+// uploaded, which is zero if the palette on screen is already right.
+
+int16_t
+updatePaletteAnimation(
+    PALETTE_ANIMATION_T *animation,
+    DISPMANX_RESOURCE_HANDLE_T resource);
+
+void
+destroyPaletteAnimation(
+    PALETTE_ANIMATION_T *animation);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
 #endif
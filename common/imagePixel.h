@@ -0,0 +1,312 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef IMAGE_PIXEL_H
+#define IMAGE_PIXEL_H
+
+//-------------------------------------------------------------------------
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "imageConvert.h"
+
+//-------------------------------------------------------------------------
+
+// Pixel accessors for each direct colour format, inlined into the caller
+// rather than called through the function pointers in IMAGE_T.
+//
+// A kernel is written once as a static IMAGE_PIXEL_INLINE function whose
+// first parameter is an IMAGE_PIXEL_FORMAT_T, and which reads and writes
+// pixels with imagePixelGet() and imagePixelPut(). IMAGE_PIXEL_DISPATCH()
+// then calls it with each format as a constant, so the compiler turns out
+// one copy of the loop per format with the switch in the accessors folded
+// away, and picks the copy once per call:
+//
+//     static IMAGE_PIXEL_INLINE void
+//     fillKernel(IMAGE_PIXEL_FORMAT_T format, IMAGE_T *image, ...)
+//     {
+//         ... imagePixelPut(format, image, row, x, y, &rgba); ...
+//     }
+//
+//     IMAGE_PIXEL_DISPATCH(imagePixelFormat(image), fillKernel, image, ...);
+//
+// Images of other types (indexed) get IMAGE_PIXEL_GENERIC, for which the
+// accessors fall back to the function pointers.
+
+typedef enum
+{
+    IMAGE_PIXEL_GENERIC,
+    IMAGE_PIXEL_RGB565,
+    IMAGE_PIXEL_DITHERED_RGB565,
+    IMAGE_PIXEL_RGB888,
+    IMAGE_PIXEL_RGBA16,
+    IMAGE_PIXEL_DITHERED_RGBA16,
+    IMAGE_PIXEL_RGBA32
+} IMAGE_PIXEL_FORMAT_T;
+
+#define IMAGE_PIXEL_INLINE inline __attribute__((always_inline))
+
+#define IMAGE_PIXEL_DISPATCH(format, kernel, ...) \
+    switch (format) \
+    { \
+    case IMAGE_PIXEL_RGB565: \
+        kernel(IMAGE_PIXEL_RGB565, __VA_ARGS__); \
+        break; \
+    case IMAGE_PIXEL_DITHERED_RGB565: \
+        kernel(IMAGE_PIXEL_DITHERED_RGB565, __VA_ARGS__); \
+        break; \
+    case IMAGE_PIXEL_RGB888: \
+        kernel(IMAGE_PIXEL_RGB888, __VA_ARGS__); \
+        break; \
+    case IMAGE_PIXEL_RGBA16: \
+        kernel(IMAGE_PIXEL_RGBA16, __VA_ARGS__); \
+        break; \
+    case IMAGE_PIXEL_DITHERED_RGBA16: \
+        kernel(IMAGE_PIXEL_DITHERED_RGBA16, __VA_ARGS__); \
+        break; \
+    case IMAGE_PIXEL_RGBA32: \
+        kernel(IMAGE_PIXEL_RGBA32, __VA_ARGS__); \
+        break; \
+    default: \
+        kernel(IMAGE_PIXEL_GENERIC, __VA_ARGS__); \
+        break; \
+    }
+
+//-------------------------------------------------------------------------
+
+static inline IMAGE_PIXEL_FORMAT_T
+imagePixelFormat(
+    const IMAGE_T *image)
+{
+    switch (image->type)
+    {
+    case VC_IMAGE_RGB565:
+
+        return (image->dither) ? IMAGE_PIXEL_DITHERED_RGB565
+                               : IMAGE_PIXEL_RGB565;
+
+    case VC_IMAGE_RGB888:
+
+        return IMAGE_PIXEL_RGB888;
+
+    case VC_IMAGE_RGBA16:
+
+        return (image->dither) ? IMAGE_PIXEL_DITHERED_RGBA16
+                               : IMAGE_PIXEL_RGBA16;
+
+    case VC_IMAGE_RGBA32:
+
+        return IMAGE_PIXEL_RGBA32;
+
+    default:
+
+        return IMAGE_PIXEL_GENERIC;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static inline uint8_t *
+imagePixelRow(
+    const IMAGE_T *image,
+    int32_t y)
+{
+    return (uint8_t *)(image->buffer) + (y * image->pitch);
+}
+
+//-------------------------------------------------------------------------
+
+static inline uint16_t
+imagePixelPackRGB565(
+    const RGBA8_T *rgba)
+{
+    return ((rgba->red >> 3) << 11) | ((rgba->green >> 2) << 5) |
+           (rgba->blue >> 3);
+}
+
+static inline uint16_t
+imagePixelPackDitheredRGB565(
+    const RGBA8_T *rgba,
+    int32_t x,
+    int32_t y)
+{
+    return packRGB565Convert(rgba, IMAGE_CONVERT_DITHER_INDEX(x, y));
+}
+
+static inline uint16_t
+imagePixelPackRGBA16(
+    const RGBA8_T *rgba)
+{
+    return ((rgba->red >> 4) << 12) | ((rgba->green >> 4) << 8) |
+           ((rgba->blue >> 4) << 4) | (rgba->alpha >> 4);
+}
+
+static inline uint16_t
+imagePixelPackDitheredRGBA16(
+    const RGBA8_T *rgba,
+    int32_t x,
+    int32_t y)
+{
+    return packRGBA16Convert(rgba, IMAGE_CONVERT_DITHER_INDEX(x, y));
+}
+
+//-------------------------------------------------------------------------
+
+// Set pixel x of row, which is row y of the image. No bounds checks are
+// made. Only the dithered formats use y, and only IMAGE_PIXEL_GENERIC
+// uses image.
+
+static IMAGE_PIXEL_INLINE void
+imagePixelPut(
+    IMAGE_PIXEL_FORMAT_T format,
+    IMAGE_T *image,
+    uint8_t *row,
+    int32_t x,
+    int32_t y,
+    const RGBA8_T *rgba)
+{
+    switch (format)
+    {
+    case IMAGE_PIXEL_RGB565:
+
+        ((uint16_t *)row)[x] = imagePixelPackRGB565(rgba);
+        break;
+
+    case IMAGE_PIXEL_DITHERED_RGB565:
+
+        ((uint16_t *)row)[x] = imagePixelPackDitheredRGB565(rgba, x, y);
+        break;
+
+    case IMAGE_PIXEL_RGB888:
+    {
+        uint8_t *pixel = row + (3 * x);
+        pixel[0] = rgba->red;
+        pixel[1] = rgba->green;
+        pixel[2] = rgba->blue;
+        break;
+    }
+    case IMAGE_PIXEL_RGBA16:
+
+        ((uint16_t *)row)[x] = imagePixelPackRGBA16(rgba);
+        break;
+
+    case IMAGE_PIXEL_DITHERED_RGBA16:
+
+        ((uint16_t *)row)[x] = imagePixelPackDitheredRGBA16(rgba, x, y);
+        break;
+
+    case IMAGE_PIXEL_RGBA32:
+    {
+        uint8_t *pixel = row + (4 * x);
+        pixel[0] = rgba->red;
+        pixel[1] = rgba->green;
+        pixel[2] = rgba->blue;
+        pixel[3] = rgba->alpha;
+        break;
+    }
+    default:
+
+        if (image->setPixelDirect != NULL)
+        {
+            image->setPixelDirect(image, x, y, rgba);
+        }
+
+        break;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Get pixel x of row, which is row y of the image, as for imagePixelPut().
+
+static IMAGE_PIXEL_INLINE void
+imagePixelGet(
+    IMAGE_PIXEL_FORMAT_T format,
+    IMAGE_T *image,
+    const uint8_t *row,
+    int32_t x,
+    int32_t y,
+    RGBA8_T *rgba)
+{
+    switch (format)
+    {
+    case IMAGE_PIXEL_RGB565:
+    case IMAGE_PIXEL_DITHERED_RGB565:
+    {
+        uint16_t pixel = ((const uint16_t *)row)[x];
+
+        rgba->red = imageConvertExpand5[(pixel >> 11) & 0x1F];
+        rgba->green = imageConvertExpand6[(pixel >> 5) & 0x3F];
+        rgba->blue = imageConvertExpand5[pixel & 0x1F];
+        rgba->alpha = 255;
+        break;
+    }
+    case IMAGE_PIXEL_RGB888:
+    {
+        const uint8_t *pixel = row + (3 * x);
+        rgba->red = pixel[0];
+        rgba->green = pixel[1];
+        rgba->blue = pixel[2];
+        rgba->alpha = 255;
+        break;
+    }
+    case IMAGE_PIXEL_RGBA16:
+    case IMAGE_PIXEL_DITHERED_RGBA16:
+    {
+        uint16_t pixel = ((const uint16_t *)row)[x];
+
+        rgba->red = ((pixel >> 12) & 0xF) * 0x11;
+        rgba->green = ((pixel >> 8) & 0xF) * 0x11;
+        rgba->blue = ((pixel >> 4) & 0xF) * 0x11;
+        rgba->alpha = (pixel & 0xF) * 0x11;
+        break;
+    }
+    case IMAGE_PIXEL_RGBA32:
+    {
+        const uint8_t *pixel = row + (4 * x);
+        rgba->red = pixel[0];
+        rgba->green = pixel[1];
+        rgba->blue = pixel[2];
+        rgba->alpha = pixel[3];
+        break;
+    }
+    default:
+
+        if (image->getPixelDirect != NULL)
+        {
+            image->getPixelDirect(image, x, y, rgba);
+        }
+
+        break;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+#endif
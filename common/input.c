@@ -0,0 +1,833 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "input.h"
+
+//-------------------------------------------------------------------------
+
+// The queue has a single writer, the input thread, and a single reader,
+// so the two ends only need to be published to each other in order. A
+// full queue drops new events rather than hold up the input thread.
+
+#define INPUT_QUEUE_SIZE 64
+#define INPUT_MAX_DEVICES 8
+#define INPUT_DEVICE_DIRECTORY "/dev/input"
+
+// A key pressed on a keyboard attached to the console also turns up on
+// the terminal. The same character from the other source within this
+// long is taken to be the same key press.
+
+#define INPUT_DUPLICATE_MICROSECONDS 100000
+
+//-------------------------------------------------------------------------
+
+// Characters for the KEY_ codes up to KEY_SPACE, on a US keyboard, with
+// and without shift. Backspace gives DEL, as it does in a terminal.
+
+static const char unshiftedCharacters[KEY_SPACE + 1] =
+    "\0\033" "1234567890-=" "\177\t" "qwertyuiop[]" "\n\0"
+    "asdfghjkl;'`" "\0\\" "zxcvbnm,./" "\0*\0 ";
+
+static const char shiftedCharacters[KEY_SPACE + 1] =
+    "\0\033" "!@#$%^&*()_+" "\177\t" "QWERTYUIOP{}" "\n\0"
+    "ASDFGHJKL:\"~" "\0|" "ZXCVBNM<>?" "\0*\0 ";
+
+//-------------------------------------------------------------------------
+
+static bool started = false;
+static bool threadRunning = false;
+static pthread_t thread;
+
+static INPUT_EVENT_T queue[INPUT_QUEUE_SIZE];
+static uint32_t queueHead = 0;
+static uint32_t queueTail = 0;
+
+static int epollFd = -1;
+static int readyFd = -1;
+static int quitFd = -1;
+
+static int terminalFd = -1;
+static bool terminalChanged = false;
+static struct termios original;
+
+static int deviceFds[INPUT_MAX_DEVICES];
+static bool deviceMonotonic[INPUT_MAX_DEVICES];
+static int32_t numberOfDevices = 0;
+
+// Only used on the input thread.
+
+static int32_t shiftKeys = 0;
+static INPUT_EVENT_T lastEvent;
+
+//-------------------------------------------------------------------------
+
+int64_t
+microsecondsInput(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec * INT64_C(1000000)) + (now.tv_nsec / 1000);
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+queuedInput(void)
+{
+    return __atomic_load_n(&queueHead, __ATOMIC_ACQUIRE) != queueTail;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+signalInput(void)
+{
+    uint64_t one = 1;
+
+    if (write(readyFd, &one, sizeof(one)) != sizeof(one))
+    {
+        // The counter can only be full if nobody is reading it.
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+queueInput(
+    const INPUT_EVENT_T *event)
+{
+    // Keys without a character, such as the arrows, are matched on their
+    // code, which the terminal escape sequences are translated to.
+
+    int64_t apart = event->microseconds - lastEvent.microseconds;
+
+    bool sameKey = (event->character == lastEvent.character) &&
+                   ((event->character != -1) ||
+                    (event->code == lastEvent.code));
+
+    if ((event->source != lastEvent.source) &&
+        sameKey &&
+        (apart < INPUT_DUPLICATE_MICROSECONDS) &&
+        (apart > -INPUT_DUPLICATE_MICROSECONDS))
+    {
+        return;
+    }
+
+    lastEvent = *event;
+
+    uint32_t head = queueHead;
+
+    if (head - __atomic_load_n(&queueTail, __ATOMIC_ACQUIRE)
+        == INPUT_QUEUE_SIZE)
+    {
+        return;
+    }
+
+    queue[head % INPUT_QUEUE_SIZE] = *event;
+    __atomic_store_n(&queueHead, head + 1, __ATOMIC_RELEASE);
+
+    signalInput();
+}
+
+//-------------------------------------------------------------------------
+
+static void
+queueKeyInput(
+    int64_t microseconds,
+    int32_t character,
+    uint16_t code,
+    INPUT_SOURCE_T source)
+{
+    INPUT_EVENT_T event =
+    {
+        .microseconds = microseconds,
+        .character = character,
+        .code = code,
+        .source = source
+    };
+
+    queueInput(&event);
+}
+
+//-------------------------------------------------------------------------
+
+static int32_t
+characterInput(
+    uint16_t code,
+    bool shift)
+{
+    char c = 0;
+
+    if (code <= KEY_SPACE)
+    {
+        c = (shift) ? shiftedCharacters[code] : unshiftedCharacters[code];
+    }
+    else
+    {
+        switch (code)
+        {
+        case KEY_KPMINUS:
+
+            c = '-';
+            break;
+
+        case KEY_KPPLUS:
+
+            c = '+';
+            break;
+
+        case KEY_KPENTER:
+
+            c = '\n';
+            break;
+
+        case KEY_KPSLASH:
+
+            c = '/';
+            break;
+        }
+    }
+
+    return (c == 0) ? -1 : c;
+}
+
+//-------------------------------------------------------------------------
+
+// Escape sequences for the cursor and editing keys: ESC [ or ESC O, an
+// optional number, then a final character.
+
+static int32_t
+escapeInput(
+    const uint8_t *buffer,
+    int32_t length,
+    uint16_t *code)
+{
+    int32_t number = 0;
+    int32_t i = 2;
+
+    while ((i < length) && (buffer[i] >= '0') && (buffer[i] <= '?'))
+    {
+        if (buffer[i] <= '9')
+        {
+            number = (number * 10) + (buffer[i] - '0');
+        }
+
+        ++i;
+    }
+
+    *code = 0;
+
+    if (i == length)
+    {
+        return length;
+    }
+
+    switch (buffer[i])
+    {
+    case 'A':
+
+        *code = KEY_UP;
+        break;
+
+    case 'B':
+
+        *code = KEY_DOWN;
+        break;
+
+    case 'C':
+
+        *code = KEY_RIGHT;
+        break;
+
+    case 'D':
+
+        *code = KEY_LEFT;
+        break;
+
+    case 'H':
+
+        *code = KEY_HOME;
+        break;
+
+    case 'F':
+
+        *code = KEY_END;
+        break;
+
+    case '~':
+
+        switch (number)
+        {
+        case 2:
+
+            *code = KEY_INSERT;
+            break;
+
+        case 3:
+
+            *code = KEY_DELETE;
+            break;
+
+        case 5:
+
+            *code = KEY_PAGEUP;
+            break;
+
+        case 6:
+
+            *code = KEY_PAGEDOWN;
+            break;
+        }
+
+        break;
+    }
+
+    return i + 1;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+removeInput(
+    int fd)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+readTerminalInput(void)
+{
+    uint8_t buffer[64];
+    int64_t now = microsecondsInput();
+
+    ssize_t length = read(terminalFd, buffer, sizeof(buffer));
+
+    if (length <= 0)
+    {
+        if ((length == 0) || (errno != EINTR))
+        {
+            removeInput(terminalFd);
+        }
+
+        return;
+    }
+
+    int32_t i = 0;
+    while (i < length)
+    {
+        if ((buffer[i] == 27) &&
+            (i + 1 < length) &&
+            ((buffer[i + 1] == '[') || (buffer[i + 1] == 'O')))
+        {
+            uint16_t code = 0;
+            i += escapeInput(buffer + i, length - i, &code);
+
+            queueKeyInput(now, -1, code, INPUT_SOURCE_TERMINAL);
+        }
+        else
+        {
+            queueKeyInput(now, buffer[i], 0, INPUT_SOURCE_TERMINAL);
+            ++i;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+readDeviceInput(
+    int32_t device)
+{
+    struct input_event events[16];
+    int fd = deviceFds[device];
+
+    ssize_t length = read(fd, events, sizeof(events));
+
+    if (length <= 0)
+    {
+        // A keyboard that has been unplugged reads as an error.
+
+        if ((length == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+        {
+            removeInput(fd);
+        }
+
+        return;
+    }
+
+    int32_t number = length / sizeof(events[0]);
+
+    int32_t i;
+    for (i = 0 ; i < number ; i++)
+    {
+        const struct input_event *event = &(events[i]);
+
+        if (event->type != EV_KEY)
+        {
+            continue;
+        }
+
+        // value is 0 for a release, 1 for a press and 2 for a repeat.
+
+        if ((event->code == KEY_LEFTSHIFT) || (event->code == KEY_RIGHTSHIFT))
+        {
+            if (event->value == 1)
+            {
+                ++shiftKeys;
+            }
+            else if ((event->value == 0) && (shiftKeys > 0))
+            {
+                --shiftKeys;
+            }
+
+            continue;
+        }
+
+        if (event->value == 0)
+        {
+            continue;
+        }
+
+        int64_t microseconds = (deviceMonotonic[device])
+                             ? (event->time.tv_sec * INT64_C(1000000))
+                               + event->time.tv_usec
+                             : microsecondsInput();
+
+        queueKeyInput(microseconds,
+                      characterInput(event->code, shiftKeys > 0),
+                      event->code,
+                      INPUT_SOURCE_DEVICE);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void *
+inputThread(
+    void *arg)
+{
+    struct epoll_event events[INPUT_MAX_DEVICES + 2];
+
+    while (true)
+    {
+        int ready = epoll_wait(epollFd,
+                               events,
+                               sizeof(events) / sizeof(events[0]),
+                               -1);
+
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        int32_t i;
+        for (i = 0 ; i < ready ; i++)
+        {
+            int32_t source = events[i].data.u32;
+
+            if (source == INPUT_MAX_DEVICES + 1)
+            {
+                return NULL;
+            }
+            else if (source == INPUT_MAX_DEVICES)
+            {
+                readTerminalInput();
+            }
+            else
+            {
+                readDeviceInput(source);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+addInput(
+    int fd,
+    uint32_t source)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+
+    event.events = EPOLLIN;
+    event.data.u32 = source;
+
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+isKeyboardInput(
+    int fd)
+{
+    uint8_t keys[(KEY_MAX / 8) + 1];
+    memset(keys, 0, sizeof(keys));
+
+    if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) == -1)
+    {
+        return false;
+    }
+
+    uint16_t needed[] = { KEY_ESC, KEY_A, KEY_Z, KEY_SPACE };
+
+    size_t i;
+    for (i = 0 ; i < sizeof(needed) / sizeof(needed[0]) ; i++)
+    {
+        if ((keys[needed[i] / 8] & (1 << (needed[i] % 8))) == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+openDevicesInput(void)
+{
+    DIR *directory = opendir(INPUT_DEVICE_DIRECTORY);
+
+    if (directory == NULL)
+    {
+        return;
+    }
+
+    struct dirent *entry;
+    while (((entry = readdir(directory)) != NULL) &&
+           (numberOfDevices < INPUT_MAX_DEVICES))
+    {
+        if (strncmp(entry->d_name, "event", 5) != 0)
+        {
+            continue;
+        }
+
+        char path[sizeof(INPUT_DEVICE_DIRECTORY) + sizeof(entry->d_name)];
+        snprintf(path,
+                 sizeof(path),
+                 "%s/%s",
+                 INPUT_DEVICE_DIRECTORY,
+                 entry->d_name);
+
+        int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+        if (fd == -1)
+        {
+            continue;
+        }
+
+        if ((isKeyboardInput(fd) == false) ||
+            (addInput(fd, numberOfDevices) == false))
+        {
+            close(fd);
+            continue;
+        }
+
+        int clock = CLOCK_MONOTONIC;
+
+        deviceMonotonic[numberOfDevices] =
+            (ioctl(fd, EVIOCSCLOCKID, &clock) == 0);
+        deviceFds[numberOfDevices++] = fd;
+    }
+
+    closedir(directory);
+}
+
+//-------------------------------------------------------------------------
+
+// Put the terminal into non-canonical mode, so that each key can be read
+// as it is pressed, without it being echoed to the screen.
+
+static void
+openTerminalInput(void)
+{
+    int fd = fileno(stdin);
+
+    if (isatty(fd) && (tcgetattr(fd, &original) == 0))
+    {
+        struct termios term = original;
+
+        term.c_lflag &= ~(ICANON | ECHO);
+        term.c_cc[VMIN] = 1;
+        term.c_cc[VTIME] = 0;
+
+        terminalChanged = (tcsetattr(fd, TCSANOW, &term) == 0);
+    }
+
+    // A pipe can be read as well, but a regular file cannot be waited on.
+
+    if (addInput(fd, INPUT_MAX_DEVICES))
+    {
+        terminalFd = fd;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+bool
+startInput(
+    INPUT_SOURCE_T sources)
+{
+    if (started)
+    {
+        return (terminalFd != -1) || (numberOfDevices > 0);
+    }
+
+    started = true;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    readyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    quitFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if ((epollFd == -1) || (readyFd == -1) || (quitFd == -1))
+    {
+        perror("input");
+        stopInput();
+        started = true;
+
+        return false;
+    }
+
+    lastEvent.microseconds = 0;
+    lastEvent.character = -1;
+    lastEvent.code = 0;
+    lastEvent.source = 0;
+
+    if (sources & INPUT_SOURCE_TERMINAL)
+    {
+        openTerminalInput();
+    }
+
+    if (sources & INPUT_SOURCE_DEVICE)
+    {
+        openDevicesInput();
+    }
+
+    if (((terminalFd == -1) && (numberOfDevices == 0)) ||
+        (addInput(quitFd, INPUT_MAX_DEVICES + 1) == false) ||
+        (pthread_create(&thread, NULL, inputThread, NULL) != 0))
+    {
+        stopInput();
+        started = true;
+
+        return false;
+    }
+
+    threadRunning = true;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+takeInput(
+    INPUT_EVENT_T *event)
+{
+    uint32_t tail = queueTail;
+
+    if (__atomic_load_n(&queueHead, __ATOMIC_ACQUIRE) == tail)
+    {
+        return false;
+    }
+
+    *event = queue[tail % INPUT_QUEUE_SIZE];
+    __atomic_store_n(&queueTail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// The ready counter is only cleared once the queue has been seen to be
+// empty, and set again if an event slipped in meanwhile, so that its file
+// descriptor polls readable whenever there is something to read.
+
+static void
+clearReadyInput(void)
+{
+    uint64_t count;
+
+    if (read(readyFd, &count, sizeof(count)) != sizeof(count))
+    {
+        // Nothing was pending.
+    }
+
+    if (queuedInput())
+    {
+        signalInput();
+    }
+}
+
+//-------------------------------------------------------------------------
+
+bool
+readInput(
+    INPUT_EVENT_T *event)
+{
+    if (readyFd == -1)
+    {
+        return false;
+    }
+
+    bool taken = takeInput(event);
+
+    if (queuedInput() == false)
+    {
+        clearReadyInput();
+    }
+
+    return taken;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+waitForInput(
+    int32_t timeout)
+{
+    if (readyFd == -1)
+    {
+        poll(NULL, 0, timeout);
+        return false;
+    }
+
+    if (queuedInput())
+    {
+        return true;
+    }
+
+    clearReadyInput();
+
+    struct pollfd ready = { .fd = readyFd, .events = POLLIN };
+
+    while ((queuedInput() == false) && (poll(&ready, 1, timeout) > 0))
+    {
+        if (timeout >= 0)
+        {
+            break;
+        }
+
+        clearReadyInput();
+    }
+
+    return queuedInput();
+}
+
+//-------------------------------------------------------------------------
+
+int
+fileDescriptorInput(void)
+{
+    return readyFd;
+}
+
+//-------------------------------------------------------------------------
+
+void
+stopInput(void)
+{
+    if (started == false)
+    {
+        return;
+    }
+
+    if (threadRunning)
+    {
+        uint64_t one = 1;
+
+        if (write(quitFd, &one, sizeof(one)) == sizeof(one))
+        {
+            pthread_join(thread, NULL);
+        }
+
+        threadRunning = false;
+    }
+
+    int32_t device;
+    for (device = 0 ; device < numberOfDevices ; device++)
+    {
+        close(deviceFds[device]);
+    }
+
+    numberOfDevices = 0;
+
+    if (terminalChanged)
+    {
+        tcsetattr(fileno(stdin), TCSANOW, &original);
+        terminalChanged = false;
+    }
+
+    terminalFd = -1;
+
+    int *fds[] = { &epollFd, &readyFd, &quitFd };
+
+    size_t i;
+    for (i = 0 ; i < sizeof(fds) / sizeof(fds[0]) ; i++)
+    {
+        if (*(fds[i]) != -1)
+        {
+            close(*(fds[i]));
+            *(fds[i]) = -1;
+        }
+    }
+
+    queueHead = 0;
+    queueTail = 0;
+    started = false;
+}
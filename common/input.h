@@ -0,0 +1,108 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Key presses are read on a thread of their own, from the terminal on
+// stdin and from any keyboards under /dev/input, and queued with the time
+// they happened. Reading the queue never blocks, and a program with
+// nothing to do can sleep in waitForInput() until a key is pressed.
+//
+// character is the ASCII code of the key, or -1 for keys that have none,
+// such as the arrow keys. code is the KEY_ code from linux/input.h, or 0
+// for a terminal character that was not an escape sequence. A key held
+// down on a keyboard repeats, as it does in the terminal.
+
+typedef enum
+{
+    INPUT_SOURCE_TERMINAL = 1,
+    INPUT_SOURCE_DEVICE = 1 << 1,
+    INPUT_SOURCE_ALL = INPUT_SOURCE_TERMINAL | INPUT_SOURCE_DEVICE
+} INPUT_SOURCE_T;
+
+typedef struct
+{
+    int64_t microseconds;
+    int32_t character;
+    uint16_t code;
+    INPUT_SOURCE_T source;
+} INPUT_EVENT_T;
+
+//-------------------------------------------------------------------------
+
+// Start reading from sources, or do nothing if input has already been
+// started. Keyboards that cannot be opened, usually for want of
+// permission, are skipped. Returns false if there was nothing to read.
+
+bool
+startInput(
+    INPUT_SOURCE_T sources);
+
+// Take the oldest event off the queue. Returns false if it was empty.
+// Events are meant to be read from one thread.
+
+bool
+readInput(
+    INPUT_EVENT_T *event);
+
+// Wait up to timeout milliseconds, or for ever if it is negative, for an
+// event to be queued. Returns true if there is one to read.
+
+bool
+waitForInput(
+    int32_t timeout);
+
+// A file descriptor that polls readable while there are events queued,
+// for a program that waits in poll() or epoll itself.
+
+int
+fileDescriptorInput(void);
+
+// Microseconds on CLOCK_MONOTONIC, the clock the events are stamped with.
+
+int64_t
+microsecondsInput(void);
+
+// Stop the input thread, close the keyboards and put the terminal back the
+// way it was found.
+
+void
+stopInput(void);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -32,13 +32,16 @@
 
 #include <stdbool.h>
 
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
 // The keyPressed function is a non-blocking function that returns true if
-// a character has been read from stdin. If the character argument is not
-// NULL, the character read is returned. NOTE when function keys, arrow keys
-// etc are pressed the function will return true, but the character argument
-// will not be set.
+// a key has been pressed, on the terminal or on a keyboard. If the
+// character argument is not NULL, the character read is returned. NOTE
+// when function keys, arrow keys etc are pressed the function will return
+// true, but the character argument will not be set. Keys are queued, so
+// none are lost between calls; see input.h to wait for them.
 bool keyPressed(int *character);
 
 // The keyboardReset function puts the stdin stream back to the way it was
@@ -47,5 +50,7 @@ void keyboardReset(void);
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
 
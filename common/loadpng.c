@@ -26,11 +26,16 @@
 //-------------------------------------------------------------------------
 
 #include <png.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "bcm_host.h"
 
 #include "loadpng.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
+#include "threadPool.h"
 
 //-------------------------------------------------------------------------
 
@@ -38,6 +43,14 @@
 #define ALIGN_TO_16(x) ((x + 15) & ~15)
 #endif
 
+// loadPngFileAs() hands each strip to the pool to convert as the next one
+// is decoded, LOADPNG_CONVERT_GRAIN rows at a time. RGB888 rows are
+// widened to RGBA8 LOADPNG_CONVERT_CHUNK pixels at a time on the stack.
+
+#define LOADPNG_CONVERT_STRIP_HEIGHT 64
+#define LOADPNG_CONVERT_GRAIN 4
+#define LOADPNG_CONVERT_CHUNK 256
+
 //-------------------------------------------------------------------------
 
 bool
@@ -60,37 +73,21 @@ loadPng(
     return result;
 }
 
-bool
-loadPngFile(
-    IMAGE_T* image,
-    FILE *file)
-{
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-                                                 NULL,
-                                                 NULL,
-                                                 NULL);
-
-    if (png_ptr == NULL)
-    {
-        return false;
-    }
-
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-
-    if (info_ptr == NULL)
-    {
-        png_destroy_read_struct(&png_ptr, 0, 0);
-        return false;
-    }
-
-    if (setjmp(png_jmpbuf(png_ptr)))
-    {
-        png_destroy_read_struct(&png_ptr, &info_ptr, 0);
-        return false;
-    }
-
-    //---------------------------------------------------------------------
+//-------------------------------------------------------------------------
 
+// Read the header and set up the transforms that turn any png into RGB888
+// or RGBA32, returning the number of interlace passes. Must be called with
+// png_jmpbuf() set. If allocate is false, the image gets its dimensions
+// but no buffer.
+
+static int
+readPngInfo(
+    png_structp png_ptr,
+    png_infop info_ptr,
+    FILE *file,
+    IMAGE_T *image,
+    bool allocate)
+{
     png_init_io(png_ptr, file);
 
     png_read_info(png_ptr, info_ptr);
@@ -107,11 +104,17 @@ loadPngFile(
         type = VC_IMAGE_RGBA32;
     }
 
-    initImage(image,
-              type,
-              png_get_image_width(png_ptr, info_ptr),
-              png_get_image_height(png_ptr, info_ptr),
-              false);
+    int32_t width = png_get_image_width(png_ptr, info_ptr);
+    int32_t height = png_get_image_height(png_ptr, info_ptr);
+
+    if (allocate)
+    {
+        initImage(image, type, width, height, false);
+    }
+    else
+    {
+        initImageHeader(image, type, width, height, false);
+    }
 
     //---------------------------------------------------------------------
 
@@ -156,8 +159,48 @@ loadPngFile(
 
     //---------------------------------------------------------------------
 
+    int passes = png_set_interlace_handling(png_ptr);
+
     png_read_update_info(png_ptr, info_ptr);
 
+    return passes;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+loadPngFile(
+    IMAGE_T* image,
+    FILE *file)
+{
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                                 NULL,
+                                                 NULL,
+                                                 NULL);
+
+    if (png_ptr == NULL)
+    {
+        return false;
+    }
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+
+    if (info_ptr == NULL)
+    {
+        png_destroy_read_struct(&png_ptr, 0, 0);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, 0);
+        return false;
+    }
+
+    //---------------------------------------------------------------------
+
+    readPngInfo(png_ptr, info_ptr, file, image, true);
+
     //---------------------------------------------------------------------
 
     png_bytepp row_pointers = malloc(image->height * sizeof(png_bytep));
@@ -181,3 +224,446 @@ loadPngFile(
     return true;
 }
 
+//-------------------------------------------------------------------------
+
+// Decode into numberOfStrips strip buffers in turn, so that a callback
+// can still be working on one strip while the next is decoded. finish, if
+// there is one, is called before the buffers are freed, whether or not
+// the png could be read.
+
+static bool
+readPngStrips(
+    IMAGE_T *image,
+    FILE *file,
+    int32_t stripHeight,
+    int32_t numberOfStrips,
+    LOADPNG_STRIP_CALLBACK_T callback,
+    void (*finish)(void *arg),
+    void *arg)
+{
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                                 NULL,
+                                                 NULL,
+                                                 NULL);
+
+    if (png_ptr == NULL)
+    {
+        return false;
+    }
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+
+    if (info_ptr == NULL)
+    {
+        png_destroy_read_struct(&png_ptr, 0, 0);
+        return false;
+    }
+
+    // These change between setjmp() and a possible longjmp(), so they
+    // must be volatile to be trusted in the error path.
+
+    png_bytep volatile strip = NULL;
+    png_bytepp volatile row_pointers = NULL;
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        if (finish != NULL)
+        {
+            finish(arg);
+        }
+
+        free(row_pointers);
+        free(strip);
+        png_destroy_read_struct(&png_ptr, &info_ptr, 0);
+        return false;
+    }
+
+    //---------------------------------------------------------------------
+
+    int passes = readPngInfo(png_ptr, info_ptr, file, image, false);
+
+    // Interlaced images need every row for each pass, so they are read
+    // as one strip.
+
+    int32_t rowsPerStrip = stripHeight;
+
+    if ((passes > 1) || (rowsPerStrip <= 0) || (rowsPerStrip > image->height))
+    {
+        rowsPerStrip = image->height;
+    }
+
+    int32_t totalRows = numberOfStrips * rowsPerStrip;
+
+    strip = calloc(totalRows, image->pitch);
+    row_pointers = malloc(totalRows * sizeof(png_bytep));
+
+    if ((strip == NULL) || (row_pointers == NULL))
+    {
+        fprintf(stderr, "loadpng: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int32_t j;
+    for (j = 0 ; j < totalRows ; j++)
+    {
+        row_pointers[j] = strip + (j * image->pitch);
+    }
+
+    //---------------------------------------------------------------------
+
+    int32_t buffer = 0;
+
+    int32_t y;
+    for (y = 0 ; y < image->height ; y += rowsPerStrip)
+    {
+        int32_t rows = image->height - y;
+
+        if (rows > rowsPerStrip)
+        {
+            rows = rowsPerStrip;
+        }
+
+        png_bytepp rowPointers = row_pointers + (buffer * rowsPerStrip);
+
+        int pass;
+        for (pass = 0 ; pass < passes ; pass++)
+        {
+            png_read_rows(png_ptr, rowPointers, NULL, rows);
+        }
+
+        callback(image, rowPointers[0], y, rows, arg);
+
+        buffer = (buffer + 1) % numberOfStrips;
+    }
+
+    // Read up to the end of the png, so that a file holding a sequence of
+    // them is left at the start of the next one.
+
+    png_read_end(png_ptr, NULL);
+
+    //---------------------------------------------------------------------
+
+    if (finish != NULL)
+    {
+        finish(arg);
+    }
+
+    free(row_pointers);
+    free(strip);
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, 0);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+loadPngFileStrips(
+    IMAGE_T *image,
+    FILE *file,
+    int32_t stripHeight,
+    LOADPNG_STRIP_CALLBACK_T callback,
+    void *arg)
+{
+    return readPngStrips(image, file, stripHeight, 1, callback, NULL, arg);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+loadPngAs(
+    IMAGE_T *image,
+    const char *path,
+    VC_IMAGE_TYPE_T type,
+    bool dither)
+{
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "loadpng: can't open file for reading\n");
+        return false;
+    }
+
+    bool result = loadPngFileAs(image, file, type, dither);
+
+    fclose(file);
+
+    return result;
+}
+
+//-------------------------------------------------------------------------
+
+typedef struct LOADPNG_CONVERT_T_ LOADPNG_CONVERT_T;
+
+// A strip for the pool to convert. There is one for each strip buffer, as
+// the next is filled in while the last is still being converted.
+
+typedef struct
+{
+    LOADPNG_CONVERT_T *load;
+    const uint8_t *strip;
+    int32_t y;
+} LOADPNG_CONVERT_STRIP_T;
+
+struct LOADPNG_CONVERT_T_
+{
+    IMAGE_T *image;
+    VC_IMAGE_TYPE_T type;
+    bool dither;
+    bool created;
+    const IMAGE_T *decoded;
+    THREAD_POOL_T *pool;
+    LOADPNG_CONVERT_STRIP_T strips[2];
+    int32_t next;
+};
+
+//-------------------------------------------------------------------------
+
+// Convert rows [start, end) of a strip into the image. Rows that are
+// already in the format of the image are copied as they are.
+
+static void
+convertRowsPng(
+    void *arg,
+    int32_t start,
+    int32_t end)
+{
+    const LOADPNG_CONVERT_STRIP_T *convert = arg;
+    const IMAGE_T *decoded = convert->load->decoded;
+    IMAGE_T *image = convert->load->image;
+    int32_t width = decoded->width;
+
+    int32_t j;
+    for (j = start ; j < end ; j++)
+    {
+        const uint8_t *src = convert->strip + (j * decoded->pitch);
+        int32_t y = convert->y + j;
+        uint8_t *line = (uint8_t *)(image->buffer) + (y * image->pitch);
+
+        if (decoded->type == image->type)
+        {
+            memcpy(line, src, (width * image->bitsPerPixel) / 8);
+        }
+        else if (decoded->type == VC_IMAGE_RGBA32)
+        {
+            image->convertRow(line, (const RGBA8_T *)src, 0, y, width);
+        }
+        else
+        {
+            RGBA8_T row[LOADPNG_CONVERT_CHUNK];
+
+            int32_t x;
+            for (x = 0 ; x < width ; x += LOADPNG_CONVERT_CHUNK)
+            {
+                int32_t length = width - x;
+
+                if (length > LOADPNG_CONVERT_CHUNK)
+                {
+                    length = LOADPNG_CONVERT_CHUNK;
+                }
+
+                const uint8_t *rgb = src + (3 * x);
+
+                int32_t i;
+                for (i = 0 ; i < length ; i++)
+                {
+                    row[i].red = rgb[3 * i];
+                    row[i].green = rgb[(3 * i) + 1];
+                    row[i].blue = rgb[(3 * i) + 2];
+                    row[i].alpha = 255;
+                }
+
+                image->convertRow(line + ((x * image->bitsPerPixel) / 8),
+                                  row,
+                                  x,
+                                  y,
+                                  length);
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+stripToImage(
+    IMAGE_T *decoded,
+    const uint8_t *strip,
+    int32_t y,
+    int32_t rows,
+    void *arg)
+{
+    LOADPNG_CONVERT_T *load = arg;
+
+    if (load->created == false)
+    {
+        initImage(load->image,
+                  load->type,
+                  decoded->width,
+                  decoded->height,
+                  load->dither);
+        load->created = true;
+        load->decoded = decoded;
+    }
+
+    // Starting this strip waits for the one before it, so the strip that
+    // is filled in next is no longer being converted.
+
+    LOADPNG_CONVERT_STRIP_T *convert = &(load->strips[load->next]);
+    load->next = (load->next + 1) % 2;
+
+    convert->load = load;
+    convert->strip = strip;
+    convert->y = y;
+
+    startForThreadPool(load->pool,
+                       rows,
+                       LOADPNG_CONVERT_GRAIN,
+                       convertRowsPng,
+                       convert);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+finishStripsToImage(
+    void *arg)
+{
+    LOADPNG_CONVERT_T *load = arg;
+
+    if (load->created)
+    {
+        waitThreadPool(load->pool);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// libpng decodes on this thread while the pool converts the strip before,
+// so the two overlap.
+
+bool
+loadPngFileAs(
+    IMAGE_T *image,
+    FILE *file,
+    VC_IMAGE_TYPE_T type,
+    bool dither)
+{
+    IMAGE_T decoded;
+
+    if ((initImageHeader(&decoded, type, 1, 1, false) == false) ||
+        (decoded.convertRow == NULL))
+    {
+        fprintf(stderr, "loadpng: can't load into an indexed image\n");
+        return false;
+    }
+
+    LOADPNG_CONVERT_T load;
+    memset(&load, 0, sizeof(load));
+
+    load.image = image;
+    load.type = type;
+    load.dither = dither;
+    load.created = false;
+    load.pool = defaultThreadPool();
+    load.next = 0;
+
+    bool result = readPngStrips(&decoded,
+                                file,
+                                LOADPNG_CONVERT_STRIP_HEIGHT,
+                                2,
+                                stripToImage,
+                                finishStripsToImage,
+                                &load);
+
+    if ((result == false) && load.created)
+    {
+        destroyImage(image);
+    }
+
+    return result;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+loadPngImageLayer(
+    IMAGE_LAYER_T *il,
+    const char *path,
+    int32_t layer,
+    int32_t stripHeight)
+{
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "loadpng: can't open file for reading\n");
+        return false;
+    }
+
+    bool result = loadPngFileImageLayer(il, file, layer, stripHeight);
+
+    fclose(file);
+
+    return result;
+}
+
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    IMAGE_LAYER_T *il;
+    int32_t layer;
+    bool created;
+} LOADPNG_IMAGE_LAYER_T;
+
+static void
+stripToImageLayer(
+    IMAGE_T *image,
+    const uint8_t *strip,
+    int32_t y,
+    int32_t rows,
+    void *arg)
+{
+    LOADPNG_IMAGE_LAYER_T *load = arg;
+
+    if (load->created == false)
+    {
+        createEmptyResourceImageLayer(load->il, load->layer);
+        load->created = true;
+    }
+
+    writeRowsImageLayer(load->il, strip, y, rows);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+loadPngFileImageLayer(
+    IMAGE_LAYER_T *il,
+    FILE *file,
+    int32_t layer,
+    int32_t stripHeight)
+{
+    LOADPNG_IMAGE_LAYER_T load = { il, layer, false };
+
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(IMAGE_LAYER_ACCOUNT));
+
+    bool result = loadPngFileStrips(&(il->image),
+                                    file,
+                                    stripHeight,
+                                    stripToImageLayer,
+                                    &load);
+
+    if ((result == false) && load.created)
+    {
+        releaseResourcePool(il->resource);
+    }
+
+    leaveMemoryAccount(previous);
+
+    return result;
+}
@@ -32,12 +32,78 @@
 #include <stdio.h>
 
 #include "image.h"
+#include "imageLayer.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Rows decoded per strip by the streaming loaders.
+
+#define LOADPNG_STRIP_HEIGHT 16
 
 //-------------------------------------------------------------------------
 
 bool loadPng(IMAGE_T *image, const char *path);
 bool loadPngFile(IMAGE_T* image, FILE *file);
 
+// Load the png into an image of the given direct colour type, dithered if
+// dither is true. Each strip is converted in the default thread pool while
+// the next is decoded.
+
+bool
+loadPngAs(
+    IMAGE_T *image,
+    const char *path,
+    VC_IMAGE_TYPE_T type,
+    bool dither);
+
+bool
+loadPngFileAs(
+    IMAGE_T *image,
+    FILE *file,
+    VC_IMAGE_TYPE_T type,
+    bool dither);
+
+// Decode the png stripHeight rows at a time into a buffer of that many
+// rows, which is passed to callback as each strip is complete. The image
+// gets its dimensions but no buffer of its own. The file is read up to
+// the end of the png, so the next of a sequence of pngs can follow.
+
+typedef void (*LOADPNG_STRIP_CALLBACK_T)(IMAGE_T *image,
+                                         const uint8_t *strip,
+                                         int32_t y,
+                                         int32_t rows,
+                                         void *arg);
+
+bool
+loadPngFileStrips(
+    IMAGE_T *image,
+    FILE *file,
+    int32_t stripHeight,
+    LOADPNG_STRIP_CALLBACK_T callback,
+    void *arg);
+
+// Decode straight into a new resource for il, stripHeight rows at a
+// time, so that only one strip is ever held in memory. On success il is
+// ready for addElementImageLayer() and its image has no buffer.
+
+bool
+loadPngImageLayer(
+    IMAGE_LAYER_T *il,
+    const char *path,
+    int32_t layer,
+    int32_t stripHeight);
+
+bool
+loadPngFileImageLayer(
+    IMAGE_LAYER_T *il,
+    FILE *file,
+    int32_t layer,
+    int32_t stripHeight);
+
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
@@ -0,0 +1,233 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <pthread.h>
+#include <string.h>
+
+#include "memoryAccount.h"
+
+//-------------------------------------------------------------------------
+
+// Accounts are never closed, so a pointer to one stays good for the life
+// of the program. The first is always "other".
+
+static pthread_mutex_t accountMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static MEMORY_ACCOUNT_T accounts[MEMORY_ACCOUNT_MAX_ACCOUNTS] =
+{
+    { .name = "other" }
+};
+
+static int32_t numberOfAccounts = 1;
+
+static __thread MEMORY_ACCOUNT_T *current = NULL;
+
+//-------------------------------------------------------------------------
+
+MEMORY_ACCOUNT_T *
+findMemoryAccount(
+    const char *name)
+{
+    MEMORY_ACCOUNT_T *account = NULL;
+
+    pthread_mutex_lock(&accountMutex);
+
+    int32_t i;
+    for (i = 0 ; i < numberOfAccounts ; i++)
+    {
+        if (strncmp(accounts[i].name, name, MEMORY_ACCOUNT_MAX_NAME - 1) == 0)
+        {
+            account = &(accounts[i]);
+            break;
+        }
+    }
+
+    if (account == NULL)
+    {
+        if (numberOfAccounts < MEMORY_ACCOUNT_MAX_ACCOUNTS)
+        {
+            account = &(accounts[numberOfAccounts++]);
+
+            strncpy(account->name, name, MEMORY_ACCOUNT_MAX_NAME - 1);
+        }
+        else
+        {
+            account = &(accounts[0]);
+        }
+    }
+
+    pthread_mutex_unlock(&accountMutex);
+
+    return account;
+}
+
+//-------------------------------------------------------------------------
+
+MEMORY_ACCOUNT_T *
+enterMemoryAccount(
+    MEMORY_ACCOUNT_T *account)
+{
+    MEMORY_ACCOUNT_T *previous = current;
+
+    if (account != NULL)
+    {
+        current = account;
+    }
+
+    return previous;
+}
+
+//-------------------------------------------------------------------------
+
+void
+leaveMemoryAccount(
+    MEMORY_ACCOUNT_T *previous)
+{
+    current = previous;
+}
+
+//-------------------------------------------------------------------------
+
+MEMORY_ACCOUNT_T *
+currentMemoryAccount(void)
+{
+    return (current == NULL) ? &(accounts[0]) : current;
+}
+
+//-------------------------------------------------------------------------
+
+void
+chargeCpuMemoryAccount(
+    MEMORY_ACCOUNT_T *account,
+    int64_t bytes,
+    int32_t buffers)
+{
+    pthread_mutex_lock(&accountMutex);
+
+    account->cpuBytes += bytes;
+    account->cpuBuffers += buffers;
+
+    if (account->cpuBytes > account->cpuBytesPeak)
+    {
+        account->cpuBytesPeak = account->cpuBytes;
+    }
+
+    if (account->cpuBuffers > account->cpuBuffersPeak)
+    {
+        account->cpuBuffersPeak = account->cpuBuffers;
+    }
+
+    pthread_mutex_unlock(&accountMutex);
+}
+
+//-------------------------------------------------------------------------
+
+void
+chargeGpuMemoryAccount(
+    MEMORY_ACCOUNT_T *account,
+    int64_t bytes,
+    int32_t resources)
+{
+    pthread_mutex_lock(&accountMutex);
+
+    account->gpuBytes += bytes;
+    account->gpuResources += resources;
+
+    if (account->gpuBytes > account->gpuBytesPeak)
+    {
+        account->gpuBytesPeak = account->gpuBytes;
+    }
+
+    if (account->gpuResources > account->gpuResourcesPeak)
+    {
+        account->gpuResourcesPeak = account->gpuResources;
+    }
+
+    pthread_mutex_unlock(&accountMutex);
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+getMemoryAccounts(
+    MEMORY_ACCOUNT_T *copies,
+    int32_t size)
+{
+    pthread_mutex_lock(&accountMutex);
+
+    int32_t count = (numberOfAccounts < size) ? numberOfAccounts : size;
+    memcpy(copies, accounts, count * sizeof(MEMORY_ACCOUNT_T));
+
+    int32_t open = numberOfAccounts;
+
+    pthread_mutex_unlock(&accountMutex);
+
+    return open;
+}
+
+//-------------------------------------------------------------------------
+
+void
+printMemoryAccounts(
+    FILE *fp)
+{
+    MEMORY_ACCOUNT_T copies[MEMORY_ACCOUNT_MAX_ACCOUNTS];
+    int32_t count = getMemoryAccounts(copies, MEMORY_ACCOUNT_MAX_ACCOUNTS);
+
+    fprintf(fp,
+            "%-*s %12s %12s %6s %12s %12s %6s\n",
+            MEMORY_ACCOUNT_MAX_NAME - 1,
+            "account",
+            "cpu bytes",
+            "peak",
+            "bufs",
+            "gpu bytes",
+            "peak",
+            "res");
+
+    int32_t i;
+    for (i = 0 ; i < count ; i++)
+    {
+        const MEMORY_ACCOUNT_T *account = &(copies[i]);
+
+        if ((account->cpuBytesPeak == 0) && (account->gpuBytesPeak == 0))
+        {
+            continue;
+        }
+
+        fprintf(fp,
+                "%-*s %12lld %12lld %6d %12lld %12lld %6d\n",
+                MEMORY_ACCOUNT_MAX_NAME - 1,
+                account->name,
+                (long long)(account->cpuBytes),
+                (long long)(account->cpuBytesPeak),
+                account->cpuBuffers,
+                (long long)(account->gpuBytes),
+                (long long)(account->gpuBytesPeak),
+                account->gpuResources);
+    }
+}
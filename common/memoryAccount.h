@@ -0,0 +1,115 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef MEMORY_ACCOUNT_H
+#define MEMORY_ACCOUNT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Memory is charged to named accounts, one per subsystem, for instance
+// "scrollingLayer" or "life". Every thread has an account that it is
+// working for, which is what the resource pool charges its buffers and
+// resources to; they are credited back to the same account whenever and
+// wherever they are released. A subsystem that allocates memory of its
+// own can charge it directly. A thread that has not entered an account
+// is working for "other".
+
+#define MEMORY_ACCOUNT_MAX_ACCOUNTS 32
+#define MEMORY_ACCOUNT_MAX_NAME 24
+
+typedef struct
+{
+    char name[MEMORY_ACCOUNT_MAX_NAME];
+    int64_t cpuBytes;
+    int64_t cpuBytesPeak;
+    int32_t cpuBuffers;
+    int32_t cpuBuffersPeak;
+    int64_t gpuBytes;
+    int64_t gpuBytesPeak;
+    int32_t gpuResources;
+    int32_t gpuResourcesPeak;
+} MEMORY_ACCOUNT_T;
+
+//-------------------------------------------------------------------------
+
+// The account called name, which is opened the first time it is asked
+// for. Once every account is open, new names are charged to "other".
+
+MEMORY_ACCOUNT_T *
+findMemoryAccount(
+    const char *name);
+
+// Work for account, and return the account that was being worked for, to
+// be handed to leaveMemoryAccount() when done. Entering NULL leaves the
+// account unchanged.
+
+MEMORY_ACCOUNT_T *
+enterMemoryAccount(
+    MEMORY_ACCOUNT_T *account);
+
+void
+leaveMemoryAccount(
+    MEMORY_ACCOUNT_T *previous);
+
+MEMORY_ACCOUNT_T *
+currentMemoryAccount(void);
+
+// Negative bytes and counts are credits.
+
+void
+chargeCpuMemoryAccount(
+    MEMORY_ACCOUNT_T *account,
+    int64_t bytes,
+    int32_t buffers);
+
+void
+chargeGpuMemoryAccount(
+    MEMORY_ACCOUNT_T *account,
+    int64_t bytes,
+    int32_t resources);
+
+// Copy up to size accounts into accounts, and return how many are open.
+
+int32_t
+getMemoryAccounts(
+    MEMORY_ACCOUNT_T *accounts,
+    int32_t size);
+
+void
+printMemoryAccounts(
+    FILE *fp);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,90 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <stdint.h>
+
+//-------------------------------------------------------------------------
+
+// A small, fast pseudo random number generator (xorshift64*) for filling
+// images and boards, not for anything that needs to be unpredictable.
+// Each thread, or each row, gets a generator of its own: seedPrng() mixes
+// the seed and a stream number with splitmix64, so that the same seed
+// and stream always give the same numbers, however the work is divided.
+
+typedef struct
+{
+    uint64_t state;
+} PRNG_T;
+
+//-------------------------------------------------------------------------
+
+static inline void
+seedPrng(
+    PRNG_T *prng,
+    uint64_t seed,
+    uint64_t stream)
+{
+    uint64_t z = seed + ((stream + 1) * UINT64_C(0x9E3779B97F4A7C15));
+
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    z ^= z >> 31;
+
+    prng->state = (z == 0) ? UINT64_C(0x9E3779B97F4A7C15) : z;
+}
+
+static inline uint64_t
+nextPrng(
+    PRNG_T *prng)
+{
+    uint64_t x = prng->state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+
+    prng->state = x;
+
+    return x * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+// A number in [0, n), n no more than 2^32.
+
+static inline uint32_t
+boundedPrng(
+    PRNG_T *prng,
+    uint64_t n)
+{
+    return (uint32_t)(((nextPrng(prng) >> 32) * n) >> 32);
+}
+
+//-------------------------------------------------------------------------
+
+#endif
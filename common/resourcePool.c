@@ -0,0 +1,541 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resourcePool.h"
+
+//-------------------------------------------------------------------------
+
+#define RESOURCE_POOL_BUFFER_ALIGNMENT 16
+
+//-------------------------------------------------------------------------
+
+// Each buffer is preceded by a header, as long as the alignment, holding
+// the account it is charged to. The free list holds the header.
+
+typedef struct
+{
+    MEMORY_ACCOUNT_T *account;
+} RESOURCE_POOL_BUFFER_HEADER_T;
+
+#define RESOURCE_POOL_BUFFER_HEADER RESOURCE_POOL_BUFFER_ALIGNMENT
+
+typedef struct
+{
+    void *buffer;
+    size_t size;
+} RESOURCE_POOL_BUFFER_T;
+
+// The free lists are kept oldest first, so that the resource or buffer
+// that has been free the longest is the first deleted to make room.
+
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static RESOURCE_POOL_RESOURCE_T *inUse = NULL;
+static int32_t inUseCapacity = 0;
+static RESOURCE_POOL_RESOURCE_T freeResources[RESOURCE_POOL_MAX_FREE_RESOURCES];
+static RESOURCE_POOL_BUFFER_T freeBuffers[RESOURCE_POOL_MAX_FREE_BUFFERS];
+static RESOURCE_POOL_STATS_T stats;
+
+//-------------------------------------------------------------------------
+
+static size_t
+resourceBytes(
+    const RESOURCE_POOL_RESOURCE_T *entry)
+{
+    if (entry->pitch != 0)
+    {
+        return (size_t)(entry->pitch) * entry->alignedHeight;
+    }
+
+    // Dispmanx picks the layout; 32 bits per pixel is the worst case.
+
+    return (size_t)(entry->width) * entry->height * 4;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+addInUse(
+    const RESOURCE_POOL_RESOURCE_T *entry)
+{
+    if (stats.resourcesInUse == inUseCapacity)
+    {
+        inUseCapacity = (inUseCapacity == 0) ? 16 : inUseCapacity * 2;
+
+        RESOURCE_POOL_RESOURCE_T *entries =
+            realloc(inUse, inUseCapacity * sizeof(RESOURCE_POOL_RESOURCE_T));
+
+        if (entries == NULL)
+        {
+            fprintf(stderr, "resourcePool: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+
+        inUse = entries;
+    }
+
+    inUse[stats.resourcesInUse++] = *entry;
+
+    stats.resourceBytesInUse += resourceBytes(entry);
+
+    if (stats.resourcesInUse > stats.resourcesInUseHighWater)
+    {
+        stats.resourcesInUseHighWater = stats.resourcesInUse;
+    }
+
+    if (stats.resourceBytesInUse > stats.resourceBytesHighWater)
+    {
+        stats.resourceBytesHighWater = stats.resourceBytesInUse;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Take free resource i off the list. The pool mutex must be held.
+
+static RESOURCE_POOL_RESOURCE_T
+removeFreeResource(
+    int32_t i)
+{
+    RESOURCE_POOL_RESOURCE_T entry = freeResources[i];
+
+    memmove(&(freeResources[i]),
+            &(freeResources[i + 1]),
+            (stats.resourcesFree - i - 1) * sizeof(freeResources[0]));
+    --(stats.resourcesFree);
+    stats.resourceBytesFree -= resourceBytes(&entry);
+
+    return entry;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+deleteResources(
+    const DISPMANX_RESOURCE_HANDLE_T *resources,
+    int32_t count)
+{
+    int32_t i;
+    for (i = 0 ; i < count ; i++)
+    {
+        int result = vc_dispmanx_resource_delete(resources[i]);
+        assert(result == 0);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static DISPMANX_RESOURCE_HANDLE_T
+createResource(
+    const RESOURCE_POOL_RESOURCE_T *entry)
+{
+    uint32_t width = entry->width | (entry->pitch << 16);
+    uint32_t height = entry->height | (entry->alignedHeight << 16);
+    uint32_t vc_image_ptr;
+
+    return vc_dispmanx_resource_create(entry->type,
+                                       width,
+                                       height,
+                                       &vc_image_ptr);
+}
+
+//-------------------------------------------------------------------------
+
+DISPMANX_RESOURCE_HANDLE_T
+acquireResourcePool(
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height,
+    int32_t pitch,
+    int32_t alignedHeight)
+{
+    RESOURCE_POOL_RESOURCE_T entry =
+    {
+        type,
+        width,
+        height,
+        pitch,
+        alignedHeight,
+        0,
+        currentMemoryAccount()
+    };
+
+    pthread_mutex_lock(&poolMutex);
+
+    // Newest first, as it is the most likely to still be in the GPU's
+    // caches.
+
+    int32_t i;
+    for (i = stats.resourcesFree - 1 ; i >= 0 ; i--)
+    {
+        const RESOURCE_POOL_RESOURCE_T *candidate = &(freeResources[i]);
+
+        if ((candidate->type == type) &&
+            (candidate->width == width) &&
+            (candidate->height == height) &&
+            (candidate->pitch == pitch) &&
+            (candidate->alignedHeight == alignedHeight))
+        {
+            entry.resource = removeFreeResource(i).resource;
+            ++(stats.resourcesReused);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&poolMutex);
+
+    //---------------------------------------------------------------------
+
+    // Creating a resource is a round trip to the GPU, so it is done
+    // without holding the pool mutex. If the GPU is out of memory, what
+    // the free list holds is given back and it is tried once more.
+
+    bool created = false;
+
+    if (entry.resource == 0)
+    {
+        entry.resource = createResource(&entry);
+
+        if (entry.resource == 0)
+        {
+            trimResourcePool();
+            entry.resource = createResource(&entry);
+        }
+
+        if (entry.resource == 0)
+        {
+            fprintf(stderr, "resourcePool: GPU memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+
+        created = true;
+    }
+
+    pthread_mutex_lock(&poolMutex);
+
+    if (created)
+    {
+        ++(stats.resourcesCreated);
+    }
+
+    addInUse(&entry);
+
+    pthread_mutex_unlock(&poolMutex);
+
+    chargeGpuMemoryAccount(entry.account, resourceBytes(&entry), 1);
+
+    return entry.resource;
+}
+
+//-------------------------------------------------------------------------
+
+void
+releaseResourcePool(
+    DISPMANX_RESOURCE_HANDLE_T resource)
+{
+    if (resource == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&poolMutex);
+
+    int32_t i;
+    for (i = 0 ; i < stats.resourcesInUse ; i++)
+    {
+        if (inUse[i].resource == resource)
+        {
+            break;
+        }
+    }
+
+    if (i == stats.resourcesInUse)
+    {
+        // Not from the pool.
+
+        pthread_mutex_unlock(&poolMutex);
+
+        deleteResources(&resource, 1);
+
+        return;
+    }
+
+    RESOURCE_POOL_RESOURCE_T entry = inUse[i];
+    inUse[i] = inUse[--(stats.resourcesInUse)];
+
+    size_t bytes = resourceBytes(&entry);
+    stats.resourceBytesInUse -= bytes;
+
+    // Make room by deleting the oldest free resources, after the mutex is
+    // released. A resource too large to keep at all goes with them.
+
+    DISPMANX_RESOURCE_HANDLE_T evicted[RESOURCE_POOL_MAX_FREE_RESOURCES + 1];
+    int32_t numberEvicted = 0;
+
+    if (bytes > RESOURCE_POOL_MAX_FREE_RESOURCE_BYTES)
+    {
+        evicted[numberEvicted++] = entry.resource;
+    }
+    else
+    {
+        while ((stats.resourcesFree == RESOURCE_POOL_MAX_FREE_RESOURCES) ||
+               (stats.resourceBytesFree + bytes >
+                RESOURCE_POOL_MAX_FREE_RESOURCE_BYTES))
+        {
+            evicted[numberEvicted++] = removeFreeResource(0).resource;
+        }
+
+        freeResources[stats.resourcesFree++] = entry;
+        stats.resourceBytesFree += bytes;
+    }
+
+    pthread_mutex_unlock(&poolMutex);
+
+    chargeGpuMemoryAccount(entry.account, -(int64_t)bytes, -1);
+
+    deleteResources(evicted, numberEvicted);
+}
+
+//-------------------------------------------------------------------------
+
+// Take free buffer i off the list. The pool mutex must be held.
+
+static RESOURCE_POOL_BUFFER_T
+removeFreeBuffer(
+    int32_t i)
+{
+    RESOURCE_POOL_BUFFER_T entry = freeBuffers[i];
+
+    memmove(&(freeBuffers[i]),
+            &(freeBuffers[i + 1]),
+            (stats.buffersFree - i - 1) * sizeof(freeBuffers[0]));
+    --(stats.buffersFree);
+    stats.bufferBytesFree -= entry.size;
+
+    return entry;
+}
+
+//-------------------------------------------------------------------------
+
+void *
+acquireBufferPool(
+    size_t size)
+{
+    void *buffer = NULL;
+
+    pthread_mutex_lock(&poolMutex);
+
+    int32_t i;
+    for (i = stats.buffersFree - 1 ; i >= 0 ; i--)
+    {
+        if (freeBuffers[i].size == size)
+        {
+            buffer = removeFreeBuffer(i).buffer;
+            ++(stats.buffersReused);
+            break;
+        }
+    }
+
+    if (buffer == NULL)
+    {
+        ++(stats.buffersAllocated);
+    }
+
+    ++(stats.buffersInUse);
+    stats.bufferBytesInUse += size;
+
+    if (stats.bufferBytesInUse > stats.bufferBytesHighWater)
+    {
+        stats.bufferBytesHighWater = stats.bufferBytesInUse;
+    }
+
+    pthread_mutex_unlock(&poolMutex);
+
+    //---------------------------------------------------------------------
+
+    if (buffer == NULL)
+    {
+        if (posix_memalign(&buffer,
+                           RESOURCE_POOL_BUFFER_ALIGNMENT,
+                           RESOURCE_POOL_BUFFER_HEADER + size) != 0)
+        {
+            fprintf(stderr, "resourcePool: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    RESOURCE_POOL_BUFFER_HEADER_T *header = buffer;
+    header->account = currentMemoryAccount();
+    chargeCpuMemoryAccount(header->account, size, 1);
+
+    buffer = (uint8_t *)buffer + RESOURCE_POOL_BUFFER_HEADER;
+    memset(buffer, 0, size);
+
+    return buffer;
+}
+
+//-------------------------------------------------------------------------
+
+void
+releaseBufferPool(
+    void *buffer,
+    size_t size)
+{
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    buffer = (uint8_t *)buffer - RESOURCE_POOL_BUFFER_HEADER;
+
+    RESOURCE_POOL_BUFFER_HEADER_T *header = buffer;
+    chargeCpuMemoryAccount(header->account, -(int64_t)size, -1);
+
+    void *evicted[RESOURCE_POOL_MAX_FREE_BUFFERS + 1];
+    int32_t numberEvicted = 0;
+
+    pthread_mutex_lock(&poolMutex);
+
+    --(stats.buffersInUse);
+    stats.bufferBytesInUse -= size;
+
+    if (size > RESOURCE_POOL_MAX_FREE_BUFFER_BYTES)
+    {
+        evicted[numberEvicted++] = buffer;
+    }
+    else
+    {
+        while ((stats.buffersFree == RESOURCE_POOL_MAX_FREE_BUFFERS) ||
+               (stats.bufferBytesFree + size >
+                RESOURCE_POOL_MAX_FREE_BUFFER_BYTES))
+        {
+            evicted[numberEvicted++] = removeFreeBuffer(0).buffer;
+        }
+
+        freeBuffers[stats.buffersFree].buffer = buffer;
+        freeBuffers[stats.buffersFree].size = size;
+        ++(stats.buffersFree);
+        stats.bufferBytesFree += size;
+    }
+
+    pthread_mutex_unlock(&poolMutex);
+
+    int32_t i;
+    for (i = 0 ; i < numberEvicted ; i++)
+    {
+        free(evicted[i]);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+trimResourcePool(void)
+{
+    DISPMANX_RESOURCE_HANDLE_T resources[RESOURCE_POOL_MAX_FREE_RESOURCES];
+    void *buffers[RESOURCE_POOL_MAX_FREE_BUFFERS];
+
+    pthread_mutex_lock(&poolMutex);
+
+    int32_t numberOfResources = stats.resourcesFree;
+    int32_t numberOfBuffers = stats.buffersFree;
+
+    int32_t i;
+    for (i = 0 ; i < numberOfResources ; i++)
+    {
+        resources[i] = freeResources[i].resource;
+    }
+
+    for (i = 0 ; i < numberOfBuffers ; i++)
+    {
+        buffers[i] = freeBuffers[i].buffer;
+    }
+
+    stats.resourcesFree = 0;
+    stats.resourceBytesFree = 0;
+    stats.buffersFree = 0;
+    stats.bufferBytesFree = 0;
+
+    pthread_mutex_unlock(&poolMutex);
+
+    deleteResources(resources, numberOfResources);
+
+    for (i = 0 ; i < numberOfBuffers ; i++)
+    {
+        free(buffers[i]);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+getStatsResourcePool(
+    RESOURCE_POOL_STATS_T *poolStats)
+{
+    pthread_mutex_lock(&poolMutex);
+    *poolStats = stats;
+    pthread_mutex_unlock(&poolMutex);
+}
+
+//-------------------------------------------------------------------------
+
+void
+printStatsResourcePool(
+    FILE *fp)
+{
+    RESOURCE_POOL_STATS_T s;
+    getStatsResourcePool(&s);
+
+    fprintf(fp,
+            "resources: %d in use (%zu bytes), %d free (%zu bytes), "
+            "high water %d (%zu bytes), %u created, %u reused\n",
+            s.resourcesInUse,
+            s.resourceBytesInUse,
+            s.resourcesFree,
+            s.resourceBytesFree,
+            s.resourcesInUseHighWater,
+            s.resourceBytesHighWater,
+            s.resourcesCreated,
+            s.resourcesReused);
+
+    fprintf(fp,
+            "buffers: %d in use (%zu bytes), %d free (%zu bytes), "
+            "high water %zu bytes, %u allocated, %u reused\n",
+            s.buffersInUse,
+            s.bufferBytesInUse,
+            s.buffersFree,
+            s.bufferBytesFree,
+            s.bufferBytesHighWater,
+            s.buffersAllocated,
+            s.buffersReused);
+}
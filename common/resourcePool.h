@@ -0,0 +1,144 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef RESOURCE_POOL_H
+#define RESOURCE_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bcm_host.h"
+
+#include "memoryAccount.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// A process wide pool of Dispmanx resources and image buffers. Released
+// resources and buffers are kept, up to a limit, and handed out again
+// for the next request with the same key, instead of being deleted and
+// created again. A resource is keyed by type, width, height, pitch and
+// aligned height; a buffer by its size. Buffers are 16 byte aligned and
+// cleared when they are handed out. A reused resource is not cleared, so
+// it must be written before it is shown. The pool may be used from any
+// thread. Buffers and resources are charged to the memory account of the
+// thread that acquired them, until they are released.
+//
+// The free lists are limited both in length and in the bytes they hold,
+// so that a few large resources or buffers are not kept just because
+// there is room for sixteen. One that is larger than the limit on its
+// own is deleted when it is released.
+
+#define RESOURCE_POOL_MAX_FREE_RESOURCES 16
+#define RESOURCE_POOL_MAX_FREE_RESOURCE_BYTES (16 * 1024 * 1024)
+#define RESOURCE_POOL_MAX_FREE_BUFFERS 16
+#define RESOURCE_POOL_MAX_FREE_BUFFER_BYTES (16 * 1024 * 1024)
+
+typedef struct
+{
+    VC_IMAGE_TYPE_T type;
+    int32_t width;
+    int32_t height;
+    int32_t pitch;
+    int32_t alignedHeight;
+    DISPMANX_RESOURCE_HANDLE_T resource;
+    MEMORY_ACCOUNT_T *account;
+} RESOURCE_POOL_RESOURCE_T;
+
+// Bytes are estimated as pitch * aligned height.
+
+typedef struct
+{
+    int32_t resourcesInUse;
+    int32_t resourcesInUseHighWater;
+    int32_t resourcesFree;
+    size_t resourceBytesFree;
+    size_t resourceBytesInUse;
+    size_t resourceBytesHighWater;
+    uint32_t resourcesCreated;
+    uint32_t resourcesReused;
+    int32_t buffersInUse;
+    int32_t buffersFree;
+    size_t bufferBytesFree;
+    size_t bufferBytesInUse;
+    size_t bufferBytesHighWater;
+    uint32_t buffersAllocated;
+    uint32_t buffersReused;
+} RESOURCE_POOL_STATS_T;
+
+//-------------------------------------------------------------------------
+
+// A pitch and aligned height of zero let Dispmanx choose them, as
+// vc_dispmanx_resource_create() with a plain width and height does. If
+// the resource cannot be created, the free resources are deleted to make
+// room and it is tried again. If that fails too the GPU is out of memory
+// and, as when malloc fails, the program exits, so it never returns 0.
+
+DISPMANX_RESOURCE_HANDLE_T
+acquireResourcePool(
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height,
+    int32_t pitch,
+    int32_t alignedHeight);
+
+// The resource must no longer be the source of any element.
+
+void
+releaseResourcePool(
+    DISPMANX_RESOURCE_HANDLE_T resource);
+
+void *
+acquireBufferPool(
+    size_t size);
+
+void
+releaseBufferPool(
+    void *buffer,
+    size_t size);
+
+// Delete every free resource and buffer.
+
+void
+trimResourcePool(void);
+
+void
+getStatsResourcePool(
+    RESOURCE_POOL_STATS_T *stats);
+
+void
+printStatsResourcePool(
+    FILE *fp);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
@@ -27,174 +27,624 @@
 
 #define _GNU_SOURCE
 
-#include <png.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "image.h"
+#include "imageConvert.h"
+#include "savepng.h"
 
 //-----------------------------------------------------------------------
 
-bool
-pngWriteImageRGB565(
-    const IMAGE_T *image,
-    png_structp pngPtr,
-    png_infop infoPtr)
+// The image is split into bands of rows that are filtered and deflated in
+// parallel, the way pigz does it. Each band but the last ends with a sync
+// flush, so the raw deflate streams can simply be concatenated. Every band
+// is primed with the last 32K of the band before, so compression barely
+// suffers.
+
+#define SAVEPNG_MAX_THREADS 8
+#define SAVEPNG_MIN_BAND_ROWS 32
+#define SAVEPNG_WINDOW_SIZE 32768
+
+//-----------------------------------------------------------------------
+
+typedef struct
+{
+    const IMAGE_T *image;
+    int32_t channels;
+    int32_t rowBytes;
+    int32_t rowsPerBand;
+    uint8_t *filtered;
+    pthread_barrier_t filteredBarrier;
+} SAVEPNG_ENCODER_T;
+
+typedef struct
+{
+    SAVEPNG_ENCODER_T *encoder;
+    pthread_t thread;
+    int32_t startRow;
+    int32_t endRow;
+    bool last;
+    uint8_t *compressed;
+    size_t compressedLength;
+    uLong adler;
+    bool result;
+} SAVEPNG_BAND_T;
+
+//-----------------------------------------------------------------------
+
+// Return row y as 8 bit channels, converting it into buffer if the image
+// is not stored that way already.
+
+static const uint8_t *
+pngRow(
+    const SAVEPNG_ENCODER_T *encoder,
+    int32_t y,
+    uint8_t *buffer)
 {
-    int32_t rowLength = 3 * image->width;
-    uint8_t *imageRow = malloc(rowLength);
+    const IMAGE_T *image = encoder->image;
+    const uint8_t *row = (uint8_t *)(image->buffer) + (y * image->pitch);
 
-    if (imageRow == NULL)
+    switch (image->type)
     {
-        fprintf(stderr, "savepng: unable to allocated row buffer\n");
-        return false;
+    case VC_IMAGE_RGB565:
+
+        expandRowRGB565((const uint16_t *)row, buffer, image->width);
+        return buffer;
+
+    case VC_IMAGE_RGBA16:
+
+        expandRowRGBA16((const uint16_t *)row, buffer, image->width);
+        return buffer;
+
+    default:
+
+        return row;
     }
+}
+
+//-----------------------------------------------------------------------
 
-    int32_t y = 0;
-    for (y = 0; y < image->height; y++)
+static inline uint8_t
+paethPredictor(
+    int16_t a,
+    int16_t b,
+    int16_t c)
+{
+    int16_t p = a + b - c;
+    int16_t pa = abs(p - a);
+    int16_t pb = abs(p - b);
+    int16_t pc = abs(p - c);
+
+    if ((pa <= pb) && (pa <= pc))
     {
-        int32_t x = 0;
-        for (x = 0; x < image->width; x++)
-        {
-            uint16_t pixels = *(uint16_t*)(image->buffer +
-                                          (y * image->pitch) +
-                                          ((x * image->bitsPerPixel) / 8));
-            int32_t index = x * 3;
-
-            uint8_t r5 = (pixels >> 11) & 0x1F;
-            uint8_t g6 = (pixels >> 5) & 0x3F;
-            uint8_t b5 = (pixels) & 0x1F;
-
-            imageRow[index] =  (r5 << 3) | (r5 >> 2);
-            imageRow[index + 1] =  (g6 << 2) | (g6 >> 4);
-            imageRow[index + 2] =  (b5 << 3) | (b5 >> 2);
-        }
-        png_write_row(pngPtr, imageRow);
+        return a;
+    }
+    else if (pb <= pc)
+    {
+        return b;
+    }
+
+    return c;
+}
+
+//-----------------------------------------------------------------------
+
+static uint32_t
+filterCost(
+    const uint8_t *filtered,
+    int32_t length)
+{
+    uint32_t sum = 0;
 
+    int32_t i;
+    for (i = 0 ; i < length ; i++)
+    {
+        uint8_t value = filtered[i];
+        sum += (value < 128) ? value : 256 - value;
     }
 
-    free(imageRow);
+    return sum;
+}
+
+//-----------------------------------------------------------------------
+
+// Filter one row with each of the five png filters and keep the one with
+// the smallest sum of absolute (signed) values, as libpng does by default.
+// out has room for the filter type byte plus rowBytes, and scratch for
+// another rowBytes.
+
+static void
+filterRow(
+    const uint8_t *row,
+    const uint8_t *previous,
+    int32_t rowBytes,
+    int32_t bpp,
+    uint8_t *out,
+    uint8_t *scratch)
+{
+    out[0] = 0;
+    memcpy(out + 1, row, rowBytes);
+    uint32_t bestCost = filterCost(row, rowBytes);
+
+    int filter;
+    for (filter = 1 ; filter < 5 ; filter++)
+    {
+        int32_t i;
+
+        switch (filter)
+        {
+        case 1:
+
+            for (i = 0 ; i < bpp ; i++)
+            {
+                scratch[i] = row[i];
+            }
 
-    return true;
+            for ( ; i < rowBytes ; i++)
+            {
+                scratch[i] = row[i] - row[i - bpp];
+            }
+
+            break;
+
+        case 2:
+
+            for (i = 0 ; i < rowBytes ; i++)
+            {
+                scratch[i] = row[i] - previous[i];
+            }
+
+            break;
+
+        case 3:
+
+            for (i = 0 ; i < bpp ; i++)
+            {
+                scratch[i] = row[i] - (previous[i] >> 1);
+            }
+
+            for ( ; i < rowBytes ; i++)
+            {
+                scratch[i] = row[i] - ((row[i - bpp] + previous[i]) >> 1);
+            }
+
+            break;
+
+        case 4:
+
+            for (i = 0 ; i < bpp ; i++)
+            {
+                scratch[i] = row[i] - previous[i];
+            }
+
+            for ( ; i < rowBytes ; i++)
+            {
+                scratch[i] = row[i] - paethPredictor(row[i - bpp],
+                                                     previous[i],
+                                                     previous[i - bpp]);
+            }
+
+            break;
+        }
+
+        uint32_t cost = filterCost(scratch, rowBytes);
+
+        if (cost < bestCost)
+        {
+            out[0] = filter;
+            memcpy(out + 1, scratch, rowBytes);
+            bestCost = cost;
+        }
+    }
 }
 
 //-----------------------------------------------------------------------
 
-bool
-pngWriteImageRGB888(
-    const IMAGE_T *image,
-    png_structp pngPtr,
-    png_infop infoPtr)
+static void *
+bandThread(
+    void *arg)
 {
-    int32_t y = 0;
-    for (y = 0; y < image->height; y++)
+    SAVEPNG_BAND_T *band = arg;
+    SAVEPNG_ENCODER_T *encoder = band->encoder;
+
+    int32_t rowBytes = encoder->rowBytes;
+    int32_t stride = rowBytes + 1;
+
+    band->result = false;
+
+    //-------------------------------------------------------------------
+    // Filter the rows of the band. The row above the band is converted
+    // again rather than shared, as the filters need it whole.
+
+    uint8_t *buffers = calloc(4, rowBytes);
+
+    if (buffers == NULL)
+    {
+        fprintf(stderr, "savepng: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t *rowBuffer[2] = { buffers, buffers + rowBytes };
+    uint8_t *zeros = buffers + (2 * rowBytes);
+    uint8_t *scratch = buffers + (3 * rowBytes);
+
+    const uint8_t *previous = zeros;
+
+    if (band->startRow > 0)
+    {
+        previous = pngRow(encoder, band->startRow - 1, rowBuffer[1]);
+    }
+
+    int32_t current = 0;
+
+    int32_t y;
+    for (y = band->startRow ; y < band->endRow ; y++)
+    {
+        const uint8_t *row = pngRow(encoder, y, rowBuffer[current]);
+        current ^= 1;
+
+        filterRow(row,
+                  previous,
+                  rowBytes,
+                  encoder->channels,
+                  encoder->filtered + (y * stride),
+                  scratch);
+
+        previous = row;
+    }
+
+    free(buffers);
+
+    pthread_barrier_wait(&(encoder->filteredBarrier));
+
+    //-------------------------------------------------------------------
+
+    const uint8_t *input = encoder->filtered + (band->startRow * stride);
+    size_t inputLength = (band->endRow - band->startRow) * stride;
+
+    band->adler = adler32(adler32(0L, Z_NULL, 0), input, inputLength);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    if (deflateInit2(&stream,
+                     Z_DEFAULT_COMPRESSION,
+                     Z_DEFLATED,
+                     -15,
+                     8,
+                     Z_FILTERED) != Z_OK)
+    {
+        return NULL;
+    }
+
+    if (band->startRow > 0)
+    {
+        size_t before = band->startRow * stride;
+        size_t dictionaryLength = (before < SAVEPNG_WINDOW_SIZE)
+                                ? before
+                                : SAVEPNG_WINDOW_SIZE;
+
+        deflateSetDictionary(&stream,
+                             input - dictionaryLength,
+                             dictionaryLength);
+    }
+
+    // Room for a sync flush marker on top of the worst case.
+
+    size_t bound = deflateBound(&stream, inputLength) + 16;
+    band->compressed = malloc(bound);
+
+    if (band->compressed == NULL)
     {
-        png_write_row(pngPtr, image->buffer + (image->pitch * y));
+        fprintf(stderr, "savepng: memory exhausted\n");
+        exit(EXIT_FAILURE);
     }
 
-    return true;
+    stream.next_in = (Bytef *)input;
+    stream.avail_in = inputLength;
+    stream.next_out = band->compressed;
+    stream.avail_out = bound;
+
+    int flush = band->last ? Z_FINISH : Z_SYNC_FLUSH;
+    int status = deflate(&stream, flush);
+
+    band->compressedLength = bound - stream.avail_out;
+    band->result = (flush == Z_FINISH) ? (status == Z_STREAM_END)
+                                       : ((status == Z_OK) &&
+                                          (stream.avail_in == 0));
+
+    deflateEnd(&stream);
+
+    return NULL;
 }
 
 //-----------------------------------------------------------------------
 
-bool
-pngWriteImageRGBA16(
+static void
+putUint32(
+    uint8_t *bytes,
+    uint32_t value)
+{
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+//-----------------------------------------------------------------------
+
+static bool
+writeChunkData(
+    FILE *fp,
+    const void *data,
+    size_t length,
+    uLong *crc)
+{
+    *crc = crc32(*crc, data, length);
+
+    return fwrite(data, 1, length, fp) == length;
+}
+
+//-----------------------------------------------------------------------
+
+static bool
+startChunk(
+    FILE *fp,
+    const char *type,
+    uint32_t length,
+    uLong *crc)
+{
+    uint8_t bytes[4];
+    putUint32(bytes, length);
+
+    *crc = crc32(0L, Z_NULL, 0);
+
+    return (fwrite(bytes, 1, sizeof(bytes), fp) == sizeof(bytes)) &&
+           writeChunkData(fp, type, 4, crc);
+}
+
+//-----------------------------------------------------------------------
+
+static bool
+endChunk(
+    FILE *fp,
+    uLong crc)
+{
+    uint8_t bytes[4];
+    putUint32(bytes, crc);
+
+    return fwrite(bytes, 1, sizeof(bytes), fp) == sizeof(bytes);
+}
+
+//-----------------------------------------------------------------------
+
+static bool
+writePng(
+    FILE *fp,
     const IMAGE_T *image,
-    png_structp pngPtr,
-    png_infop infoPtr)
+    SAVEPNG_BAND_T *bands,
+    int32_t numberOfBands,
+    uLong adler)
 {
-    int32_t rowLength = 4 * image->width;
-    uint8_t *imageRow = malloc(rowLength);
+    static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    static const uint8_t zlibHeader[2] = { 0x78, 0x9C };
+
+    uLong crc;
+
+    if (fwrite(signature, 1, sizeof(signature), fp) != sizeof(signature))
+    {
+        return false;
+    }
+
+    //-------------------------------------------------------------------
+
+    uint8_t header[13];
+    putUint32(header, image->width);
+    putUint32(header + 4, image->height);
+    header[8] = 8;
+    header[9] = ((image->type == VC_IMAGE_RGBA16) ||
+                 (image->type == VC_IMAGE_RGBA32)) ? 6 : 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+
+    if ((startChunk(fp, "IHDR", sizeof(header), &crc) == false) ||
+        (writeChunkData(fp, header, sizeof(header), &crc) == false) ||
+        (endChunk(fp, crc) == false))
+    {
+        return false;
+    }
+
+    //-------------------------------------------------------------------
+
+    uint32_t length = sizeof(zlibHeader) + 4;
+
+    int32_t i;
+    for (i = 0 ; i < numberOfBands ; i++)
+    {
+        length += bands[i].compressedLength;
+    }
 
-    if (imageRow == NULL)
+    if ((startChunk(fp, "IDAT", length, &crc) == false) ||
+        (writeChunkData(fp, zlibHeader, sizeof(zlibHeader), &crc) == false))
     {
-        fprintf(stderr, "savepng: unable to allocated row buffer\n");
         return false;
     }
 
-    int32_t y = 0;
-    for (y = 0; y < image->height; y++)
+    for (i = 0 ; i < numberOfBands ; i++)
     {
-        int32_t x = 0;
-        for (x = 0; x < image->width; x++)
+        if (writeChunkData(fp,
+                           bands[i].compressed,
+                           bands[i].compressedLength,
+                           &crc) == false)
         {
-            uint16_t pixels = *(uint16_t*)(image->buffer +
-                                           (y * image->pitch) +
-                                           ((x * image->bitsPerPixel) / 8));
-            int32_t index = x * 4;
-
-            uint8_t r4 = (pixels >> 12) & 0xF;
-            uint8_t g4 = (pixels >> 8) & 0xF;
-            uint8_t b4 = (pixels >> 4) & 0xF;
-            uint8_t a4 = pixels & 0xF;
-
-            imageRow[index] = (r4 << 4) | r4;
-            imageRow[index + 1] = (g4 << 4) | g4;
-            imageRow[index + 2] = (b4 << 4) | b4;
-            imageRow[index + 3] = (a4 << 4) | a4;
+            return false;
         }
-        png_write_row(pngPtr, imageRow);
+    }
+
+    uint8_t trailer[4];
+    putUint32(trailer, adler);
 
+    if ((writeChunkData(fp, trailer, sizeof(trailer), &crc) == false) ||
+        (endChunk(fp, crc) == false))
+    {
+        return false;
     }
 
-    free(imageRow);
+    //-------------------------------------------------------------------
 
-    return true;
+    return startChunk(fp, "IEND", 0, &crc) && endChunk(fp, crc);
 }
 
 //-----------------------------------------------------------------------
 
 bool
-pngWriteImageRGBA32(
+savePngFile(
     const IMAGE_T *image,
-    png_structp pngPtr,
-    png_infop infoPtr)
+    FILE *fp)
 {
-    int32_t y = 0;
-    for (y = 0; y < image->height; y++)
+    SAVEPNG_ENCODER_T encoder;
+    encoder.image = image;
+
+    switch (image->type)
+    {
+    case VC_IMAGE_RGB565:
+    case VC_IMAGE_RGB888:
+
+        encoder.channels = 3;
+        break;
+
+    case VC_IMAGE_RGBA16:
+    case VC_IMAGE_RGBA32:
+
+        encoder.channels = 4;
+        break;
+
+    default:
+
+        fprintf(stderr, "savepng: unsupported image type\n");
+        return false;
+    }
+
+    encoder.rowBytes = encoder.channels * image->width;
+    encoder.filtered = malloc(image->height * (encoder.rowBytes + 1));
+
+    if (encoder.filtered == NULL)
     {
-        png_write_row(pngPtr, image->buffer + (image->pitch * y));
+        fprintf(stderr, "savepng: memory exhausted\n");
+        exit(EXIT_FAILURE);
     }
 
-    return true;
-}
+    //-------------------------------------------------------------------
 
-//-----------------------------------------------------------------------
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
 
-bool savePng(const IMAGE_T* image, const char *file)
-{
-    png_structp pngPtr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-                                                 NULL,
-                                                 NULL,
-                                                 NULL);
+    if (cores < 1)
+    {
+        cores = 1;
+    }
 
-    if (pngPtr == NULL)
+    if (cores > SAVEPNG_MAX_THREADS)
     {
-        fprintf(stderr,
-                "savepng: unable to allocated PNG write structure\n");
+        cores = SAVEPNG_MAX_THREADS;
+    }
 
-        return false;
+    int32_t numberOfBands = (image->height + SAVEPNG_MIN_BAND_ROWS - 1)
+                          / SAVEPNG_MIN_BAND_ROWS;
+
+    if (numberOfBands > cores)
+    {
+        numberOfBands = cores;
     }
 
-    png_infop infoPtr = png_create_info_struct(pngPtr);
+    if (numberOfBands < 1)
+    {
+        numberOfBands = 1;
+    }
+
+    encoder.rowsPerBand = (image->height + numberOfBands - 1) / numberOfBands;
+
+    pthread_barrier_init(&(encoder.filteredBarrier), NULL, numberOfBands);
 
-    if (infoPtr == NULL)
+    SAVEPNG_BAND_T bands[SAVEPNG_MAX_THREADS];
+
+    int32_t i;
+    for (i = 0 ; i < numberOfBands ; i++)
     {
-        fprintf(stderr,
-                "savepng: unable to allocated PNG info structure\n");
+        SAVEPNG_BAND_T *band = &(bands[i]);
 
-        return false;
+        band->encoder = &encoder;
+        band->startRow = i * encoder.rowsPerBand;
+        band->endRow = band->startRow + encoder.rowsPerBand;
+        band->last = (i == numberOfBands - 1);
+        band->compressed = NULL;
+        band->compressedLength = 0;
+
+        if (band->endRow > image->height)
+        {
+            band->endRow = image->height;
+        }
+
+        if (band->startRow > band->endRow)
+        {
+            band->startRow = band->endRow;
+        }
+
+        pthread_create(&(band->thread), NULL, bandThread, band);
+    }
+
+    //-------------------------------------------------------------------
+
+    bool result = true;
+    uLong adler = adler32(0L, Z_NULL, 0);
+
+    for (i = 0 ; i < numberOfBands ; i++)
+    {
+        SAVEPNG_BAND_T *band = &(bands[i]);
+
+        pthread_join(band->thread, NULL);
+
+        result = result && band->result;
+        adler = adler32_combine(adler,
+                                band->adler,
+                                (band->endRow - band->startRow)
+                                * (encoder.rowBytes + 1));
     }
 
-    if (setjmp(png_jmpbuf(pngPtr)))
+    pthread_barrier_destroy(&(encoder.filteredBarrier));
+    free(encoder.filtered);
+
+    //-------------------------------------------------------------------
+
+    if (result)
+    {
+        result = writePng(fp, image, bands, numberOfBands, adler);
+    }
+    else
     {
         fprintf(stderr, "savepng: unable to create PNG\n");
-        return false;
     }
 
+    for (i = 0 ; i < numberOfBands ; i++)
+    {
+        free(bands[i].compressed);
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------
+
+bool savePng(const IMAGE_T* image, const char *file)
+{
     FILE *pngfp = fopen(file, "wb");
 
     if (pngfp == NULL)
@@ -204,64 +654,95 @@ bool savePng(const IMAGE_T* image, const char *file)
                 file,
                 strerror(errno));
 
-        exit(EXIT_FAILURE);
+        return false;
     }
 
-    png_init_io(pngPtr, pngfp);
+    bool result = savePngFile(image, pngfp);
 
-    int png_color_type = PNG_COLOR_TYPE_RGB;
+    if (fclose(pngfp) != 0)
+    {
+        result = false;
+    }
 
-    if ((image->type == VC_IMAGE_RGBA16) ||
-        (image->type == VC_IMAGE_RGBA32))
+    if (result == false)
     {
-        png_color_type = PNG_COLOR_TYPE_RGBA;
+        fprintf(stderr, "savepng: unable to write %s\n", file);
     }
 
-    png_set_IHDR(
-        pngPtr,
-        infoPtr,
-        image->width,
-        image->height,
-        8,
-        png_color_type,
-        PNG_INTERLACE_NONE,
-        PNG_COMPRESSION_TYPE_BASE,
-        PNG_FILTER_TYPE_BASE);
+    return result;
+}
+
+//-----------------------------------------------------------------------
+
+static void *
+savePngAsyncThread(
+    void *arg)
+{
+    SAVE_PNG_ASYNC_T *handle = arg;
+
+    handle->result = savePng(&(handle->image), handle->file);
+
+    __sync_synchronize();
+    handle->finished = true;
 
-    png_write_info(pngPtr, infoPtr);
+    return NULL;
+}
+
+//-----------------------------------------------------------------------
 
-    bool result = false;
+SAVE_PNG_ASYNC_T *
+savePngAsync(
+    const IMAGE_T *image,
+    const char *file)
+{
+    SAVE_PNG_ASYNC_T *handle = calloc(1, sizeof(SAVE_PNG_ASYNC_T));
 
-    switch(image->type)
+    if (handle != NULL)
     {
-    case VC_IMAGE_RGB565:
+        handle->image = *image;
+        handle->image.buffer = malloc(image->size);
+        handle->image.dirty = NULL;
+        handle->image.freeBuffer = NULL;
+        handle->file = strdup(file);
+    }
 
-        result = pngWriteImageRGB565(image, pngPtr, infoPtr);
-        break;
+    if ((handle == NULL) ||
+        (handle->image.buffer == NULL) ||
+        (handle->file == NULL))
+    {
+        fprintf(stderr, "savepng: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
 
-    case VC_IMAGE_RGB888:
+    memcpy(handle->image.buffer, image->buffer, image->size);
 
-        result = pngWriteImageRGB888(image, pngPtr, infoPtr);
-        break;
+    pthread_create(&(handle->thread), NULL, savePngAsyncThread, handle);
 
-    case VC_IMAGE_RGBA16:
+    return handle;
+}
 
-        result = pngWriteImageRGBA16(image, pngPtr, infoPtr);
-        break;
+//-----------------------------------------------------------------------
 
-    case VC_IMAGE_RGBA32:
+bool
+finishedSavePng(
+    const SAVE_PNG_ASYNC_T *handle)
+{
+    return handle->finished;
+}
 
-        result = pngWriteImageRGBA32(image, pngPtr, infoPtr);
-        break;
+//-----------------------------------------------------------------------
 
-    default:
+bool
+waitForSavePng(
+    SAVE_PNG_ASYNC_T *handle)
+{
+    pthread_join(handle->thread, NULL);
 
-        break;
-    }
+    bool result = handle->result;
 
-    png_write_end(pngPtr, NULL);
-    png_destroy_write_struct(&pngPtr, &infoPtr);
-    fclose(pngfp);
+    destroyImage(&(handle->image));
+    free(handle->file);
+    free(handle);
 
     return result;
 }
@@ -28,14 +28,62 @@
 #ifndef SAVEPNG_H
 #define SAVEPNG_H
 
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "image.h"
 
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// A png being written in the background from a private copy of an image.
+
+typedef struct
+{
+    pthread_t thread;
+    IMAGE_T image;
+    char *file;
+    volatile bool finished;
+    bool result;
+} SAVE_PNG_ASYNC_T;
+
 //-------------------------------------------------------------------------
 
 bool savePng(const IMAGE_T* image, const char *file);
 
+// Write the image as a png to fp, which is left open, so that a sequence
+// of pngs can be written to one stream.
+
+bool
+savePngFile(
+    const IMAGE_T *image,
+    FILE *fp);
+
+// Copy the image and write it to file on another thread, so the caller
+// can carry on drawing into the original straight away. The handle must
+// be passed to waitForSavePng(), which frees it and returns false if the
+// file could not be created or written.
+
+SAVE_PNG_ASYNC_T *
+savePngAsync(
+    const IMAGE_T *image,
+    const char *file);
+
+// True once the png has been written (or has failed), when
+// waitForSavePng() will not block.
+
+bool
+finishedSavePng(
+    const SAVE_PNG_ASYNC_T *handle);
+
+bool
+waitForSavePng(
+    SAVE_PNG_ASYNC_T *handle);
+
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
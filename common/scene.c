@@ -0,0 +1,470 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "element_change.h"
+#include "scene.h"
+
+//-------------------------------------------------------------------------
+
+#define SCENE_INITIAL_CAPACITY 16
+
+//-------------------------------------------------------------------------
+
+void
+initScene(
+    SCENE_T *scene,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    FRAME_LOOP_T *loop)
+{
+    scene->display = display;
+    scene->loop = loop;
+    scene->capacity = SCENE_INITIAL_CAPACITY;
+    scene->numberOfNodes = 0;
+    scene->numberOfChangedNodes = 0;
+    scene->updates = 0;
+    scene->nodes = malloc(scene->capacity * sizeof(SCENE_NODE_T));
+    scene->changedNodes = malloc(scene->capacity * sizeof(int32_t));
+
+    if ((scene->nodes == NULL) || (scene->changedNodes == NULL))
+    {
+        fprintf(stderr, "scene: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+markChangedScene(
+    SCENE_T *scene,
+    int32_t index,
+    uint32_t change)
+{
+    SCENE_NODE_T *node = &(scene->nodes[index]);
+
+    if (node->changed == 0)
+    {
+        scene->changedNodes[scene->numberOfChangedNodes++] = index;
+    }
+
+    node->changed |= change;
+}
+
+//-------------------------------------------------------------------------
+
+// Reuse the slot of a node that has been removed, if there is one, so
+// that indices stay small and stable.
+
+static int32_t
+newNodeScene(
+    SCENE_T *scene)
+{
+    int32_t index;
+    for (index = 0 ; index < scene->numberOfNodes ; index++)
+    {
+        if (scene->nodes[index].type == SCENE_NODE_NONE)
+        {
+            return index;
+        }
+    }
+
+    if (scene->numberOfNodes == scene->capacity)
+    {
+        scene->capacity *= 2;
+
+        SCENE_NODE_T *nodes =
+            realloc(scene->nodes, scene->capacity * sizeof(SCENE_NODE_T));
+        int32_t *changedNodes =
+            realloc(scene->changedNodes, scene->capacity * sizeof(int32_t));
+
+        if ((nodes == NULL) || (changedNodes == NULL))
+        {
+            fprintf(stderr, "scene: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+
+        scene->nodes = nodes;
+        scene->changedNodes = changedNodes;
+    }
+
+    return scene->numberOfNodes++;
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+addImageLayerScene(
+    SCENE_T *scene,
+    IMAGE_LAYER_T *il,
+    int32_t x,
+    int32_t y)
+{
+    int32_t index = newNodeScene(scene);
+    SCENE_NODE_T *node = &(scene->nodes[index]);
+
+    node->type = SCENE_NODE_IMAGE_LAYER;
+    node->data = il;
+    node->callbacks = NULL;
+    node->layer = il->layer;
+    node->opacity = 255;
+    node->changed = 0;
+
+    vc_dispmanx_rect_set(&(il->srcRect),
+                         0 << 16,
+                         0 << 16,
+                         il->image.width << 16,
+                         il->image.height << 16);
+
+    // The element is added by the scene, so there is none to change yet.
+
+    setDestinationImageLayer(il,
+                             x,
+                             y,
+                             il->destWidth,
+                             il->destHeight,
+                             0);
+
+    markChangedScene(scene, index, SCENE_CHANGE_ADD);
+
+    return index;
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+addCallbackScene(
+    SCENE_T *scene,
+    void *data,
+    const SCENE_CALLBACKS_T *callbacks)
+{
+    int32_t index = newNodeScene(scene);
+    SCENE_NODE_T *node = &(scene->nodes[index]);
+
+    node->type = SCENE_NODE_CALLBACK;
+    node->data = data;
+    node->callbacks = callbacks;
+    node->layer = 0;
+    node->opacity = 255;
+    node->changed = 0;
+
+    if (callbacks->add != NULL)
+    {
+        markChangedScene(scene, index, SCENE_CHANGE_ADD);
+    }
+
+    return index;
+}
+
+//-------------------------------------------------------------------------
+
+void
+moveNodeScene(
+    SCENE_T *scene,
+    int32_t index,
+    int32_t x,
+    int32_t y)
+{
+    SCENE_NODE_T *node = &(scene->nodes[index]);
+
+    if (node->type != SCENE_NODE_IMAGE_LAYER)
+    {
+        return;
+    }
+
+    IMAGE_LAYER_T *il = node->data;
+
+    if ((il->dstRect.x != x) || (il->dstRect.y != y))
+    {
+        il->dstRect.x = x;
+        il->dstRect.y = y;
+
+        markChangedScene(scene, index, ELEMENT_CHANGE_DEST_RECT);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+setOpacityNodeScene(
+    SCENE_T *scene,
+    int32_t index,
+    uint8_t opacity)
+{
+    SCENE_NODE_T *node = &(scene->nodes[index]);
+
+    if ((node->type == SCENE_NODE_IMAGE_LAYER) && (node->opacity != opacity))
+    {
+        node->opacity = opacity;
+
+        markChangedScene(scene, index, ELEMENT_CHANGE_OPACITY);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+setLayerNodeScene(
+    SCENE_T *scene,
+    int32_t index,
+    int32_t layer)
+{
+    SCENE_NODE_T *node = &(scene->nodes[index]);
+
+    if ((node->type == SCENE_NODE_IMAGE_LAYER) && (node->layer != layer))
+    {
+        node->layer = layer;
+
+        markChangedScene(scene, index, ELEMENT_CHANGE_LAYER);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+markChangedNodeScene(
+    SCENE_T *scene,
+    int32_t index)
+{
+    markChangedScene(scene, index, SCENE_CHANGE_SOURCE);
+}
+
+//-------------------------------------------------------------------------
+
+void
+removeNodeScene(
+    SCENE_T *scene,
+    int32_t index)
+{
+    markChangedScene(scene, index, SCENE_CHANGE_REMOVE);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+updateImageLayerNode(
+    SCENE_T *scene,
+    SCENE_NODE_T *node,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    IMAGE_LAYER_T *il = node->data;
+
+    if (node->changed & SCENE_CHANGE_REMOVE)
+    {
+        if ((node->changed & SCENE_CHANGE_ADD) == 0)
+        {
+            removeElementImageLayer(il, update);
+        }
+
+        return;
+    }
+
+    uint32_t attributes = node->changed & (ELEMENT_CHANGE_LAYER |
+                                           ELEMENT_CHANGE_OPACITY |
+                                           ELEMENT_CHANGE_DEST_RECT);
+
+    if (node->changed & SCENE_CHANGE_ADD)
+    {
+        // The element is added with the layer and rectangles as they are
+        // now; only the opacity is not one of its arguments.
+
+        il->layer = node->layer;
+        addElementImageLayer(il, scene->display, update);
+
+        attributes = (node->opacity != 255) ? ELEMENT_CHANGE_OPACITY : 0;
+    }
+
+    // A node drawn into before its first update has its rows written in
+    // that same update.
+
+    if (node->changed & SCENE_CHANGE_SOURCE)
+    {
+        changeSourceImageLayer(il, update);
+    }
+
+    if (attributes != 0)
+    {
+        il->layer = node->layer;
+
+        int result =
+        vc_dispmanx_element_change_attributes(update,
+                                              il->element,
+                                              attributes,
+                                              node->layer,
+                                              node->opacity,
+                                              &(il->dstRect),
+                                              &(il->srcRect),
+                                              0,
+                                              il->transform);
+        assert(result == 0);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+updateCallbackNode(
+    SCENE_T *scene,
+    SCENE_NODE_T *node,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    const SCENE_CALLBACKS_T *callbacks = node->callbacks;
+
+    if (node->changed & SCENE_CHANGE_REMOVE)
+    {
+        if (((node->changed & SCENE_CHANGE_ADD) == 0) &&
+            (callbacks->remove != NULL))
+        {
+            (callbacks->remove)(node->data, update);
+        }
+
+        return;
+    }
+
+    if (node->changed & SCENE_CHANGE_ADD)
+    {
+        (callbacks->add)(node->data, scene->display, update);
+    }
+    else if (callbacks->update != NULL)
+    {
+        (callbacks->update)(node->data, update);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+updateScene(
+    SCENE_T *scene)
+{
+    // Callback nodes that poll are asked first, so that a frame in which
+    // nothing is due goes without an update.
+
+    int32_t i;
+    for (i = 0 ; i < scene->numberOfNodes ; i++)
+    {
+        SCENE_NODE_T *node = &(scene->nodes[i]);
+
+        if ((node->type == SCENE_NODE_CALLBACK) &&
+            (node->changed == 0) &&
+            (node->callbacks->due != NULL) &&
+            (node->callbacks->due)(node->data))
+        {
+            markChangedScene(scene, i, SCENE_CHANGE_SOURCE);
+        }
+    }
+
+    int32_t changed = scene->numberOfChangedNodes;
+
+    if (changed == 0)
+    {
+        return 0;
+    }
+
+    //---------------------------------------------------------------------
+
+    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    assert(update != 0);
+
+    for (i = 0 ; i < changed ; i++)
+    {
+        SCENE_NODE_T *node = &(scene->nodes[scene->changedNodes[i]]);
+
+        if (node->type == SCENE_NODE_IMAGE_LAYER)
+        {
+            updateImageLayerNode(scene, node, update);
+        }
+        else if (node->type == SCENE_NODE_CALLBACK)
+        {
+            updateCallbackNode(scene, node, update);
+        }
+
+        if (node->changed & SCENE_CHANGE_REMOVE)
+        {
+            node->type = SCENE_NODE_NONE;
+        }
+
+        node->changed = 0;
+    }
+
+    scene->numberOfChangedNodes = 0;
+
+    while ((scene->numberOfNodes > 0) &&
+           (scene->nodes[scene->numberOfNodes - 1].type == SCENE_NODE_NONE))
+    {
+        --(scene->numberOfNodes);
+    }
+
+    //---------------------------------------------------------------------
+
+    if (scene->loop != NULL)
+    {
+        submitUpdateFrameLoop(scene->loop, update);
+    }
+    else
+    {
+        int result = vc_dispmanx_update_submit_sync(update);
+        assert(result == 0);
+    }
+
+    ++(scene->updates);
+
+    return changed;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyScene(
+    SCENE_T *scene)
+{
+    int32_t i;
+    for (i = 0 ; i < scene->numberOfNodes ; i++)
+    {
+        if (scene->nodes[i].type != SCENE_NODE_NONE)
+        {
+            removeNodeScene(scene, i);
+        }
+    }
+
+    if ((updateScene(scene) > 0) && (scene->loop != NULL))
+    {
+        waitForUpdateFrameLoop(scene->loop);
+    }
+
+    free(scene->nodes);
+    scene->nodes = NULL;
+    free(scene->changedNodes);
+    scene->changedNodes = NULL;
+    scene->numberOfNodes = 0;
+    scene->numberOfChangedNodes = 0;
+}
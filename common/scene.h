@@ -0,0 +1,188 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frameLoop.h"
+#include "imageLayer.h"
+
+#include "bcm_host.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// A scene owns the layers on a display and sends every change made to
+// them during a frame as a single update. Adding, moving, fading or
+// removing a node, or marking its contents as changed, only records what
+// changed; updateScene() then starts one update, adds just the changed
+// attributes of just the nodes that changed, and submits it. If nothing
+// changed there is no update at all.
+//
+// An image layer node is handled by the scene itself. Anything else (a
+// sprite layer, a scrolling layer, the worms ...) is a callback node: the
+// callbacks add its own element changes to the scene's update. A callback
+// node with a due() callback is asked every frame whether it has
+// something to send, otherwise it is only updated once marked.
+
+typedef struct
+{
+    void (*add)(void *data,
+                DISPMANX_DISPLAY_HANDLE_T display,
+                DISPMANX_UPDATE_HANDLE_T update);
+    bool (*due)(void *data);
+    void (*update)(void *data, DISPMANX_UPDATE_HANDLE_T update);
+    void (*remove)(void *data, DISPMANX_UPDATE_HANDLE_T update);
+} SCENE_CALLBACKS_T;
+
+typedef enum
+{
+    SCENE_NODE_NONE,
+    SCENE_NODE_IMAGE_LAYER,
+    SCENE_NODE_CALLBACK
+} SCENE_NODE_TYPE_T;
+
+// changed holds ELEMENT_CHANGE_* flags (see element_change.h) and the
+// SCENE_CHANGE_* flags below.
+
+#define SCENE_CHANGE_ADD (1 << 16)
+#define SCENE_CHANGE_SOURCE (1 << 17)
+#define SCENE_CHANGE_REMOVE (1 << 18)
+
+typedef struct
+{
+    SCENE_NODE_TYPE_T type;
+    void *data;
+    const SCENE_CALLBACKS_T *callbacks;
+    int32_t layer;
+    uint8_t opacity;
+    uint32_t changed;
+} SCENE_NODE_T;
+
+typedef struct
+{
+    DISPMANX_DISPLAY_HANDLE_T display;
+    FRAME_LOOP_T *loop;
+    SCENE_NODE_T *nodes;
+    int32_t numberOfNodes;
+    int32_t *changedNodes;
+    int32_t numberOfChangedNodes;
+    int32_t capacity;
+    uint32_t updates;
+} SCENE_T;
+
+//-------------------------------------------------------------------------
+
+// If loop is not NULL, updates are submitted through it without waiting,
+// otherwise updateScene() waits for each one to be applied.
+
+void
+initScene(
+    SCENE_T *scene,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    FRAME_LOOP_T *loop);
+
+// Add an image layer, whose resource has been created, with its top left
+// corner at (x, y) on the display. Returns the index used to refer to the
+// node from then on. Not for a layer with an upload thread.
+
+int32_t
+addImageLayerScene(
+    SCENE_T *scene,
+    IMAGE_LAYER_T *il,
+    int32_t x,
+    int32_t y);
+
+// callbacks must stay valid until the node has been removed.
+
+int32_t
+addCallbackScene(
+    SCENE_T *scene,
+    void *data,
+    const SCENE_CALLBACKS_T *callbacks);
+
+// Moving, fading and changing the layer of a node are for image layer
+// nodes; a callback node sends its own changes.
+
+void
+moveNodeScene(
+    SCENE_T *scene,
+    int32_t index,
+    int32_t x,
+    int32_t y);
+
+void
+setOpacityNodeScene(
+    SCENE_T *scene,
+    int32_t index,
+    uint8_t opacity);
+
+void
+setLayerNodeScene(
+    SCENE_T *scene,
+    int32_t index,
+    int32_t layer);
+
+// The contents of the node have changed: the image of an image layer is
+// written to its resource, a callback node is updated.
+
+void
+markChangedNodeScene(
+    SCENE_T *scene,
+    int32_t index);
+
+// The element is removed as part of the next update. Once that update has
+// been applied (see waitForUpdateFrameLoop()), the layer can be destroyed
+// without another update.
+
+void
+removeNodeScene(
+    SCENE_T *scene,
+    int32_t index);
+
+// Send everything that changed since the last call as one update. Returns
+// the number of nodes that were sent, zero if no update was needed.
+
+int32_t
+updateScene(
+    SCENE_T *scene);
+
+// Remove every node that is left, in one update.
+
+void
+destroyScene(
+    SCENE_T *scene);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
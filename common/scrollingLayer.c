@@ -28,30 +28,100 @@
 #include <assert.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "element_change.h"
 #include "image.h"
+#include "imageCache.h"
 #include "loadpng.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
 #include "scrollingLayer.h"
 
 #include "bcm_host.h"
 
 //-------------------------------------------------------------------------
 
+#define SCROLLING_LAYER_ACCOUNT "scrollingLayer"
+
+//-------------------------------------------------------------------------
+
+// Cut size pixels into tiles of nearly equal size, no larger than
+// SCROLLING_LAYER_TILE_SIZE, unless the whole texture fits in one.
+
+static void
+tileScrollingLayer(
+    int32_t size,
+    int32_t *tileSize,
+    int32_t *tiles)
+{
+    if (size <= SCROLLING_LAYER_MAX_WHOLE_TEXTURE)
+    {
+        *tileSize = size;
+        *tiles = 1;
+
+        return;
+    }
+
+    *tiles = (size + SCROLLING_LAYER_TILE_SIZE - 1) / SCROLLING_LAYER_TILE_SIZE;
+    *tileSize = (size + *tiles - 1) / *tiles;
+    *tiles = (size + *tileSize - 1) / *tileSize;
+}
+
+//-------------------------------------------------------------------------
+
+// The last tile in a row or column holds whatever is left over.
+
+static int32_t
+tileSizeScrollingLayer(
+    int32_t index,
+    int32_t tileSize,
+    int32_t tiles,
+    int32_t size)
+{
+    if (index < tiles - 1)
+    {
+        return tileSize;
+    }
+
+    return size - ((tiles - 1) * tileSize);
+}
+
+//-------------------------------------------------------------------------
+
 void
 initScrollingLayer(SCROLLING_LAYER_T *sl,
     const char* file,
     int32_t layer)
 {
-    int result = 0;
+    IMAGE_T image;
 
-    //---------------------------------------------------------------------
-    if (loadScrollingLayerPng(&sl->image, file, true, true) == false)
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(SCROLLING_LAYER_ACCOUNT));
+
+    if (loadPngCached(&image, file) == false)
     {
         fprintf(stderr, "scrollingBgLayer: unable to load %s\n", file);
         exit(EXIT_FAILURE);
     }
 
+    leaveMemoryAccount(previous);
+
+    initScrollingLayerImage(sl, &image, layer);
+}
+
+//-------------------------------------------------------------------------
+
+void
+initScrollingLayerImage(
+    SCROLLING_LAYER_T *sl,
+    const IMAGE_T *image,
+    int32_t layer)
+{
+    sl->image = *image;
+
     sl->direction = 0;
     sl->directionMax = 7;
 
@@ -75,47 +145,30 @@ initScrollingLayer(SCROLLING_LAYER_T *sl,
 
     //---------------------------------------------------------------------
 
-    uint32_t vc_image_ptr;
+    sl->viewWidth = sl->image.width;
+    sl->viewHeight = sl->image.height;
 
-    sl->layer = layer;
+    sl->xOffsetMax = sl->image.width - 1;
+    sl->xOffset = 0;
 
-    sl->frontResource =
-        vc_dispmanx_resource_create(
-            sl->image.type,
-            sl->image.width | (sl->image.pitch << 16),
-            sl->image.height | (sl->image.alignedHeight << 16),
-            &vc_image_ptr);
-    assert(sl->frontResource != 0);
-
-    sl->backResource =
-        vc_dispmanx_resource_create(
-            sl->image.type,
-            sl->image.width | (sl->image.pitch << 16),
-            sl->image.height | (sl->image.alignedHeight << 16),
-            &vc_image_ptr);
-    assert(sl->backResource != 0);
+    sl->yOffsetMax = sl->image.height - 1;
+    sl->yOffset = 0;
 
-    //---------------------------------------------------------------------
+    tileScrollingLayer(sl->image.width, &(sl->tileWidth), &(sl->tileColumns));
+    tileScrollingLayer(sl->image.height, &(sl->tileHeight), &(sl->tileRows));
 
-    vc_dispmanx_rect_set(&(sl->bmpRect),
-                         0,
-                         0,
-                         sl->image.width,
-                         sl->image.height);
-
-    result = vc_dispmanx_resource_write_data(sl->frontResource,
-                                             sl->image.type,
-                                             sl->image.pitch,
-                                             sl->image.buffer,
-                                             &(sl->bmpRect));
-    assert(result == 0);
+    // The tile pool and the slots for the elements depend on the size of
+    // the view, so they are set up when the element is added.
 
-    result = vc_dispmanx_resource_write_data(sl->backResource,
-                                             sl->image.type,
-                                             sl->image.pitch,
-                                             sl->image.buffer,
-                                             &(sl->bmpRect));
-    assert(result == 0);
+    sl->tiles = NULL;
+    sl->numberOfTiles = 0;
+    sl->slots = NULL;
+    sl->slotColumns = 0;
+    sl->slotRows = 0;
+    sl->frame = 0;
+
+    sl->layer = layer;
+    sl->display = 0;
 }
 
 //-------------------------------------------------------------------------
@@ -127,13 +180,10 @@ addElementScrollingLayerCentered(
     DISPMANX_DISPLAY_HANDLE_T display,
     DISPMANX_UPDATE_HANDLE_T update)
 {
-    sl->viewWidth = sl->image.width / 2;
-    sl->viewHeight = sl->image.height / 2;
+    sl->viewWidth = sl->image.width;
+    sl->viewHeight = sl->image.height;
 
-    sl->xOffsetMax = sl->viewWidth - 1;
     sl->xOffset = sl->xOffsetMax / 2;
-
-    sl->yOffsetMax = sl->viewHeight - 1;
     sl->yOffset = sl->yOffsetMax / 2;
 
     if (sl->viewWidth > info->width)
@@ -146,12 +196,6 @@ addElementScrollingLayerCentered(
         sl->viewHeight = info->height;
     }
 
-    vc_dispmanx_rect_set(&sl->srcRect,
-                         sl->xOffset << 16,
-                         sl->yOffset << 16,
-                         sl->viewWidth << 16,
-                         sl->viewHeight << 16);
-
     vc_dispmanx_rect_set(&(sl->dstRect),
                          (info->width - sl->viewWidth) / 2,
                          (info->height - sl->viewHeight) / 2,
@@ -163,30 +207,322 @@ addElementScrollingLayerCentered(
 
 //-------------------------------------------------------------------------
 
+// Find the resource holding tile, copying the tile into the pool if it is
+// not there already. The resource reused is the one used longest ago, and
+// never one shown by either this or the previous layout, as the previous
+// layout stays on screen until the update is applied.
+
+static DISPMANX_RESOURCE_HANDLE_T
+resourceForTileScrollingLayer(
+    SCROLLING_LAYER_T *sl,
+    int32_t tile)
+{
+    SCROLLING_LAYER_TILE_T *entry = NULL;
+
+    int32_t i;
+    for (i = 0 ; i < sl->numberOfTiles ; i++)
+    {
+        if (sl->tiles[i].tile == tile)
+        {
+            sl->tiles[i].lastUsed = sl->frame;
+
+            return sl->tiles[i].resource;
+        }
+
+        if ((entry == NULL) || (sl->tiles[i].lastUsed < entry->lastUsed))
+        {
+            entry = &(sl->tiles[i]);
+        }
+    }
+
+    assert(entry->lastUsed < sl->frame - 1);
+
+    //---------------------------------------------------------------------
+
+    if (entry->resource == 0)
+    {
+        MEMORY_ACCOUNT_T *previous =
+            enterMemoryAccount(findMemoryAccount(SCROLLING_LAYER_ACCOUNT));
+
+        entry->resource = acquireResourcePool(sl->image.type,
+                                              sl->tileWidth,
+                                              sl->tileHeight,
+                                              0,
+                                              0);
+
+        leaveMemoryAccount(previous);
+    }
+
+    int32_t column = tile % sl->tileColumns;
+    int32_t row = tile / sl->tileColumns;
+
+    VC_RECT_T rect;
+    vc_dispmanx_rect_set(&rect,
+                         0,
+                         0,
+                         tileSizeScrollingLayer(column,
+                                                sl->tileWidth,
+                                                sl->tileColumns,
+                                                sl->image.width),
+                         tileSizeScrollingLayer(row,
+                                                sl->tileHeight,
+                                                sl->tileRows,
+                                                sl->image.height));
+
+    int32_t tileLeft = column * sl->tileWidth;
+
+    const uint8_t *src = (const uint8_t *)(sl->image.buffer)
+                       + (row * sl->tileHeight * sl->image.pitch)
+                       + ((tileLeft * sl->image.bitsPerPixel) / 8);
+
+    int result = vc_dispmanx_resource_write_data(entry->resource,
+                                                 sl->image.type,
+                                                 sl->image.pitch,
+                                                 (void *)src,
+                                                 &rect);
+    assert(result == 0);
+
+    entry->tile = tile;
+    entry->lastUsed = sl->frame;
+
+    return entry->resource;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+showSlotScrollingLayer(
+    SCROLLING_LAYER_T *sl,
+    SCROLLING_LAYER_SLOT_T *slot,
+    int32_t tile,
+    const VC_RECT_T *srcRect,
+    const VC_RECT_T *dstRect,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int result = 0;
+
+    DISPMANX_RESOURCE_HANDLE_T resource
+        = resourceForTileScrollingLayer(sl, tile);
+
+    if (slot->element == 0)
+    {
+        VC_DISPMANX_ALPHA_T alpha =
+        {
+            DISPMANX_FLAGS_ALPHA_FROM_SOURCE, 
+            255,
+            0
+        };
+
+        slot->element = vc_dispmanx_element_add(update,
+                                                sl->display,
+                                                sl->layer,
+                                                dstRect,
+                                                resource,
+                                                srcRect,
+                                                DISPMANX_PROTECTION_NONE,
+                                                &alpha,
+                                                NULL,
+                                                DISPMANX_NO_ROTATE);
+        assert(slot->element != 0);
+    }
+    else
+    {
+        if (slot->resource != resource)
+        {
+            result = vc_dispmanx_element_change_source(update,
+                                                       slot->element,
+                                                       resource);
+            assert(result == 0);
+        }
+
+        if ((memcmp(&(slot->srcRect), srcRect, sizeof(VC_RECT_T)) != 0) ||
+            (memcmp(&(slot->dstRect), dstRect, sizeof(VC_RECT_T)) != 0))
+        {
+            result = 
+            vc_dispmanx_element_change_attributes(update,
+                                                  slot->element,
+                                                  ELEMENT_CHANGE_DEST_RECT
+                                                  | ELEMENT_CHANGE_SRC_RECT,
+                                                  0,
+                                                  255,
+                                                  dstRect,
+                                                  srcRect,
+                                                  0,
+                                                  DISPMANX_NO_ROTATE);
+            assert(result == 0);
+        }
+    }
+
+    slot->tile = tile;
+    slot->resource = resource;
+    slot->srcRect = *srcRect;
+    slot->dstRect = *dstRect;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+hideSlotScrollingLayer(
+    SCROLLING_LAYER_SLOT_T *slot,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    if (slot->element != 0)
+    {
+        int result = vc_dispmanx_element_remove(update, slot->element);
+        assert(result == 0);
+
+        slot->element = 0;
+        slot->resource = 0;
+        slot->tile = -1;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Walk the tiles under the view from its top left corner, wrapping around
+// the texture, and give each visible piece of a tile its own element.
+// Positions here are in an unwrapped plane in which the texture repeats.
+
+static void
+layoutScrollingLayer(
+    SCROLLING_LAYER_T *sl,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    ++(sl->frame);
+
+    int32_t viewRight = sl->xOffset + sl->viewWidth;
+    int32_t viewBottom = sl->yOffset + sl->viewHeight;
+
+    int32_t row = sl->yOffset / sl->tileHeight;
+    int32_t top = row * sl->tileHeight;
+
+    int32_t j;
+    for (j = 0 ; j < sl->slotRows ; j++)
+    {
+        int32_t height = tileSizeScrollingLayer(row,
+                                                sl->tileHeight,
+                                                sl->tileRows,
+                                                sl->image.height);
+
+        int32_t y0 = (top > sl->yOffset) ? top : sl->yOffset;
+        int32_t y1 = (top + height < viewBottom) ? top + height : viewBottom;
+
+        int32_t column = sl->xOffset / sl->tileWidth;
+        int32_t left = column * sl->tileWidth;
+
+        int32_t i;
+        for (i = 0 ; i < sl->slotColumns ; i++)
+        {
+            int32_t width = tileSizeScrollingLayer(column,
+                                                   sl->tileWidth,
+                                                   sl->tileColumns,
+                                                   sl->image.width);
+
+            int32_t x0 = (left > sl->xOffset) ? left : sl->xOffset;
+            int32_t x1 = (left + width < viewRight) ? left + width : viewRight;
+
+            SCROLLING_LAYER_SLOT_T *slot
+                = &(sl->slots[(j * sl->slotColumns) + i]);
+
+            if ((x0 < x1) && (y0 < y1))
+            {
+                VC_RECT_T srcRect;
+                vc_dispmanx_rect_set(&srcRect,
+                                     (x0 - left) << 16,
+                                     (y0 - top) << 16,
+                                     (x1 - x0) << 16,
+                                     (y1 - y0) << 16);
+
+                VC_RECT_T dstRect;
+                vc_dispmanx_rect_set(&dstRect,
+                                     sl->dstRect.x + x0 - sl->xOffset,
+                                     sl->dstRect.y + y0 - sl->yOffset,
+                                     x1 - x0,
+                                     y1 - y0);
+
+                showSlotScrollingLayer(sl,
+                                       slot,
+                                       (row * sl->tileColumns) + column,
+                                       &srcRect,
+                                       &dstRect,
+                                       update);
+            }
+            else
+            {
+                hideSlotScrollingLayer(slot, update);
+            }
+
+            left += width;
+            column = (column + 1) % sl->tileColumns;
+        }
+
+        top += height;
+        row = (row + 1) % sl->tileRows;
+    }
+}
+
+//-------------------------------------------------------------------------
+
 void
 addElementScrollingLayer(
     SCROLLING_LAYER_T *sl,
     DISPMANX_DISPLAY_HANDLE_T display,
     DISPMANX_UPDATE_HANDLE_T update)
 {
-    VC_DISPMANX_ALPHA_T alpha =
+    sl->display = display;
+
+    // Every piece of a tile in the view, except the first and the last in
+    // a row or column, is a whole tile, so this many slots always do.
+
+    int32_t minTileWidth = tileSizeScrollingLayer(sl->tileColumns - 1,
+                                                  sl->tileWidth,
+                                                  sl->tileColumns,
+                                                  sl->image.width);
+
+    int32_t minTileHeight = tileSizeScrollingLayer(sl->tileRows - 1,
+                                                   sl->tileHeight,
+                                                   sl->tileRows,
+                                                   sl->image.height);
+
+    sl->slotColumns = ((sl->viewWidth + minTileWidth - 1) / minTileWidth) + 1;
+    sl->slotRows = ((sl->viewHeight + minTileHeight - 1) / minTileHeight) + 1;
+
+    int32_t numberOfSlots = sl->slotColumns * sl->slotRows;
+
+    sl->slots = calloc(numberOfSlots, sizeof(SCROLLING_LAYER_SLOT_T));
+
+    // Enough tiles for the previous layout and the next one, which share
+    // none if the view jumps by more than a tile, but never more than the
+    // texture has.
+
+    sl->numberOfTiles = 2 * numberOfSlots;
+
+    if (sl->numberOfTiles > sl->tileColumns * sl->tileRows)
+    {
+        sl->numberOfTiles = sl->tileColumns * sl->tileRows;
+    }
+
+    sl->tiles = calloc(sl->numberOfTiles, sizeof(SCROLLING_LAYER_TILE_T));
+
+    if ((sl->slots == NULL) || (sl->tiles == NULL))
     {
-        DISPMANX_FLAGS_ALPHA_FROM_SOURCE, 
-        255,
-        0
-    };
-
-    sl->element = vc_dispmanx_element_add(update,
-                                          display,
-                                          sl->layer,
-                                          &(sl->dstRect),
-                                          sl->frontResource,
-                                          &(sl->srcRect),
-                                          DISPMANX_PROTECTION_NONE,
-                                          &alpha,
-                                          NULL,
-                                          DISPMANX_NO_ROTATE);
-    assert(sl->element != 0);
+        fprintf(stderr, "scrollingBgLayer: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int32_t i;
+    for (i = 0 ; i < numberOfSlots ; i++)
+    {
+        sl->slots[i].tile = -1;
+    }
+
+    for (i = 0 ; i < sl->numberOfTiles ; i++)
+    {
+        sl->tiles[i].tile = -1;
+        sl->tiles[i].lastUsed = -1;
+    }
+
+    layoutScrollingLayer(sl, update);
 }
 
 //-------------------------------------------------------------------------
@@ -236,10 +572,6 @@ updatePositionScrollingLayer(
     SCROLLING_LAYER_T *sl,
     DISPMANX_UPDATE_HANDLE_T update)
 {
-    int result = 0;
-
-    //---------------------------------------------------------------------
-
     sl->xOffset += sl->xDirections[sl->direction];
 
     if (sl->xOffset < 0)
@@ -262,36 +594,33 @@ updatePositionScrollingLayer(
         sl->yOffset = 0;
     }
 
-    //---------------------------------------------------------------------
+    layoutScrollingLayer(sl, update);
+}
 
-    result = vc_dispmanx_element_change_source(update,
-                                               sl->element,
-                                               sl->backResource);
-    assert(result == 0);
+//-------------------------------------------------------------------------
 
-    vc_dispmanx_rect_set(&(sl->srcRect),
-                         sl->xOffset << 16,
-                         sl->yOffset << 16,
-                         sl->viewWidth << 16,
-                         sl->viewHeight << 16);
-
-    result = 
-    vc_dispmanx_element_change_attributes(update,
-                                          sl->element,
-                                          ELEMENT_CHANGE_SRC_RECT,
-                                          0,
-                                          255,
-                                          &(sl->dstRect),
-                                          &(sl->srcRect),
-                                          0,
-                                          DISPMANX_NO_ROTATE);
-    assert(result == 0);
+void
+setOffsetScrollingLayer(
+    SCROLLING_LAYER_T *sl,
+    int32_t x,
+    int32_t y,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    sl->xOffset = x % sl->image.width;
 
-    //---------------------------------------------------------------------
+    if (sl->xOffset < 0)
+    {
+        sl->xOffset += sl->image.width;
+    }
+
+    sl->yOffset = y % sl->image.height;
 
-    DISPMANX_RESOURCE_HANDLE_T tmp = sl->frontResource;
-    sl->frontResource = sl->backResource;
-    sl->backResource = tmp;
+    if (sl->yOffset < 0)
+    {
+        sl->yOffset += sl->image.height;
+    }
+
+    layoutScrollingLayer(sl, update);
 }
 
 //-------------------------------------------------------------------------
@@ -304,17 +633,27 @@ destroyScrollingLayer(
 
     DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
     assert(update != 0);
-    result = vc_dispmanx_element_remove(update, sl->element);
-    assert(result == 0);
+
+    int32_t i;
+    for (i = 0 ; i < sl->slotColumns * sl->slotRows ; i++)
+    {
+        hideSlotScrollingLayer(&(sl->slots[i]), update);
+    }
+
     result = vc_dispmanx_update_submit_sync(update);
     assert(result == 0);
 
     //---------------------------------------------------------------------
 
-    result = vc_dispmanx_resource_delete(sl->frontResource);
-    assert(result == 0);
-    result = vc_dispmanx_resource_delete(sl->backResource);
-    assert(result == 0);
+    for (i = 0 ; i < sl->numberOfTiles ; i++)
+    {
+        releaseResourcePool(sl->tiles[i].resource);
+    }
+
+    free(sl->tiles);
+    sl->tiles = NULL;
+    free(sl->slots);
+    sl->slots = NULL;
 
     //---------------------------------------------------------------------
 
@@ -330,6 +669,9 @@ loadScrollingLayerPng(
     bool extendX,
     bool extendY)
 {
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(SCROLLING_LAYER_ACCOUNT));
+
     IMAGE_T baseImage;
     bool loaded = loadPng(&baseImage, file);
 
@@ -340,41 +682,44 @@ loadScrollingLayerPng(
 
         initImage(image, baseImage.type, width, height, false);
 
-        if (extendX)
-        {
-            int32_t rowLength = (baseImage.width*baseImage.bitsPerPixel)/8;
+        // Tile the base image across the image, one copy per quadrant
+        // that is wanted.
 
-            int32_t baseOffset = 0;
-            int32_t offset = 0;
+        IMAGE_RECT_T src;
+        getRectImage(&baseImage,
+                     0,
+                     0,
+                     baseImage.width,
+                     baseImage.height,
+                     &src);
 
-            int32_t y = 0;
-            for (y = 0 ; y < baseImage.width ; y++)
+        int32_t copy;
+        for (copy = 0 ; copy < 4 ; copy++)
+        {
+            IMAGE_RECT_T dst;
+
+            if (getRectImage(image,
+                             (copy & 1) * baseImage.width,
+                             (copy >> 1) * baseImage.height,
+                             baseImage.width,
+                             baseImage.height,
+                             &dst))
             {
-                baseOffset = y * baseImage.pitch;
-                offset = y * image->pitch;
-
-                memcpy(image->buffer + offset,
-                       baseImage.buffer + baseOffset,
-                       rowLength);
-
-                memcpy(image->buffer + offset + rowLength,
-                       baseImage.buffer + baseOffset,
-                       rowLength);
+                int32_t j;
+                for (j = 0 ; j < dst.height ; j++)
+                {
+                    memcpy(rowImageRect(&dst, j),
+                           rowImageRect(&src, j),
+                           src.rowBytes);
+                }
             }
         }
-        else
-        {
-            memcpy(image->buffer, baseImage.buffer, baseImage.size);
-        }
-
-        if (extendY)
-        {
-            int32_t size = image->pitch * baseImage.height;
 
-            memcpy(image->buffer + size, image->buffer, size);
-        }
+        destroyImage(&baseImage);
     }
 
+    leaveMemoryAccount(previous);
+
     return loaded;
 }
 
@@ -29,13 +29,44 @@
 #define SCROLLING_LAYER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "image.h"
 
 #include "bcm_host.h"
 
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
+// A texture that scrolls and wraps around in both directions, kept as a
+// single copy. The texture is cut into tiles (one tile, if it is small
+// enough), and the view is made up of one element for each tile, or part
+// of a tile, that it covers. Only the tiles around the view are held in
+// GPU memory, in a small pool of resources that are reused as the view
+// moves, so the texture can be larger than the GPU could hold. Tiles are
+// copied into the pool from the decoded image, which is mapped in from
+// the image cache.
+
+#define SCROLLING_LAYER_MAX_WHOLE_TEXTURE 2048
+#define SCROLLING_LAYER_TILE_SIZE 512
+
+typedef struct
+{
+    int32_t tile;
+    int32_t lastUsed;
+    DISPMANX_RESOURCE_HANDLE_T resource;
+} SCROLLING_LAYER_TILE_T;
+
+typedef struct
+{
+    int32_t tile;
+    DISPMANX_RESOURCE_HANDLE_T resource;
+    VC_RECT_T srcRect;
+    VC_RECT_T dstRect;
+    DISPMANX_ELEMENT_HANDLE_T element;
+} SCROLLING_LAYER_SLOT_T;
+
 typedef struct
 {
     IMAGE_T image;
@@ -49,13 +80,19 @@ typedef struct
     int16_t directionMax;
     int32_t xDirections[8];
     int32_t yDirections[8];
-    VC_RECT_T bmpRect;
-    VC_RECT_T srcRect;
+    int32_t tileWidth;
+    int32_t tileHeight;
+    int32_t tileColumns;
+    int32_t tileRows;
+    SCROLLING_LAYER_TILE_T *tiles;
+    int32_t numberOfTiles;
+    SCROLLING_LAYER_SLOT_T *slots;
+    int32_t slotColumns;
+    int32_t slotRows;
+    int32_t frame;
     VC_RECT_T dstRect;
     int32_t layer;
-    DISPMANX_RESOURCE_HANDLE_T frontResource;
-    DISPMANX_RESOURCE_HANDLE_T backResource;
-    DISPMANX_ELEMENT_HANDLE_T element;
+    DISPMANX_DISPLAY_HANDLE_T display;
 } SCROLLING_LAYER_T;
 
 //-------------------------------------------------------------------------
@@ -65,6 +102,15 @@ initScrollingLayer(SCROLLING_LAYER_T *sl,
     const char* file,
     int32_t layer);
 
+// As initScrollingLayer(), with a texture that has already been loaded.
+// The scrolling layer takes the image over, and destroys it with itself.
+
+void
+initScrollingLayerImage(
+    SCROLLING_LAYER_T *sl,
+    const IMAGE_T *image,
+    int32_t layer);
+
 void
 addElementScrollingLayerCentered(
     SCROLLING_LAYER_T *sl,
@@ -72,6 +118,9 @@ addElementScrollingLayerCentered(
     DISPMANX_DISPLAY_HANDLE_T display,
     DISPMANX_UPDATE_HANDLE_T update);
 
+// Show a viewWidth x viewHeight view of the texture, at dstRect on the
+// display, with its top left corner at (xOffset, yOffset) in the texture.
+
 void
 addElementScrollingLayer(
     SCROLLING_LAYER_T *sl,
@@ -85,8 +134,22 @@ updatePositionScrollingLayer(
     SCROLLING_LAYER_T *sl,
     DISPMANX_UPDATE_HANDLE_T update);
 
+// Move the view so that its top left corner is at (x, y) in the texture.
+// Any position is allowed; the texture repeats in every direction.
+
+void
+setOffsetScrollingLayer(
+    SCROLLING_LAYER_T *sl,
+    int32_t x,
+    int32_t y,
+    DISPMANX_UPDATE_HANDLE_T update);
+
 void destroyScrollingLayer(SCROLLING_LAYER_T *sl);
 
+// Load the png, doubled in width and or height so that a wrapped view can
+// be cut from it as a single rectangle. The scrolling layer itself no
+// longer needs this.
+
 bool
 loadScrollingLayerPng(
     IMAGE_T* image,
@@ -96,4 +159,6 @@ loadScrollingLayerPng(
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
@@ -0,0 +1,457 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "element_change.h"
+#include "frameLoop.h"
+#include "image.h"
+#include "imageCache.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
+#include "spriteBatch.h"
+
+//-------------------------------------------------------------------------
+
+#define SPRITE_BATCH_INITIAL_CAPACITY 16
+
+//-------------------------------------------------------------------------
+
+void
+initSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t columns,
+    int32_t rows,
+    const char *file,
+    int32_t layer)
+{
+    IMAGE_T image;
+
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount("spriteBatch"));
+
+    if (loadPngCached(&image, file) == false)
+    {
+        fprintf(stderr, "spriteBatch: unable to load %s\n", file);
+        exit(EXIT_FAILURE);
+    }
+
+    batch->type = image.type;
+    batch->columns = columns;
+    batch->rows = rows;
+    batch->frames = columns * rows;
+    batch->width = image.width / columns;
+    batch->height = image.height / rows;
+    batch->layer = layer;
+
+    //---------------------------------------------------------------------
+
+    // Once the sheet is in its resource the decoded image is not needed.
+
+    batch->resource = acquireResourcePool(image.type,
+                                          image.width,
+                                          image.height,
+                                          image.pitch,
+                                          image.alignedHeight);
+
+    VC_RECT_T bmpRect;
+    vc_dispmanx_rect_set(&bmpRect, 0, 0, image.width, image.height);
+
+    int result = vc_dispmanx_resource_write_data(batch->resource,
+                                                 image.type,
+                                                 image.pitch,
+                                                 image.buffer,
+                                                 &bmpRect);
+    assert(result == 0);
+
+    destroyImage(&image);
+
+    leaveMemoryAccount(previous);
+
+    //---------------------------------------------------------------------
+
+    batch->capacity = SPRITE_BATCH_INITIAL_CAPACITY;
+    batch->numberOfInstances = 0;
+    batch->numberOfChangedInstances = 0;
+    batch->instances = malloc(batch->capacity * sizeof(SPRITE_INSTANCE_T));
+    batch->changedInstances = malloc(batch->capacity * sizeof(int32_t));
+
+    if ((batch->instances == NULL) || (batch->changedInstances == NULL))
+    {
+        fprintf(stderr, "spriteBatch: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+markChangedSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    SPRITE_INSTANCE_T *instance,
+    uint32_t change)
+{
+    if (instance->changed == 0)
+    {
+        batch->changedInstances[batch->numberOfChangedInstances++]
+            = instance - batch->instances;
+    }
+
+    instance->changed |= change;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+setSrcRectSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    SPRITE_INSTANCE_T *instance)
+{
+    int32_t column = instance->frame % batch->columns;
+    int32_t row = instance->frame / batch->columns;
+
+    vc_dispmanx_rect_set(&(instance->srcRect),
+                         (column * batch->width) << 16,
+                         (row * batch->height) << 16,
+                         batch->width << 16,
+                         batch->height << 16);
+}
+
+//-------------------------------------------------------------------------
+
+static int32_t
+wrapFrameSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t frame)
+{
+    frame %= batch->frames;
+
+    if (frame < 0)
+    {
+        frame += batch->frames;
+    }
+
+    return frame;
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+addInstanceSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t x,
+    int32_t y,
+    int32_t frame,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    if (batch->numberOfInstances == batch->capacity)
+    {
+        batch->capacity *= 2;
+
+        batch->instances = realloc(batch->instances,
+                                   batch->capacity * sizeof(SPRITE_INSTANCE_T));
+        batch->changedInstances = realloc(batch->changedInstances,
+                                          batch->capacity * sizeof(int32_t));
+
+        if ((batch->instances == NULL) || (batch->changedInstances == NULL))
+        {
+            fprintf(stderr, "spriteBatch: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int32_t index = batch->numberOfInstances++;
+    SPRITE_INSTANCE_T *instance = &(batch->instances[index]);
+
+    instance->x = x;
+    instance->y = y;
+    instance->frame = wrapFrameSpriteBatch(batch, frame);
+    instance->frameDuration = 0;
+    instance->animationStart = 0;
+    instance->opacity = 255;
+    instance->changed = 0;
+
+    setSrcRectSpriteBatch(batch, instance);
+
+    vc_dispmanx_rect_set(&(instance->dstRect),
+                         x,
+                         y,
+                         batch->width,
+                         batch->height);
+
+    VC_DISPMANX_ALPHA_T alpha =
+    {
+        DISPMANX_FLAGS_ALPHA_FROM_SOURCE,
+        255, /*alpha 0->255*/
+        0
+    };
+
+    instance->element =
+        vc_dispmanx_element_add(update,
+                                display,
+                                batch->layer,
+                                &(instance->dstRect),
+                                batch->resource,
+                                &(instance->srcRect),
+                                DISPMANX_PROTECTION_NONE,
+                                &alpha,
+                                NULL, // clamp
+                                DISPMANX_NO_ROTATE);
+    assert(instance->element != 0);
+
+    return index;
+}
+
+//-------------------------------------------------------------------------
+
+void
+setPositionSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t index,
+    int32_t x,
+    int32_t y)
+{
+    SPRITE_INSTANCE_T *instance = &(batch->instances[index]);
+
+    if ((instance->x != x) || (instance->y != y))
+    {
+        instance->x = x;
+        instance->y = y;
+
+        vc_dispmanx_rect_set(&(instance->dstRect),
+                             x,
+                             y,
+                             batch->width,
+                             batch->height);
+
+        markChangedSpriteBatch(batch, instance, ELEMENT_CHANGE_DEST_RECT);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+setFrameSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t index,
+    int32_t frame)
+{
+    SPRITE_INSTANCE_T *instance = &(batch->instances[index]);
+
+    frame = wrapFrameSpriteBatch(batch, frame);
+
+    if (instance->frame != frame)
+    {
+        instance->frame = frame;
+        setSrcRectSpriteBatch(batch, instance);
+
+        markChangedSpriteBatch(batch, instance, ELEMENT_CHANGE_SRC_RECT);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+nextFrameSpriteBatch(
+    SPRITE_BATCH_T *batch)
+{
+    int32_t i;
+    for (i = 0 ; i < batch->numberOfInstances ; i++)
+    {
+        setFrameSpriteBatch(batch, i, batch->instances[i].frame + 1);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+startAnimationSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t index,
+    uint32_t frameDuration)
+{
+    SPRITE_INSTANCE_T *instance = &(batch->instances[index]);
+
+    instance->frameDuration = frameDuration;
+    instance->animationStart = nowMicrosecondsFrameLoop()
+                             - ((int64_t)(instance->frame)
+                                * frameDuration
+                                * 1000);
+}
+
+//-------------------------------------------------------------------------
+
+void
+animateSpriteBatch(
+    SPRITE_BATCH_T *batch)
+{
+    int64_t now = nowMicrosecondsFrameLoop();
+
+    int32_t i;
+    for (i = 0 ; i < batch->numberOfInstances ; i++)
+    {
+        SPRITE_INSTANCE_T *instance = &(batch->instances[i]);
+
+        if (instance->frameDuration > 0)
+        {
+            int64_t elapsed = now - instance->animationStart;
+
+            setFrameSpriteBatch(batch,
+                                i,
+                                (elapsed / (instance->frameDuration * 1000))
+                                % batch->frames);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+timeToNextFrameSpriteBatch(
+    SPRITE_BATCH_T *batch)
+{
+    int64_t now = nowMicrosecondsFrameLoop();
+    int64_t next = -1;
+
+    int32_t i;
+    for (i = 0 ; i < batch->numberOfInstances ; i++)
+    {
+        SPRITE_INSTANCE_T *instance = &(batch->instances[i]);
+
+        if (instance->frameDuration > 0)
+        {
+            int64_t duration = instance->frameDuration * INT64_C(1000);
+            int64_t elapsed = now - instance->animationStart;
+            int64_t remaining = duration - (elapsed % duration);
+
+            if ((next == -1) || (remaining < next))
+            {
+                next = remaining;
+            }
+        }
+    }
+
+    return (next == -1) ? -1 : (next + 999) / 1000;
+}
+
+//-------------------------------------------------------------------------
+
+void
+setOpacitySpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t index,
+    uint8_t opacity)
+{
+    SPRITE_INSTANCE_T *instance = &(batch->instances[index]);
+
+    if (instance->opacity != opacity)
+    {
+        instance->opacity = opacity;
+
+        markChangedSpriteBatch(batch, instance, ELEMENT_CHANGE_OPACITY);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+updateSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int32_t changed = batch->numberOfChangedInstances;
+
+    int32_t i;
+    for (i = 0 ; i < changed ; i++)
+    {
+        SPRITE_INSTANCE_T *instance
+            = &(batch->instances[batch->changedInstances[i]]);
+
+        int result =
+        vc_dispmanx_element_change_attributes(update,
+                                              instance->element,
+                                              instance->changed,
+                                              batch->layer,
+                                              instance->opacity,
+                                              &(instance->dstRect),
+                                              &(instance->srcRect),
+                                              0,
+                                              DISPMANX_NO_ROTATE);
+        assert(result == 0);
+
+        instance->changed = 0;
+    }
+
+    batch->numberOfChangedInstances = 0;
+
+    return changed;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroySpriteBatch(
+    SPRITE_BATCH_T *batch)
+{
+    int result = 0;
+
+    if (batch->numberOfInstances > 0)
+    {
+        DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+        assert(update != 0);
+
+        int32_t i;
+        for (i = 0 ; i < batch->numberOfInstances ; i++)
+        {
+            result = vc_dispmanx_element_remove(update,
+                                                batch->instances[i].element);
+            assert(result == 0);
+        }
+
+        result = vc_dispmanx_update_submit_sync(update);
+        assert(result == 0);
+    }
+
+    //---------------------------------------------------------------------
+
+    releaseResourcePool(batch->resource);
+
+    //---------------------------------------------------------------------
+
+    free(batch->instances);
+    batch->instances = NULL;
+    free(batch->changedInstances);
+    batch->changedInstances = NULL;
+    batch->numberOfInstances = 0;
+    batch->numberOfChangedInstances = 0;
+}
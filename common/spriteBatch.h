@@ -0,0 +1,175 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "image.h"
+
+#include "bcm_host.h"
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// Many sprites drawn from one sprite sheet (an atlas of columns x rows
+// frames), which is uploaded to a single resource that all of their
+// elements share. Setting the position, frame or opacity of a sprite only
+// records what changed; updateSpriteBatch() then sends the changed fields
+// of just the sprites that changed, all as part of one update.
+//
+// A sprite with a frameDuration (in milliseconds) is animated from the
+// monotonic clock by animateSpriteBatch(), from animationStart (in
+// microseconds).
+
+typedef struct
+{
+    int32_t x;
+    int32_t y;
+    int32_t frame;
+    uint32_t frameDuration;
+    int64_t animationStart;
+    uint8_t opacity;
+    uint32_t changed;
+    VC_RECT_T srcRect;
+    VC_RECT_T dstRect;
+    DISPMANX_ELEMENT_HANDLE_T element;
+} SPRITE_INSTANCE_T;
+
+typedef struct
+{
+    VC_IMAGE_TYPE_T type;
+    int32_t width;
+    int32_t height;
+    int32_t columns;
+    int32_t rows;
+    int32_t frames;
+    int32_t layer;
+    DISPMANX_RESOURCE_HANDLE_T resource;
+    SPRITE_INSTANCE_T *instances;
+    int32_t numberOfInstances;
+    int32_t *changedInstances;
+    int32_t numberOfChangedInstances;
+    int32_t capacity;
+} SPRITE_BATCH_T;
+
+//-------------------------------------------------------------------------
+
+void
+initSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t columns,
+    int32_t rows,
+    const char *file,
+    int32_t layer);
+
+// Add a sprite with its top left corner at (x, y) showing frame, as part
+// of update. Returns the index used to refer to the sprite from then on.
+
+int32_t
+addInstanceSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t x,
+    int32_t y,
+    int32_t frame,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+void
+setPositionSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t index,
+    int32_t x,
+    int32_t y);
+
+// Frames are numbered across and then down the sprite sheet, and wrap
+// around.
+
+void
+setFrameSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t index,
+    int32_t frame);
+
+// Step every sprite on to its next frame.
+
+void
+nextFrameSpriteBatch(
+    SPRITE_BATCH_T *batch);
+
+// Show each frame of the sprite for frameDuration milliseconds, starting
+// with its current frame now. A frameDuration of 0 stops the animation.
+
+void
+startAnimationSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t index,
+    uint32_t frameDuration);
+
+// Move every animated sprite on to the frame due now. Only those whose
+// frame changes are marked as changed.
+
+void
+animateSpriteBatch(
+    SPRITE_BATCH_T *batch);
+
+// Milliseconds until the next frame of any animated sprite is due, or -1
+// if none are animated.
+
+int32_t
+timeToNextFrameSpriteBatch(
+    SPRITE_BATCH_T *batch);
+
+// An opacity of 0 hides the sprite.
+
+void
+setOpacitySpriteBatch(
+    SPRITE_BATCH_T *batch,
+    int32_t index,
+    uint8_t opacity);
+
+// Add the changes made since the last call to update. Returns the number
+// of sprites that changed.
+
+int32_t
+updateSpriteBatch(
+    SPRITE_BATCH_T *batch,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+void
+destroySpriteBatch(
+    SPRITE_BATCH_T *batch);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
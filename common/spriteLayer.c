@@ -27,14 +27,22 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "element_change.h"
+#include "frameLoop.h"
 #include "image.h"
-#include "loadpng.h"
+#include "imageCache.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
 #include "spriteLayer.h"
 
 //-------------------------------------------------------------------------
 
+#define SPRITE_LAYER_ACCOUNT "spriteLayer"
+
+//-------------------------------------------------------------------------
+
 void initSpriteLayer(
     SPRITE_LAYER_T *s,
     int columns,
@@ -42,16 +50,36 @@ void initSpriteLayer(
     const char *file,
     int32_t layer)
 {
-    int result = 0;
+    IMAGE_T image;
 
-    bool loaded = loadPng(&(s->image), file);
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(SPRITE_LAYER_ACCOUNT));
 
-    if (loaded == false)
+    if (loadPngCached(&image, file) == false)
     {
         fprintf(stderr, "sprite: unable to load %s\n", file);
         exit(EXIT_FAILURE);
     }
 
+    leaveMemoryAccount(previous);
+
+    initSpriteLayerImage(s, columns, rows, &image, layer);
+}
+
+//-------------------------------------------------------------------------
+
+void
+initSpriteLayerImage(
+    SPRITE_LAYER_T *s,
+    int columns,
+    int rows,
+    const IMAGE_T *image,
+    int32_t layer)
+{
+    int result = 0;
+
+    s->image = *image;
+
     s->columns = columns;
     s->rows = rows;
     s->width = s->image.width / s->columns;
@@ -60,28 +88,32 @@ void initSpriteLayer(
     s->xOffset = 0;
     s->yOffsetMax = (s->rows - 1) * s->height;
     s->yOffset = 0;
+    s->frame = 0;
+    s->frames = s->columns * s->rows;
+    s->frameDuration = 0;
+    s->animationStart = 0;
 
     //---------------------------------------------------------------------
 
-    uint32_t vc_image_ptr;
-
     s->layer = layer;
+    s->element = 0;
 
-    s->frontResource =
-        vc_dispmanx_resource_create(
-            s->image.type,
-            s->image.width | (s->image.pitch << 16),
-            s->image.height | (s->image.alignedHeight << 16),
-            &vc_image_ptr);
-    assert(s->frontResource != 0);
-
-    s->backResource =
-        vc_dispmanx_resource_create(
-            s->image.type,
-            s->image.width | (s->image.pitch << 16),
-            s->image.height | (s->image.alignedHeight << 16),
-            &vc_image_ptr);
-    assert(s->backResource != 0);
+    MEMORY_ACCOUNT_T *previous =
+        enterMemoryAccount(findMemoryAccount(SPRITE_LAYER_ACCOUNT));
+
+    s->frontResource = acquireResourcePool(s->image.type,
+                                           s->image.width,
+                                           s->image.height,
+                                           s->image.pitch,
+                                           s->image.alignedHeight);
+
+    s->backResource = acquireResourcePool(s->image.type,
+                                          s->image.width,
+                                          s->image.height,
+                                          s->image.pitch,
+                                          s->image.alignedHeight);
+
+    leaveMemoryAccount(previous);
 
     //---------------------------------------------------------------------
 
@@ -188,27 +220,17 @@ addElementSpriteLayer(
 
 //-------------------------------------------------------------------------
 
-void
-updatePositionSpriteLayer(
+static void
+changeFrameSpriteLayer(
     SPRITE_LAYER_T *s,
+    int32_t frame,
     DISPMANX_UPDATE_HANDLE_T update)
 {
     int result = 0;
 
-    //---------------------------------------------------------------------
-
-    s->xOffset += s->width;
-
-    if (s->xOffset > s->xOffsetMax)
-    {
-        s->xOffset = 0;
-        s->yOffset += s->height;
-
-        if (s->yOffset > s->yOffsetMax)
-        {
-            s->yOffset = 0;
-        }
-    }
+    s->frame = frame;
+    s->xOffset = (frame % s->columns) * s->width;
+    s->yOffset = (frame / s->columns) * s->height;
 
     //---------------------------------------------------------------------
 
@@ -239,25 +261,121 @@ updatePositionSpriteLayer(
 
 //-------------------------------------------------------------------------
 
+void
+updatePositionSpriteLayer(
+    SPRITE_LAYER_T *s,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    changeFrameSpriteLayer(s, (s->frame + 1) % s->frames, update);
+}
+
+//-------------------------------------------------------------------------
+
+void
+startAnimationSpriteLayer(
+    SPRITE_LAYER_T *s,
+    uint32_t frameDuration)
+{
+    s->frameDuration = frameDuration;
+    s->animationStart = nowMicrosecondsFrameLoop()
+                      - ((int64_t)(s->frame) * frameDuration * 1000);
+}
+
+//-------------------------------------------------------------------------
+
+static int32_t
+dueFrameSpriteLayer(
+    SPRITE_LAYER_T *s)
+{
+    if (s->frameDuration == 0)
+    {
+        return (s->frame + 1) % s->frames;
+    }
+
+    int64_t elapsed = nowMicrosecondsFrameLoop() - s->animationStart;
+
+    return (elapsed / (s->frameDuration * INT64_C(1000))) % s->frames;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+frameDueSpriteLayer(
+    SPRITE_LAYER_T *s)
+{
+    return dueFrameSpriteLayer(s) != s->frame;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+animateSpriteLayer(
+    SPRITE_LAYER_T *s,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int32_t frame = dueFrameSpriteLayer(s);
+
+    if (frame == s->frame)
+    {
+        return false;
+    }
+
+    changeFrameSpriteLayer(s, frame, update);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+int32_t
+timeToNextFrameSpriteLayer(
+    SPRITE_LAYER_T *s)
+{
+    if (s->frameDuration == 0)
+    {
+        return 0;
+    }
+
+    int64_t duration = s->frameDuration * INT64_C(1000);
+    int64_t elapsed = nowMicrosecondsFrameLoop() - s->animationStart;
+
+    return ((duration - (elapsed % duration)) + 999) / 1000;
+}
+
+//-------------------------------------------------------------------------
+
+void
+removeElementSpriteLayer(
+    SPRITE_LAYER_T *s,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    int result = vc_dispmanx_element_remove(update, s->element);
+    assert(result == 0);
+
+    s->element = 0;
+}
+
+//-------------------------------------------------------------------------
+
 void
 destroySpriteLayer(
     SPRITE_LAYER_T *s)
 {
     int result = 0;
 
-    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
-    assert(update != 0);
-    result = vc_dispmanx_element_remove(update, s->element);
-    assert(result == 0);
-    result = vc_dispmanx_update_submit_sync(update);
-    assert(result == 0);
+    if (s->element != 0)
+    {
+        DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+        assert(update != 0);
+        removeElementSpriteLayer(s, update);
+        result = vc_dispmanx_update_submit_sync(update);
+        assert(result == 0);
+    }
 
     //---------------------------------------------------------------------
 
-    result = vc_dispmanx_resource_delete(s->frontResource);
-    assert(result == 0);
-    result = vc_dispmanx_resource_delete(s->backResource);
-    assert(result == 0);
+    releaseResourcePool(s->frontResource);
+    releaseResourcePool(s->backResource);
 
     //---------------------------------------------------------------------
 
@@ -28,12 +28,21 @@
 #ifndef SPRITE_LAYER_H
 #define SPRITE_LAYER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "image.h"
 
 #include "bcm_host.h"
 
+#pragma GCC visibility push(default)
+
 //-------------------------------------------------------------------------
 
+// If frameDuration is not zero, the frame shown is chosen from the
+// monotonic clock: frame n is due n * frameDuration milliseconds after
+// animationStart (in microseconds).
+
 typedef struct
 {
     IMAGE_T image;
@@ -45,6 +54,10 @@ typedef struct
     int xOffset;
     int yOffsetMax;
     int yOffset;
+    int32_t frame;
+    int32_t frames;
+    uint32_t frameDuration;
+    int64_t animationStart;
     VC_RECT_T bmpRect;
     VC_RECT_T srcRect;
     VC_RECT_T dstRect;
@@ -64,6 +77,18 @@ initSpriteLayer(
     const char *file,
     int32_t layer);
 
+// As initSpriteLayer(), with the frames in an image that has already been
+// loaded. The sprite layer takes the image over, and destroys it with
+// itself.
+
+void
+initSpriteLayerImage(
+    SPRITE_LAYER_T *s,
+    int columns,
+    int rows,
+    const IMAGE_T *image,
+    int32_t layer);
+
 void
 addElementSpriteLayerOffset(
     SPRITE_LAYER_T *s,
@@ -90,8 +115,48 @@ updatePositionSpriteLayer(
     SPRITE_LAYER_T *s,
     DISPMANX_UPDATE_HANDLE_T update);
 
+// Show each frame for frameDuration milliseconds, starting with the
+// current frame now.
+
+void
+startAnimationSpriteLayer(
+    SPRITE_LAYER_T *s,
+    uint32_t frameDuration);
+
+// True if the frame due now is not the one on screen.
+
+bool
+frameDueSpriteLayer(
+    SPRITE_LAYER_T *s);
+
+// Add the frame due now to update. Returns false, leaving update alone,
+// if it is already on screen, so that a loop with nothing else to change
+// can skip the update altogether.
+
+bool
+animateSpriteLayer(
+    SPRITE_LAYER_T *s,
+    DISPMANX_UPDATE_HANDLE_T update);
+
+// Milliseconds until the next frame is due, for a loop that wants to
+// sleep until then.
+
+int32_t
+timeToNextFrameSpriteLayer(
+    SPRITE_LAYER_T *s);
+
+// Remove the element as part of update, so that destroySpriteLayer() does
+// not need an update of its own.
+
+void
+removeElementSpriteLayer(
+    SPRITE_LAYER_T *s,
+    DISPMANX_UPDATE_HANDLE_T update);
+
 void destroySpriteLayer(SPRITE_LAYER_T *s);
 
 //-------------------------------------------------------------------------
 
+#pragma GCC visibility pop
+
 #endif
@@ -0,0 +1,386 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "threadPool.h"
+
+//-------------------------------------------------------------------------
+
+// Set on the pool threads, and on any thread while it runs a task, so
+// that a job submitted from a task is run inline rather than waiting for
+// the job that it is part of.
+
+static __thread bool inThreadPool = false;
+
+static pthread_mutex_t defaultPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static bool defaultPoolStarted = false;
+static THREAD_POOL_T defaultPool;
+
+//-------------------------------------------------------------------------
+
+// What a thread taking part in a job needs to know about it, copied with
+// the pool mutex held.
+
+typedef struct
+{
+    THREAD_POOL_TASK_T task;
+    void *arg;
+    int32_t count;
+    int32_t grain;
+} THREAD_POOL_JOB_T;
+
+//-------------------------------------------------------------------------
+
+static void
+copyJobThreadPool(
+    const THREAD_POOL_T *pool,
+    THREAD_POOL_JOB_T *job)
+{
+    job->task = pool->task;
+    job->arg = pool->arg;
+    job->count = pool->count;
+    job->grain = pool->grain;
+}
+
+//-------------------------------------------------------------------------
+
+// The caller must be counted in busyThreads, so that the job cannot be
+// replaced (and next reset) while it takes tasks from it.
+
+static void
+runTasksThreadPool(
+    THREAD_POOL_T *pool,
+    const THREAD_POOL_JOB_T *job)
+{
+    bool wasInThreadPool = inThreadPool;
+    inThreadPool = true;
+
+    int32_t start;
+    while ((start = __sync_fetch_and_add(&(pool->next), job->grain))
+           < job->count)
+    {
+        int32_t end = start + job->grain;
+
+        if (end > job->count)
+        {
+            end = job->count;
+        }
+
+        (job->task)(job->arg, start, end);
+    }
+
+    inThreadPool = wasInThreadPool;
+}
+
+//-------------------------------------------------------------------------
+
+// Every thread takes part in every job, if only to find that there is
+// nothing left to do, so a job has finished once busyThreads is back to
+// zero, and no thread can still be looking at the one before.
+
+static void *
+workerThreadPool(
+    void *arg)
+{
+    THREAD_POOL_T *pool = arg;
+
+    inThreadPool = true;
+
+    // A job may already have been started before this thread got going, so
+    // start from the generation that initThreadPool() left.
+
+    uint32_t generation = 0;
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    while (true)
+    {
+        while ((pool->generation == generation) && (pool->quit == false))
+        {
+            pthread_cond_wait(&(pool->startCondition), &(pool->mutex));
+        }
+
+        if (pool->quit)
+        {
+            break;
+        }
+
+        generation = pool->generation;
+
+        THREAD_POOL_JOB_T job;
+        copyJobThreadPool(pool, &job);
+
+        pthread_mutex_unlock(&(pool->mutex));
+
+        runTasksThreadPool(pool, &job);
+
+        pthread_mutex_lock(&(pool->mutex));
+
+        if (--(pool->busyThreads) == 0)
+        {
+            pthread_cond_broadcast(&(pool->finishedCondition));
+        }
+    }
+
+    pthread_mutex_unlock(&(pool->mutex));
+
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+
+void
+initThreadPool(
+    THREAD_POOL_T *pool,
+    int32_t numberOfThreads)
+{
+    if (numberOfThreads <= 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        numberOfThreads = (cores < 1) ? 1 : cores;
+    }
+
+    pool->numberOfThreads = numberOfThreads;
+    pool->generation = 0;
+    pool->busyThreads = 0;
+    pool->quit = false;
+    pool->task = NULL;
+    pool->arg = NULL;
+    pool->count = 0;
+    pool->grain = 1;
+    pool->next = 0;
+
+    pthread_mutex_init(&(pool->mutex), NULL);
+    pthread_cond_init(&(pool->startCondition), NULL);
+    pthread_cond_init(&(pool->finishedCondition), NULL);
+
+    pool->threads = calloc(numberOfThreads, sizeof(pthread_t));
+
+    if (pool->threads == NULL)
+    {
+        fprintf(stderr, "threadPool: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int32_t thread;
+    for (thread = 0 ; thread < numberOfThreads ; thread++)
+    {
+        if (pthread_create(&(pool->threads[thread]),
+                           NULL,
+                           workerThreadPool,
+                           pool) != 0)
+        {
+            break;
+        }
+    }
+
+    // Carry on with the threads there are; with none at all every job is
+    // run by the thread that submits it.
+
+    pool->numberOfThreads = thread;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyThreadPool(
+    THREAD_POOL_T *pool)
+{
+    waitThreadPool(pool);
+
+    pthread_mutex_lock(&(pool->mutex));
+    pool->quit = true;
+    pthread_cond_broadcast(&(pool->startCondition));
+    pthread_mutex_unlock(&(pool->mutex));
+
+    int32_t thread;
+    for (thread = 0 ; thread < pool->numberOfThreads ; thread++)
+    {
+        pthread_join(pool->threads[thread], NULL);
+    }
+
+    pthread_cond_destroy(&(pool->finishedCondition));
+    pthread_cond_destroy(&(pool->startCondition));
+    pthread_mutex_destroy(&(pool->mutex));
+
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->numberOfThreads = 0;
+}
+
+//-------------------------------------------------------------------------
+
+THREAD_POOL_T *
+defaultThreadPool(void)
+{
+    pthread_mutex_lock(&defaultPoolMutex);
+
+    if (defaultPoolStarted == false)
+    {
+        initThreadPool(&defaultPool, 0);
+        defaultPoolStarted = true;
+    }
+
+    pthread_mutex_unlock(&defaultPoolMutex);
+
+    return &defaultPool;
+}
+
+//-------------------------------------------------------------------------
+
+void
+shutdownDefaultThreadPool(void)
+{
+    pthread_mutex_lock(&defaultPoolMutex);
+
+    if (defaultPoolStarted)
+    {
+        destroyThreadPool(&defaultPool);
+        defaultPoolStarted = false;
+    }
+
+    pthread_mutex_unlock(&defaultPoolMutex);
+}
+
+//-------------------------------------------------------------------------
+
+void
+startForThreadPool(
+    THREAD_POOL_T *pool,
+    int32_t count,
+    int32_t grain,
+    THREAD_POOL_TASK_T task,
+    void *arg)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (inThreadPool || (pool->numberOfThreads == 0))
+    {
+        bool wasInThreadPool = inThreadPool;
+        inThreadPool = true;
+        task(arg, 0, count);
+        inThreadPool = wasInThreadPool;
+
+        return;
+    }
+
+    waitThreadPool(pool);
+
+    // Another thread may have got a job in first.
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    while (pool->busyThreads > 0)
+    {
+        pthread_cond_wait(&(pool->finishedCondition), &(pool->mutex));
+    }
+
+    pool->task = task;
+    pool->arg = arg;
+    pool->count = count;
+    pool->grain = (grain < 1) ? 1 : grain;
+    pool->next = 0;
+    pool->busyThreads = pool->numberOfThreads;
+    ++(pool->generation);
+
+    pthread_cond_broadcast(&(pool->startCondition));
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+bool
+finishedThreadPool(
+    THREAD_POOL_T *pool)
+{
+    pthread_mutex_lock(&(pool->mutex));
+    bool finished = (pool->busyThreads == 0);
+    pthread_mutex_unlock(&(pool->mutex));
+
+    return finished;
+}
+
+//-------------------------------------------------------------------------
+
+void
+waitThreadPool(
+    THREAD_POOL_T *pool)
+{
+    if (inThreadPool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    // Help with the job while waiting for it. The helper counts itself in
+    // busyThreads, as the pool threads do, so the job is not finished (and
+    // no new one can start) until it has stopped taking tasks.
+
+    if (pool->busyThreads > 0)
+    {
+        THREAD_POOL_JOB_T job;
+        copyJobThreadPool(pool, &job);
+        ++(pool->busyThreads);
+
+        pthread_mutex_unlock(&(pool->mutex));
+        runTasksThreadPool(pool, &job);
+        pthread_mutex_lock(&(pool->mutex));
+
+        if (--(pool->busyThreads) == 0)
+        {
+            pthread_cond_broadcast(&(pool->finishedCondition));
+        }
+    }
+
+    while (pool->busyThreads > 0)
+    {
+        pthread_cond_wait(&(pool->finishedCondition), &(pool->mutex));
+    }
+
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+void
+forThreadPool(
+    THREAD_POOL_T *pool,
+    int32_t count,
+    int32_t grain,
+    THREAD_POOL_TASK_T task,
+    void *arg)
+{
+    startForThreadPool(pool, count, grain, task, arg);
+    waitThreadPool(pool);
+}
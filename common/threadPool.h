@@ -0,0 +1,133 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#pragma GCC visibility push(default)
+
+//-------------------------------------------------------------------------
+
+// A task is handed the items [start, end) of a job, for instance a band
+// of rows of an image. It may be called from any of the pool threads, and
+// from the thread that waits for the job.
+
+typedef void (*THREAD_POOL_TASK_T)(void *arg, int32_t start, int32_t end);
+
+// The pool runs one job at a time. The items of a job are handed out
+// grain at a time to whichever thread is free, so a thread that gets
+// cheap items simply takes more of them. A job submitted while another
+// is running waits for it to finish first, and a job submitted from inside
+// a task is run there and then, on that thread.
+
+typedef struct
+{
+    int32_t numberOfThreads;
+    pthread_t *threads;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t startCondition;
+    pthread_cond_t finishedCondition;
+    uint32_t generation;
+    int32_t busyThreads;
+    bool quit;
+
+    THREAD_POOL_TASK_T task;
+    void *arg;
+    int32_t count;
+    int32_t grain;
+    volatile int32_t next;
+} THREAD_POOL_T;
+
+//-------------------------------------------------------------------------
+
+// Start numberOfThreads threads, or one per core if it is 0.
+
+void
+initThreadPool(
+    THREAD_POOL_T *pool,
+    int32_t numberOfThreads);
+
+void
+destroyThreadPool(
+    THREAD_POOL_T *pool);
+
+// A pool with one thread per core, shared by everything in the program.
+// It is started the first time it is asked for.
+
+THREAD_POOL_T *
+defaultThreadPool(void);
+
+// Join the threads of the default pool, once nothing is using it. It is
+// started again if it is asked for afterwards.
+
+void
+shutdownDefaultThreadPool(void);
+
+// Start running task over the items [0, count) and return straight away.
+// Waits for the previous job first if it has not finished.
+
+void
+startForThreadPool(
+    THREAD_POOL_T *pool,
+    int32_t count,
+    int32_t grain,
+    THREAD_POOL_TASK_T task,
+    void *arg);
+
+// True once every item of the last job has been done.
+
+bool
+finishedThreadPool(
+    THREAD_POOL_T *pool);
+
+// Help with the last job until it is finished.
+
+void
+waitThreadPool(
+    THREAD_POOL_T *pool);
+
+// Run task over the items [0, count) and return once they are all done,
+// with the calling thread taking a share of them.
+
+void
+forThreadPool(
+    THREAD_POOL_T *pool,
+    int32_t count,
+    int32_t grain,
+    THREAD_POOL_TASK_T task,
+    void *arg);
+
+//-------------------------------------------------------------------------
+
+#pragma GCC visibility pop
+
+#endif
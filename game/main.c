@@ -34,12 +34,16 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "assetLoader.h"
 #include "backgroundLayer.h"
+#include "displayManager.h"
 #include "element_change.h"
 #include "image.h"
 #include "imageLayer.h"
-#include "loadpng.h"
+#include "input.h"
 #include "key.h"
+#include "memoryAccount.h"
+#include "scene.h"
 #include "scrollingLayer.h"
 #include "spriteLayer.h"
 
@@ -51,124 +55,445 @@
 
 //-------------------------------------------------------------------------
 
+// Milliseconds each frame of the sprite is shown for, however fast the
+// display refreshes.
+
+#define GAME_SPRITE_FRAME_DURATION 40
+
+#define GAME_DEFAULT_DISPLAY 0
+
+// The pngs, in the order they are added to the asset loader.
+
+typedef enum
+{
+    GAME_ASSET_TEXTURE,
+    GAME_ASSET_SPOTLIGHT,
+    GAME_ASSET_SPRITE,
+    GAME_ASSETS
+} GAME_ASSET_T;
+
+//-------------------------------------------------------------------------
+
+// The layers on one display, and what the scene's callbacks need to put
+// them on screen. spotlight shows the one copy of the spotlight image that
+// every display shares. The layers made from pngs are set up by the
+// display thread once the png is in, and has[] records which are. key is
+// the last key pressed, for the display thread to act on.
+
+typedef struct
+{
+    DISPMANX_MODEINFO_T info;
+    ASSET_LOADER_T *assets;
+    bool has[GAME_ASSETS];
+    BACKGROUND_LAYER_T bg;
+    SCROLLING_LAYER_T sl;
+    SPRITE_LAYER_T sprite;
+    IMAGE_LAYER_T spotlight;
+    int key;
+} GAME_T;
+
+//-------------------------------------------------------------------------
+
+static void
+addBackground(
+    void *data,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    GAME_T *game = data;
+    addElementBackgroundLayer(&(game->bg), display, update);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+removeBackground(
+    void *data,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    GAME_T *game = data;
+    removeElementBackgroundLayer(&(game->bg), update);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+addScrolling(
+    void *data,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    GAME_T *game = data;
+    addElementScrollingLayerCentered(&(game->sl),
+                                     &(game->info),
+                                     display,
+                                     update);
+}
+
+static bool
+dueScrolling(
+    void *data)
+{
+    GAME_T *game = data;
+    SCROLLING_LAYER_T *sl = &(game->sl);
+
+    return (sl->xDirections[sl->direction] != 0) ||
+           (sl->yDirections[sl->direction] != 0);
+}
+
+static void
+updateScrolling(
+    void *data,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    GAME_T *game = data;
+    updatePositionScrollingLayer(&(game->sl), update);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+addSprite(
+    void *data,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    GAME_T *game = data;
+    addElementSpriteLayerCentered(&(game->sprite),
+                                  &(game->info),
+                                  display,
+                                  update);
+}
+
+static bool
+dueSprite(
+    void *data)
+{
+    GAME_T *game = data;
+    return frameDueSpriteLayer(&(game->sprite));
+}
+
+static void
+updateSprite(
+    void *data,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    GAME_T *game = data;
+    animateSpriteLayer(&(game->sprite), update);
+}
+
+static void
+removeSprite(
+    void *data,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    GAME_T *game = data;
+    removeElementSpriteLayer(&(game->sprite), update);
+}
+
+//-------------------------------------------------------------------------
+
+static const SCENE_CALLBACKS_T backgroundCallbacks =
+{
+    addBackground, NULL, NULL, removeBackground
+};
+
+static const SCENE_CALLBACKS_T scrollingCallbacks =
+{
+    addScrolling, dueScrolling, updateScrolling, NULL
+};
+
+static const SCENE_CALLBACKS_T spriteCallbacks =
+{
+    addSprite, dueSprite, updateSprite, removeSprite
+};
+
+//-------------------------------------------------------------------------
+
+// True the first time the png is found to be in.
+
+static bool
+arrivedGame(
+    GAME_T *game,
+    GAME_ASSET_T asset)
+{
+    if (game->has[asset] ||
+        (stateAssetLoader(game->assets, asset) != ASSET_READY))
+    {
+        return false;
+    }
+
+    game->has[asset] = true;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// Add each layer made from a png in the first frame after the png is in.
+// Until then the display shows what it has, if only the background.
+
+static void
+addArrivedLayersGame(
+    GAME_T *game,
+    SCENE_T *scene)
+{
+    IMAGE_T image;
+
+    if (arrivedGame(game, GAME_ASSET_TEXTURE))
+    {
+        viewImageAssetLoader(game->assets, GAME_ASSET_TEXTURE, &image);
+        initScrollingLayerImage(&(game->sl), &image, 1);
+        addCallbackScene(scene, game, &scrollingCallbacks);
+    }
+
+    if (arrivedGame(game, GAME_ASSET_SPOTLIGHT))
+    {
+        IMAGE_LAYER_T *spotlight = layerAssetLoader(game->assets,
+                                                    GAME_ASSET_SPOTLIGHT);
+
+        shareImageLayer(&(game->spotlight), spotlight);
+        addImageLayerScene(scene,
+                           &(game->spotlight),
+                           (game->info.width - spotlight->image.width) / 2,
+                           (game->info.height - spotlight->image.height) / 2);
+    }
+
+    if (arrivedGame(game, GAME_ASSET_SPRITE))
+    {
+        viewImageAssetLoader(game->assets, GAME_ASSET_SPRITE, &image);
+        initSpriteLayerImage(&(game->sprite), 12, 1, &image, 3);
+        startAnimationSpriteLayer(&(game->sprite),
+                                  GAME_SPRITE_FRAME_DURATION);
+        addCallbackScene(scene, game, &spriteCallbacks);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Called on the thread of each display, every frame.
+
+static bool
+frameGame(
+    DISPLAY_T *display,
+    void *arg)
+{
+    GAME_T *game = arg;
+
+    addArrivedLayersGame(game, &(display->scene));
+
+    int c = __atomic_exchange_n(&(game->key), 0, __ATOMIC_ACQ_REL);
+
+    if ((c != 0) && game->has[GAME_ASSET_TEXTURE])
+    {
+        setDirectionScrollingLayer(&(game->sl), c);
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
 int main(int argc, char *argv[])
 {
-    uint32_t displayNumber = 0;
+    uint32_t displayNumbers[DISPLAY_MANAGER_MAX_DISPLAYS];
+    int32_t numberOfDisplays = 0;
+    bool printMemory = false;
 
     //-------------------------------------------------------------------
 
     int opt;
 
-    while ((opt = getopt(argc, argv, "d:")) != -1)
+    while ((opt = getopt(argc, argv, "d:u")) != -1)
     {
         switch (opt)
         {
         case 'd':
 
-            displayNumber = atoi(optarg);
+            if (numberOfDisplays < DISPLAY_MANAGER_MAX_DISPLAYS)
+            {
+                displayNumbers[numberOfDisplays++] = atoi(optarg);
+            }
+
+            break;
+
+        case 'u':
+
+            printMemory = true;
             break;
 
         default:
 
-            fprintf(stderr, "Usage: %s [-d <number>]\n", basename(argv[0]));
-            fprintf(stderr, "    -d - Raspberry Pi display number\n");
+            fprintf(stderr,
+                    "Usage: %s [-d <number>]... [-u]\n",
+                    basename(argv[0]));
+            fprintf(stderr, "    -d - Raspberry Pi display number, ");
+            fprintf(stderr, "repeat for more than one display\n");
+            fprintf(stderr, "    -u - print the memory each part of the");
+            fprintf(stderr, " program used, on exit\n");
             exit(EXIT_FAILURE);
             break;
         }
     }
 
+    if (numberOfDisplays == 0)
+    {
+        displayNumbers[numberOfDisplays++] = GAME_DEFAULT_DISPLAY;
+    }
+
     //-------------------------------------------------------------------
 
     bcm_host_init();
 
     //---------------------------------------------------------------------
 
-    BACKGROUND_LAYER_T bg;
-    initBackgroundLayer(&bg, 0x000F, 0);
+    // The pngs are decoded in the background, once for all the displays,
+    // and the spotlight is uploaded once too.
 
-    SCROLLING_LAYER_T sl;
-    initScrollingLayer(&sl, "texture.png", 1);
+    ASSET_LOADER_T assets;
+    initAssetLoader(&assets);
 
-    IMAGE_LAYER_T spotlight;
+    addImageAssetLoader(&assets, "texture.png");
+    addLayerAssetLoader(&assets, "spotlight.png", 2);
+    addImageAssetLoader(&assets, "sprite.png");
 
-    if (loadPng(&(spotlight.image), "spotlight.png") == false)
-    {
-        fprintf(stderr, "unable to load spotlight\n");
-        exit(EXIT_FAILURE);
-    }
+    startAssetLoader(&assets);
 
-    createResourceImageLayer(&spotlight, 2);
-
-    SPRITE_LAYER_T sprite;
-    initSpriteLayer(&sprite, 12, 1, "sprite.png", 3);
+    DISPLAY_MANAGER_T manager;
+    initDisplayManager(&manager);
 
     //---------------------------------------------------------------------
 
-    DISPMANX_DISPLAY_HANDLE_T display
-        = vc_dispmanx_display_open(displayNumber);
-    assert(display != 0);
+    // The background goes on screen in the first update, and each of the
+    // other layers in the first frame after its png is in. After that each
+    // frame sends one update with whatever moved or changed frame. Each
+    // display runs on its own thread, at its own refresh rate.
 
-    //---------------------------------------------------------------------
+    GAME_T games[DISPLAY_MANAGER_MAX_DISPLAYS];
 
-    DISPMANX_MODEINFO_T info;
-    int result = vc_dispmanx_display_get_info(display, &info);
-    assert(result == 0);
+    int32_t i;
+    for (i = 0 ; i < numberOfDisplays ; i++)
+    {
+        GAME_T *game = &(games[i]);
 
-    //---------------------------------------------------------------------
+        DISPLAY_T *display = openDisplayManager(&manager,
+                                                displayNumbers[i],
+                                                frameGame,
+                                                game);
+
+        if (display == NULL)
+        {
+            fprintf(stderr,
+                    "unable to open display %u\n",
+                    displayNumbers[i]);
+            exit(EXIT_FAILURE);
+        }
 
-    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
-    assert(update != 0);
+        game->info = display->info;
+        game->assets = &assets;
+        game->key = 0;
+
+        int32_t asset;
+        for (asset = 0 ; asset < GAME_ASSETS ; asset++)
+        {
+            game->has[asset] = false;
+        }
 
-    addElementBackgroundLayer(&bg, display, update);
-    addElementScrollingLayerCentered(&sl, &info, display, update);
-    addElementImageLayerCentered(&spotlight, &info, display, update);
-    addElementSpriteLayerCentered(&sprite, &info, display, update);
+        initBackgroundLayer(&(game->bg), 0x000F, 0);
+        addCallbackScene(&(display->scene), game, &backgroundCallbacks);
+    }
 
-    result = vc_dispmanx_update_submit_sync(update);
-    assert(result == 0);
+    startDisplayManager(&manager);
 
     //---------------------------------------------------------------------
 
+    // The main thread helps with the pngs while the displays start. Keys
+    // are then handed to every display, which acts on them in its next
+    // frame. In between, the main thread sleeps until one is pressed.
+
     int c = 0;
+    bool loaded = waitAssetLoader(&assets);
+
+    if (loaded == false)
+    {
+        int32_t asset;
+        for (asset = 0 ; asset < GAME_ASSETS ; asset++)
+        {
+            if (stateAssetLoader(&assets, asset) == ASSET_FAILED)
+            {
+                fprintf(stderr,
+                        "unable to load %s\n",
+                        assets.assets[asset].path);
+            }
+        }
+
+        c = 27;
+    }
 
     while (c != 27)
     {
         if (keyPressed(&c))
         {
             c = tolower(c);
-            setDirectionScrollingLayer(&sl, c);
+
+            for (i = 0 ; i < numberOfDisplays ; i++)
+            {
+                __atomic_store_n(&(games[i].key), c, __ATOMIC_RELEASE);
+            }
         }
+        else
+        {
+            waitForInput(-1);
+        }
+    }
 
-        //-----------------------------------------------------------------
+    //---------------------------------------------------------------------
 
-        DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
-        assert(update != 0);
+    // The scenes are destroyed, removing every layer, before the layers
+    // themselves and the pngs they share.
 
-        updatePositionScrollingLayer(&sl, update);
-        updatePositionSpriteLayer(&sprite, update);
+    stopDisplayManager(&manager);
 
-        result = vc_dispmanx_update_submit_sync(update);
-        assert(result == 0);
+    for (i = 0 ; i < numberOfDisplays ; i++)
+    {
+        destroyScene(&(manager.displays[i].scene));
     }
 
-    //---------------------------------------------------------------------
-
     keyboardReset();
 
-    //---------------------------------------------------------------------
+    for (i = 0 ; i < numberOfDisplays ; i++)
+    {
+        GAME_T *game = &(games[i]);
 
-    destroyBackgroundLayer(&bg);
-    destroyScrollingLayer(&sl);
-    destroyImageLayer(&spotlight);
-    destroySpriteLayer(&sprite);
+        destroyBackgroundLayer(&(game->bg));
 
-    //---------------------------------------------------------------------
+        if (game->has[GAME_ASSET_TEXTURE])
+        {
+            destroyScrollingLayer(&(game->sl));
+        }
 
-    result = vc_dispmanx_display_close(display);
-    assert(result == 0);
+        if (game->has[GAME_ASSET_SPOTLIGHT])
+        {
+            destroyImageLayer(&(game->spotlight));
+        }
+
+        if (game->has[GAME_ASSET_SPRITE])
+        {
+            destroySpriteLayer(&(game->sprite));
+        }
+    }
+
+    destroyDisplayManager(&manager);
+    destroyAssetLoader(&assets);
+
+    // Anything still charged once everything is destroyed has leaked.
+
+    if (printMemory)
+    {
+        printMemoryAccounts(stdout);
+    }
 
     //---------------------------------------------------------------------
 
-    return 0;
+    return (loaded) ? 0 : EXIT_FAILURE;
 }
-
@@ -45,8 +45,10 @@ void
 lifeInfo(
     IMAGE_LAYER_T *imageLayer,
     int32_t size,
+    const char *engine,
     bool paused,
     int32_t threads,
+    int32_t step,
     bool framesPerSecondValid,
     double framesPerSecond)
 {
@@ -87,6 +89,13 @@ lifeInfo(
 
     key_dimensions = drawKey(imageLayer, x, y, "space", "step");
 
+    if (step >= 0)
+    {
+        y += key_dimensions.height + INFO_TOP_PADDING;
+
+        key_dimensions = drawKey(imageLayer, x, y, "+/-", "speed");
+    }
+
     //---------------------------------------------------------------------
 
     char buffer[128];
@@ -98,11 +107,24 @@ lifeInfo(
 
     y += FONT_HEIGHT + INFO_TOP_PADDING;
 
+    snprintf(buffer, sizeof(buffer), "engine: %s", engine);
+    drawStringRGB(x, y, buffer, &textColour, image);
+
+    y += FONT_HEIGHT + INFO_TOP_PADDING;
+
     snprintf(buffer, sizeof(buffer), "threads: %d", threads);
     drawStringRGB(x, y, buffer, &textColour, image);
 
     y += FONT_HEIGHT + INFO_TOP_PADDING;
 
+    if (step >= 0)
+    {
+        snprintf(buffer, sizeof(buffer), "step: 2^%d", step);
+        drawStringRGB(x, y, buffer, &textColour, image);
+
+        y += FONT_HEIGHT + INFO_TOP_PADDING;
+    }
+
     if (framesPerSecondValid)
     {
         snprintf(buffer, sizeof(buffer), "fps: %.f", framesPerSecond);
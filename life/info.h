@@ -34,12 +34,17 @@
 
 //-------------------------------------------------------------------------
 
+// A step of less than 0 is of an engine that only moves on a generation at
+// a time.
+
 void
 lifeInfo(
     IMAGE_LAYER_T *imageLayer,
     int32_t size,
+    const char *engine,
     bool paused,
     int32_t threads,
+    int32_t step,
     bool framesPerSecondValid,
     double framesPerSecond);
 
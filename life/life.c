@@ -30,10 +30,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 #include <sys/time.h>
 
 #include "life.h"
+#include "lifeHash.h"
+#include "lifePacked.h"
+#include "prng.h"
+#include "resourcePool.h"
+#include "threadPool.h"
 
 //-------------------------------------------------------------------------
 
@@ -48,66 +52,572 @@
 
 //-------------------------------------------------------------------------
 
+// Cells in the byte engine hold their state in bit 0 and a count of their
+// live neighbours in bits 1 to 4.
+
+#define CELL_ALIVE 0x01
+
+// Non-zero for the cell values that change state in the next generation:
+// a dead cell with three neighbours, or a live cell without two or three.
+
+static const uint8_t flips[] =
+{
+    0, 1, 0, 1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 1, 0, 1,
+    0, 1
+};
+
+//-------------------------------------------------------------------------
+
+// Add delta to the neighbour count of the eight cells around (col, row),
+// wrapping at the edges of the board, but only in rows [startRow, endRow).
+
+static inline void
+addNeighbours(
+    LIFE_T *life,
+    int32_t col,
+    int32_t row,
+    int8_t delta,
+    int32_t startRow,
+    int32_t endRow)
+{
+    int32_t width = life->width;
+    int32_t height = life->height;
+
+    int32_t left = (col == 0) ? width - 1 : col - 1;
+    int32_t right = (col == width - 1) ? 0 : col + 1;
+
+    int32_t above = (row == 0) ? height - 1 : row - 1;
+    int32_t below = (row == height - 1) ? 0 : row + 1;
+
+    uint8_t *cells = life->field + (row * width);
+
+    if ((above >= startRow) && (above < endRow))
+    {
+        uint8_t *cellsAbove = life->field + (above * width);
+
+        cellsAbove[left] += delta;
+        cellsAbove[col] += delta;
+        cellsAbove[right] += delta;
+    }
+
+    if ((row >= startRow) && (row < endRow))
+    {
+        cells[left] += delta;
+        cells[right] += delta;
+    }
+
+    if ((below >= startRow) && (below < endRow))
+    {
+        uint8_t *cellsBelow = life->field + (below * width);
+
+        cellsBelow[left] += delta;
+        cellsBelow[col] += delta;
+        cellsBelow[right] += delta;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Fill rows [startRow, endRow) of the board with random cells. Each row
+// has a generator of its own, so the board only depends on the seed.
+
+static void
+seedRowsLife(
+    void *arg,
+    int32_t startRow,
+    int32_t endRow)
+{
+    LIFE_T *life = arg;
+    int32_t width = life->width;
+
+    int32_t row;
+    for (row = startRow ; row < endRow ; row++)
+    {
+        PRNG_T prng;
+        seedPrng(&prng, life->seed, row);
+
+        uint8_t *pixels = life->buffer + (row * life->alignedWidth);
+        uint8_t *cells = (life->field) ? life->field + (row * width) : NULL;
+        uint64_t *words = (life->packed)
+                        ? life->packed + (row * life->wordsPerRow)
+                        : NULL;
+
+        int32_t col;
+        for (col = 0 ; col < width ; col += 64)
+        {
+            uint64_t bits = nextPrng(&prng);
+            int32_t n = ((width - col) < 64) ? (width - col) : 64;
+
+            if (n < 64)
+            {
+                bits &= ((uint64_t)1 << n) - 1;
+            }
+
+            if (words)
+            {
+                words[col / 64] = bits;
+            }
+
+            int32_t i;
+            for (i = 0 ; i < n ; i++)
+            {
+                uint8_t alive = (bits >> i) & 1;
+
+                pixels[col + i] = (alive) ? LIVE : DEAD;
+
+                if (cells)
+                {
+                    cells[col + i] = alive;
+                }
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Draw rows [startRow, endRow) of the board into the pixels, from the
+// cells of whichever engine is in use.
+
+static void
+drawRowsLife(
+    void *arg,
+    int32_t startRow,
+    int32_t endRow)
+{
+    LIFE_T *life = arg;
+    int32_t width = life->width;
+
+    int32_t row;
+    for (row = startRow ; row < endRow ; row++)
+    {
+        uint8_t *pixels = life->buffer + (row * life->alignedWidth);
+
+        int32_t col;
+        for (col = 0 ; col < width ; col++)
+        {
+            bool alive = false;
+
+            if (life->packed)
+            {
+                uint64_t word = life->packed[(row * life->wordsPerRow)
+                                             + (col / 64)];
+
+                alive = (word >> (col % 64)) & 1;
+            }
+            else
+            {
+                alive = life->field[(row * width) + col] & CELL_ALIVE;
+            }
+
+            pixels[col] = (alive) ? LIVE : DEAD;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Work out the neighbour counts of the byte engine for rows [startRow,
+// endRow), from the pixels of the cells around them, so that each thread
+// only writes to its own rows.
+
+static void
+countRowsLife(
+    void *arg,
+    int32_t startRow,
+    int32_t endRow)
+{
+    LIFE_T *life = arg;
+    int32_t width = life->width;
+    int32_t height = life->height;
+
+    int32_t row;
+    for (row = startRow ; row < endRow ; row++)
+    {
+        int32_t above = (row == 0) ? height - 1 : row - 1;
+        int32_t below = (row == height - 1) ? 0 : row + 1;
+
+        const uint8_t *rows[3] =
+        {
+            life->buffer + (above * life->alignedWidth),
+            life->buffer + (row * life->alignedWidth),
+            life->buffer + (below * life->alignedWidth)
+        };
+
+        uint8_t *cells = life->field + (row * width);
+
+        int32_t col;
+        for (col = 0 ; col < width ; col++)
+        {
+            int32_t left = (col == 0) ? width - 1 : col - 1;
+            int32_t right = (col == width - 1) ? 0 : col + 1;
+
+            int32_t neighbours = (rows[0][left] == LIVE)
+                               + (rows[0][col] == LIVE)
+                               + (rows[0][right] == LIVE)
+                               + (rows[1][left] == LIVE)
+                               + (rows[1][right] == LIVE)
+                               + (rows[2][left] == LIVE)
+                               + (rows[2][col] == LIVE)
+                               + (rows[2][right] == LIVE);
+
+            cells[col] |= neighbours << 1;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+const char *
+lifeEngineName(
+    LIFE_ENGINE_T engine)
+{
+    switch (engine)
+    {
+    case LIFE_ENGINE_BYTE:
+
+        return "byte";
+
+    case LIFE_ENGINE_PACKED:
+
+        return "packed";
+
+    case LIFE_ENGINE_HASH:
+
+        return "hash";
+    }
+
+    return "unknown";
+}
+
+//-------------------------------------------------------------------------
+
+void
+addElementLife(
+    LIFE_T *life,
+    int32_t xOffset,
+    int32_t yOffset,
+    int32_t dstSize,
+    DISPMANX_DISPLAY_HANDLE_T display,
+    DISPMANX_UPDATE_HANDLE_T update)
+{
+    VC_DISPMANX_ALPHA_T alpha =
+    {
+        DISPMANX_FLAGS_ALPHA_FROM_SOURCE, 
+        255, /*alpha 0->255*/
+        0
+    };
+
+    //---------------------------------------------------------------------
+
+    vc_dispmanx_rect_set(&(life->srcRect),
+                         0,
+                         0,
+                         life->width << 16,
+                         life->height << 16);
+
+    vc_dispmanx_rect_set(&(life->dstRect),
+                         xOffset,
+                         yOffset,
+                         dstSize,
+                         dstSize);
+
+    life->element =
+        vc_dispmanx_element_add(update,
+                                display,
+                                1,
+                                &(life->dstRect),
+                                life->frontResource,
+                                &(life->srcRect),
+                                DISPMANX_PROTECTION_NONE,
+                                &alpha,
+                                NULL,
+                                DISPMANX_NO_ROTATE);
+    assert(life->element != 0);
+}
+
+//-------------------------------------------------------------------------
+
+// First phase of a byte engine generation. Each thread only reads the
+// cells in its own rows and lists the ones that change, in row order, as
+// (offset << 1) | alive. The changes in its first and last rows are at the
+// start and end of the list, where the threads either side can find them.
+
+static void
+computeLifeKernel(
+    LIFE_T *life,
+    LIFE_HEIGHT_RANGE_T *range)
+{
+    int32_t width = life->width;
+    int32_t startHeight = range->startHeight;
+    int32_t endHeight = range->endHeight;
+    int32_t changedStart = endHeight;
+    int32_t changedEnd = startHeight;
+    int32_t numberOfChanges = 0;
+    int32_t numberOfFirstRowChanges = 0;
+    uint32_t *changes = range->changes;
+
+    int32_t row;
+    for (row = startHeight ; row < endHeight ; row++)
+    {
+        const uint8_t *cells = life->field + (row * width);
+        uint8_t *pixels = life->buffer + (row * life->alignedWidth);
+        int32_t numberOfRowChanges = numberOfChanges;
+
+        int32_t col;
+        for (col = 0 ; col < width ; col++)
+        {
+            uint8_t cell = cells[col];
+
+            if (flips[cell] == 0)
+            {
+                continue;
+            }
+
+            bool next = (cell & CELL_ALIVE) == 0;
+
+            pixels[col] = (next) ? LIVE : DEAD;
+
+            if (numberOfChanges == range->maxChanges)
+            {
+                range->maxChanges *= 2;
+                changes = realloc(changes,
+                                  range->maxChanges * sizeof(uint32_t));
+
+                if (changes == NULL)
+                {
+                    fprintf(stderr, "life: memory exhausted\n");
+                    exit(EXIT_FAILURE);
+                }
+
+                range->changes = changes;
+            }
+
+            changes[numberOfChanges++] =
+                (((row * width) + col) << 1) | next;
+        }
+
+        numberOfRowChanges = numberOfChanges - numberOfRowChanges;
+
+        if (numberOfRowChanges > 0)
+        {
+            if (row < changedStart)
+            {
+                changedStart = row;
+            }
+
+            changedEnd = row + 1;
+        }
+
+        if (row == startHeight)
+        {
+            numberOfFirstRowChanges = numberOfRowChanges;
+        }
+
+        if (row == endHeight - 1)
+        {
+            range->numberOfLastRowChanges = numberOfRowChanges;
+        }
+    }
+
+    range->changedStart = changedStart;
+    range->changedEnd = changedEnd;
+    range->numberOfChanges = numberOfChanges;
+    range->numberOfFirstRowChanges = numberOfFirstRowChanges;
+}
+
+//-------------------------------------------------------------------------
+
+// Apply the changes listed by the thread that owns the row next to this
+// thread's range, to this thread's edge row.
+
+static void
+commitHaloRow(
+    LIFE_T *life,
+    LIFE_HEIGHT_RANGE_T *range,
+    int32_t row)
+{
+    if ((row >= range->startHeight) && (row < range->endHeight))
+    {
+        return;
+    }
+
+    int32_t thread;
+    for (thread = 0 ; thread < life->numberOfThreads ; thread++)
+    {
+        LIFE_HEIGHT_RANGE_T *owner = &(life->heightRange[thread]);
+
+        if ((row < owner->startHeight) || (row >= owner->endHeight))
+        {
+            continue;
+        }
+
+        const uint32_t *changes = owner->changes;
+        int32_t numberOfChanges = owner->numberOfFirstRowChanges;
+
+        if (row != owner->startHeight)
+        {
+            numberOfChanges = owner->numberOfLastRowChanges;
+            changes += owner->numberOfChanges - numberOfChanges;
+        }
+
+        int32_t i;
+        for (i = 0 ; i < numberOfChanges ; i++)
+        {
+            int32_t col = (changes[i] >> 1) - (row * life->width);
+
+            addNeighbours(life,
+                          col,
+                          row,
+                          (changes[i] & 1) ? 2 : -2,
+                          range->startHeight,
+                          range->endHeight);
+        }
+
+        break;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Second phase of a byte engine generation. Each thread flips the listed
+// cells in its own rows and updates the neighbour counts, but only writes
+// to its own rows, so the result does not depend on the number of threads
+// or the order they run in.
+
+static void
+commitLifeKernel(
+    LIFE_T *life,
+    LIFE_HEIGHT_RANGE_T *range)
+{
+    int32_t width = life->width;
+    int32_t row = range->startHeight;
+    uint32_t rowEnd = (row + 1) * width;
+
+    int32_t i;
+    for (i = 0 ; i < range->numberOfChanges ; i++)
+    {
+        uint32_t offset = range->changes[i] >> 1;
+
+        while (offset >= rowEnd)
+        {
+            ++row;
+            rowEnd += width;
+        }
+
+        life->field[offset] ^= CELL_ALIVE;
+
+        addNeighbours(life,
+                      offset - (rowEnd - width),
+                      row,
+                      (range->changes[i] & 1) ? 2 : -2,
+                      range->startHeight,
+                      range->endHeight);
+    }
+
+    if (range->startHeight < range->endHeight)
+    {
+        int32_t height = life->height;
+        int32_t above = (range->startHeight == 0)
+                      ? height - 1
+                      : range->startHeight - 1;
+        int32_t below = (range->endHeight == height) ? 0 : range->endHeight;
+
+        // If the same row is above and below, commitHaloRow() updates
+        // both edges in one go.
+
+        commitHaloRow(life, range, above);
+
+        if (below != above)
+        {
+            commitHaloRow(life, range, below);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+computeRangesLife(
+    void *arg,
+    int32_t start,
+    int32_t end)
+{
+    LIFE_T *life = arg;
+
+    int32_t range;
+    for (range = start ; range < end ; range++)
+    {
+        switch (life->engine)
+        {
+        case LIFE_ENGINE_PACKED:
+
+            iterateLifePackedKernel(life, range);
+            break;
+
+        case LIFE_ENGINE_HASH:
+
+            iterateLifeHashKernel(life, range);
+            break;
+
+        default:
+
+            computeLifeKernel(life, &(life->heightRange[range]));
+            break;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
 static void
-setCell(
-    LIFE_T *life,
-    int32_t col,
-    int32_t row)
+commitRangesLife(
+    void *arg,
+    int32_t start,
+    int32_t end)
 {
-    life->buffer[col + (row * life->alignedWidth)] = LIVE;
+    LIFE_T *life = arg;
 
-    int32_t width = life->width;
-    int32_t height = life->height;
-    int32_t fieldLength = life->fieldLength;
-
-    uint8_t *cell = life->fieldNext + col + (row * width);
-
-    uint32_t left = (col == 0) ? width - 1 :  -1;
-    uint32_t right = (col == width - 1) ?  -(width - 1) : 1;
-    uint32_t above = (row == 0) ? fieldLength - width : -width;
-    uint32_t below = (row == height - 1) ? -(fieldLength - width) : width;
-
-    *(cell) |= 0x01;
-    *(cell + above + left) += 2;
-    *(cell + above) += 2;
-    *(cell + above + right) += 2;
-    *(cell + left) += 2;
-    *(cell + right) += 2;
-    *(cell + below + left) += 2;
-    *(cell + below) += 2;
-    *(cell + below + right) += 2;
+    int32_t range;
+    for (range = start ; range < end ; range++)
+    {
+        commitLifeKernel(life, &(life->heightRange[range]));
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Start working out the next generation in the pool and return. The
+// byte engine only lists the changes here; they are committed once every
+// range has been listed, in finishIterationLife().
+
+static void
+startIterationLife(
+    LIFE_T *life)
+{
+    startForThreadPool(life->pool,
+                       life->numberOfThreads,
+                       1,
+                       computeRangesLife,
+                       life);
 }
 
 //-------------------------------------------------------------------------
 
 static void
-clearCell(
-    LIFE_T *life,
-    int32_t col,
-    int32_t row)
+finishIterationLife(
+    LIFE_T *life)
 {
-    life->buffer[col + (row * life->alignedWidth)] = DEAD;
+    waitThreadPool(life->pool);
 
-    int32_t width = life->width;
-    int32_t height = life->height;
-    int32_t fieldLength = life->fieldLength;
-
-    uint8_t *cell = life->fieldNext + col + (row * width);
-
-    uint32_t left = (col == 0) ? width - 1 :  -1;
-    uint32_t right = (col == width - 1) ?  -(width - 1) : 1;
-    uint32_t above = (row == 0) ? fieldLength - width : -width;
-    uint32_t below = (row == height - 1) ? -(fieldLength - width) : width;
-
-    *(cell) &= ~0x01;
-    *(cell + above + left) -= 2;
-    *(cell + above) -= 2;
-    *(cell + above + right) -= 2;
-    *(cell + left) -= 2;
-    *(cell + right) -= 2;
-    *(cell + below + left) -= 2;
-    *(cell + below) -= 2;
-    *(cell + below + right) -= 2;
+    if (life->engine == LIFE_ENGINE_BYTE)
+    {
+        forThreadPool(life->pool,
+                      life->numberOfThreads,
+                      1,
+                      commitRangesLife,
+                      life);
+    }
 }
 
 //-------------------------------------------------------------------------
@@ -115,13 +625,15 @@ clearCell(
 void
 newLife(
     LIFE_T *life,
-    int32_t size)
+    int32_t size,
+    LIFE_ENGINE_T engine)
 {
     life->width = size;
     life->height = size;
     life->alignedWidth = ALIGN_TO_16(life->width);
     life->alignedHeight = ALIGN_TO_16(life->height);
     life->pitch = ALIGN_TO_16(life->width);
+    life->account = findMemoryAccount("life");
 
     life->buffer = calloc(1, life->pitch * life->alignedHeight);
 
@@ -131,71 +643,94 @@ newLife(
         exit(EXIT_FAILURE);
     }
 
-    life->fieldLength = life->width * life->height;
-
-    life->field = calloc(1, life->fieldLength);
+    chargeCpuMemoryAccount(life->account,
+                           life->pitch * life->alignedHeight,
+                           1);
 
-    if (life->field == NULL)
+    life->engine = engine;
+    life->fieldLength = life->width * life->height;
+    life->field = NULL;
+    life->wordsPerRow = 0;
+    life->packed = NULL;
+    life->packedNext = NULL;
+    life->mapping = NULL;
+    life->mappingLength = 0;
+    life->tileRows = 0;
+    life->tileChanged = NULL;
+    life->tileActive = NULL;
+    life->hash = NULL;
+    life->step = 0;
+    life->memoryLimit = LIFE_HASH_MEMORY;
+    life->generation = 0;
+
+    if (engine == LIFE_ENGINE_PACKED)
     {
-        fprintf(stderr, "life: memory exhausted\n");
-        exit(EXIT_FAILURE);
+        newLifePacked(life);
+    }
+    else if (engine == LIFE_ENGINE_HASH)
+    {
+        newLifeHash(life);
     }
+    else
+    {
+        life->field = calloc(1, life->fieldLength);
 
-    life->fieldNext = calloc(1, life->fieldLength);
+        if (life->field == NULL)
+        {
+            fprintf(stderr, "life: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
 
-    if (life->fieldNext == NULL)
-    {
-        fprintf(stderr, "life: memory exhausted\n");
-        exit(EXIT_FAILURE);
+        chargeCpuMemoryAccount(life->account, life->fieldLength, 1);
     }
 
     struct timeval tv;
     gettimeofday(&tv, NULL);
-    srand(tv.tv_usec);
+    life->seed = ((uint64_t)(tv.tv_sec) << 20) ^ tv.tv_usec;
 
-    int32_t row = 0;
-    for (row = 0 ; row < life->height ; row++)
+    life->pool = defaultThreadPool();
+
+    forThreadPool(life->pool, life->height, 16, seedRowsLife, life);
+
+    if (engine == LIFE_ENGINE_BYTE)
     {
-        int32_t col = 0;
-        for (col = 0 ; col < life->width ; col++)
-        {
-            if (rand() > (RAND_MAX / 2))
-            {
-                setCell(life, col, row);
-            }
-            else
-            {
-                life->buffer[col + (row * life->alignedWidth)] = DEAD;
-            }
-        }
+        forThreadPool(life->pool, life->height, 16, countRowsLife, life);
+    }
+    else if (engine == LIFE_ENGINE_HASH)
+    {
+        restartLifeHash(life);
     }
 
     //---------------------------------------------------------------------
 
     VC_IMAGE_TYPE_T type = VC_IMAGE_8BPP;
-    uint32_t vc_image_ptr;
     int result = 0;
 
-    life->frontResource = 
-        vc_dispmanx_resource_create(
-            type,
-            life->width | (life->pitch << 16),
-            life->height | (life->alignedHeight << 16),
-            &vc_image_ptr);
-    assert(life->frontResource != 0);
-
-    life->backResource = 
-        vc_dispmanx_resource_create(
-            type,
-            life->width | (life->pitch << 16),
-            life->height | (life->alignedHeight << 16),
-            &vc_image_ptr);
-    assert(life->backResource != 0);
+    MEMORY_ACCOUNT_T *previous = enterMemoryAccount(life->account);
+
+    life->frontResource = acquireResourcePool(type,
+                                              life->width,
+                                              life->height,
+                                              life->pitch,
+                                              life->alignedHeight);
+
+    life->backResource = acquireResourcePool(type,
+                                             life->width,
+                                             life->height,
+                                             life->pitch,
+                                             life->alignedHeight);
+
+    leaveMemoryAccount(previous);
 
     //---------------------------------------------------------------------
 
     vc_dispmanx_rect_set(&(life->bmpRect), 0, 0, life->width, life->height);
 
+    // Nothing has been written to the back resource yet.
+
+    life->changedStart = 0;
+    life->changedEnd = life->height;
+
     result = vc_dispmanx_resource_write_data(life->frontResource,
                                              type,
                                              life->pitch,
@@ -205,47 +740,72 @@ newLife(
 
     //---------------------------------------------------------------------
 
-    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    // The board is split into one range of rows for each thread of the
+    // pool, which each generation is then divided up by.
 
-    if (cores == -1)
-    {
-        cores = 1;
-    }
+    life->numberOfThreads = life->pool->numberOfThreads;
 
-    if (cores > LIFE_MAX_THREADS)
+    if (life->numberOfThreads > LIFE_MAX_THREADS)
     {
         life->numberOfThreads = LIFE_MAX_THREADS;
     }
-    else
-    {
-        life->numberOfThreads = cores;
-    }
 
-    pthread_barrier_init(&(life->startIterationBarrier),
-                         NULL,
-                         life->numberOfThreads + 1);
+    // The hash engine works out the whole board as one step.
 
-    pthread_barrier_init(&(life->finishedIterationBarrier),
-                         NULL,
-                         life->numberOfThreads + 1);
+    if ((life->numberOfThreads < 1) || (engine == LIFE_ENGINE_HASH))
+    {
+        life->numberOfThreads = 1;
+    }
 
     //---------------------------------------------------------------------
 
     int32_t heightStep = life->height / life->numberOfThreads;
     int32_t heightStart = 0;
 
+    if (engine == LIFE_ENGINE_PACKED)
+    {
+        // keep each thread to whole rows of tiles
+
+        heightStep = ((heightStep + LIFE_TILE_HEIGHT - 1) / LIFE_TILE_HEIGHT)
+                   * LIFE_TILE_HEIGHT;
+    }
+
     int32_t thread;
     for (thread = 0 ; thread < life->numberOfThreads ; thread++)
     {
-        life->heightRange[thread].startHeight = heightStart;
-        life->heightRange[thread].endHeight = heightStart + heightStep;
+        if (heightStart > life->height)
+        {
+            heightStart = life->height;
+        }
 
-        heightStart += heightStep;
+        int32_t heightEnd = heightStart + heightStep;
 
-        pthread_create(&(life->threads[thread]),
-                       NULL,
-                       workerLife,
-                       life);
+        if (heightEnd > life->height)
+        {
+            heightEnd = life->height;
+        }
+
+        LIFE_HEIGHT_RANGE_T *range = &(life->heightRange[thread]);
+
+        range->startHeight = heightStart;
+        range->endHeight = heightEnd;
+        range->changes = NULL;
+        range->numberOfChanges = 0;
+        range->maxChanges = 0;
+
+        if (engine == LIFE_ENGINE_BYTE)
+        {
+            range->maxChanges = life->width;
+            range->changes = malloc(range->maxChanges * sizeof(uint32_t));
+
+            if (range->changes == NULL)
+            {
+                fprintf(stderr, "life: memory exhausted\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        heightStart += heightStep;
     }
 
     thread = life->numberOfThreads - 1;
@@ -253,127 +813,254 @@ newLife(
 
     //---------------------------------------------------------------------
 
-    memcpy(life->field, life->fieldNext, life->fieldLength);
-    pthread_barrier_wait(&(life->startIterationBarrier));
+    startIterationLife(life);
 }
 
 //-------------------------------------------------------------------------
 
-void *
-workerLife(
-    void *arg)
+void
+iterateLife(
+    LIFE_T *life)
 {
-    LIFE_T *life = arg;
+    finishIterationLife(life);
 
-    int32_t thread = -1;
-    int32_t i;
-    for (i = 0 ; i < life->numberOfThreads ; i++)
+    int32_t changedStart = life->height;
+    int32_t changedEnd = 0;
+
+    int32_t thread;
+    for (thread = 0 ; thread < life->numberOfThreads ; thread++)
     {
-        if (pthread_equal(pthread_self(), life->threads[i]))
+        LIFE_HEIGHT_RANGE_T *range = &(life->heightRange[thread]);
+
+        if (range->changedStart < range->changedEnd)
         {
-            thread = i;
-            break;
+            if (range->changedStart < changedStart)
+            {
+                changedStart = range->changedStart;
+            }
+
+            if (range->changedEnd > changedEnd)
+            {
+                changedEnd = range->changedEnd;
+            }
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    // The back resource last received the generation before the previous
+    // one, so it needs the rows that changed in both.
+
+    int32_t writeStart = changedStart;
+    int32_t writeEnd = changedEnd;
+
+    if (life->changedStart < life->changedEnd)
+    {
+        if (life->changedStart < writeStart)
+        {
+            writeStart = life->changedStart;
+        }
+
+        if (life->changedEnd > writeEnd)
+        {
+            writeEnd = life->changedEnd;
         }
     }
 
-    if (thread == -1)
+    life->changedStart = changedStart;
+    life->changedEnd = changedEnd;
+
+    if (writeStart < writeEnd)
     {
-        fprintf(stderr, "life: cannot find thread index\n");
-        return NULL;
+        // The x of the rect is ignored and the source address is offset by
+        // y * pitch, so the whole buffer is passed in.
+
+        vc_dispmanx_rect_set(&(life->bmpRect),
+                             0,
+                             writeStart,
+                             life->width,
+                             writeEnd - writeStart);
+
+        int result = 0;
+        VC_IMAGE_TYPE_T type = VC_IMAGE_8BPP;
+
+        result = vc_dispmanx_resource_write_data(life->backResource,
+                                                 type,
+                                                 life->pitch,
+                                                 life->buffer,
+                                                 &(life->bmpRect));
+        assert(result == 0);
     }
 
-    while (true)
+    switch (life->engine)
     {
-        pthread_barrier_wait(&(life->startIterationBarrier));
-        iterateLifeKernel(life, thread);
-        pthread_barrier_wait(&(life->finishedIterationBarrier));
+    case LIFE_ENGINE_PACKED:
+
+        swapLifePacked(life);
+        ++(life->generation);
+        break;
+
+    case LIFE_ENGINE_HASH:
+
+        life->generation += swapLifeHash(life);
+        break;
+
+    default:
+
+        ++(life->generation);
+        break;
     }
 
-    return NULL;
+    startIterationLife(life);
 }
 
 //-------------------------------------------------------------------------
 
 void
-addElementLife(
+clearLife(
+    LIFE_T *life)
+{
+    finishIterationLife(life);
+
+    // The changes have been committed, so make sure nothing commits them
+    // a second time.
+
+    int32_t thread;
+    for (thread = 0 ; thread < life->numberOfThreads ; thread++)
+    {
+        LIFE_HEIGHT_RANGE_T *range = &(life->heightRange[thread]);
+
+        range->numberOfChanges = 0;
+        range->numberOfFirstRowChanges = 0;
+        range->numberOfLastRowChanges = 0;
+    }
+
+    if (life->packed)
+    {
+        memset(life->packed,
+               0,
+               (size_t)(life->wordsPerRow) * life->height * sizeof(uint64_t));
+    }
+    else
+    {
+        memset(life->field, 0, life->fieldLength);
+    }
+
+    life->generation = 0;
+}
+
+//-------------------------------------------------------------------------
+
+void
+setCellLife(
     LIFE_T *life,
-    int32_t xOffset,
-    int32_t yOffset,
-    int32_t dstSize,
-    DISPMANX_DISPLAY_HANDLE_T display,
-    DISPMANX_UPDATE_HANDLE_T update)
+    int32_t col,
+    int32_t row)
 {
-    VC_DISPMANX_ALPHA_T alpha =
+    col %= life->width;
+    row %= life->height;
+
+    if (col < 0)
     {
-        DISPMANX_FLAGS_ALPHA_FROM_SOURCE, 
-        255, /*alpha 0->255*/
-        0
-    };
+        col += life->width;
+    }
+
+    if (row < 0)
+    {
+        row += life->height;
+    }
+
+    if (life->packed)
+    {
+        setCellPacked(life, col, row);
+    }
+    else
+    {
+        life->field[(row * life->width) + col] = CELL_ALIVE;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+restartLife(
+    LIFE_T *life)
+{
+    forThreadPool(life->pool, life->height, 16, drawRowsLife, life);
+
+    if (life->engine == LIFE_ENGINE_BYTE)
+    {
+        forThreadPool(life->pool, life->height, 16, countRowsLife, life);
+    }
+    else if (life->engine == LIFE_ENGINE_HASH)
+    {
+        restartLifeHash(life);
+    }
+    else
+    {
+        // Every tile has to be worked out once before the changed tiles
+        // mean anything again.
+
+        memset(life->tileActive,
+               1,
+               (size_t)(life->wordsPerRow) * life->tileRows);
+    }
 
     //---------------------------------------------------------------------
 
-    vc_dispmanx_rect_set(&(life->srcRect),
-                         0,
-                         0,
-                         life->width << 16,
-                         life->height << 16);
+    // Both resources are out of date, the front one is written now and
+    // the back one with the next generation.
 
-    vc_dispmanx_rect_set(&(life->dstRect),
-                         xOffset,
-                         yOffset,
-                         dstSize,
-                         dstSize);
+    vc_dispmanx_rect_set(&(life->bmpRect), 0, 0, life->width, life->height);
 
-    life->element =
-        vc_dispmanx_element_add(update,
-                                display,
-                                1,
-                                &(life->dstRect),
-                                life->frontResource,
-                                &(life->srcRect),
-                                DISPMANX_PROTECTION_NONE,
-                                &alpha,
-                                NULL,
-                                DISPMANX_NO_ROTATE);
-    assert(life->element != 0);
+    int result = vc_dispmanx_resource_write_data(life->frontResource,
+                                                 VC_IMAGE_8BPP,
+                                                 life->pitch,
+                                                 life->buffer,
+                                                 &(life->bmpRect));
+    assert(result == 0);
+
+    life->changedStart = 0;
+    life->changedEnd = life->height;
+
+    startIterationLife(life);
 }
 
 //-------------------------------------------------------------------------
 
 void
-iterateLifeKernel(
-    LIFE_T *life,
-    int32_t thread)
+packLife(
+    const LIFE_T *life,
+    uint64_t *words)
 {
-    uint8_t *cell = life->field +
-                    (life->heightRange[thread].startHeight * life->width);
+    int32_t wordsPerRow = (life->width + 63) / 64;
+
+    if (life->packed)
+    {
+        memcpy(words,
+               life->packed,
+               (size_t)wordsPerRow * life->height * sizeof(uint64_t));
+        return;
+    }
+
+    // The byte engine only changes its cells once every range has been
+    // worked out, so they hold the current generation until then.
 
     int32_t row;
-    for (row = life->heightRange[thread].startHeight ;
-         row < life->heightRange[thread].endHeight ;
-         row++)
+    for (row = 0 ; row < life->height ; row++)
     {
+        const uint8_t *cells = life->field + (row * life->width);
+        uint64_t *rowWords = words + (row * wordsPerRow);
+
+        memset(rowWords, 0, wordsPerRow * sizeof(uint64_t));
+
         int32_t col;
         for (col = 0 ; col < life->width ; col++)
         {
-            uint8_t neighbours = *cell >> 1;
-
-            if (*cell & 0x01)
-            {
-                if ((neighbours != 2) && (neighbours != 3))
-                {
-                    clearCell(life, col, row);
-                }
-            }
-            else
+            if (cells[col] & CELL_ALIVE)
             {
-                if (neighbours == 3)
-                {
-                    setCell(life, col, row);
-                }
+                rowWords[col / 64] |= (uint64_t)1 << (col % 64);
             }
-
-            ++cell;
         }
     }
 }
@@ -381,23 +1068,31 @@ iterateLifeKernel(
 //-------------------------------------------------------------------------
 
 void
-iterateLife(
-    LIFE_T *life)
+setStepLife(
+    LIFE_T *life,
+    int32_t step)
 {
-    pthread_barrier_wait(&(life->finishedIterationBarrier));
+    if (step < 0)
+    {
+        step = 0;
+    }
 
-    int result = 0;
-    VC_IMAGE_TYPE_T type = VC_IMAGE_RGBA16;
+    if (step > LIFE_HASH_MAX_STEP)
+    {
+        step = LIFE_HASH_MAX_STEP;
+    }
 
-    result = vc_dispmanx_resource_write_data(life->backResource,
-                                             type,
-                                             life->pitch,
-                                             life->buffer,
-                                             &(life->bmpRect));
-    assert(result == 0);
+    life->step = step;
+}
+
+//-------------------------------------------------------------------------
 
-    memcpy(life->field, life->fieldNext, life->fieldLength);
-    pthread_barrier_wait(&(life->startIterationBarrier));
+void
+setMemoryLimitLife(
+    LIFE_T *life,
+    size_t memoryLimit)
+{
+    life->memoryLimit = memoryLimit;
 }
 
 //-------------------------------------------------------------------------
@@ -426,24 +1121,33 @@ void
 destroyLife(
     LIFE_T *life)
 {
+    // The next generation is being worked out in the background.
+
+    finishIterationLife(life);
+
     if (life->buffer)
     {
         free(life->buffer);
         life->buffer = NULL;
+
+        chargeCpuMemoryAccount(life->account,
+                               -(int64_t)(life->pitch * life->alignedHeight),
+                               -1);
     }
 
     if (life->field)
     {
         free(life->field);
         life->field = NULL;
-    }
 
-    if (life->fieldNext)
-    {
-        free(life->fieldNext);
-        life->fieldNext = NULL;
+        chargeCpuMemoryAccount(life->account,
+                               -(int64_t)(life->fieldLength),
+                               -1);
     }
 
+    destroyLifeHash(life);
+    destroyLifePacked(life);
+
     life->width = 0;
     life->alignedWidth = 0;
     life->height = 0;
@@ -464,17 +1168,16 @@ destroyLife(
 
     //---------------------------------------------------------------------
 
-    result = vc_dispmanx_resource_delete(life->frontResource);
-    assert(result == 0);
-    result = vc_dispmanx_resource_delete(life->backResource);
-    assert(result == 0);
+    releaseResourcePool(life->frontResource);
+    releaseResourcePool(life->backResource);
 
     //---------------------------------------------------------------------
 
     int32_t thread;
     for (thread = 0 ; thread < life->numberOfThreads ; thread++)
     {
-        pthread_cancel(life->threads[thread]);
+        free(life->heightRange[thread].changes);
+        life->heightRange[thread].changes = NULL;
     }
 }
 
@@ -28,27 +28,54 @@
 #ifndef LIFE_H
 #define LIFE_H
 
-#include <pthread.h>
 #include <stdint.h>
 
+#include "memoryAccount.h"
+#include "threadPool.h"
+
 #include "bcm_host.h"
 
 //-------------------------------------------------------------------------
 
 #define LIFE_MAX_THREADS 4
 
+// The packed engine divides the board into tiles one word (64 cells) wide
+// and LIFE_TILE_HEIGHT rows high.
+
+#define LIFE_TILE_HEIGHT 16
+
+//-------------------------------------------------------------------------
+
+typedef enum
+{
+    LIFE_ENGINE_BYTE,
+    LIFE_ENGINE_PACKED,
+    LIFE_ENGINE_HASH
+} LIFE_ENGINE_T;
+
 //-------------------------------------------------------------------------
 
 typedef struct
 {
     int32_t startHeight;
     int32_t endHeight;
+    int32_t changedStart;
+    int32_t changedEnd;
+
+    // Cells that change in the current generation, as (offset << 1) | alive.
+
+    uint32_t *changes;
+    int32_t numberOfChanges;
+    int32_t maxChanges;
+    int32_t numberOfFirstRowChanges;
+    int32_t numberOfLastRowChanges;
 } LIFE_HEIGHT_RANGE_T;
 
 //-------------------------------------------------------------------------
 
 typedef struct
 {
+    LIFE_ENGINE_T engine;
     int32_t width;
     int32_t alignedWidth;
     int32_t height;
@@ -57,7 +84,39 @@ typedef struct
     uint8_t *buffer;
     int32_t fieldLength;
     uint8_t *field;
-    uint8_t *fieldNext;
+
+    // LIFE_ENGINE_PACKED keeps 64 cells per word, bit n of word w in a row
+    // holding column (64 * w) + n. Unused bits of the last word are zero.
+
+    int32_t wordsPerRow;
+    uint64_t *packed;
+    uint64_t *packedNext;
+
+    // A board restored from a snapshot can have one of these buffers in a
+    // private mapping of the snapshot file rather than from calloc().
+
+    void *mapping;
+    size_t mappingLength;
+
+    // A tile is only worked out if it, or one of its neighbours, changed
+    // in the previous generation.
+
+    int32_t tileRows;
+    uint8_t *tileChanged;
+    uint8_t *tileActive;
+
+    // Rows [changedStart, changedEnd) of the previous generation differed
+    // from the one before it.
+
+    int32_t changedStart;
+    int32_t changedEnd;
+
+    // LIFE_ENGINE_HASH moves on 2^step generations at a time, and keeps
+    // the board in packed as well, drawn from the centre of its plane.
+
+    struct LIFE_HASH_T_ *hash;
+    int32_t step;
+    size_t memoryLimit;
 
     VC_RECT_T bmpRect;
     VC_RECT_T srcRect;
@@ -66,16 +125,23 @@ typedef struct
     DISPMANX_RESOURCE_HANDLE_T backResource;
     DISPMANX_ELEMENT_HANDLE_T element;
 
+    // Each generation is worked out in the pool while the previous one is
+    // on its way to the screen, numberOfThreads ranges of rows at a time.
+
+    uint64_t seed;
+    uint64_t generation;
+    THREAD_POOL_T *pool;
     int32_t numberOfThreads;
-    pthread_t threads[LIFE_MAX_THREADS];
     LIFE_HEIGHT_RANGE_T heightRange[LIFE_MAX_THREADS];
-    pthread_barrier_t startIterationBarrier;
-    pthread_barrier_t finishedIterationBarrier;
+
+    MEMORY_ACCOUNT_T *account;
 } LIFE_T;
 
 //-------------------------------------------------------------------------
 
-void newLife(LIFE_T *life, int32_t size);
+void newLife(LIFE_T *life, int32_t size, LIFE_ENGINE_T engine);
+
+const char *lifeEngineName(LIFE_ENGINE_T engine);
 
 void
 addElementLife(
@@ -86,19 +152,52 @@ addElementLife(
     DISPMANX_DISPLAY_HANDLE_T display,
     DISPMANX_UPDATE_HANDLE_T update);
 
-void *
-workerLife(
-    void *arg);
+void
+iterateLife(
+    LIFE_T *life);
+
+// Replace the board: clearLife() empties it, setCellLife() brings cells to
+// life (wrapping at the edges) and restartLife() redraws the board and
+// carries on from it.
 
 void
-iterateLifeKernel(
+clearLife(
+    LIFE_T *life);
+
+void
+setCellLife(
     LIFE_T *life,
-    int32_t thread);
+    int32_t col,
+    int32_t row);
 
 void
-iterateLife(
+restartLife(
     LIFE_T *life);
 
+// Pack the current generation into words as the packed engine holds it,
+// (width + 63) / 64 words per row. Safe to call while the next generation
+// is being worked out.
+
+void
+packLife(
+    const LIFE_T *life,
+    uint64_t *words);
+
+// The hash engine moves on 2^step generations in each iterateLife(), from
+// the generation after the one being worked out, and collects the nodes
+// it no longer needs once it holds more than memoryLimit bytes. Neither
+// makes any difference to the other engines.
+
+void
+setStepLife(
+    LIFE_T *life,
+    int32_t step);
+
+void
+setMemoryLimitLife(
+    LIFE_T *life,
+    size_t memoryLimit);
+
 void
 changeSourceLife(
     LIFE_T *life,
@@ -0,0 +1,1044 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lifeHash.h"
+
+//-------------------------------------------------------------------------
+
+#define LIVE 210
+#define DEAD 3
+
+//-------------------------------------------------------------------------
+
+#define CELLS_PER_WORD 64
+
+#define LIFE_HASH_BLOCK_NODES 4096
+#define LIFE_HASH_BLOCK_BYTES (sizeof(LIFE_HASH_BLOCK_T) + \
+                               (LIFE_HASH_BLOCK_NODES * \
+                                sizeof(LIFE_HASH_NODE_T)))
+#define LIFE_HASH_BUCKETS 4096
+
+#define LIFE_HASH_FREE 0x01
+#define LIFE_HASH_MARKED 0x02
+
+//-------------------------------------------------------------------------
+
+static inline void
+fullAdder(
+    uint64_t x,
+    uint64_t y,
+    uint64_t z,
+    uint64_t *sum,
+    uint64_t *carry)
+{
+    uint64_t xy = x ^ y;
+    *sum = xy ^ z;
+    *carry = (x & y) | (z & xy);
+}
+
+//-------------------------------------------------------------------------
+
+static size_t
+hashLifeHash(
+    uint8_t level,
+    const LIFE_HASH_NODE_T *nw,
+    const LIFE_HASH_NODE_T *ne,
+    const LIFE_HASH_NODE_T *sw,
+    const LIFE_HASH_NODE_T *se,
+    uint16_t bits)
+{
+    uint64_t h = level;
+
+    h = (h * 0x9E3779B97F4A7C15ULL) + (uintptr_t)nw;
+    h = (h * 0x9E3779B97F4A7C15ULL) + (uintptr_t)ne;
+    h = (h * 0x9E3779B97F4A7C15ULL) + (uintptr_t)sw;
+    h = (h * 0x9E3779B97F4A7C15ULL) + (uintptr_t)se;
+    h = (h * 0x9E3779B97F4A7C15ULL) + bits;
+
+    return h ^ (h >> 29);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+insertLifeHash(
+    LIFE_HASH_T *hash,
+    LIFE_HASH_NODE_T *node)
+{
+    size_t bucket = hashLifeHash(node->level,
+                                 node->nw,
+                                 node->ne,
+                                 node->sw,
+                                 node->se,
+                                 node->bits)
+                  & (hash->numberOfBuckets - 1);
+
+    node->next = hash->buckets[bucket];
+    hash->buckets[bucket] = node;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+growLifeHash(
+    LIFE_HASH_T *hash)
+{
+    LIFE_HASH_NODE_T **buckets = hash->buckets;
+    size_t numberOfBuckets = hash->numberOfBuckets;
+
+    hash->numberOfBuckets = numberOfBuckets * 2;
+    hash->buckets = calloc(hash->numberOfBuckets,
+                           sizeof(LIFE_HASH_NODE_T *));
+
+    if (hash->buckets == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    chargeCpuMemoryAccount(hash->account,
+                           numberOfBuckets * sizeof(LIFE_HASH_NODE_T *),
+                           0);
+
+    size_t bucket;
+    for (bucket = 0 ; bucket < numberOfBuckets ; bucket++)
+    {
+        LIFE_HASH_NODE_T *node = buckets[bucket];
+
+        while (node)
+        {
+            LIFE_HASH_NODE_T *next = node->next;
+            insertLifeHash(hash, node);
+            node = next;
+        }
+    }
+
+    free(buckets);
+}
+
+//-------------------------------------------------------------------------
+
+static LIFE_HASH_NODE_T *
+allocateNodeLifeHash(
+    LIFE_HASH_T *hash)
+{
+    if (hash->free == NULL)
+    {
+        LIFE_HASH_BLOCK_T *block = malloc(sizeof(LIFE_HASH_BLOCK_T));
+
+        if (block != NULL)
+        {
+            block->nodes = calloc(LIFE_HASH_BLOCK_NODES,
+                                  sizeof(LIFE_HASH_NODE_T));
+        }
+
+        if ((block == NULL) || (block->nodes == NULL))
+        {
+            fprintf(stderr, "life: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+
+        block->next = hash->blocks;
+        hash->blocks = block;
+
+        chargeCpuMemoryAccount(hash->account, LIFE_HASH_BLOCK_BYTES, 2);
+
+        int32_t i;
+        for (i = 0 ; i < LIFE_HASH_BLOCK_NODES ; i++)
+        {
+            block->nodes[i].flags = LIFE_HASH_FREE;
+            block->nodes[i].next = hash->free;
+            hash->free = &(block->nodes[i]);
+        }
+    }
+
+    LIFE_HASH_NODE_T *node = hash->free;
+    hash->free = node->next;
+    ++(hash->nodesInUse);
+
+    return node;
+}
+
+//-------------------------------------------------------------------------
+
+// Return the one node there is of these quadrants, or of these cells for
+// a leaf.
+
+static LIFE_HASH_NODE_T *
+findLifeHash(
+    LIFE_HASH_T *hash,
+    uint8_t level,
+    LIFE_HASH_NODE_T *nw,
+    LIFE_HASH_NODE_T *ne,
+    LIFE_HASH_NODE_T *sw,
+    LIFE_HASH_NODE_T *se,
+    uint16_t bits)
+{
+    size_t bucket = hashLifeHash(level, nw, ne, sw, se, bits)
+                  & (hash->numberOfBuckets - 1);
+
+    LIFE_HASH_NODE_T *node = hash->buckets[bucket];
+
+    while (node)
+    {
+        if ((node->level == level) &&
+            (node->nw == nw) &&
+            (node->ne == ne) &&
+            (node->sw == sw) &&
+            (node->se == se) &&
+            (node->bits == bits))
+        {
+            return node;
+        }
+
+        node = node->next;
+    }
+
+    //---------------------------------------------------------------------
+
+    node = allocateNodeLifeHash(hash);
+
+    node->nw = nw;
+    node->ne = ne;
+    node->sw = sw;
+    node->se = se;
+    node->result = NULL;
+    node->bits = bits;
+    node->level = level;
+    node->flags = 0;
+
+    node->next = hash->buckets[bucket];
+    hash->buckets[bucket] = node;
+
+    if (hash->nodesInUse > hash->numberOfBuckets)
+    {
+        growLifeHash(hash);
+    }
+
+    return node;
+}
+
+//-------------------------------------------------------------------------
+
+static LIFE_HASH_NODE_T *
+leafLifeHash(
+    LIFE_HASH_T *hash,
+    uint16_t bits)
+{
+    return findLifeHash(hash,
+                        LIFE_HASH_LEAF_LEVEL,
+                        NULL,
+                        NULL,
+                        NULL,
+                        NULL,
+                        bits);
+}
+
+//-------------------------------------------------------------------------
+
+static LIFE_HASH_NODE_T *
+joinLifeHash(
+    LIFE_HASH_T *hash,
+    LIFE_HASH_NODE_T *nw,
+    LIFE_HASH_NODE_T *ne,
+    LIFE_HASH_NODE_T *sw,
+    LIFE_HASH_NODE_T *se)
+{
+    return findLifeHash(hash, nw->level + 1, nw, ne, sw, se, 0);
+}
+
+//-------------------------------------------------------------------------
+
+static LIFE_HASH_NODE_T *
+emptyLifeHash(
+    LIFE_HASH_T *hash,
+    int32_t level)
+{
+    if (hash->empty[level] == NULL)
+    {
+        if (level == LIFE_HASH_LEAF_LEVEL)
+        {
+            hash->empty[level] = leafLifeHash(hash, 0);
+        }
+        else
+        {
+            LIFE_HASH_NODE_T *quadrant = emptyLifeHash(hash, level - 1);
+
+            hash->empty[level] = joinLifeHash(hash,
+                                              quadrant,
+                                              quadrant,
+                                              quadrant,
+                                              quadrant);
+        }
+    }
+
+    return hash->empty[level];
+}
+
+//-------------------------------------------------------------------------
+
+// The 8 x 8 cells of a level 3 node, as bit (8 * y) + x.
+
+static uint64_t
+gridLifeHash(
+    const LIFE_HASH_NODE_T *node)
+{
+    uint64_t grid = 0;
+
+    int32_t y;
+    for (y = 0 ; y < 4 ; y++)
+    {
+        int32_t shift = 4 * y;
+
+        grid |= (uint64_t)((node->nw->bits >> shift) & 0xF) << (8 * y);
+        grid |= (uint64_t)((node->ne->bits >> shift) & 0xF) << ((8 * y) + 4);
+        grid |= (uint64_t)((node->sw->bits >> shift) & 0xF) << (8 * (y + 4));
+        grid |= (uint64_t)((node->se->bits >> shift) & 0xF)
+              << ((8 * (y + 4)) + 4);
+    }
+
+    return grid;
+}
+
+//-------------------------------------------------------------------------
+
+static uint16_t
+leafOfGridLifeHash(
+    uint64_t grid,
+    int32_t x,
+    int32_t y)
+{
+    uint16_t bits = 0;
+
+    int32_t row;
+    for (row = 0 ; row < 4 ; row++)
+    {
+        bits |= ((grid >> ((8 * (y + row)) + x)) & 0xF) << (4 * row);
+    }
+
+    return bits;
+}
+
+//-------------------------------------------------------------------------
+
+// One generation of an 8 x 8 grid, with the cells around it dead, worked
+// out the same way as the packed engine does a word. Only the cells away
+// from the edge are right.
+
+static uint64_t
+generationLifeHash(
+    uint64_t grid)
+{
+    uint64_t west = (grid << 1) & 0xFEFEFEFEFEFEFEFEULL;
+    uint64_t east = (grid >> 1) & 0x7F7F7F7F7F7F7F7FULL;
+
+    uint64_t a0, a1;
+    fullAdder(west << 8, grid << 8, east << 8, &a0, &a1);
+
+    uint64_t b0, b1;
+    fullAdder(west >> 8, grid >> 8, east >> 8, &b0, &b1);
+
+    uint64_t c0 = west ^ east;
+    uint64_t c1 = west & east;
+
+    uint64_t s0, k0;
+    fullAdder(a0, b0, c0, &s0, &k0);
+
+    uint64_t h0, h1;
+    fullAdder(a1, b1, c1, &h0, &h1);
+
+    uint64_t twos = (h0 ^ k0) & ~h1;
+
+    return twos & (s0 | grid);
+}
+
+//-------------------------------------------------------------------------
+
+// The centre half of a node, as it is now.
+
+static LIFE_HASH_NODE_T *
+centreLifeHash(
+    LIFE_HASH_T *hash,
+    LIFE_HASH_NODE_T *node)
+{
+    if (node->level == LIFE_HASH_LEAF_LEVEL + 1)
+    {
+        uint64_t grid = gridLifeHash(node);
+
+        return leafLifeHash(hash, leafOfGridLifeHash(grid, 2, 2));
+    }
+
+    return joinLifeHash(hash,
+                        node->nw->se,
+                        node->ne->sw,
+                        node->sw->ne,
+                        node->se->nw);
+}
+
+//-------------------------------------------------------------------------
+
+// The centre half of a node, 2^min(step, level - 2) generations on. The
+// node is split into nine overlapping squares of half its size. At full
+// speed each of those is moved on by half the time, and the four squares
+// that are made from them by the other half. Steps shorter than that
+// leave the nine as they are and only move the four on.
+
+static LIFE_HASH_NODE_T *
+resultLifeHash(
+    LIFE_HASH_T *hash,
+    LIFE_HASH_NODE_T *node)
+{
+    if (node->result)
+    {
+        return node->result;
+    }
+
+    if (node->level == LIFE_HASH_LEAF_LEVEL + 1)
+    {
+        uint64_t grid = generationLifeHash(gridLifeHash(node));
+
+        if (hash->step > 0)
+        {
+            grid = generationLifeHash(grid);
+        }
+
+        node->result = leafLifeHash(hash, leafOfGridLifeHash(grid, 2, 2));
+
+        return node->result;
+    }
+
+    //---------------------------------------------------------------------
+
+    LIFE_HASH_NODE_T *nw = node->nw;
+    LIFE_HASH_NODE_T *ne = node->ne;
+    LIFE_HASH_NODE_T *sw = node->sw;
+    LIFE_HASH_NODE_T *se = node->se;
+
+    LIFE_HASH_NODE_T *n[9] =
+    {
+        nw,
+        joinLifeHash(hash, nw->ne, ne->nw, nw->se, ne->sw),
+        ne,
+        joinLifeHash(hash, nw->sw, nw->se, sw->nw, sw->ne),
+        joinLifeHash(hash, nw->se, ne->sw, sw->ne, se->nw),
+        joinLifeHash(hash, ne->sw, ne->se, se->nw, se->ne),
+        sw,
+        joinLifeHash(hash, sw->ne, se->nw, sw->se, se->sw),
+        se
+    };
+
+    bool fullSpeed = (hash->step >= node->level - 2);
+
+    int32_t i;
+    for (i = 0 ; i < 9 ; i++)
+    {
+        n[i] = (fullSpeed) ? resultLifeHash(hash, n[i])
+                           : centreLifeHash(hash, n[i]);
+    }
+
+    LIFE_HASH_NODE_T *q[4] =
+    {
+        joinLifeHash(hash, n[0], n[1], n[3], n[4]),
+        joinLifeHash(hash, n[1], n[2], n[4], n[5]),
+        joinLifeHash(hash, n[3], n[4], n[6], n[7]),
+        joinLifeHash(hash, n[4], n[5], n[7], n[8])
+    };
+
+    for (i = 0 ; i < 4 ; i++)
+    {
+        q[i] = resultLifeHash(hash, q[i]);
+    }
+
+    node->result = joinLifeHash(hash, q[0], q[1], q[2], q[3]);
+
+    return node->result;
+}
+
+//-------------------------------------------------------------------------
+
+// Make a node twice the size with the old one in the middle.
+
+static LIFE_HASH_NODE_T *
+expandLifeHash(
+    LIFE_HASH_T *hash,
+    LIFE_HASH_NODE_T *node)
+{
+    LIFE_HASH_NODE_T *e = emptyLifeHash(hash, node->level - 1);
+
+    return joinLifeHash(hash,
+                        joinLifeHash(hash, e, e, e, node->nw),
+                        joinLifeHash(hash, e, e, node->ne, e),
+                        joinLifeHash(hash, e, node->sw, e, e),
+                        joinLifeHash(hash, node->se, e, e, e));
+}
+
+//-------------------------------------------------------------------------
+
+// True if all the cells of a node are in its centre half.
+
+static bool
+centredLifeHash(
+    LIFE_HASH_T *hash,
+    const LIFE_HASH_NODE_T *node)
+{
+    const LIFE_HASH_NODE_T *e = emptyLifeHash(hash, node->level - 2);
+
+    return (node->nw->nw == e) && (node->nw->ne == e) && (node->nw->sw == e)
+        && (node->ne->nw == e) && (node->ne->ne == e) && (node->ne->se == e)
+        && (node->sw->nw == e) && (node->sw->sw == e) && (node->sw->se == e)
+        && (node->se->ne == e) && (node->se->sw == e) && (node->se->se == e);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+markLifeHash(
+    LIFE_HASH_NODE_T *node,
+    bool results)
+{
+    if ((node == NULL) || (node->flags & LIFE_HASH_MARKED))
+    {
+        return;
+    }
+
+    node->flags |= LIFE_HASH_MARKED;
+
+    if (node->level > LIFE_HASH_LEAF_LEVEL)
+    {
+        markLifeHash(node->nw, results);
+        markLifeHash(node->ne, results);
+        markLifeHash(node->sw, results);
+        markLifeHash(node->se, results);
+    }
+
+    if (results)
+    {
+        markLifeHash(node->result, results);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Free every node that the root (and the results it has worked out, if
+// results is true) does not lead to, and put the rest back in the table.
+
+static void
+collectLifeHash(
+    LIFE_HASH_T *hash,
+    bool results)
+{
+    markLifeHash(hash->root, results);
+
+    int32_t level;
+    for (level = 0 ; level <= LIFE_HASH_MAX_LEVEL ; level++)
+    {
+        markLifeHash(hash->empty[level], results);
+    }
+
+    // The table is sized again for the nodes that are left, as a
+    // board that was seeded at random can leave it far larger.
+
+    size_t marked = 0;
+
+    LIFE_HASH_BLOCK_T *block;
+    for (block = hash->blocks ; block != NULL ; block = block->next)
+    {
+        int32_t i;
+        for (i = 0 ; i < LIFE_HASH_BLOCK_NODES ; i++)
+        {
+            if (block->nodes[i].flags & LIFE_HASH_MARKED)
+            {
+                ++marked;
+            }
+        }
+    }
+
+    chargeCpuMemoryAccount(hash->account,
+                           -(int64_t)(hash->numberOfBuckets
+                                      * sizeof(LIFE_HASH_NODE_T *)),
+                           -1);
+
+    hash->numberOfBuckets = LIFE_HASH_BUCKETS;
+
+    while (hash->numberOfBuckets < marked)
+    {
+        hash->numberOfBuckets *= 2;
+    }
+
+    free(hash->buckets);
+    hash->buckets = calloc(hash->numberOfBuckets,
+                           sizeof(LIFE_HASH_NODE_T *));
+
+    if (hash->buckets == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    chargeCpuMemoryAccount(hash->account,
+                           hash->numberOfBuckets * sizeof(LIFE_HASH_NODE_T *),
+                           1);
+
+    hash->free = NULL;
+    hash->nodesInUse = 0;
+
+    for (block = hash->blocks ; block != NULL ; block = block->next)
+    {
+        int32_t i;
+        for (i = 0 ; i < LIFE_HASH_BLOCK_NODES ; i++)
+        {
+            LIFE_HASH_NODE_T *node = &(block->nodes[i]);
+
+            if (node->flags & LIFE_HASH_MARKED)
+            {
+                node->flags &= ~LIFE_HASH_MARKED;
+
+                if (results == false)
+                {
+                    node->result = NULL;
+                }
+
+                insertLifeHash(hash, node);
+                ++(hash->nodesInUse);
+            }
+            else
+            {
+                node->flags = LIFE_HASH_FREE;
+                node->next = hash->free;
+                hash->free = node;
+            }
+        }
+    }
+
+    ++(hash->collections);
+}
+
+//-------------------------------------------------------------------------
+
+static size_t
+memoryLifeHash(
+    const LIFE_HASH_T *hash)
+{
+    return (hash->nodesInUse * sizeof(LIFE_HASH_NODE_T))
+         + (hash->numberOfBuckets * sizeof(LIFE_HASH_NODE_T *));
+}
+
+//-------------------------------------------------------------------------
+
+// Set the cells of a node that fall on the board in words, for the node
+// with its top left cell at (x, y) on the board.
+
+static void
+drawLifeHash(
+    LIFE_T *life,
+    const LIFE_HASH_NODE_T *node,
+    int64_t x,
+    int64_t y,
+    uint64_t *words)
+{
+    int64_t size = (int64_t)1 << node->level;
+
+    if ((node == life->hash->empty[node->level]) ||
+        (x >= life->width) ||
+        (y >= life->height) ||
+        ((x + size) <= 0) ||
+        ((y + size) <= 0))
+    {
+        return;
+    }
+
+    if (node->level == LIFE_HASH_LEAF_LEVEL)
+    {
+        uint16_t bits = node->bits;
+
+        while (bits)
+        {
+            int bit = __builtin_ctz(bits);
+            int64_t col = x + (bit % 4);
+            int64_t row = y + (bit / 4);
+
+            if ((col >= 0) &&
+                (col < life->width) &&
+                (row >= 0) &&
+                (row < life->height))
+            {
+                words[(row * life->wordsPerRow) + (col / CELLS_PER_WORD)]
+                    |= (uint64_t)1 << (col % CELLS_PER_WORD);
+            }
+
+            bits &= bits - 1;
+        }
+
+        return;
+    }
+
+    int64_t half = size / 2;
+
+    drawLifeHash(life, node->nw, x, y, words);
+    drawLifeHash(life, node->ne, x + half, y, words);
+    drawLifeHash(life, node->sw, x, y + half, words);
+    drawLifeHash(life, node->se, x + half, y + half, words);
+}
+
+//-------------------------------------------------------------------------
+
+// Build a node of the given level from the cells of life->packed, for the
+// node with its top left cell at (x, y) on the board.
+
+static LIFE_HASH_NODE_T *
+buildLifeHash(
+    LIFE_T *life,
+    int32_t level,
+    int64_t x,
+    int64_t y)
+{
+    LIFE_HASH_T *hash = life->hash;
+    int64_t size = (int64_t)1 << level;
+
+    if ((x >= life->width) ||
+        (y >= life->height) ||
+        ((x + size) <= 0) ||
+        ((y + size) <= 0))
+    {
+        return emptyLifeHash(hash, level);
+    }
+
+    if (level == LIFE_HASH_LEAF_LEVEL)
+    {
+        uint16_t bits = 0;
+
+        int32_t i;
+        for (i = 0 ; i < 16 ; i++)
+        {
+            int64_t col = x + (i % 4);
+            int64_t row = y + (i / 4);
+
+            if ((col >= 0) &&
+                (col < life->width) &&
+                (row >= 0) &&
+                (row < life->height))
+            {
+                uint64_t word = life->packed[(row * life->wordsPerRow)
+                                             + (col / CELLS_PER_WORD)];
+
+                bits |= ((word >> (col % CELLS_PER_WORD)) & 1) << i;
+            }
+        }
+
+        return leafLifeHash(hash, bits);
+    }
+
+    int64_t half = size / 2;
+
+    LIFE_HASH_NODE_T *nw = buildLifeHash(life, level - 1, x, y);
+    LIFE_HASH_NODE_T *ne = buildLifeHash(life, level - 1, x + half, y);
+    LIFE_HASH_NODE_T *sw = buildLifeHash(life, level - 1, x, y + half);
+    LIFE_HASH_NODE_T *se = buildLifeHash(life, level - 1, x + half, y + half);
+
+    return joinLifeHash(hash, nw, ne, sw, se);
+}
+
+//-------------------------------------------------------------------------
+
+void
+newLifeHash(
+    LIFE_T *life)
+{
+    life->wordsPerRow = (life->width + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+
+    size_t words = (size_t)(life->wordsPerRow) * life->height;
+
+    life->packed = calloc(words, sizeof(uint64_t));
+
+    if (life->packed == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    life->packedNext = calloc(words, sizeof(uint64_t));
+
+    if (life->packedNext == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    //---------------------------------------------------------------------
+
+    LIFE_HASH_T *hash = calloc(1, sizeof(LIFE_HASH_T));
+
+    if (hash == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    hash->account = life->account;
+    hash->numberOfBuckets = LIFE_HASH_BUCKETS;
+    hash->buckets = calloc(hash->numberOfBuckets,
+                           sizeof(LIFE_HASH_NODE_T *));
+
+    if (hash->buckets == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    chargeCpuMemoryAccount(hash->account,
+                           hash->numberOfBuckets * sizeof(LIFE_HASH_NODE_T *),
+                           1);
+
+    hash->blocks = NULL;
+    hash->free = NULL;
+    hash->nodesInUse = 0;
+    hash->memoryLimit = life->memoryLimit;
+    hash->collections = 0;
+    hash->root = NULL;
+    hash->step = life->step;
+
+    life->hash = hash;
+}
+
+//-------------------------------------------------------------------------
+
+void
+restartLifeHash(
+    LIFE_T *life)
+{
+    // The board goes from (-width / 2, -height / 2), so the root has to
+    // reach at least width - (width / 2) cells either side of the origin.
+
+    int32_t extent = life->width - (life->width / 2);
+
+    if ((life->height - (life->height / 2)) > extent)
+    {
+        extent = life->height - (life->height / 2);
+    }
+
+    int32_t level = LIFE_HASH_LEAF_LEVEL + 2;
+
+    while (((int64_t)1 << (level - 1)) < extent)
+    {
+        ++level;
+    }
+
+    int64_t half = (int64_t)1 << (level - 1);
+
+    life->hash->root = buildLifeHash(life,
+                                     level,
+                                     (life->width / 2) - half,
+                                     (life->height / 2) - half);
+}
+
+//-------------------------------------------------------------------------
+
+// Move the root on by 2^step generations and draw the board from it into
+// packedNext, and into the display buffer where it differs from the
+// current generation.
+
+void
+iterateLifeHashKernel(
+    LIFE_T *life,
+    int32_t thread)
+{
+    LIFE_HASH_T *hash = life->hash;
+    LIFE_HEIGHT_RANGE_T *range = &(life->heightRange[thread]);
+
+    range->changedStart = range->endHeight;
+    range->changedEnd = range->startHeight;
+
+    // Nodes that the root no longer leads to are only freed between steps,
+    // so a step can go over the limit. Results are kept if that frees
+    // enough, as they are what makes the engine fast.
+
+    if (memoryLifeHash(hash) > hash->memoryLimit)
+    {
+        collectLifeHash(hash, true);
+
+        if (memoryLifeHash(hash) > (hash->memoryLimit / 2))
+        {
+            collectLifeHash(hash, false);
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    // The pattern is kept in the middle quarter of the root. Nothing moves
+    // into empty cells faster than half a cell a generation, so the result
+    // holds everything the pattern can reach in 2^step generations.
+
+    LIFE_HASH_NODE_T *root = hash->root;
+
+    while ((root->level < (LIFE_HASH_LEAF_LEVEL + 2)) ||
+           (root->level < (hash->step + 3)) ||
+           (centredLifeHash(hash, root) == false))
+    {
+        root = expandLifeHash(hash, root);
+    }
+
+    root = expandLifeHash(hash, root);
+    hash->root = resultLifeHash(hash, root);
+
+    //---------------------------------------------------------------------
+
+    size_t words = (size_t)(life->wordsPerRow) * life->height;
+    memset(life->packedNext, 0, words * sizeof(uint64_t));
+
+    int64_t half = (int64_t)1 << (hash->root->level - 1);
+
+    drawLifeHash(life,
+                 hash->root,
+                 (life->width / 2) - half,
+                 (life->height / 2) - half,
+                 life->packedNext);
+
+    int32_t row;
+    for (row = range->startHeight ; row < range->endHeight ; row++)
+    {
+        const uint64_t *current = life->packed + (row * life->wordsPerRow);
+        const uint64_t *next = life->packedNext + (row * life->wordsPerRow);
+        uint8_t *cells = life->buffer + (row * life->alignedWidth);
+        bool rowChanged = false;
+
+        int32_t w;
+        for (w = 0 ; w < life->wordsPerRow ; w++)
+        {
+            uint64_t changed = current[w] ^ next[w];
+
+            if (changed)
+            {
+                rowChanged = true;
+            }
+
+            while (changed)
+            {
+                int bit = __builtin_ctzll(changed);
+                cells[(w * CELLS_PER_WORD) + bit] =
+                    ((next[w] >> bit) & 1) ? LIVE : DEAD;
+                changed &= changed - 1;
+            }
+        }
+
+        if (rowChanged)
+        {
+            if (row < range->changedStart)
+            {
+                range->changedStart = row;
+            }
+
+            range->changedEnd = row + 1;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+uint64_t
+swapLifeHash(
+    LIFE_T *life)
+{
+    LIFE_HASH_T *hash = life->hash;
+
+    uint64_t *tmp = life->packed;
+    life->packed = life->packedNext;
+    life->packedNext = tmp;
+
+    uint64_t generations = (uint64_t)1 << hash->step;
+
+    //---------------------------------------------------------------------
+
+    // A result only depends on the step for nodes of a level above it
+    // plus two, so only those have to be worked out again.
+
+    if (life->step != hash->step)
+    {
+        int32_t level = ((life->step < hash->step) ? life->step : hash->step)
+                      + 2;
+
+        LIFE_HASH_BLOCK_T *block;
+        for (block = hash->blocks ; block != NULL ; block = block->next)
+        {
+            int32_t i;
+            for (i = 0 ; i < LIFE_HASH_BLOCK_NODES ; i++)
+            {
+                if (block->nodes[i].level > level)
+                {
+                    block->nodes[i].result = NULL;
+                }
+            }
+        }
+
+        hash->step = life->step;
+    }
+
+    hash->memoryLimit = life->memoryLimit;
+
+    return generations;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyLifeHash(
+    LIFE_T *life)
+{
+    LIFE_HASH_T *hash = life->hash;
+
+    if (hash == NULL)
+    {
+        return;
+    }
+
+    while (hash->blocks)
+    {
+        LIFE_HASH_BLOCK_T *block = hash->blocks;
+        hash->blocks = block->next;
+
+        free(block->nodes);
+        free(block);
+
+        chargeCpuMemoryAccount(hash->account,
+                               -(int64_t)LIFE_HASH_BLOCK_BYTES,
+                               -2);
+    }
+
+    chargeCpuMemoryAccount(hash->account,
+                           -(int64_t)(hash->numberOfBuckets
+                                      * sizeof(LIFE_HASH_NODE_T *)),
+                           -1);
+
+    free(hash->buckets);
+    free(hash);
+
+    life->hash = NULL;
+}
@@ -0,0 +1,151 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LIFE_HASH_H
+#define LIFE_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "life.h"
+
+//-------------------------------------------------------------------------
+
+// The hash engine keeps an unbounded plane as a quadtree in which equal
+// squares are the same node, and remembers what each node becomes, so a
+// pattern that repeats itself in space or time is only ever worked out
+// once. A node of level n is 2^n cells square; leaves are of level 2 and
+// hold their 4 x 4 cells as bits, (4 * y) + x.
+
+#define LIFE_HASH_LEAF_LEVEL 2
+#define LIFE_HASH_MAX_LEVEL 62
+
+// Each step advances 2^step generations, up to 2^LIFE_HASH_MAX_STEP.
+
+#define LIFE_HASH_MAX_STEP 48
+
+#define LIFE_HASH_MEMORY (128 * 1024 * 1024)
+
+//-------------------------------------------------------------------------
+
+typedef struct LIFE_HASH_NODE_T_ LIFE_HASH_NODE_T;
+
+struct LIFE_HASH_NODE_T_
+{
+    LIFE_HASH_NODE_T *nw;
+    LIFE_HASH_NODE_T *ne;
+    LIFE_HASH_NODE_T *sw;
+    LIFE_HASH_NODE_T *se;
+
+    // The next node in the same bucket of the hash table, or in the list
+    // of free nodes.
+
+    LIFE_HASH_NODE_T *next;
+
+    // The centre half of the node, 2^min(step, level - 2) generations on,
+    // once it has been worked out.
+
+    LIFE_HASH_NODE_T *result;
+
+    uint16_t bits;
+    uint8_t level;
+    uint8_t flags;
+};
+
+//-------------------------------------------------------------------------
+
+typedef struct LIFE_HASH_BLOCK_T_ LIFE_HASH_BLOCK_T;
+
+struct LIFE_HASH_BLOCK_T_
+{
+    LIFE_HASH_BLOCK_T *next;
+    LIFE_HASH_NODE_T *nodes;
+};
+
+//-------------------------------------------------------------------------
+
+typedef struct LIFE_HASH_T_ LIFE_HASH_T;
+
+struct LIFE_HASH_T_
+{
+    LIFE_HASH_NODE_T **buckets;
+    size_t numberOfBuckets;
+
+    // Nodes come from blocks that are only freed with the engine. Nodes
+    // that the garbage collector finds are of no more use go on the free
+    // list.
+
+    LIFE_HASH_BLOCK_T *blocks;
+    LIFE_HASH_NODE_T *free;
+    size_t nodesInUse;
+    size_t memoryLimit;
+    uint32_t collections;
+
+    // What the blocks and the buckets are charged to.
+
+    MEMORY_ACCOUNT_T *account;
+
+    LIFE_HASH_NODE_T *empty[LIFE_HASH_MAX_LEVEL + 1];
+
+    // The root is centred on the origin, and the board shows the cells
+    // from (-width / 2, -height / 2).
+
+    LIFE_HASH_NODE_T *root;
+    int32_t step;
+};
+
+//-------------------------------------------------------------------------
+
+void
+newLifeHash(
+    LIFE_T *life);
+
+// Build the tree from the cells in life->packed.
+
+void
+restartLifeHash(
+    LIFE_T *life);
+
+void
+iterateLifeHashKernel(
+    LIFE_T *life,
+    int32_t thread);
+
+// Make the generation just worked out the current one and return how many
+// generations it moved on by.
+
+uint64_t
+swapLifeHash(
+    LIFE_T *life);
+
+void
+destroyLifeHash(
+    LIFE_T *life);
+
+//-------------------------------------------------------------------------
+
+#endif
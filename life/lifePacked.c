@@ -0,0 +1,453 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "lifePacked.h"
+
+//-------------------------------------------------------------------------
+
+#define LIVE 210
+#define DEAD 3
+
+//-------------------------------------------------------------------------
+
+#define CELLS_PER_WORD 64
+
+//-------------------------------------------------------------------------
+
+static inline void
+fullAdder(
+    uint64_t x,
+    uint64_t y,
+    uint64_t z,
+    uint64_t *sum,
+    uint64_t *carry)
+{
+    uint64_t xy = x ^ y;
+
+    *sum = xy ^ z;
+    *carry = (x & y) | (z & xy);
+}
+
+//-------------------------------------------------------------------------
+
+// Neighbours to the west and east of every cell in word w of a row. The
+// board wraps, so the last column feeds bit 0 of the first word and the
+// first column feeds the top used bit of the last word.
+
+static inline uint64_t
+westOf(
+    const uint64_t *row,
+    int32_t w,
+    int32_t lastWord,
+    int32_t lastBits)
+{
+    uint64_t carry = (w == 0)
+                   ? (row[lastWord] >> (lastBits - 1)) & 1
+                   : row[w - 1] >> (CELLS_PER_WORD - 1);
+
+    return (row[w] << 1) | carry;
+}
+
+static inline uint64_t
+eastOf(
+    const uint64_t *row,
+    int32_t w,
+    int32_t lastWord,
+    int32_t lastBits)
+{
+    if (w == lastWord)
+    {
+        return (row[w] >> 1) | ((row[0] & 1) << (lastBits - 1));
+    }
+
+    return (row[w] >> 1) | ((row[w + 1] & 1) << (CELLS_PER_WORD - 1));
+}
+
+//-------------------------------------------------------------------------
+
+void
+newLifePacked(
+    LIFE_T *life)
+{
+    life->wordsPerRow = (life->width + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+
+    size_t words = (size_t)(life->wordsPerRow) * life->height;
+
+    life->packed = calloc(words, sizeof(uint64_t));
+
+    if (life->packed == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    life->packedNext = calloc(words, sizeof(uint64_t));
+
+    if (life->packedNext == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    //---------------------------------------------------------------------
+
+    life->tileRows = (life->height + LIFE_TILE_HEIGHT - 1) / LIFE_TILE_HEIGHT;
+
+    size_t tiles = (size_t)(life->wordsPerRow) * life->tileRows;
+
+    life->tileChanged = calloc(tiles, 1);
+
+    if (life->tileChanged == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    life->tileActive = malloc(tiles);
+
+    if (life->tileActive == NULL)
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(life->tileActive, 1, tiles);
+}
+
+//-------------------------------------------------------------------------
+
+void
+setCellPacked(
+    LIFE_T *life,
+    int32_t col,
+    int32_t row)
+{
+    life->buffer[col + (row * life->alignedWidth)] = LIVE;
+
+    uint64_t *word = life->packed
+                   + (row * life->wordsPerRow)
+                   + (col / CELLS_PER_WORD);
+
+    *word |= (uint64_t)1 << (col % CELLS_PER_WORD);
+}
+
+//-------------------------------------------------------------------------
+
+// Each neighbour count is held bit-sliced across several words, so one
+// pass of the adders below works out the next state of 64 cells. The rows
+// above and below contribute three neighbours each and the current row
+// two, giving three two bit partial sums. A cell lives if the total is 3,
+// or if it is 2 and the cell is already alive; in both cases the total
+// shifted right by one is exactly 1.
+
+void
+iterateLifePackedKernel(
+    LIFE_T *life,
+    int32_t thread)
+{
+    int32_t width = life->width;
+    int32_t height = life->height;
+    int32_t wordsPerRow = life->wordsPerRow;
+    int32_t lastWord = wordsPerRow - 1;
+    int32_t lastBits = width - (lastWord * CELLS_PER_WORD);
+
+    uint64_t lastMask = (lastBits == CELLS_PER_WORD)
+                      ? ~(uint64_t)0
+                      : ((uint64_t)1 << lastBits) - 1;
+
+    LIFE_HEIGHT_RANGE_T *range = &(life->heightRange[thread]);
+
+    range->changedStart = range->endHeight;
+    range->changedEnd = range->startHeight;
+
+    if (range->startHeight == range->endHeight)
+    {
+        return;
+    }
+
+    // Thread ranges start on a tile boundary, so each thread owns whole
+    // rows of tiles.
+
+    int32_t firstTile = (range->startHeight / LIFE_TILE_HEIGHT) * wordsPerRow;
+    int32_t lastTile = ((range->endHeight + LIFE_TILE_HEIGHT - 1)
+                     / LIFE_TILE_HEIGHT) * wordsPerRow;
+
+    if (lastTile > firstTile)
+    {
+        memset(life->tileChanged + firstTile, 0, lastTile - firstTile);
+    }
+
+    int32_t row;
+    for (row = range->startHeight ; row < range->endHeight ; row++)
+    {
+        int32_t tile = (row / LIFE_TILE_HEIGHT) * wordsPerRow;
+        const uint8_t *active = life->tileActive + tile;
+        uint8_t *tileChanged = life->tileChanged + tile;
+        bool rowChanged = false;
+
+        int32_t rowAbove = (row == 0) ? height - 1 : row - 1;
+        int32_t rowBelow = (row == height - 1) ? 0 : row + 1;
+
+        const uint64_t *above = life->packed + (rowAbove * wordsPerRow);
+        const uint64_t *current = life->packed + (row * wordsPerRow);
+        const uint64_t *below = life->packed + (rowBelow * wordsPerRow);
+        uint64_t *next = life->packedNext + (row * wordsPerRow);
+        uint8_t *cells = life->buffer + (row * life->alignedWidth);
+
+        int32_t w;
+        for (w = 0 ; w < wordsPerRow ; w++)
+        {
+            // Inactive tiles and their previous generation are identical,
+            // so packedNext already holds the right cells.
+
+            if (active[w] == 0)
+            {
+                continue;
+            }
+
+            uint64_t a0, a1;
+            fullAdder(westOf(above, w, lastWord, lastBits),
+                      above[w],
+                      eastOf(above, w, lastWord, lastBits),
+                      &a0,
+                      &a1);
+
+            uint64_t b0, b1;
+            fullAdder(westOf(below, w, lastWord, lastBits),
+                      below[w],
+                      eastOf(below, w, lastWord, lastBits),
+                      &b0,
+                      &b1);
+
+            uint64_t west = westOf(current, w, lastWord, lastBits);
+            uint64_t east = eastOf(current, w, lastWord, lastBits);
+            uint64_t c0 = west ^ east;
+            uint64_t c1 = west & east;
+
+            uint64_t s0, k0;
+            fullAdder(a0, b0, c0, &s0, &k0);
+
+            uint64_t h0, h1;
+            fullAdder(a1, b1, c1, &h0, &h1);
+
+            uint64_t twos = (h0 ^ k0) & ~(h0 & k0) & ~h1;
+            uint64_t alive = current[w];
+            uint64_t state = twos & (s0 | alive);
+
+            if (w == lastWord)
+            {
+                state &= lastMask;
+            }
+
+            next[w] = state;
+
+            //-------------------------------------------------------------
+
+            // Only the cells that changed are expanded into the display
+            // buffer.
+
+            uint64_t changed = state ^ alive;
+
+            if (changed)
+            {
+                tileChanged[w] = 1;
+                rowChanged = true;
+            }
+
+            while (changed)
+            {
+                int bit = __builtin_ctzll(changed);
+
+                cells[(w * CELLS_PER_WORD) + bit] =
+                    ((state >> bit) & 1) ? LIVE : DEAD;
+
+                changed &= changed - 1;
+            }
+        }
+
+        if (rowChanged)
+        {
+            if (row < range->changedStart)
+            {
+                range->changedStart = row;
+            }
+
+            range->changedEnd = row + 1;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+swapLifePacked(
+    LIFE_T *life)
+{
+    uint64_t *tmp = life->packed;
+    life->packed = life->packedNext;
+    life->packedNext = tmp;
+
+    //---------------------------------------------------------------------
+
+    // A tile is active in the next generation if any tile in the 3 x 3
+    // block around it (wrapping at the edges) changed in this one.
+
+    int32_t columns = life->wordsPerRow;
+    int32_t rows = life->tileRows;
+
+    int32_t tileRow;
+    for (tileRow = 0 ; tileRow < rows ; tileRow++)
+    {
+        int32_t rowAbove = (tileRow == 0) ? rows - 1 : tileRow - 1;
+        int32_t rowBelow = (tileRow == rows - 1) ? 0 : tileRow + 1;
+
+        const uint8_t *above = life->tileChanged + (rowAbove * columns);
+        const uint8_t *current = life->tileChanged + (tileRow * columns);
+        const uint8_t *below = life->tileChanged + (rowBelow * columns);
+        uint8_t *active = life->tileActive + (tileRow * columns);
+
+        int32_t column;
+        for (column = 0 ; column < columns ; column++)
+        {
+            int32_t left = (column == 0) ? columns - 1 : column - 1;
+            int32_t right = (column == columns - 1) ? 0 : column + 1;
+
+            active[column] = above[left] | above[column] | above[right]
+                           | current[left] | current[column] | current[right]
+                           | below[left] | below[column] | below[right];
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+isMappedLifePacked(
+    const LIFE_T *life,
+    const uint64_t *words)
+{
+    const uint8_t *start = life->mapping;
+
+    return (life->mapping != NULL) &&
+           ((const uint8_t *)words >= start) &&
+           ((const uint8_t *)words < start + life->mappingLength);
+}
+
+//-------------------------------------------------------------------------
+
+void
+mapLifePacked(
+    LIFE_T *life,
+    void *mapping,
+    size_t mappingLength,
+    uint64_t *words)
+{
+    if (isMappedLifePacked(life, life->packed) == false)
+    {
+        free(life->packed);
+    }
+
+    if (life->mapping)
+    {
+        // Every tile is worked out again after a restore, so the contents
+        // of packedNext do not matter, only that it is not unmapped.
+
+        if (isMappedLifePacked(life, life->packedNext))
+        {
+            size_t words = (size_t)(life->wordsPerRow) * life->height;
+
+            life->packedNext = calloc(words, sizeof(uint64_t));
+
+            if (life->packedNext == NULL)
+            {
+                fprintf(stderr, "life: memory exhausted\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        munmap(life->mapping, life->mappingLength);
+    }
+
+    life->mapping = mapping;
+    life->mappingLength = mappingLength;
+    life->packed = words;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyLifePacked(
+    LIFE_T *life)
+{
+    if (life->packed)
+    {
+        if (isMappedLifePacked(life, life->packed) == false)
+        {
+            free(life->packed);
+        }
+
+        life->packed = NULL;
+    }
+
+    if (life->packedNext)
+    {
+        if (isMappedLifePacked(life, life->packedNext) == false)
+        {
+            free(life->packedNext);
+        }
+
+        life->packedNext = NULL;
+    }
+
+    if (life->mapping)
+    {
+        munmap(life->mapping, life->mappingLength);
+        life->mapping = NULL;
+        life->mappingLength = 0;
+    }
+
+    if (life->tileChanged)
+    {
+        free(life->tileChanged);
+        life->tileChanged = NULL;
+    }
+
+    if (life->tileActive)
+    {
+        free(life->tileActive);
+        life->tileActive = NULL;
+    }
+
+    life->wordsPerRow = 0;
+    life->tileRows = 0;
+}
@@ -0,0 +1,72 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LIFE_PACKED_H
+#define LIFE_PACKED_H
+
+#include <stdint.h>
+
+#include "life.h"
+
+//-------------------------------------------------------------------------
+
+void
+newLifePacked(
+    LIFE_T *life);
+
+void
+setCellPacked(
+    LIFE_T *life,
+    int32_t col,
+    int32_t row);
+
+void
+iterateLifePackedKernel(
+    LIFE_T *life,
+    int32_t thread);
+
+void
+swapLifePacked(
+    LIFE_T *life);
+
+// Use words, which lie in mapping, as the current generation. The mapping
+// is unmapped by destroyLifePacked().
+
+void
+mapLifePacked(
+    LIFE_T *life,
+    void *mapping,
+    size_t mappingLength,
+    uint64_t *words);
+
+void
+destroyLifePacked(
+    LIFE_T *life);
+
+//-------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,374 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lifePattern.h"
+
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    int32_t *cells;
+    int32_t numberOfCells;
+    int32_t maxCells;
+    int32_t minX;
+    int32_t maxX;
+    int32_t minY;
+    int32_t maxY;
+} LIFE_PATTERN_T;
+
+//-------------------------------------------------------------------------
+
+static void
+addCellPattern(
+    LIFE_PATTERN_T *pattern,
+    int32_t x,
+    int32_t y)
+{
+    if (pattern->numberOfCells == pattern->maxCells)
+    {
+        pattern->maxCells = (pattern->maxCells) ? 2 * pattern->maxCells : 256;
+        pattern->cells = realloc(pattern->cells,
+                                 2 * pattern->maxCells * sizeof(int32_t));
+
+        if (pattern->cells == NULL)
+        {
+            fprintf(stderr, "life: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((pattern->numberOfCells == 0) || (x < pattern->minX))
+    {
+        pattern->minX = x;
+    }
+
+    if ((pattern->numberOfCells == 0) || (x > pattern->maxX))
+    {
+        pattern->maxX = x;
+    }
+
+    if ((pattern->numberOfCells == 0) || (y < pattern->minY))
+    {
+        pattern->minY = y;
+    }
+
+    if ((pattern->numberOfCells == 0) || (y > pattern->maxY))
+    {
+        pattern->maxY = y;
+    }
+
+    pattern->cells[2 * pattern->numberOfCells] = x;
+    pattern->cells[(2 * pattern->numberOfCells) + 1] = y;
+    ++(pattern->numberOfCells);
+}
+
+//-------------------------------------------------------------------------
+
+// The rule is given as B3/S23 or, in the older form, 23/3.
+
+static bool
+supportedRulePattern(
+    const char *rule)
+{
+    char compact[32];
+    size_t length = 0;
+
+    for ( ; (*rule != '\0') && (*rule != '\n') && (*rule != ',') ; rule++)
+    {
+        if (isspace((unsigned char)*rule))
+        {
+            continue;
+        }
+
+        if (length == sizeof(compact) - 1)
+        {
+            return false;
+        }
+
+        compact[length++] = toupper((unsigned char)*rule);
+    }
+
+    compact[length] = '\0';
+
+    return (strcmp(compact, "B3/S23") == 0) || (strcmp(compact, "23/3") == 0);
+}
+
+//-------------------------------------------------------------------------
+
+// A header line x = <width>, y = <height>[, rule = <rule>] follows any
+// comments, and then runs of b (dead), o (alive) and $ (end of row), each
+// optionally preceded by a count, up to a !.
+
+static bool
+readRlePattern(
+    FILE *file,
+    const char *path,
+    char **buffer,
+    size_t *size,
+    int32_t lineNumber,
+    LIFE_PATTERN_T *pattern)
+{
+    bool header = false;
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t run = 0;
+
+    do
+    {
+        const char *line = *buffer;
+
+        ++lineNumber;
+
+        if ((line[0] == '#') || (line[strspn(line, " \t\r\n")] == '\0'))
+        {
+            continue;
+        }
+
+        if (header == false)
+        {
+            int32_t width = 0;
+            int32_t height = 0;
+
+            if (sscanf(line, " x = %d , y = %d", &width, &height) != 2)
+            {
+                fprintf(stderr,
+                        "life: %s: line %d: expected x = <width>, "
+                        "y = <height>\n",
+                        path,
+                        lineNumber);
+                return false;
+            }
+
+            const char *rule = strstr(line, "rule");
+
+            if (rule && (strchr(rule, '=') != NULL) &&
+                (supportedRulePattern(strchr(rule, '=') + 1) == false))
+            {
+                fprintf(stderr,
+                        "life: %s: line %d: only rule B3/S23 is supported\n",
+                        path,
+                        lineNumber);
+                return false;
+            }
+
+            header = true;
+            continue;
+        }
+
+        //-----------------------------------------------------------------
+
+        const char *c;
+        for (c = line ; *c != '\0' ; c++)
+        {
+            if (isdigit((unsigned char)*c))
+            {
+                run = (run * 10) + (*c - '0');
+                continue;
+            }
+
+            if (isspace((unsigned char)*c))
+            {
+                continue;
+            }
+
+            int32_t count = (run) ? run : 1;
+            run = 0;
+
+            if ((*c == 'b') || (*c == '.'))
+            {
+                x += count;
+            }
+            else if (*c == '$')
+            {
+                x = 0;
+                y += count;
+            }
+            else if (*c == '!')
+            {
+                return true;
+            }
+            else if (isalpha((unsigned char)*c))
+            {
+                // Any other state is taken as alive.
+
+                int32_t i;
+                for (i = 0 ; i < count ; i++)
+                {
+                    addCellPattern(pattern, x++, y);
+                }
+            }
+            else
+            {
+                fprintf(stderr,
+                        "life: %s: line %d: unexpected '%c'\n",
+                        path,
+                        lineNumber,
+                        *c);
+                return false;
+            }
+        }
+    }
+    while (getline(buffer, size, file) != -1);
+
+    if (header == false)
+    {
+        fprintf(stderr, "life: %s: no x = <width>, y = <height> line\n", path);
+        return false;
+    }
+
+    // Some files leave off the final !.
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+readLife106Pattern(
+    FILE *file,
+    const char *path,
+    char **buffer,
+    size_t *size,
+    int32_t lineNumber,
+    LIFE_PATTERN_T *pattern)
+{
+    while (getline(buffer, size, file) != -1)
+    {
+        const char *line = *buffer;
+
+        ++lineNumber;
+
+        if ((line[0] == '#') || (line[strspn(line, " \t\r\n")] == '\0'))
+        {
+            continue;
+        }
+
+        int32_t x = 0;
+        int32_t y = 0;
+
+        if (sscanf(line, "%d %d", &x, &y) != 2)
+        {
+            fprintf(stderr,
+                    "life: %s: line %d: expected <x> <y>\n",
+                    path,
+                    lineNumber);
+            return false;
+        }
+
+        addCellPattern(pattern, x, y);
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+loadPatternLife(
+    LIFE_T *life,
+    const char *path)
+{
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "life: cannot open %s\n", path);
+        return false;
+    }
+
+    LIFE_PATTERN_T pattern = { NULL, 0, 0, 0, 0, 0, 0 };
+
+    // The first line tells the formats apart, and is then handed on to
+    // the reader along with the buffer.
+
+    char *line = NULL;
+    size_t size = 0;
+    bool read = false;
+
+    if (getline(&line, &size, file) == -1)
+    {
+        fprintf(stderr, "life: %s is empty\n", path);
+    }
+    else if (strncmp(line, "#Life 1.06", 10) == 0)
+    {
+        read = readLife106Pattern(file, path, &line, &size, 1, &pattern);
+    }
+    else
+    {
+        read = readRlePattern(file, path, &line, &size, 0, &pattern);
+    }
+
+    free(line);
+    fclose(file);
+
+    //---------------------------------------------------------------------
+
+    if (read &&
+        (pattern.numberOfCells > 0) &&
+        (((pattern.maxX - pattern.minX) >= life->width) ||
+         ((pattern.maxY - pattern.minY) >= life->height)))
+    {
+        fprintf(stderr,
+                "life: %s is %dx%d, larger than the board\n",
+                path,
+                pattern.maxX - pattern.minX + 1,
+                pattern.maxY - pattern.minY + 1);
+        read = false;
+    }
+
+    if (read)
+    {
+        int32_t offsetX = ((life->width - (pattern.maxX - pattern.minX + 1))
+                        / 2) - pattern.minX;
+        int32_t offsetY = ((life->height - (pattern.maxY - pattern.minY + 1))
+                        / 2) - pattern.minY;
+
+        clearLife(life);
+
+        int32_t i;
+        for (i = 0 ; i < pattern.numberOfCells ; i++)
+        {
+            setCellLife(life,
+                        pattern.cells[2 * i] + offsetX,
+                        pattern.cells[(2 * i) + 1] + offsetY);
+        }
+
+        restartLife(life);
+    }
+
+    free(pattern.cells);
+
+    return read;
+}
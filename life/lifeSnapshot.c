@@ -0,0 +1,668 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lifePacked.h"
+#include "lifeSnapshot.h"
+
+//-------------------------------------------------------------------------
+
+static size_t
+slotLengthSnapshot(
+    const LIFE_SNAPSHOT_HEADER_T *header)
+{
+    return (size_t)(header->wordsPerRow) * header->height * sizeof(uint64_t);
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+validHeaderSnapshot(
+    const LIFE_SNAPSHOT_HEADER_T *header,
+    size_t length,
+    const char *path)
+{
+    if ((length < sizeof(LIFE_SNAPSHOT_HEADER_T)) ||
+        (memcmp(header->magic, LIFE_SNAPSHOT_MAGIC, sizeof(header->magic))))
+    {
+        fprintf(stderr, "life: %s is not a snapshot\n", path);
+        return false;
+    }
+
+    if (header->order != LIFE_SNAPSHOT_ORDER)
+    {
+        fprintf(stderr, "life: %s was saved with another byte order\n", path);
+        return false;
+    }
+
+    if (header->version != LIFE_SNAPSHOT_VERSION)
+    {
+        fprintf(stderr,
+                "life: %s is a version %u snapshot\n",
+                path,
+                header->version);
+        return false;
+    }
+
+    if ((header->width == 0) ||
+        (header->height == 0) ||
+        (header->wordsPerRow != (header->width + 63) / 64) ||
+        ((header->slot > 1) && (header->slot != LIFE_SNAPSHOT_NO_SLOT)) ||
+        (length < sizeof(LIFE_SNAPSHOT_HEADER_T)
+                  + (2 * slotLengthSnapshot(header))))
+    {
+        fprintf(stderr, "life: %s is damaged\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+openLifeSnapshot(
+    LIFE_SNAPSHOT_T *snapshot,
+    const char *path)
+{
+    snapshot->mapping = NULL;
+    snapshot->mappingLength = 0;
+    snapshot->words = NULL;
+
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+    {
+        fprintf(stderr, "life: cannot open %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+
+    if ((fstat(fd, &st) == -1) ||
+        (st.st_size < (off_t)sizeof(LIFE_SNAPSHOT_HEADER_T)))
+    {
+        fprintf(stderr, "life: %s is not a snapshot\n", path);
+        close(fd);
+        return false;
+    }
+
+    // A private mapping, so the board can be worked on in place without
+    // anything going back to the file.
+
+    void *mapping = mmap(NULL,
+                         st.st_size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE,
+                         fd,
+                         0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        fprintf(stderr, "life: cannot map %s\n", path);
+        return false;
+    }
+
+    snapshot->mapping = mapping;
+    snapshot->mappingLength = st.st_size;
+
+    memcpy(&(snapshot->header), mapping, sizeof(LIFE_SNAPSHOT_HEADER_T));
+
+    LIFE_SNAPSHOT_HEADER_T *header = &(snapshot->header);
+
+    if (validHeaderSnapshot(header, st.st_size, path) == false)
+    {
+        closeLifeSnapshot(snapshot);
+        return false;
+    }
+
+    if (header->slot == LIFE_SNAPSHOT_NO_SLOT)
+    {
+        fprintf(stderr, "life: %s has no board saved in it yet\n", path);
+        closeLifeSnapshot(snapshot);
+        return false;
+    }
+
+    snapshot->words = (uint64_t *)((uint8_t *)mapping
+                    + sizeof(LIFE_SNAPSHOT_HEADER_T)
+                    + (header->slot * slotLengthSnapshot(header)));
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void
+restoreLifeSnapshot(
+    LIFE_T *life,
+    LIFE_SNAPSHOT_T *snapshot)
+{
+    const LIFE_SNAPSHOT_HEADER_T *header = &(snapshot->header);
+
+    int32_t wordsPerRow = header->wordsPerRow;
+    int32_t lastBits = header->width - ((wordsPerRow - 1) * 64);
+
+    uint64_t lastMask = (lastBits == 64)
+                      ? ~(uint64_t)0
+                      : ((uint64_t)1 << lastBits) - 1;
+
+    clearLife(life);
+
+    if (life->engine == LIFE_ENGINE_PACKED)
+    {
+        // The packed engine needs the unused bits of each row clear. They
+        // are only written to if they are not, so that the pages of the
+        // mapping are not copied for nothing.
+
+        int32_t row;
+        for (row = 0 ; row < life->height ; row++)
+        {
+            uint64_t *last = snapshot->words
+                           + (row * wordsPerRow)
+                           + (wordsPerRow - 1);
+
+            if (*last & ~lastMask)
+            {
+                *last &= lastMask;
+            }
+        }
+
+        // A saver writing to the same file only ever stores the cells the
+        // board holds. Any page of the mapping that has not been copied on
+        // write is of tiles that have not changed since, so it is never
+        // given anything it does not already hold.
+
+        mapLifePacked(life,
+                      snapshot->mapping,
+                      snapshot->mappingLength,
+                      snapshot->words);
+
+        snapshot->mapping = NULL;
+        snapshot->mappingLength = 0;
+        snapshot->words = NULL;
+    }
+    else
+    {
+        int32_t row;
+        for (row = 0 ; row < life->height ; row++)
+        {
+            const uint64_t *words = snapshot->words + (row * wordsPerRow);
+
+            int32_t w;
+            for (w = 0 ; w < wordsPerRow ; w++)
+            {
+                uint64_t bits = words[w];
+
+                if (w == wordsPerRow - 1)
+                {
+                    bits &= lastMask;
+                }
+
+                while (bits)
+                {
+                    setCellLife(life, (w * 64) + __builtin_ctzll(bits), row);
+                    bits &= bits - 1;
+                }
+            }
+        }
+    }
+
+    life->generation = header->generation[header->slot];
+
+    restartLife(life);
+}
+
+//-------------------------------------------------------------------------
+
+void
+closeLifeSnapshot(
+    LIFE_SNAPSHOT_T *snapshot)
+{
+    if (snapshot->mapping)
+    {
+        munmap(snapshot->mapping, snapshot->mappingLength);
+        snapshot->mapping = NULL;
+        snapshot->mappingLength = 0;
+    }
+
+    snapshot->words = NULL;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+writeAllLifeSaver(
+    int fd,
+    const void *data,
+    size_t length,
+    off_t offset)
+{
+    const uint8_t *bytes = data;
+
+    while (length > 0)
+    {
+        ssize_t written = pwrite(fd, bytes, length, offset);
+
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        bytes += written;
+        length -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+readAllLifeSaver(
+    int fd,
+    void *data,
+    size_t length,
+    off_t offset)
+{
+    uint8_t *bytes = data;
+
+    while (length > 0)
+    {
+        ssize_t bytesRead = pread(fd, bytes, length, offset);
+
+        if (bytesRead == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        if (bytesRead == 0)
+        {
+            return false;
+        }
+
+        bytes += bytesRead;
+        length -= bytesRead;
+        offset += bytesRead;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// Write the staged board to the slot that is not current, a run of changed
+// rows at a time, and then point the header at it.
+
+static void
+writeLifeSaver(
+    LIFE_SAVER_T *saver)
+{
+    LIFE_SNAPSHOT_HEADER_T *header = &(saver->header);
+
+    uint32_t slot = (header->slot == 0) ? 1 : 0;
+    uint64_t *saved = saver->slots[slot];
+    off_t base = sizeof(LIFE_SNAPSHOT_HEADER_T)
+               + (slot * slotLengthSnapshot(header));
+
+    int32_t wordsPerRow = header->wordsPerRow;
+    int32_t height = header->height;
+    bool ok = true;
+
+    int32_t row = 0;
+    while (ok && (row < height))
+    {
+        size_t offset = row * wordsPerRow;
+
+        if (memcmp(saver->staging + offset,
+                   saved + offset,
+                   saver->rowLength) == 0)
+        {
+            ++row;
+            continue;
+        }
+
+        int32_t end = row + 1;
+
+        while ((end < height) &&
+               memcmp(saver->staging + (end * wordsPerRow),
+                      saved + (end * wordsPerRow),
+                      saver->rowLength))
+        {
+            ++end;
+        }
+
+        size_t length = (end - row) * saver->rowLength;
+
+        ok = writeAllLifeSaver(saver->fd,
+                               saver->staging + offset,
+                               length,
+                               base + (offset * sizeof(uint64_t)));
+
+        if (ok)
+        {
+            memcpy(saved + offset, saver->staging + offset, length);
+        }
+
+        row = end;
+    }
+
+    //---------------------------------------------------------------------
+
+    ok = ok && (fdatasync(saver->fd) == 0);
+
+    if (ok)
+    {
+        LIFE_SNAPSHOT_HEADER_T next = *header;
+
+        next.slot = slot;
+        next.generation[slot] = saver->generation;
+
+        ok = writeAllLifeSaver(saver->fd, &next, sizeof(next), 0) &&
+             (fdatasync(saver->fd) == 0);
+
+        if (ok)
+        {
+            *header = next;
+        }
+    }
+
+    if (ok == false)
+    {
+        fprintf(stderr, "life: cannot save to %s\n", saver->path);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void *
+saverThread(
+    void *arg)
+{
+    LIFE_SAVER_T *saver = arg;
+
+    pthread_mutex_lock(&(saver->mutex));
+
+    while (true)
+    {
+        while ((saver->pending == false) && (saver->quit == false))
+        {
+            pthread_cond_wait(&(saver->cond), &(saver->mutex));
+        }
+
+        // Anything still to save is saved before quitting.
+
+        if (saver->pending == false)
+        {
+            break;
+        }
+
+        pthread_mutex_unlock(&(saver->mutex));
+
+        writeLifeSaver(saver);
+
+        pthread_mutex_lock(&(saver->mutex));
+
+        saver->pending = false;
+        pthread_cond_broadcast(&(saver->cond));
+    }
+
+    pthread_mutex_unlock(&(saver->mutex));
+
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+initLifeSaver(
+    LIFE_SAVER_T *saver,
+    const LIFE_T *life,
+    const char *path)
+{
+    saver->fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (saver->fd == -1)
+    {
+        fprintf(stderr, "life: cannot open %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(saver->fd, &st) == -1)
+    {
+        fprintf(stderr, "life: cannot open %s\n", path);
+        close(saver->fd);
+        return false;
+    }
+
+    //---------------------------------------------------------------------
+
+    LIFE_SNAPSHOT_HEADER_T *header = &(saver->header);
+
+    if (st.st_size == 0)
+    {
+        memset(header, 0, sizeof(LIFE_SNAPSHOT_HEADER_T));
+        memcpy(header->magic, LIFE_SNAPSHOT_MAGIC, sizeof(header->magic));
+        header->order = LIFE_SNAPSHOT_ORDER;
+        header->version = LIFE_SNAPSHOT_VERSION;
+        header->width = life->width;
+        header->height = life->height;
+        header->wordsPerRow = (life->width + 63) / 64;
+        header->slot = LIFE_SNAPSHOT_NO_SLOT;
+    }
+    else if ((readAllLifeSaver(saver->fd,
+                               header,
+                               sizeof(LIFE_SNAPSHOT_HEADER_T),
+                               0) == false) ||
+             (validHeaderSnapshot(header, st.st_size, path) == false))
+    {
+        close(saver->fd);
+        return false;
+    }
+    else if ((header->width != (uint32_t)(life->width)) ||
+             (header->height != (uint32_t)(life->height)))
+    {
+        fprintf(stderr,
+                "life: %s is a snapshot of a %ux%u board\n",
+                path,
+                header->width,
+                header->height);
+        close(saver->fd);
+        return false;
+    }
+
+    //---------------------------------------------------------------------
+
+    size_t slotLength = slotLengthSnapshot(header);
+
+    saver->path = strdup(path);
+    saver->rowLength = header->wordsPerRow * sizeof(uint64_t);
+    saver->slots[0] = calloc(1, slotLength);
+    saver->slots[1] = calloc(1, slotLength);
+    saver->staging = calloc(1, slotLength);
+
+    if ((saver->path == NULL) ||
+        (saver->slots[0] == NULL) ||
+        (saver->slots[1] == NULL) ||
+        (saver->staging == NULL))
+    {
+        fprintf(stderr, "life: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Both slots of a new file are empty boards, which is what the copies
+    // start as.
+
+    bool ok = true;
+
+    if (st.st_size == 0)
+    {
+        ok = (ftruncate(saver->fd,
+                        sizeof(LIFE_SNAPSHOT_HEADER_T) + (2 * slotLength))
+              == 0) &&
+             writeAllLifeSaver(saver->fd,
+                               header,
+                               sizeof(LIFE_SNAPSHOT_HEADER_T),
+                               0);
+    }
+    else
+    {
+        off_t offset = sizeof(LIFE_SNAPSHOT_HEADER_T);
+
+        ok = readAllLifeSaver(saver->fd, saver->slots[0], slotLength, offset)
+          && readAllLifeSaver(saver->fd,
+                              saver->slots[1],
+                              slotLength,
+                              offset + slotLength);
+    }
+
+    if (ok == false)
+    {
+        fprintf(stderr, "life: cannot set up %s\n", path);
+        close(saver->fd);
+        free(saver->path);
+        free(saver->slots[0]);
+        free(saver->slots[1]);
+        free(saver->staging);
+        return false;
+    }
+
+    //---------------------------------------------------------------------
+
+    saver->generation = 0;
+    saver->pending = false;
+    saver->quit = false;
+
+    pthread_mutex_init(&(saver->mutex), NULL);
+    pthread_cond_init(&(saver->cond), NULL);
+
+    if (pthread_create(&(saver->thread), NULL, saverThread, saver) != 0)
+    {
+        fprintf(stderr, "life: cannot start saver thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+saveLifeSaver(
+    LIFE_SAVER_T *saver,
+    const LIFE_T *life)
+{
+    pthread_mutex_lock(&(saver->mutex));
+    bool pending = saver->pending;
+    pthread_mutex_unlock(&(saver->mutex));
+
+    if (pending)
+    {
+        return false;
+    }
+
+    // The thread leaves the staging copy alone while nothing is pending.
+
+    packLife(life, saver->staging);
+    saver->generation = life->generation;
+
+    pthread_mutex_lock(&(saver->mutex));
+    saver->pending = true;
+    pthread_cond_broadcast(&(saver->cond));
+    pthread_mutex_unlock(&(saver->mutex));
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void
+waitLifeSaver(
+    LIFE_SAVER_T *saver)
+{
+    pthread_mutex_lock(&(saver->mutex));
+
+    while (saver->pending)
+    {
+        pthread_cond_wait(&(saver->cond), &(saver->mutex));
+    }
+
+    pthread_mutex_unlock(&(saver->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyLifeSaver(
+    LIFE_SAVER_T *saver)
+{
+    pthread_mutex_lock(&(saver->mutex));
+    saver->quit = true;
+    pthread_cond_broadcast(&(saver->cond));
+    pthread_mutex_unlock(&(saver->mutex));
+
+    pthread_join(saver->thread, NULL);
+
+    pthread_cond_destroy(&(saver->cond));
+    pthread_mutex_destroy(&(saver->mutex));
+
+    close(saver->fd);
+    saver->fd = -1;
+
+    free(saver->path);
+    free(saver->slots[0]);
+    free(saver->slots[1]);
+    free(saver->staging);
+
+    saver->path = NULL;
+    saver->slots[0] = NULL;
+    saver->slots[1] = NULL;
+    saver->staging = NULL;
+}
@@ -0,0 +1,146 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LIFE_SNAPSHOT_H
+#define LIFE_SNAPSHOT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "life.h"
+
+//-------------------------------------------------------------------------
+
+// A snapshot file is this header followed by two slots, each a whole board
+// packed as the packed engine holds it: (width + 63) / 64 words per row,
+// bit n of word w holding column (64 * w) + n, in the byte order of the
+// machine that wrote it. Saves go to the slot that is not current, and the
+// header is only rewritten to point at it once it is on disk, so there is
+// always a complete board to go back to.
+
+#define LIFE_SNAPSHOT_MAGIC "RDMXLIFE"
+#define LIFE_SNAPSHOT_ORDER 0x01020304
+#define LIFE_SNAPSHOT_VERSION 1
+#define LIFE_SNAPSHOT_NO_SLOT 0xFFFFFFFF
+
+typedef struct
+{
+    char magic[8];
+    uint32_t order;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t wordsPerRow;
+    uint32_t slot;
+    uint64_t generation[2];
+    uint8_t reserved[16];
+} LIFE_SNAPSHOT_HEADER_T;
+
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    LIFE_SNAPSHOT_HEADER_T header;
+    void *mapping;
+    size_t mappingLength;
+    uint64_t *words;
+} LIFE_SNAPSHOT_T;
+
+//-------------------------------------------------------------------------
+
+// Saves are made on a thread of their own from a copy of the board, and
+// only the rows that differ from what the slot already holds are written.
+
+typedef struct
+{
+    char *path;
+    int fd;
+    LIFE_SNAPSHOT_HEADER_T header;
+    size_t rowLength;
+    uint64_t *slots[2];
+    uint64_t *staging;
+    uint64_t generation;
+    bool pending;
+    bool quit;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} LIFE_SAVER_T;
+
+//-------------------------------------------------------------------------
+
+// Map the current board of the snapshot at path. Errors are reported on
+// stderr.
+
+bool
+openLifeSnapshot(
+    LIFE_SNAPSHOT_T *snapshot,
+    const char *path);
+
+// Make the board of the snapshot the board of life, which must be the
+// same size. The packed engine takes the mapping over rather than copy it.
+
+void
+restoreLifeSnapshot(
+    LIFE_T *life,
+    LIFE_SNAPSHOT_T *snapshot);
+
+void
+closeLifeSnapshot(
+    LIFE_SNAPSHOT_T *snapshot);
+
+//-------------------------------------------------------------------------
+
+// Save to path, which is created if need be. An existing snapshot has to
+// be of a board the size of life.
+
+bool
+initLifeSaver(
+    LIFE_SAVER_T *saver,
+    const LIFE_T *life,
+    const char *path);
+
+// Start saving the current generation, unless the last save has still to
+// finish, in which case false is returned and nothing is saved.
+
+bool
+saveLifeSaver(
+    LIFE_SAVER_T *saver,
+    const LIFE_T *life);
+
+void
+waitLifeSaver(
+    LIFE_SAVER_T *saver);
+
+void
+destroyLifeSaver(
+    LIFE_SAVER_T *saver);
+
+//-------------------------------------------------------------------------
+
+#endif
@@ -32,6 +32,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termio.h>
 #include <unistd.h>
 #include <sys/time.h>
@@ -40,10 +41,15 @@
 
 #include "backgroundLayer.h"
 #include "font.h"
+#include "frameLoop.h"
 #include "imageLayer.h"
 #include "info.h"
 #include "key.h"
 #include "life.h"
+#include "lifeHash.h"
+#include "lifePattern.h"
+#include "lifeSnapshot.h"
+#include "threadPool.h"
 
 //-------------------------------------------------------------------------
 
@@ -51,15 +57,25 @@
 
 //-------------------------------------------------------------------------
 
+#define LIFE_SAVE_INTERVAL 10000
+
+//-------------------------------------------------------------------------
+
 int main(int argc, char *argv[])
 {
     int opt = 0;
     int32_t size = 0;
     uint32_t displayNumber = 0;
+    LIFE_ENGINE_T engine = LIFE_ENGINE_BYTE;
+    const char *patternPath = NULL;
+    const char *snapshotPath = NULL;
+    uint64_t saveInterval = LIFE_SAVE_INTERVAL;
+    int32_t hashStep = 0;
+    size_t memoryLimit = LIFE_HASH_MEMORY;
 
     //-------------------------------------------------------------------
 
-    while ((opt = getopt(argc, argv, "d:s:")) != -1)
+    while ((opt = getopt(argc, argv, "d:e:f:i:k:m:p:s:")) != -1)
     {
         switch (opt)
         {
@@ -68,6 +84,53 @@ int main(int argc, char *argv[])
             displayNumber = atoi(optarg);
             break;
 
+        case 'e':
+
+            if (strcmp(optarg, "packed") == 0)
+            {
+                engine = LIFE_ENGINE_PACKED;
+            }
+            else if (strcmp(optarg, "byte") == 0)
+            {
+                engine = LIFE_ENGINE_BYTE;
+            }
+            else if (strcmp(optarg, "hash") == 0)
+            {
+                engine = LIFE_ENGINE_HASH;
+            }
+            else
+            {
+                fprintf(stderr, "%s: unknown engine %s\n",
+                        basename(argv[0]), optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'f':
+
+            snapshotPath = optarg;
+            break;
+
+        case 'i':
+
+            saveInterval = strtoull(optarg, NULL, 10);
+            break;
+
+        case 'k':
+
+            hashStep = atoi(optarg);
+            break;
+
+        case 'm':
+
+            memoryLimit = (size_t)strtoul(optarg, NULL, 10) << 20;
+            break;
+
+        case 'p':
+
+            patternPath = optarg;
+            break;
+
         case 's':
 
             size = atoi(optarg);
@@ -76,10 +139,25 @@ int main(int argc, char *argv[])
         default:
 
             fprintf(stderr,
-                    "Usage: %s [-d <number>] [-s <size>]\n",
+                    "Usage: %s [-d <number>] [-e <engine>] [-f <file>] "
+                    "[-i <generations>] [-k <step>] [-m <megabytes>] "
+                    "[-p <file>] [-s <size>]\n",
                     basename(argv[0]));
 
             fprintf(stderr, "    -d - Raspberry Pi display number\n");
+            fprintf(stderr, "    -e - engine, byte (default), packed");
+            fprintf(stderr, " or hash\n");
+            fprintf(stderr, "    -f - snapshot file to carry on from, if it");
+            fprintf(stderr, " exists, and save to\n");
+            fprintf(stderr, "    -i - generations between saves (%d)\n",
+                    LIFE_SAVE_INTERVAL);
+            fprintf(stderr, "    -k - hash engine moves on 2^step");
+            fprintf(stderr, " generations at a time (0)\n");
+            fprintf(stderr, "    -m - megabytes the hash engine collects");
+            fprintf(stderr, " garbage above (%d)\n",
+                    LIFE_HASH_MEMORY >> 20);
+            fprintf(stderr, "    -p - pattern file (.rle or Life 1.06)");
+            fprintf(stderr, " to start from\n");
             fprintf(stderr, "    -s - size of image to create\n");
             exit(EXIT_FAILURE);
             break;
@@ -105,31 +183,60 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
-    if (size < 1)
-    {
-        size = info.height;
-    }
+    // A snapshot that is there to carry on from sets the size of the
+    // board, which can then be larger than the display.
+
+    LIFE_SNAPSHOT_T snapshot;
+    bool resume = false;
 
-    if (size > info.height)
+    if ((snapshotPath != NULL) && (access(snapshotPath, F_OK) == 0))
     {
-        size = info.height;
-    }
+        if (openLifeSnapshot(&snapshot, snapshotPath) == false)
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        if (snapshot.header.width != snapshot.header.height)
+        {
+            fprintf(stderr,
+                    "%s: %s is not of a square board\n",
+                    basename(argv[0]),
+                    snapshotPath);
+            exit(EXIT_FAILURE);
+        }
 
-    if (size > info.width)
+        size = snapshot.header.width;
+        resume = true;
+    }
+    else
     {
-        size = info.width;
+        if (size < 1)
+        {
+            size = info.height;
+        }
+
+        if (size > info.height)
+        {
+            size = info.height;
+        }
+
+        if (size > info.width)
+        {
+            size = info.width;
+        }
     }
 
     //---------------------------------------------------------------------
 
     int32_t infoLayerWidth = 96;
-    int32_t infoLayerHeight = 134;
+    int32_t infoLayerHeight = (engine == LIFE_ENGINE_HASH) ? 198 : 154;
 
     IMAGE_LAYER_T infoLayer;
     initImageLayer(&infoLayer,
                    infoLayerWidth,
                    infoLayerHeight,
                    VC_IMAGE_RGBA16);
+    enableDirtyImageLayer(&infoLayer);
     createResourceImageLayer(&infoLayer, 2);
 
     //---------------------------------------------------------------------
@@ -138,7 +245,29 @@ int main(int argc, char *argv[])
     initBackgroundLayer(&bg, 0x000F, 0);
 
     LIFE_T life;
-    newLife(&life, size);
+    newLife(&life, size, engine);
+    setStepLife(&life, hashStep);
+    setMemoryLimitLife(&life, memoryLimit);
+
+    if (resume)
+    {
+        restoreLifeSnapshot(&life, &snapshot);
+        closeLifeSnapshot(&snapshot);
+    }
+    else if ((patternPath != NULL) &&
+             (loadPatternLife(&life, patternPath) == false))
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    LIFE_SAVER_T saver;
+    uint64_t nextSave = life.generation + saveInterval;
+
+    if ((snapshotPath != NULL) &&
+        (initLifeSaver(&saver, &life, snapshotPath) == false))
+    {
+        exit(EXIT_FAILURE);
+    }
 
     //---------------------------------------------------------------------
 
@@ -153,6 +282,10 @@ int main(int argc, char *argv[])
     {
         dstSize = info.height - (info.height % size);
     }
+    else if (dstSize > info.height)
+    {
+        dstSize = info.height;
+    }
 
     //---------------------------------------------------------------------
 
@@ -177,7 +310,18 @@ int main(int argc, char *argv[])
                                display,
                                update);
 
-    lifeInfo(&infoLayer, size, false, life.numberOfThreads, false, 0.0);
+    // Only the hash engine has a step to show.
+
+    int32_t infoStep = (engine == LIFE_ENGINE_HASH) ? life.step : -1;
+
+    lifeInfo(&infoLayer,
+             size,
+             lifeEngineName(engine),
+             false,
+             life.numberOfThreads,
+             infoStep,
+             false,
+             0.0);
 
     //---------------------------------------------------------------------
 
@@ -186,6 +330,9 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
+    FRAME_LOOP_T frameLoop;
+    initFrameLoop(&frameLoop, display);
+
     bool paused = false;
     bool step = false;
 
@@ -221,8 +368,10 @@ int main(int argc, char *argv[])
 
                 lifeInfo(&infoLayer,
                          size,
+                         lifeEngineName(engine),
                          paused,
                          life.numberOfThreads,
+                         infoStep,
                          false,
                          0.0);
 
@@ -234,6 +383,29 @@ int main(int argc, char *argv[])
                 {
                     step = true;
                 }
+
+                break;
+
+            case '+':
+            case '=':
+            case '-':
+
+                if (engine == LIFE_ENGINE_HASH)
+                {
+                    setStepLife(&life, life.step + ((c == '-') ? -1 : 1));
+                    infoStep = life.step;
+
+                    lifeInfo(&infoLayer,
+                             size,
+                             lifeEngineName(engine),
+                             paused,
+                             life.numberOfThreads,
+                             infoStep,
+                             false,
+                             0.0);
+                }
+
+                break;
             }
         }
 
@@ -253,8 +425,10 @@ int main(int argc, char *argv[])
 
             lifeInfo(&infoLayer,
                      size,
+                     lifeEngineName(engine),
                      paused,
                      life.numberOfThreads,
+                     infoStep,
                      true,
                      frames_per_second);
 
@@ -265,33 +439,59 @@ int main(int argc, char *argv[])
 
         if ((paused == false) || step)
         {
+            // The back resource is written by iterateLife(), and may still
+            // be on screen until the last update has been applied. The
+            // worker threads carry on with the next generation meanwhile.
+
+            waitForUpdateFrameLoop(&frameLoop);
             iterateLife(&life);
 
+            // A save that is still being written holds the next one back
+            // rather than the game.
+
+            if ((snapshotPath != NULL) &&
+                (life.generation >= nextSave) &&
+                saveLifeSaver(&saver, &life))
+            {
+                nextSave = life.generation + saveInterval;
+            }
+
             //-------------------------------------------------------------
 
             update = vc_dispmanx_update_start(0);
             assert(update != 0);
 
             changeSourceLife(&life, update);
-
-            result = vc_dispmanx_update_submit_sync(update);
-            assert(result == 0);
+            submitUpdateFrameLoop(&frameLoop, update);
 
             //-------------------------------------------------------------
 
             step = false;
         }
+        else
+        {
+            waitForVsyncFrameLoop(&frameLoop);
+        }
     }
 
     //---------------------------------------------------------------------
 
+    destroyFrameLoop(&frameLoop);
     keyboardReset();
 
+    if (snapshotPath != NULL)
+    {
+        waitLifeSaver(&saver);
+        saveLifeSaver(&saver, &life);
+        destroyLifeSaver(&saver);
+    }
+
     //---------------------------------------------------------------------
 
     destroyBackgroundLayer(&bg);
     destroyLife(&life);
     destroyImageLayer(&infoLayer);
+    shutdownDefaultThreadPool();
 
     //---------------------------------------------------------------------
 
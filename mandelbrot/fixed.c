@@ -0,0 +1,218 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "fixed.h"
+
+//-------------------------------------------------------------------------
+
+static bool
+isNegativeFixed(
+    const FIXED_T *f)
+{
+    return (f->limbs[FIXED_LIMBS - 1] & 0x80000000) != 0;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+negateFixed(
+    FIXED_T *f)
+{
+    uint64_t carry = 1;
+
+    int32_t i;
+    for (i = 0 ; i < FIXED_LIMBS ; i++)
+    {
+        carry += (uint32_t)~(f->limbs[i]);
+        f->limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+setDoubleFixed(
+    FIXED_T *f,
+    double value)
+{
+    bool negative = (value < 0.0);
+    double magnitude = fabs(value);
+    double whole = floor(magnitude);
+
+    f->limbs[FIXED_LIMBS - 1] = (uint32_t)whole;
+
+    // Each step only scales by a power of two and takes off the whole
+    // part, so nothing is rounded.
+
+    double fraction = magnitude - whole;
+
+    int32_t i;
+    for (i = FIXED_LIMBS - 2 ; i >= 0 ; i--)
+    {
+        fraction = ldexp(fraction, 32);
+        whole = floor(fraction);
+        f->limbs[i] = (uint32_t)whole;
+        fraction -= whole;
+    }
+
+    if (negative)
+    {
+        negateFixed(f);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+double
+getDoubleFixed(
+    const FIXED_T *f)
+{
+    FIXED_T magnitude = *f;
+    bool negative = isNegativeFixed(f);
+
+    if (negative)
+    {
+        negateFixed(&magnitude);
+    }
+
+    double value = 0.0;
+
+    int32_t i;
+    for (i = 0 ; i < FIXED_LIMBS ; i++)
+    {
+        value += ldexp(magnitude.limbs[i], 32 * (i - (FIXED_LIMBS - 1)));
+    }
+
+    return (negative) ? -value : value;
+}
+
+//-------------------------------------------------------------------------
+
+void
+addFixed(
+    FIXED_T *result,
+    const FIXED_T *a,
+    const FIXED_T *b)
+{
+    uint64_t carry = 0;
+
+    int32_t i;
+    for (i = 0 ; i < FIXED_LIMBS ; i++)
+    {
+        carry += (uint64_t)(a->limbs[i]) + b->limbs[i];
+        result->limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+subtractFixed(
+    FIXED_T *result,
+    const FIXED_T *a,
+    const FIXED_T *b)
+{
+    FIXED_T negative = *b;
+    negateFixed(&negative);
+
+    addFixed(result, a, &negative);
+}
+
+//-------------------------------------------------------------------------
+
+void
+multiplyFixed(
+    FIXED_T *result,
+    const FIXED_T *a,
+    const FIXED_T *b)
+{
+    FIXED_T x = *a;
+    FIXED_T y = *b;
+
+    bool negative = (isNegativeFixed(&x) != isNegativeFixed(&y));
+
+    if (isNegativeFixed(&x))
+    {
+        negateFixed(&x);
+    }
+
+    if (isNegativeFixed(&y))
+    {
+        negateFixed(&y);
+    }
+
+    // The full product has twice the fraction limbs; the lowest
+    // FIXED_LIMBS - 1 of them are dropped.
+
+    uint32_t product[2 * FIXED_LIMBS];
+    memset(product, 0, sizeof(product));
+
+    int32_t i;
+    for (i = 0 ; i < FIXED_LIMBS ; i++)
+    {
+        uint64_t carry = 0;
+
+        int32_t j;
+        for (j = 0 ; j < FIXED_LIMBS ; j++)
+        {
+            carry += ((uint64_t)(x.limbs[i]) * y.limbs[j]) + product[i + j];
+            product[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+
+        product[i + FIXED_LIMBS] = (uint32_t)carry;
+    }
+
+    memcpy(result->limbs,
+           &(product[FIXED_LIMBS - 1]),
+           sizeof(result->limbs));
+
+    if (negative)
+    {
+        negateFixed(result);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+addDoubleFixed(
+    FIXED_T *f,
+    double value)
+{
+    FIXED_T offset;
+    setDoubleFixed(&offset, value);
+
+    addFixed(f, f, &offset);
+}
+
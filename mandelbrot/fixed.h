@@ -0,0 +1,89 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdint.h>
+
+//-------------------------------------------------------------------------
+
+// A signed fixed point number, held in two's complement as FIXED_LIMBS
+// limbs of 32 bits, least significant first. The top limb is the integer
+// part and the others are the fraction, which gives 224 bits after the
+// point: enough to place a pixel well past the depth at which a double
+// runs out.
+
+#define FIXED_LIMBS 8
+#define FIXED_FRACTION_BITS (32 * (FIXED_LIMBS - 1))
+
+typedef struct
+{
+    uint32_t limbs[FIXED_LIMBS];
+} FIXED_T;
+
+//-------------------------------------------------------------------------
+
+// A double is converted exactly, as long as it fits.
+
+void
+setDoubleFixed(
+    FIXED_T *f,
+    double value);
+
+double
+getDoubleFixed(
+    const FIXED_T *f);
+
+void
+addFixed(
+    FIXED_T *result,
+    const FIXED_T *a,
+    const FIXED_T *b);
+
+void
+subtractFixed(
+    FIXED_T *result,
+    const FIXED_T *a,
+    const FIXED_T *b);
+
+// The product is truncated towards zero.
+
+void
+multiplyFixed(
+    FIXED_T *result,
+    const FIXED_T *a,
+    const FIXED_T *b);
+
+void
+addDoubleFixed(
+    FIXED_T *f,
+    double value);
+
+//-------------------------------------------------------------------------
+
+#endif
@@ -41,11 +41,10 @@
 //-------------------------------------------------------------------------
 
 void
-calculatingInfo(
+mandelbrotInfo(
     IMAGE_LAYER_T *imageLayer,
-    int32_t threads)
+    MANDELBROT_T *mbrot)
 {
-    static RGBA8_T textColour = { 0, 0, 0, 255 };
     static RGBA8_T backgroundColour = { 255, 255, 255, 255 };
 
     IMAGE_T *image = &(imageLayer->image);
@@ -54,62 +53,111 @@ calculatingInfo(
 
     //---------------------------------------------------------------------
 
-    drawStringRGB(INFO_LEFT_PADDING,
-                  INFO_TOP_PADDING,
-                  "Calculating ...",
-                  &textColour,
-                  image);
+    KEY_DIMENSIONS_T key_dimensions = { 0, 0 };
+    int32_t x = INFO_LEFT_PADDING;
+    int32_t y = 0;
 
     //---------------------------------------------------------------------
 
-    char buffer[128];
+    y += key_dimensions.height + INFO_TOP_PADDING;
 
-    snprintf(buffer, sizeof(buffer), "threads: %d", threads);
+    key_dimensions = drawKey(imageLayer, x, y, "Esc", "exit");
 
-    drawStringRGB(INFO_LEFT_PADDING,
-                  (2 * INFO_TOP_PADDING) + FONT_HEIGHT,
-                  buffer,
-                  &textColour,
-                  image);
+    //---------------------------------------------------------------------
 
-    changeSourceAndUpdateImageLayer(imageLayer);
-}
+    y += key_dimensions.height + INFO_TOP_PADDING;
 
-//-------------------------------------------------------------------------
+    key_dimensions = drawKey(imageLayer, x, y, "Z", "zoom in");
 
-void
-mandelbrotInfo(
-    IMAGE_LAYER_T *imageLayer)
-{
-    static RGBA8_T backgroundColour = { 255, 255, 255, 255 };
+    //---------------------------------------------------------------------
 
-    IMAGE_T *image = &(imageLayer->image);
+    y += key_dimensions.height + INFO_TOP_PADDING;
 
-    clearImageRGB(image, &backgroundColour);
+    key_dimensions = drawKey(imageLayer, x, y, "+ -", "zoom in/out");
 
     //---------------------------------------------------------------------
 
-    KEY_DIMENSIONS_T key_dimensions = { 0, 0 };
-    int32_t x = INFO_LEFT_PADDING;
-    int32_t y = 0;
+    y += key_dimensions.height + INFO_TOP_PADDING;
+
+    key_dimensions = drawKey(imageLayer, x, y, "IJKL", "pan");
 
     //---------------------------------------------------------------------
 
     y += key_dimensions.height + INFO_TOP_PADDING;
 
-    key_dimensions = drawKey(imageLayer, x, y, "Esc", "exit");
+    key_dimensions = drawKey(imageLayer, x, y, "S", "save PNG file");
 
     //---------------------------------------------------------------------
 
     y += key_dimensions.height + INFO_TOP_PADDING;
 
-    key_dimensions = drawKey(imageLayer, x, y, "Z", "zoom in");
+    key_dimensions = drawKey(imageLayer, x, y, "V", "change kernel");
 
     //---------------------------------------------------------------------
 
     y += key_dimensions.height + INFO_TOP_PADDING;
 
-    key_dimensions = drawKey(imageLayer, x, y, "S", "save PNG file");
+    key_dimensions = drawKey(imageLayer, x, y, "C", "cycle colours");
+
+    //---------------------------------------------------------------------
+
+    y += key_dimensions.height + INFO_TOP_PADDING;
+
+    key_dimensions = drawKey(imageLayer, x, y, "G", "smooth colour");
+
+    //---------------------------------------------------------------------
+
+    y += key_dimensions.height + INFO_TOP_PADDING;
+
+    key_dimensions = drawKey(imageLayer, x, y, "M N", "iterations");
+
+    //---------------------------------------------------------------------
+
+    static RGBA8_T textColour = { 0, 0, 0, 255 };
+
+    y += key_dimensions.height + INFO_TOP_PADDING;
+
+    drawStringRGB(x, y, mandelbrotKernelName(mbrot), &textColour, image);
+
+    y += FONT_HEIGHT + INFO_TOP_PADDING;
+
+    char buffer[128];
+
+    snprintf(buffer, sizeof(buffer), "threads: %d", mbrot->numberOfThreads);
+
+    drawStringRGB(x, y, buffer, &textColour, image);
+
+    y += FONT_HEIGHT + INFO_TOP_PADDING;
+
+    snprintf(buffer, sizeof(buffer), "iterations: %d", mbrot->maxIterations);
+
+    drawStringRGB(x, y, buffer, &textColour, image);
+
+    y += FONT_HEIGHT + INFO_TOP_PADDING;
+
+    if (mbrot->rendering)
+    {
+        snprintf(buffer, sizeof(buffer), "rendering ...");
+    }
+    else
+    {
+        snprintf(buffer,
+                 sizeof(buffer),
+                 "%.1f ms",
+                 mbrot->renderMicroseconds / 1000.0);
+    }
+
+    drawStringRGB(x, y, buffer, &textColour, image);
+
+    y += FONT_HEIGHT + INFO_TOP_PADDING;
+
+    snprintf(buffer,
+             sizeof(buffer),
+             "size: %dx%d",
+             mbrot->width,
+             mbrot->height);
+
+    drawStringRGB(x, y, buffer, &textColour, image);
 
     //---------------------------------------------------------------------
 
@@ -31,17 +31,14 @@
 #include <stdint.h>
 
 #include "imageLayer.h"
+#include "mandelbrot.h"
 
 //-------------------------------------------------------------------------
 
-void
-calculatingInfo(
-    IMAGE_LAYER_T *imageLayer,
-    int32_t threads);
-
 void
 mandelbrotInfo(
-    IMAGE_LAYER_T *imageLayer);
+    IMAGE_LAYER_T *imageLayer,
+    MANDELBROT_T *mbrot);
 
 void
 zoomInfo(
@@ -40,13 +40,17 @@
 #include "bcm_host.h"
 
 #include "backgroundLayer.h"
+#include "dynamicResolution.h"
 #include "font.h"
+#include "frameLoop.h"
 #include "imageGraphics.h"
 #include "imageLayer.h"
 #include "info.h"
+#include "input.h"
 #include "key.h"
 #include "mandelbrot.h"
 #include "savepng.h"
+#include "threadPool.h"
 
 //-------------------------------------------------------------------------
 
@@ -54,6 +58,30 @@
 
 //-------------------------------------------------------------------------
 
+// Renders started by a key press drop in resolution to keep within the
+// budget, down to a quarter of each side. Once the keys have been left
+// alone for MANDELBROT_IDLE_MICROSECONDS the image is drawn again at full
+// resolution.
+
+#define MANDELBROT_BUDGET_MILLISECONDS 200
+#define MANDELBROT_MINIMUM_SCALE (DYNAMIC_RESOLUTION_ONE / 4)
+#define MANDELBROT_IDLE_MICROSECONDS 500000
+
+//-------------------------------------------------------------------------
+
+static int64_t
+microsecondsSince(
+    const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((now.tv_sec - start->tv_sec) * 1000000LL) +
+           ((now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+//-------------------------------------------------------------------------
+
 bool
 zoom(
     IMAGE_LAYER_T *zoomLayer,
@@ -89,7 +117,7 @@ zoom(
     int c = 0;
     while ((c != 27) && (changed == false))
     {
-        usleep(100000);
+        waitForInput(-1);
 
         if (keyPressed(&c))
         {
@@ -180,9 +208,15 @@ zoom(
 
     if (changed)
     {
-        coords->x0 += (coords->side * x) / zoomLayer->image.width;
-        coords->y0 += (coords->side * y) / zoomLayer->image.height;
+        moveMandelbrotCoords(coords,
+                             (coords->side * x) / zoomLayer->image.width,
+                             (coords->side * y) / zoomLayer->image.height);
         coords->side *=  (double)width / zoomLayer->image.width;
+
+        if (coords->side < MANDELBROT_MINIMUM_SIDE)
+        {
+            coords->side = MANDELBROT_MINIMUM_SIDE;
+        }
     }
 
     return changed;
@@ -193,15 +227,21 @@ zoom(
 int main(int argc, char *argv[])
 {
     uint32_t displayNumber = 0;
+    int32_t budgetMilliseconds = MANDELBROT_BUDGET_MILLISECONDS;
 
     //-------------------------------------------------------------------
 
     int opt;
 
-    while ((opt = getopt(argc, argv, "d:")) != -1)
+    while ((opt = getopt(argc, argv, "b:d:")) != -1)
     {
         switch (opt)
         {
+        case 'b':
+
+            budgetMilliseconds = atoi(optarg);
+            break;
+
         case 'd':
 
             displayNumber = atoi(optarg);
@@ -209,7 +249,11 @@ int main(int argc, char *argv[])
 
         default:
 
-            fprintf(stderr, "Usage: %s [-d <number>]\n", basename(argv[0]));
+            fprintf(stderr,
+                    "Usage: %s [-b <milliseconds>] [-d <number>]\n",
+                    basename(argv[0]));
+            fprintf(stderr, "    -b - render time budget, 0 for always full");
+            fprintf(stderr, " resolution\n");
             fprintf(stderr, "    -d - Raspberry Pi display number\n");
             exit(EXIT_FAILURE);
             break;
@@ -236,7 +280,7 @@ int main(int argc, char *argv[])
     //---------------------------------------------------------------------
 
     int32_t infoLayerWidth = 140;
-    int32_t infoLayerHeight = 232;
+    int32_t infoLayerHeight = 316;
 
     int32_t mandelbrotLayerSize = info.height;
 
@@ -269,6 +313,7 @@ int main(int argc, char *argv[])
                    infoLayerWidth,
                    infoLayerHeight,
                    VC_IMAGE_RGBA16);
+    enableDirtyImageLayer(&infoLayer);
     createResourceImageLayer(&infoLayer, 2);
 
     //---------------------------------------------------------------------
@@ -302,28 +347,82 @@ int main(int argc, char *argv[])
     result = vc_dispmanx_update_submit_sync(update);
     assert(result == 0);
 
+    // Each finished pass is a full frame of RGB888. In VideoCore shared
+    // memory the VideoCore copies it into the back resource itself;
+    // otherwise hand it to an upload thread rather than wait on the write
+    // at every refinement.
+
+    if (enableSharedMemoryImageLayer(&mandelbrotLayer))
+    {
+        createBackResourceImageLayer(&mandelbrotLayer);
+    }
+    else
+    {
+        startUploadThreadImageLayer(&mandelbrotLayer);
+    }
+
     //---------------------------------------------------------------------
 
+    FRAME_LOOP_T frameLoop;
+    initFrameLoop(&frameLoop, display);
+
     MANDELBROT_T mandelbrot;
     newMandelbrot(&mandelbrot, &mandelbrotLayer);
 
+    DYNAMIC_RESOLUTION_T resolution;
+    initDynamicResolution(&resolution,
+                          mandelbrotLayer.image.width,
+                          mandelbrotLayer.image.height,
+                          budgetMilliseconds * 1000LL,
+                          MANDELBROT_MINIMUM_SCALE);
+
     //---------------------------------------------------------------------
 
-    MANDELBROT_COORDS_T coords = { -2.0, -1.5, 3.0 };
+    MANDELBROT_COORDS_T coords;
+    initMandelbrotCoords(&coords, -2.0, -1.5, 3.0);
 
-    calculatingInfo(&infoLayer, mandelbrot.numberOfThreads);
-    mandelbrotImage(&mandelbrot, &coords);
-    mandelbrotInfo(&infoLayer);
+    startMandelbrotImage(&mandelbrot, &coords);
+    mandelbrotInfo(&infoLayer, &mandelbrot);
 
-    //---------------------------------------------------------------------
+    // Only renders started by a key press are timed, as those are the
+    // ones that need to keep up.
+
+    bool interactive = false;
+
+    struct timespec lastKey;
+    clock_gettime(CLOCK_MONOTONIC, &lastKey);
+
+    // Screenshots are written in the background so rendering carries on.
+
+    SAVE_PNG_ASYNC_T *screenshot = NULL;
+
+    // Cycling the colours of a finished image only looks them up again.
+
+    bool cycle = false;
 
     int c = 0;
     while (c != 27)
     {
+        bool render = false;
+
+        if ((screenshot != NULL) && finishedSavePng(screenshot))
+        {
+            waitForSavePng(screenshot);
+            screenshot = NULL;
+        }
+
         if (keyPressed(&c))
         {
             c = tolower(c);
 
+            // Pans move by a whole number of rendered pixels so that the
+            // part of the image still on screen can be reused.
+
+            int32_t panPixels = mandelbrot.width / 8;
+
+            double dx = coords.side / (mandelbrot.width - 1);
+            double dy = coords.side / (mandelbrot.height - 1);
+
             switch (c)
             {
             case 's':
@@ -344,30 +443,193 @@ int main(int argc, char *argv[])
                          tm->tm_min,
                          tm->tm_sec);
 
-                savePng(&(mandelbrotLayer.image), filename);
+                if (screenshot != NULL)
+                {
+                    waitForSavePng(screenshot);
+                }
+
+                // Only the part that has been rendered is saved.
+
+                IMAGE_T rendered = mandelbrotLayer.image;
+                rendered.width = mandelbrot.width;
+                rendered.height = mandelbrot.height;
+
+                screenshot = savePngAsync(&rendered, filename);
                 break;
             }
             case 'z':
 
                 if (zoom(&zoomLayer, &infoLayer, &coords))
                 {
-                    calculatingInfo(&infoLayer, mandelbrot.numberOfThreads);
-                    mandelbrotImage(&mandelbrot, &coords);
+                    render = true;
                 }
+                else
+                {
+                    mandelbrotInfo(&infoLayer, &mandelbrot);
+                }
+
+                break;
+
+            case 'i':
+
+                moveMandelbrotCoords(&coords, 0.0, -panPixels * dy);
+                render = true;
+                break;
+
+            case 'j':
 
-                mandelbrotInfo(&infoLayer);
+                moveMandelbrotCoords(&coords, -panPixels * dx, 0.0);
+                render = true;
+                break;
+
+            case 'k':
 
+                moveMandelbrotCoords(&coords, 0.0, panPixels * dy);
+                render = true;
+                break;
+
+            case 'l':
+
+                moveMandelbrotCoords(&coords, panPixels * dx, 0.0);
+                render = true;
+                break;
+
+            case '+':
+            case '=':
+
+                if ((coords.side / 2.0) >= MANDELBROT_MINIMUM_SIDE)
+                {
+                    moveMandelbrotCoords(&coords,
+                                         coords.side / 4.0,
+                                         coords.side / 4.0);
+                    coords.side /= 2.0;
+                    render = true;
+                }
+
+                break;
+
+            case '-':
+
+                moveMandelbrotCoords(&coords,
+                                     -coords.side / 2.0,
+                                     -coords.side / 2.0);
+                coords.side *= 2.0;
+                render = true;
+                break;
+
+            case 'c':
+
+                cycle = (cycle == false);
+                break;
+
+            case 'g':
+
+                setSmoothMandelbrot(&mandelbrot, mandelbrot.smooth == false);
+                break;
+
+            case 'm':
+
+                changeIterationsMandelbrot(&mandelbrot, 1);
+                mandelbrotInfo(&infoLayer, &mandelbrot);
+                break;
+
+            case 'n':
+
+                changeIterationsMandelbrot(&mandelbrot, -1);
+                mandelbrotInfo(&infoLayer, &mandelbrot);
+                break;
+
+            case 'v':
+
+                if (mandelbrot.kernel == MANDELBROT_KERNEL_SCALAR)
+                {
+                    setKernelMandelbrot(&mandelbrot, MANDELBROT_KERNEL_VECTOR);
+                }
+                else
+                {
+                    setKernelMandelbrot(&mandelbrot, MANDELBROT_KERNEL_SCALAR);
+                }
+
+                render = true;
                 break;
             }
         }
+
+        //-----------------------------------------------------------------
+
+        if (render)
+        {
+            // A render that is cut short by the next key press has still
+            // gone over budget if it has run for longer than that.
+
+            if (interactive && mandelbrot.rendering)
+            {
+                int64_t elapsed = microsecondsSince(&(mandelbrot.renderStart));
+
+                if (elapsed > resolution.budgetMicroseconds)
+                {
+                    frameTimeDynamicResolution(&resolution, elapsed);
+                }
+            }
+
+            if (budgetMilliseconds > 0)
+            {
+                setRenderSizeMandelbrot(&mandelbrot,
+                                        resolution.width,
+                                        resolution.height);
+            }
+
+            interactive = true;
+            clock_gettime(CLOCK_MONOTONIC, &lastKey);
+
+            startMandelbrotImage(&mandelbrot, &coords);
+            mandelbrotInfo(&infoLayer, &mandelbrot);
+        }
+        else if (updateMandelbrotImage(&mandelbrot))
+        {
+            if (interactive)
+            {
+                frameTimeDynamicResolution(&resolution,
+                                           mandelbrot.renderMicroseconds);
+                interactive = false;
+            }
+
+            mandelbrotInfo(&infoLayer, &mandelbrot);
+        }
+        else if (mandelbrot.rendering)
+        {
+            waitForVsyncFrameLoop(&frameLoop);
+        }
+        else if ((mandelbrot.width != resolution.fullWidth) &&
+                 (microsecondsSince(&lastKey) > MANDELBROT_IDLE_MICROSECONDS))
+        {
+            setRenderSizeMandelbrot(&mandelbrot,
+                                    resolution.fullWidth,
+                                    resolution.fullHeight);
+
+            startMandelbrotImage(&mandelbrot, &coords);
+            mandelbrotInfo(&infoLayer, &mandelbrot);
+        }
+        else if (cycle)
+        {
+            setColourOffsetMandelbrot(&mandelbrot,
+                                      mandelbrot.colourOffset + 1);
+            waitForVsyncFrameLoop(&frameLoop);
+        }
         else
         {
-            usleep(100000);
+            waitForInput(100);
         }
     }
 
     //---------------------------------------------------------------------
 
+    if (screenshot != NULL)
+    {
+        waitForSavePng(screenshot);
+    }
+
+    destroyFrameLoop(&frameLoop);
     keyboardReset();
 
     //---------------------------------------------------------------------
@@ -377,6 +639,7 @@ int main(int argc, char *argv[])
     destroyImageLayer(&mandelbrotLayer);
     destroyImageLayer(&zoomLayer);
     destroyImageLayer(&infoLayer);
+    shutdownDefaultThreadPool();
 
     //---------------------------------------------------------------------
 
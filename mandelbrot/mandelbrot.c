@@ -26,12 +26,97 @@
 //-------------------------------------------------------------------------
 
 #include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <time.h>
 
 #include "bcm_host.h"
 
 #include "hsv2rgb.h"
 #include "image.h"
+#include "imagePixel.h"
 #include "mandelbrot.h"
+#include "threadPool.h"
+
+//-------------------------------------------------------------------------
+
+// Single precision is only used while the distance between neighbouring
+// pixels is comfortably larger than the rounding error of a coordinate.
+
+#define MANDELBROT_FLOAT_STEP_FACTOR (256.0 * FLT_EPSILON)
+
+// Likewise for double precision, past which perturbation takes over.
+
+#define MANDELBROT_DOUBLE_STEP_FACTOR (256.0 * DBL_EPSILON)
+
+//-------------------------------------------------------------------------
+
+typedef float MANDELBROT_FLOAT4_T __attribute__ ((vector_size (16)));
+typedef int32_t MANDELBROT_INT4_T __attribute__ ((vector_size (16)));
+typedef double MANDELBROT_DOUBLE2_T __attribute__ ((vector_size (16)));
+typedef int64_t MANDELBROT_INT2_T __attribute__ ((vector_size (16)));
+
+//-------------------------------------------------------------------------
+
+void
+initMandelbrotCoords(
+    MANDELBROT_COORDS_T *coords,
+    double x0,
+    double y0,
+    double side)
+{
+    setDoubleFixed(&(coords->x0), x0);
+    setDoubleFixed(&(coords->y0), y0);
+    coords->side = side;
+}
+
+//-------------------------------------------------------------------------
+
+void
+moveMandelbrotCoords(
+    MANDELBROT_COORDS_T *coords,
+    double dx,
+    double dy)
+{
+    addDoubleFixed(&(coords->x0), dx);
+    addDoubleFixed(&(coords->y0), dy);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+mandelbrotBuildLookup(
+    MANDELBROT_T *mbrot)
+{
+    int32_t colours = mbrot->numberOfColours;
+    int32_t steps = 1 << MANDELBROT_SMOOTH_BITS;
+    int32_t offset = mbrot->colourOffset % colours;
+
+    if (offset < 0)
+    {
+        offset += colours;
+    }
+
+    int32_t colour;
+    for (colour = 0 ; colour < colours ; colour++)
+    {
+        const RGBA8_T *from = &(mbrot->colours[(colour + offset) % colours]);
+        const RGBA8_T *to = &(mbrot->colours[(colour + offset + 1) % colours]);
+
+        int32_t step;
+        for (step = 0 ; step < steps ; step++)
+        {
+            RGBA8_T *rgba = &(mbrot->lookup[(colour * steps) + step]);
+
+            rgba->red = from->red + ((to->red - from->red) * step) / steps;
+            rgba->green = from->green
+                        + ((to->green - from->green) * step) / steps;
+            rgba->blue = from->blue + ((to->blue - from->blue) * step) / steps;
+            rgba->alpha = from->alpha
+                        + ((to->alpha - from->alpha) * step) / steps;
+        }
+    }
+}
 
 //-------------------------------------------------------------------------
 
@@ -48,6 +133,21 @@ newMandelbrot(
     size_t colour = 0;
 
     mbrot->numberOfColours = colours;
+    mbrot->kernel = MANDELBROT_KERNEL_VECTOR;
+    mbrot->useFloat = true;
+    mbrot->usePerturbation = false;
+    mbrot->maxIterations = MANDELBROT_ITERATIONS_PER_ROUND;
+    mbrot->renderMicroseconds = 0;
+
+    mbrot->x0 = 0.0;
+    mbrot->y0 = 0.0;
+
+    mbrot->referenceX = NULL;
+    mbrot->referenceY = NULL;
+    mbrot->referenceLength = 0;
+    mbrot->referenceCapacity = 0;
+    mbrot->referenceI = 0;
+    mbrot->referenceJ = 0;
 
     for (colour = 0 ; colour < colours ; colour++)
     {
@@ -57,57 +157,65 @@ newMandelbrot(
                 &(mbrot->colours[colour]));
     }
 
-    //---------------------------------------------------------------------
-    
-    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    mbrot->colourOffset = 0;
+    mbrot->smooth = false;
 
-    if (cores == -1)
-    {
-        cores = 1;
-    }
+    mandelbrotBuildLookup(mbrot);
 
-    if (cores > MANDELBROT_MAX_THREADS)
-    {
-        mbrot->numberOfThreads = MANDELBROT_MAX_THREADS;
-    }
-    else
-    {
-        mbrot->numberOfThreads = cores;
-    }
+    //---------------------------------------------------------------------
 
-    pthread_barrier_init(&(mbrot->startBarrier),
-                         NULL,
-                         mbrot->numberOfThreads + 1);
+    mbrot->numberOfRegions = 0;
+    mbrot->step = 1;
+    mbrot->rendering = false;
+    mbrot->complete = false;
 
-    pthread_barrier_init(&(mbrot->finishedBarrier),
-                         NULL,
-                         mbrot->numberOfThreads + 1);
+    //---------------------------------------------------------------------
+    
+    mbrot->pool = defaultThreadPool();
+    mbrot->numberOfThreads = mbrot->pool->numberOfThreads;
 
     //---------------------------------------------------------------------
 
     IMAGE_T *image = &(imageLayer->image);
 
+    mbrot->width = image->width;
+    mbrot->height = image->height;
+
     //---------------------------------------------------------------------
+    // Regions other than the whole image can each add a partial row and
+    // column of tiles, so allow for that.
 
-    int32_t heightStep = image->height / mbrot->numberOfThreads;
-    int32_t heightStart = 0;
+    int32_t tilesAcross = (image->width + MANDELBROT_TILE_SIZE - 1)
+                        / MANDELBROT_TILE_SIZE;
+    int32_t tilesDown = (image->height + MANDELBROT_TILE_SIZE - 1)
+                      / MANDELBROT_TILE_SIZE;
 
-    int32_t thread;
-    for (thread = 0 ; thread < mbrot->numberOfThreads ; thread++)
-    {
-        mbrot->heightRange[thread].startHeight = heightStart;
-        mbrot->heightRange[thread].endHeight = heightStart + heightStep;
+    mbrot->maxTiles = MANDELBROT_MAX_REGIONS
+                    * (tilesAcross + 1)
+                    * (tilesDown + 1);
+    mbrot->numberOfTiles = 0;
+    mbrot->cancel = false;
 
-        heightStart += heightStep;
+    mbrot->tiles = calloc(mbrot->maxTiles, sizeof(MANDELBROT_TILE_T));
 
-        pthread_create(&(mbrot->threads[thread]),
-                       NULL,
-                       workerMandelbrot,
-                       mbrot);
+    mbrot->iterations = calloc(image->width * image->height,
+                               sizeof(MANDELBROT_ITERATION_T));
+    mbrot->continueFrom = 0;
+    mbrot->extraRounds = 0;
+
+    if ((mbrot->tiles == NULL) || (mbrot->iterations == NULL))
+    {
+        fprintf(stderr, "mandelbrot: memory exhausted\n");
+        exit(EXIT_FAILURE);
     }
 
-    thread = mbrot->numberOfThreads - 1;
-    mbrot->heightRange[thread].endHeight = image->height;
+    mbrot->account = findMemoryAccount("mandelbrot");
+
+    chargeCpuMemoryAccount(mbrot->account,
+                           (mbrot->maxTiles * sizeof(MANDELBROT_TILE_T))
+                           + (image->width * image->height
+                              * sizeof(MANDELBROT_ITERATION_T)),
+                           2);
 }
 
 //-------------------------------------------------------------------------
@@ -116,71 +224,229 @@ void
 destroyMandelbrot(
     MANDELBROT_T *mbrot)
 {
-    int32_t thread;
-    for (thread = 0 ; thread < mbrot->numberOfThreads ; thread++)
+    cancelMandelbrotImage(mbrot);
+
+    const IMAGE_T *image = &(mbrot->imageLayer->image);
+
+    free(mbrot->tiles);
+    mbrot->tiles = NULL;
+
+    free(mbrot->iterations);
+    mbrot->iterations = NULL;
+
+    chargeCpuMemoryAccount(mbrot->account,
+                           -(int64_t)((mbrot->maxTiles
+                                       * sizeof(MANDELBROT_TILE_T))
+                                      + (image->width * image->height
+                                         * sizeof(MANDELBROT_ITERATION_T))),
+                           -2);
+
+    if (mbrot->referenceX != NULL)
     {
-        pthread_cancel(mbrot->threads[thread]);
+        chargeCpuMemoryAccount(mbrot->account,
+                               -(int64_t)(2 * mbrot->referenceCapacity
+                                          * sizeof(double)),
+                               -2);
     }
+
+    free(mbrot->referenceX);
+    mbrot->referenceX = NULL;
+    free(mbrot->referenceY);
+    mbrot->referenceY = NULL;
+    mbrot->referenceCapacity = 0;
 }
 
 //-------------------------------------------------------------------------
 
-void *
-workerMandelbrot(
-    void *arg)
+// Tiles are handed out one at a time, so threads that get cheap tiles
+// simply take more of them.
+
+static void
+tilesMandelbrot(
+    void *arg,
+    int32_t start,
+    int32_t end)
 {
     MANDELBROT_T *mbrot = arg;
 
-    int32_t thread = -1;
-    int32_t i;
-    for (i = 0 ; i < mbrot->numberOfThreads ; i++)
+    int32_t index;
+    for (index = start ; (index < end) && (mbrot->cancel == false) ; index++)
+    {
+        mandelbrotImageKernel(mbrot, &(mbrot->tiles[index]));
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+mandelbrotImageKernel(
+    MANDELBROT_T *mbrot,
+    const MANDELBROT_TILE_T *tile)
+{
+    if (mbrot->usePerturbation)
+    {
+        mandelbrotImageKernelPerturbation(mbrot, tile);
+    }
+    else if (mbrot->kernel == MANDELBROT_KERNEL_SCALAR)
+    {
+        mandelbrotImageKernelScalar(mbrot, tile);
+    }
+    else if (mbrot->useFloat)
+    {
+        mandelbrotImageKernelVectorFloat(mbrot, tile);
+    }
+    else
+    {
+        mandelbrotImageKernelVectorDouble(mbrot, tile);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// The palette repeats for as many iterations as the depth calls for.
+
+static const RGBA8_T *
+mandelbrotColour(
+    const MANDELBROT_T *mbrot,
+    const MANDELBROT_ITERATION_T *iteration)
+{
+    static const RGBA8_T black = { 0, 0, 0, 0 };
+
+    if (iteration->count >= mbrot->maxIterations)
+    {
+        return &black;
+    }
+
+    int32_t index = (iteration->count % mbrot->numberOfColours)
+                  << MANDELBROT_SMOOTH_BITS;
+
+    if (mbrot->smooth)
+    {
+        index += iteration->fraction >> (16 - MANDELBROT_SMOOTH_BITS);
+    }
+
+    return &(mbrot->lookup[index]);
+}
+
+//-------------------------------------------------------------------------
+
+// While continuing, only pixels that had reached the old limit are
+// iterated, and a group of lanes is skipped if none of them had.
+
+static bool
+mandelbrotNeedsIterating(
+    const MANDELBROT_T *mbrot,
+    const MANDELBROT_TILE_T *tile,
+    int32_t i,
+    int32_t j,
+    int32_t lanes)
+{
+    if (mbrot->continueFrom == 0)
+    {
+        return true;
+    }
+
+    const MANDELBROT_ITERATION_T *row =
+        &(mbrot->iterations[j * mbrot->imageLayer->image.width]);
+
+    int32_t lane;
+    for (lane = 0 ; lane < lanes ; lane++)
     {
-        if (pthread_equal(pthread_self(), mbrot->threads[i]))
+        int32_t px = i + (lane * mbrot->step);
+
+        if ((px < tile->endX) && (row[px].count >= mbrot->continueFrom))
         {
-            thread = i;
-            break;
+            return true;
         }
     }
 
-    if (thread == -1)
+    return false;
+}
+
+//-------------------------------------------------------------------------
+
+// modulus is |z|^2 once the pixel has escaped, from which the fraction of
+// an iteration for smooth colouring is worked out.
+
+static void
+mandelbrotWritePixel(
+    MANDELBROT_T *mbrot,
+    IMAGE_T *image,
+    uint8_t *line,
+    int32_t i,
+    int32_t j,
+    const MANDELBROT_TILE_T *tile,
+    int32_t count,
+    double modulus)
+{
+    MANDELBROT_ITERATION_T *iteration =
+        &(mbrot->iterations[(j * image->width) + i]);
+
+    iteration->count = count;
+    iteration->fraction = 0;
+
+    if (count < mbrot->maxIterations)
     {
-        fprintf(stderr, "mandelbrot: cannot find thread index\n");
-        return NULL;
+        double fraction = 1.0 - log2(0.5 * log2(modulus));
+
+        if (fraction > 0.0)
+        {
+            iteration->fraction = (fraction < 1.0) ? fraction * 65536.0
+                                                   : 65535;
+        }
     }
 
-    while (true)
+    const RGBA8_T *rgb = mandelbrotColour(mbrot, iteration);
+
+    //---------------------------------------------------------------------
+    // On a coarse pass each sample fills a block of step x step pixels.
+
+    if (mbrot->step > 1)
     {
-        pthread_barrier_wait(&(mbrot->startBarrier));
-        mandelbrotImageKernel(mbrot,
-                              mbrot->heightRange[thread].startHeight,
-                              mbrot->heightRange[thread].endHeight);
-        pthread_barrier_wait(&(mbrot->finishedBarrier));
+        int32_t width = tile->endX - i;
+        int32_t height = tile->endY - j;
+
+        setRectRGB(image,
+                   i,
+                   j,
+                   (width < mbrot->step) ? width : mbrot->step,
+                   (height < mbrot->step) ? height : mbrot->step,
+                   rgb);
+        return;
     }
 
-    return NULL;
+    imagePixelPut(imagePixelFormat(image), image, line, i, j, rgb);
 }
 
 //-------------------------------------------------------------------------
 
 void
-mandelbrotImageKernel(
+mandelbrotImageKernelScalar(
     MANDELBROT_T *mbrot,
-    int32_t startHeight,
-    int32_t endHeight)
+    const MANDELBROT_TILE_T *tile)
 {
     IMAGE_T *image = &(mbrot->imageLayer->image);
 
-    double dx = (mbrot->coords.side / (image->width - 1));
-    double dy = (mbrot->coords.side / (image->height - 1));
+    double dx = (mbrot->coords.side / (mbrot->width - 1));
+    double dy = (mbrot->coords.side / (mbrot->height - 1));
+
+    int32_t step = mbrot->step;
 
     int32_t j;
-    for (j = startHeight ; j < endHeight ; j++)
+    for (j = tile->startY ; j < tile->endY ; j += step)
     {
+        uint8_t *line = (uint8_t *)(image->buffer) + (j * image->pitch);
+
         int32_t i;
-        for (i = 0 ; i < image->width ; i++)
+        for (i = tile->startX ; i < tile->endX ; i += step)
         {
-            double x0 = mbrot->coords.x0 + dx * i;
-            double y0 = mbrot->coords.y0 + dy * j;
+            if (mandelbrotNeedsIterating(mbrot, tile, i, j, 1) == false)
+            {
+                continue;
+            }
+
+            double x0 = mbrot->x0 + dx * i;
+            double y0 = mbrot->y0 + dy * j;
 
             double x = 0.0;
             double y = 0.0;
@@ -188,9 +454,9 @@ mandelbrotImageKernel(
             double x2 = x * x;
             double y2 = y * y;
 
-            size_t n = 0;
+            int32_t n = 0;
 
-            while ((x2 + y2 < 4.0) && (n < mbrot->numberOfColours))
+            while ((x2 + y2 < 4.0) && (n < mbrot->maxIterations))
             {
                 double xtemp = x2 - y2 + x0;
                 y = 2 * x * y + y0;
@@ -202,9 +468,102 @@ mandelbrotImageKernel(
                 n++;
             }
 
-            if (n < mbrot->numberOfColours)
+            mandelbrotWritePixel(mbrot, image, line, i, j, tile, n, x2 + y2);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+mandelbrotImageKernelVectorFloat(
+    MANDELBROT_T *mbrot,
+    const MANDELBROT_TILE_T *tile)
+{
+    IMAGE_T *image = &(mbrot->imageLayer->image);
+
+    double dx = (mbrot->coords.side / (mbrot->width - 1));
+    double dy = (mbrot->coords.side / (mbrot->height - 1));
+
+    int32_t step = mbrot->step;
+
+    const int32_t maxIterations = mbrot->maxIterations;
+    const MANDELBROT_FLOAT4_T four = { 4.0f, 4.0f, 4.0f, 4.0f };
+
+    int32_t j;
+    for (j = tile->startY ; j < tile->endY ; j += step)
+    {
+        uint8_t *line = (uint8_t *)(image->buffer) + (j * image->pitch);
+        float y0 = mbrot->y0 + dy * j;
+
+        const MANDELBROT_FLOAT4_T cy = { y0, y0, y0, y0 };
+
+        int32_t i;
+        for (i = tile->startX ; i < tile->endX ; i += 4 * step)
+        {
+            if (mandelbrotNeedsIterating(mbrot, tile, i, j, 4) == false)
+            {
+                continue;
+            }
+
+            const MANDELBROT_FLOAT4_T cx =
+            {
+                mbrot->x0 + dx * i,
+                mbrot->x0 + dx * (i + step),
+                mbrot->x0 + dx * (i + 2 * step),
+                mbrot->x0 + dx * (i + 3 * step)
+            };
+
+            MANDELBROT_FLOAT4_T x = { 0.0f, 0.0f, 0.0f, 0.0f };
+            MANDELBROT_FLOAT4_T y = { 0.0f, 0.0f, 0.0f, 0.0f };
+            MANDELBROT_FLOAT4_T modulus = { 0.0f, 0.0f, 0.0f, 0.0f };
+            MANDELBROT_INT4_T active = { -1, -1, -1, -1 };
+            MANDELBROT_INT4_T count = { 0, 0, 0, 0 };
+
+            int32_t n;
+            for (n = 0 ; n < maxIterations ; n++)
+            {
+                MANDELBROT_FLOAT4_T x2 = x * x;
+                MANDELBROT_FLOAT4_T y2 = y * y;
+                MANDELBROT_FLOAT4_T z2 = x2 + y2;
+
+                // each lane drops out of the count once it escapes, and
+                // keeps the modulus it escaped with
+
+                MANDELBROT_INT4_T escaped = active & (z2 >= four);
+                active &= ~escaped;
+                modulus = (MANDELBROT_FLOAT4_T)
+                          (((MANDELBROT_INT4_T)modulus & ~escaped) |
+                           ((MANDELBROT_INT4_T)z2 & escaped));
+
+                if ((active[0] | active[1] | active[2] | active[3]) == 0)
+                {
+                    break;
+                }
+
+                count -= active;
+
+                MANDELBROT_FLOAT4_T xy = x * y;
+                x = x2 - y2 + cx;
+                y = xy + xy + cy;
+            }
+
+            int32_t lane;
+            for (lane = 0 ; lane < 4 ; lane++)
             {
-                setPixelRGB(image, i, j, &(mbrot->colours[n]));
+                int32_t px = i + (lane * step);
+
+                if (px < tile->endX)
+                {
+                    mandelbrotWritePixel(mbrot,
+                                         image,
+                                         line,
+                                         px,
+                                         j,
+                                         tile,
+                                         count[lane],
+                                         modulus[lane]);
+                }
             }
         }
     }
@@ -213,24 +572,926 @@ mandelbrotImageKernel(
 //-------------------------------------------------------------------------
 
 void
-mandelbrotImage(
+mandelbrotImageKernelVectorDouble(
     MANDELBROT_T *mbrot,
-    MANDELBROT_COORDS_T *coords)
+    const MANDELBROT_TILE_T *tile)
 {
-    memcpy(&(mbrot->coords), coords, sizeof(MANDELBROT_COORDS_T));
+    IMAGE_T *image = &(mbrot->imageLayer->image);
+
+    double dx = (mbrot->coords.side / (mbrot->width - 1));
+    double dy = (mbrot->coords.side / (mbrot->height - 1));
+
+    int32_t step = mbrot->step;
+
+    const int32_t maxIterations = mbrot->maxIterations;
+    const MANDELBROT_DOUBLE2_T four = { 4.0, 4.0 };
+
+    int32_t j;
+    for (j = tile->startY ; j < tile->endY ; j += step)
+    {
+        uint8_t *line = (uint8_t *)(image->buffer) + (j * image->pitch);
+        double y0 = mbrot->y0 + dy * j;
+
+        const MANDELBROT_DOUBLE2_T cy = { y0, y0 };
+
+        int32_t i;
+        for (i = tile->startX ; i < tile->endX ; i += 4 * step)
+        {
+            if (mandelbrotNeedsIterating(mbrot, tile, i, j, 4) == false)
+            {
+                continue;
+            }
+
+            // two registers of two lanes each, run side by side
+
+            const MANDELBROT_DOUBLE2_T cxa =
+            {
+                mbrot->x0 + dx * i,
+                mbrot->x0 + dx * (i + step)
+            };
+
+            const MANDELBROT_DOUBLE2_T cxb =
+            {
+                mbrot->x0 + dx * (i + 2 * step),
+                mbrot->x0 + dx * (i + 3 * step)
+            };
+
+            MANDELBROT_DOUBLE2_T xa = { 0.0, 0.0 };
+            MANDELBROT_DOUBLE2_T ya = { 0.0, 0.0 };
+            MANDELBROT_DOUBLE2_T xb = { 0.0, 0.0 };
+            MANDELBROT_DOUBLE2_T yb = { 0.0, 0.0 };
+            MANDELBROT_DOUBLE2_T modulusa = { 0.0, 0.0 };
+            MANDELBROT_DOUBLE2_T modulusb = { 0.0, 0.0 };
+            MANDELBROT_INT2_T activea = { -1, -1 };
+            MANDELBROT_INT2_T activeb = { -1, -1 };
+            MANDELBROT_INT2_T counta = { 0, 0 };
+            MANDELBROT_INT2_T countb = { 0, 0 };
+
+            int32_t n;
+            for (n = 0 ; n < maxIterations ; n++)
+            {
+                MANDELBROT_DOUBLE2_T xa2 = xa * xa;
+                MANDELBROT_DOUBLE2_T ya2 = ya * ya;
+                MANDELBROT_DOUBLE2_T xb2 = xb * xb;
+                MANDELBROT_DOUBLE2_T yb2 = yb * yb;
+
+                MANDELBROT_DOUBLE2_T za2 = xa2 + ya2;
+                MANDELBROT_DOUBLE2_T zb2 = xb2 + yb2;
 
-    static RGBA8_T black = {0, 0, 0, 0};
+                MANDELBROT_INT2_T escapeda = activea & (za2 >= four);
+                MANDELBROT_INT2_T escapedb = activeb & (zb2 >= four);
+                activea &= ~escapeda;
+                activeb &= ~escapedb;
+                modulusa = (MANDELBROT_DOUBLE2_T)
+                           (((MANDELBROT_INT2_T)modulusa & ~escapeda) |
+                            ((MANDELBROT_INT2_T)za2 & escapeda));
+                modulusb = (MANDELBROT_DOUBLE2_T)
+                           (((MANDELBROT_INT2_T)modulusb & ~escapedb) |
+                            ((MANDELBROT_INT2_T)zb2 & escapedb));
 
+                if ((activea[0] | activea[1] | activeb[0] | activeb[1]) == 0)
+                {
+                    break;
+                }
+
+                counta -= activea;
+                countb -= activeb;
+
+                MANDELBROT_DOUBLE2_T xya = xa * ya;
+                MANDELBROT_DOUBLE2_T xyb = xb * yb;
+                xa = xa2 - ya2 + cxa;
+                ya = xya + xya + cy;
+                xb = xb2 - yb2 + cxb;
+                yb = xyb + xyb + cy;
+            }
+
+            int32_t counts[4] = { counta[0], counta[1], countb[0], countb[1] };
+
+            double moduli[4] =
+            {
+                modulusa[0],
+                modulusa[1],
+                modulusb[0],
+                modulusb[1]
+            };
+
+            int32_t lane;
+            for (lane = 0 ; lane < 4 ; lane++)
+            {
+                int32_t px = i + (lane * step);
+
+                if (px < tile->endX)
+                {
+                    mandelbrotWritePixel(mbrot,
+                                         image,
+                                         line,
+                                         px,
+                                         j,
+                                         tile,
+                                         counts[lane],
+                                         moduli[lane]);
+                }
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Each pixel c = C + dc is iterated as an offset d from the reference
+// orbit Z, using d' = (2Z + d)d + dc, which only involves numbers as small
+// as the offsets themselves and so keeps its precision in a double. Where
+// the pixel comes closer to zero than to the reference, or the reference
+// runs out, the offset carries on from the start of the reference orbit
+// instead; that keeps it from drifting off into a glitch, and lets one
+// reference do for the whole image.
+
+void
+mandelbrotImageKernelPerturbation(
+    MANDELBROT_T *mbrot,
+    const MANDELBROT_TILE_T *tile)
+{
     IMAGE_T *image = &(mbrot->imageLayer->image);
-    clearImageRGB(image, &black);
 
-    //---------------------------------------------------------------------
+    double dx = (mbrot->coords.side / (mbrot->width - 1));
+    double dy = (mbrot->coords.side / (mbrot->height - 1));
 
-    pthread_barrier_wait(&(mbrot->startBarrier));
-    pthread_barrier_wait(&(mbrot->finishedBarrier));
+    int32_t step = mbrot->step;
 
-    //---------------------------------------------------------------------
+    const int32_t maxIterations = mbrot->maxIterations;
+    const double *referenceX = mbrot->referenceX;
+    const double *referenceY = mbrot->referenceY;
+    const int32_t last = mbrot->referenceLength - 1;
+    const MANDELBROT_DOUBLE2_T four = { 4.0, 4.0 };
 
-    changeSourceAndUpdateImageLayer(mbrot->imageLayer);
+    int32_t j;
+    for (j = tile->startY ; j < tile->endY ; j += step)
+    {
+        uint8_t *line = (uint8_t *)(image->buffer) + (j * image->pitch);
+        double dcy = dy * (j - mbrot->referenceJ);
+
+        const MANDELBROT_DOUBLE2_T ccy = { dcy, dcy };
+
+        int32_t i;
+        for (i = tile->startX ; i < tile->endX ; i += 2 * step)
+        {
+            if (mandelbrotNeedsIterating(mbrot, tile, i, j, 2) == false)
+            {
+                continue;
+            }
+
+            const MANDELBROT_DOUBLE2_T ccx =
+            {
+                dx * (i - mbrot->referenceI),
+                dx * (i + step - mbrot->referenceI)
+            };
+
+            MANDELBROT_DOUBLE2_T ex = { 0.0, 0.0 };
+            MANDELBROT_DOUBLE2_T ey = { 0.0, 0.0 };
+            MANDELBROT_DOUBLE2_T modulus = { 0.0, 0.0 };
+            MANDELBROT_INT2_T active = { -1, -1 };
+            MANDELBROT_INT2_T count = { 0, 0 };
+            int32_t m[2] = { 0, 0 };
+
+            int32_t n;
+            for (n = 0 ; n < maxIterations ; n++)
+            {
+                MANDELBROT_DOUBLE2_T zx =
+                {
+                    referenceX[m[0]],
+                    referenceX[m[1]]
+                };
+
+                MANDELBROT_DOUBLE2_T zy =
+                {
+                    referenceY[m[0]],
+                    referenceY[m[1]]
+                };
+
+                MANDELBROT_DOUBLE2_T x = zx + ex;
+                MANDELBROT_DOUBLE2_T y = zy + ey;
+                MANDELBROT_DOUBLE2_T z2 = (x * x) + (y * y);
+
+                MANDELBROT_INT2_T escaped = active & (z2 >= four);
+                active &= ~escaped;
+                modulus = (MANDELBROT_DOUBLE2_T)
+                          (((MANDELBROT_INT2_T)modulus & ~escaped) |
+                           ((MANDELBROT_INT2_T)z2 & escaped));
+
+                if ((active[0] | active[1]) == 0)
+                {
+                    break;
+                }
+
+                count -= active;
+
+                //---------------------------------------------------------
+
+                MANDELBROT_DOUBLE2_T e2 = (ex * ex) + (ey * ey);
+
+                int32_t lane;
+                for (lane = 0 ; lane < 2 ; lane++)
+                {
+                    if ((z2[lane] < e2[lane]) || (m[lane] == last))
+                    {
+                        ex[lane] = x[lane];
+                        ey[lane] = y[lane];
+                        zx[lane] = 0.0;
+                        zy[lane] = 0.0;
+                        m[lane] = 0;
+                    }
+                }
+
+                //---------------------------------------------------------
+
+                MANDELBROT_DOUBLE2_T tx = zx + zx + ex;
+                MANDELBROT_DOUBLE2_T ty = zy + zy + ey;
+                MANDELBROT_DOUBLE2_T ex2 = (tx * ex) - (ty * ey) + ccx;
+                ey = (tx * ey) + (ty * ex) + ccy;
+                ex = ex2;
+
+                m[0]++;
+                m[1]++;
+            }
+
+            int32_t lane;
+            for (lane = 0 ; lane < 2 ; lane++)
+            {
+                int32_t px = i + (lane * step);
+
+                if (px < tile->endX)
+                {
+                    mandelbrotWritePixel(mbrot,
+                                         image,
+                                         line,
+                                         px,
+                                         j,
+                                         tile,
+                                         count[lane],
+                                         modulus[lane]);
+                }
+            }
+        }
+    }
 }
 
+//-------------------------------------------------------------------------
+
+const char *
+mandelbrotKernelName(
+    MANDELBROT_T *mbrot)
+{
+    if (mbrot->usePerturbation)
+    {
+        return "perturbation";
+    }
+    else if (mbrot->kernel == MANDELBROT_KERNEL_SCALAR)
+    {
+        return "scalar";
+    }
+    else if (mbrot->useFloat)
+    {
+        return "vector float";
+    }
+
+    return "vector double";
+}
+
+//-------------------------------------------------------------------------
+
+void
+setKernelMandelbrot(
+    MANDELBROT_T *mbrot,
+    MANDELBROT_KERNEL_T kernel)
+{
+    cancelMandelbrotImage(mbrot);
+
+    mbrot->kernel = kernel;
+    mbrot->complete = false;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+mandelbrotStartPass(
+    MANDELBROT_T *mbrot)
+{
+    mbrot->numberOfTiles = 0;
+
+    int32_t region;
+    for (region = 0 ; region < mbrot->numberOfRegions ; region++)
+    {
+        const MANDELBROT_TILE_T *r = &(mbrot->regions[region]);
+
+        int32_t y;
+        for (y = r->startY ; y < r->endY ; y += MANDELBROT_TILE_SIZE)
+        {
+            int32_t x;
+            for (x = r->startX ; x < r->endX ; x += MANDELBROT_TILE_SIZE)
+            {
+                MANDELBROT_TILE_T *tile
+                    = &(mbrot->tiles[mbrot->numberOfTiles++]);
+
+                tile->startX = x;
+                tile->startY = y;
+                tile->endX = x + MANDELBROT_TILE_SIZE;
+                tile->endY = y + MANDELBROT_TILE_SIZE;
+
+                if (tile->endX > r->endX)
+                {
+                    tile->endX = r->endX;
+                }
+
+                if (tile->endY > r->endY)
+                {
+                    tile->endY = r->endY;
+                }
+            }
+        }
+    }
+
+    assert(mbrot->numberOfTiles <= mbrot->maxTiles);
+
+    //---------------------------------------------------------------------
+
+    mbrot->cancel = false;
+
+    startForThreadPool(mbrot->pool,
+                       mbrot->numberOfTiles,
+                       1,
+                       tilesMandelbrot,
+                       mbrot);
+}
+
+//-------------------------------------------------------------------------
+
+static bool
+mandelbrotPassFinished(
+    MANDELBROT_T *mbrot,
+    bool wait)
+{
+    if (wait)
+    {
+        waitThreadPool(mbrot->pool);
+        return true;
+    }
+
+    return finishedThreadPool(mbrot->pool);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+mandelbrotShift(
+    uint8_t *buffer,
+    int32_t pitch,
+    int32_t bytesPerPixel,
+    int32_t width,
+    int32_t height,
+    int32_t shiftX,
+    int32_t shiftY)
+{
+    // Pixel (i, j) of the new image is pixel (i + shiftX, j + shiftY) of
+    // the old one, within the width x height being rendered. Rows are
+    // walked so that no row is overwritten before it has been moved.
+
+    int32_t columns = width - abs(shiftX);
+    int32_t rows = height - abs(shiftY);
+
+    int32_t srcX = (shiftX > 0) ? shiftX : 0;
+    int32_t dstX = (shiftX > 0) ? 0 : -shiftX;
+    int32_t srcY = (shiftY > 0) ? shiftY : 0;
+    int32_t dstY = (shiftY > 0) ? 0 : -shiftY;
+
+    int32_t j;
+    for (j = 0 ; j < rows ; j++)
+    {
+        int32_t row = (shiftY > 0) ? j : (rows - 1 - j);
+
+        memmove(buffer
+                + ((dstY + row) * pitch)
+                + (dstX * bytesPerPixel),
+                buffer
+                + ((srcY + row) * pitch)
+                + (srcX * bytesPerPixel),
+                columns * bytesPerPixel);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+mandelbrotSetRegion(
+    MANDELBROT_T *mbrot,
+    int32_t startX,
+    int32_t endX,
+    int32_t startY,
+    int32_t endY)
+{
+    if ((startX < endX) && (startY < endY))
+    {
+        MANDELBROT_TILE_T *region
+            = &(mbrot->regions[mbrot->numberOfRegions++]);
+
+        region->startX = startX;
+        region->endX = endX;
+        region->startY = startY;
+        region->endY = endY;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// Deeper zooms need more iterations to show any detail, so allow another
+// round every eight halvings of the side.
+
+static int32_t
+mandelbrotMaxIterations(
+    const MANDELBROT_T *mbrot,
+    double side)
+{
+    double depth = log2(3.0 / side);
+
+    if (depth < 0.0)
+    {
+        depth = 0.0;
+    }
+
+    int32_t rounds = 1 + ((int32_t)depth / 8) + mbrot->extraRounds;
+
+    if (rounds < 1)
+    {
+        rounds = 1;
+    }
+
+    if (rounds > MANDELBROT_MAX_ITERATIONS / MANDELBROT_ITERATIONS_PER_ROUND)
+    {
+        return MANDELBROT_MAX_ITERATIONS;
+    }
+
+    return rounds * MANDELBROT_ITERATIONS_PER_ROUND;
+}
+
+//-------------------------------------------------------------------------
+
+// The reference is the pixel in the middle of the image, iterated in fixed
+// point until it escapes or runs out of iterations. Only its orbit as
+// doubles is kept.
+
+static void
+mandelbrotReferenceOrbit(
+    MANDELBROT_T *mbrot)
+{
+    if (mbrot->referenceCapacity < mbrot->maxIterations + 1)
+    {
+        if (mbrot->referenceX != NULL)
+        {
+            chargeCpuMemoryAccount(mbrot->account,
+                                   -(int64_t)(2 * mbrot->referenceCapacity
+                                              * sizeof(double)),
+                                   -2);
+        }
+
+        mbrot->referenceCapacity = mbrot->maxIterations + 1;
+
+        free(mbrot->referenceX);
+        free(mbrot->referenceY);
+
+        mbrot->referenceX = malloc(mbrot->referenceCapacity * sizeof(double));
+        mbrot->referenceY = malloc(mbrot->referenceCapacity * sizeof(double));
+
+        if ((mbrot->referenceX == NULL) || (mbrot->referenceY == NULL))
+        {
+            fprintf(stderr, "mandelbrot: memory exhausted\n");
+            exit(EXIT_FAILURE);
+        }
+
+        chargeCpuMemoryAccount(mbrot->account,
+                               2 * mbrot->referenceCapacity * sizeof(double),
+                               2);
+    }
+
+    //---------------------------------------------------------------------
+
+    mbrot->referenceI = mbrot->width / 2;
+    mbrot->referenceJ = mbrot->height / 2;
+
+    double dx = mbrot->coords.side / (mbrot->width - 1);
+    double dy = mbrot->coords.side / (mbrot->height - 1);
+
+    FIXED_T cx = mbrot->coords.x0;
+    FIXED_T cy = mbrot->coords.y0;
+
+    addDoubleFixed(&cx, dx * mbrot->referenceI);
+    addDoubleFixed(&cy, dy * mbrot->referenceJ);
+
+    FIXED_T x;
+    FIXED_T y;
+
+    setDoubleFixed(&x, 0.0);
+    setDoubleFixed(&y, 0.0);
+
+    mbrot->referenceX[0] = 0.0;
+    mbrot->referenceY[0] = 0.0;
+    mbrot->referenceLength = 1;
+
+    int32_t n;
+    for (n = 0 ; n < mbrot->maxIterations ; n++)
+    {
+        FIXED_T x2;
+        FIXED_T y2;
+        FIXED_T xy;
+
+        multiplyFixed(&x2, &x, &x);
+        multiplyFixed(&y2, &y, &y);
+        multiplyFixed(&xy, &x, &y);
+
+        subtractFixed(&x, &x2, &y2);
+        addFixed(&x, &x, &cx);
+        addFixed(&y, &xy, &xy);
+        addFixed(&y, &y, &cy);
+
+        double zx = getDoubleFixed(&x);
+        double zy = getDoubleFixed(&y);
+
+        mbrot->referenceX[mbrot->referenceLength] = zx;
+        mbrot->referenceY[mbrot->referenceLength] = zy;
+        ++(mbrot->referenceLength);
+
+        if ((zx * zx) + (zy * zy) > 4.0)
+        {
+            break;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+setRenderSizeMandelbrot(
+    MANDELBROT_T *mbrot,
+    int32_t width,
+    int32_t height)
+{
+    if ((width == mbrot->width) && (height == mbrot->height))
+    {
+        return;
+    }
+
+    // A finished image at another size has nothing to give a pan.
+
+    cancelMandelbrotImage(mbrot);
+
+    mbrot->width = width;
+    mbrot->height = height;
+    mbrot->complete = false;
+
+    setSourceSizeImageLayer(mbrot->imageLayer, width, height);
+}
+
+//-------------------------------------------------------------------------
+
+void
+startMandelbrotImage(
+    MANDELBROT_T *mbrot,
+    MANDELBROT_COORDS_T *coords)
+{
+    cancelMandelbrotImage(mbrot);
+
+    IMAGE_T *image = &(mbrot->imageLayer->image);
+
+    int32_t width = mbrot->width;
+    int32_t height = mbrot->height;
+
+    double dx = coords->side / (width - 1);
+    double dy = coords->side / (height - 1);
+
+    mbrot->numberOfRegions = 0;
+
+    //---------------------------------------------------------------------
+    // If the previous image is finished and this is a pan by a whole
+    // number of pixels, keep the overlap and only render what is new.
+
+    bool reused = false;
+
+    if (mbrot->complete && (coords->side == mbrot->coords.side))
+    {
+        FIXED_T panFixedX;
+        FIXED_T panFixedY;
+
+        subtractFixed(&panFixedX, &(coords->x0), &(mbrot->coords.x0));
+        subtractFixed(&panFixedY, &(coords->y0), &(mbrot->coords.y0));
+
+        double panX = getDoubleFixed(&panFixedX) / dx;
+        double panY = getDoubleFixed(&panFixedY) / dy;
+
+        int32_t shiftX = lround(panX);
+        int32_t shiftY = lround(panY);
+
+        if ((fabs(panX - shiftX) < 1.0e-3) &&
+            (fabs(panY - shiftY) < 1.0e-3) &&
+            (abs(shiftX) < width) &&
+            (abs(shiftY) < height))
+        {
+            mandelbrotShift(image->buffer,
+                            image->pitch,
+                            image->bitsPerPixel / 8,
+                            width,
+                            height,
+                            shiftX,
+                            shiftY);
+
+            mandelbrotShift((uint8_t *)(mbrot->iterations),
+                            image->width * sizeof(MANDELBROT_ITERATION_T),
+                            sizeof(MANDELBROT_ITERATION_T),
+                            width,
+                            height,
+                            shiftX,
+                            shiftY);
+
+            int32_t keepStartX = (shiftX > 0) ? 0 : -shiftX;
+            int32_t keepEndX = width - ((shiftX > 0) ? shiftX : 0);
+            int32_t keepStartY = (shiftY > 0) ? 0 : -shiftY;
+            int32_t keepEndY = height - ((shiftY > 0) ? shiftY : 0);
+
+            mandelbrotSetRegion(mbrot,
+                                (shiftX > 0) ? keepEndX : 0,
+                                (shiftX > 0) ? width : keepStartX,
+                                0,
+                                height);
+
+            mandelbrotSetRegion(mbrot,
+                                keepStartX,
+                                keepEndX,
+                                (shiftY > 0) ? keepEndY : 0,
+                                (shiftY > 0) ? height : keepStartY);
+
+            reused = true;
+        }
+    }
+
+    if (reused == false)
+    {
+        mandelbrotSetRegion(mbrot, 0, width, 0, height);
+    }
+
+    memcpy(&(mbrot->coords), coords, sizeof(MANDELBROT_COORDS_T));
+
+    //---------------------------------------------------------------------
+
+    mbrot->x0 = getDoubleFixed(&(coords->x0));
+    mbrot->y0 = getDoubleFixed(&(coords->y0));
+
+    double magnitude = fmax(fmax(fabs(mbrot->x0),
+                                 fabs(mbrot->x0 + coords->side)),
+                            fmax(fabs(mbrot->y0),
+                                 fabs(mbrot->y0 + coords->side)));
+
+    mbrot->useFloat = (dx > (MANDELBROT_FLOAT_STEP_FACTOR * magnitude));
+    mbrot->usePerturbation =
+        (dx < (MANDELBROT_DOUBLE_STEP_FACTOR * magnitude));
+
+    mbrot->maxIterations = mandelbrotMaxIterations(mbrot, coords->side);
+    mbrot->continueFrom = 0;
+
+    if (mbrot->usePerturbation)
+    {
+        mandelbrotReferenceOrbit(mbrot);
+    }
+
+    //---------------------------------------------------------------------
+
+    clock_gettime(CLOCK_MONOTONIC, &(mbrot->renderStart));
+
+    mbrot->complete = false;
+    mbrot->rendering = true;
+    mbrot->step = MANDELBROT_COARSE_STEP;
+
+    mandelbrotStartPass(mbrot);
+}
+
+//-------------------------------------------------------------------------
+
+bool
+updateMandelbrotImage(
+    MANDELBROT_T *mbrot)
+{
+    if ((mbrot->rendering == false) ||
+        (mandelbrotPassFinished(mbrot, false) == false))
+    {
+        return false;
+    }
+
+    changeSourceAndUpdateImageLayer(mbrot->imageLayer);
+
+    if (mbrot->step > 1)
+    {
+        mbrot->step = 1;
+        mandelbrotStartPass(mbrot);
+
+        return false;
+    }
+
+    //---------------------------------------------------------------------
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    mbrot->renderMicroseconds =
+        ((end.tv_sec - mbrot->renderStart.tv_sec) * 1000000LL) +
+        ((end.tv_nsec - mbrot->renderStart.tv_nsec) / 1000);
+
+    mbrot->rendering = false;
+    mbrot->complete = true;
+    mbrot->continueFrom = 0;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void
+cancelMandelbrotImage(
+    MANDELBROT_T *mbrot)
+{
+    if (mbrot->rendering)
+    {
+        mbrot->cancel = true;
+        mandelbrotPassFinished(mbrot, true);
+
+        mbrot->rendering = false;
+        mbrot->complete = false;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+mandelbrotColourRows(
+    void *arg,
+    int32_t start,
+    int32_t end)
+{
+    MANDELBROT_T *mbrot = arg;
+    IMAGE_T *image = &(mbrot->imageLayer->image);
+    IMAGE_PIXEL_FORMAT_T format = imagePixelFormat(image);
+
+    int32_t j;
+    for (j = start ; j < end ; j++)
+    {
+        uint8_t *line = imagePixelRow(image, j);
+        const MANDELBROT_ITERATION_T *row =
+            &(mbrot->iterations[j * image->width]);
+
+        int32_t i;
+        for (i = 0 ; i < mbrot->width ; i++)
+        {
+            imagePixelPut(format,
+                          image,
+                          line,
+                          i,
+                          j,
+                          mandelbrotColour(mbrot, &(row[i])));
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+mandelbrotColourImage(
+    MANDELBROT_T *mbrot)
+{
+    if (mbrot->complete)
+    {
+        forThreadPool(mbrot->pool,
+                      mbrot->height,
+                      16,
+                      mandelbrotColourRows,
+                      mbrot);
+
+        changeSourceAndUpdateImageLayer(mbrot->imageLayer);
+    }
+    else if (mbrot->rendering)
+    {
+        MANDELBROT_COORDS_T coords = mbrot->coords;
+        startMandelbrotImage(mbrot, &coords);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+void
+setColoursMandelbrot(
+    MANDELBROT_T *mbrot,
+    const RGBA8_T *colours,
+    size_t numberOfColours)
+{
+    size_t maxColours = sizeof(mbrot->colours) / sizeof(mbrot->colours[0]);
+
+    if (numberOfColours > maxColours)
+    {
+        numberOfColours = maxColours;
+    }
+
+    memcpy(mbrot->colours, colours, numberOfColours * sizeof(RGBA8_T));
+    mbrot->numberOfColours = numberOfColours;
+
+    mandelbrotBuildLookup(mbrot);
+    mandelbrotColourImage(mbrot);
+}
+
+//-------------------------------------------------------------------------
+
+void
+setColourOffsetMandelbrot(
+    MANDELBROT_T *mbrot,
+    int32_t offset)
+{
+    mbrot->colourOffset = offset;
+
+    mandelbrotBuildLookup(mbrot);
+    mandelbrotColourImage(mbrot);
+}
+
+//-------------------------------------------------------------------------
+
+void
+setSmoothMandelbrot(
+    MANDELBROT_T *mbrot,
+    bool smooth)
+{
+    mbrot->smooth = smooth;
+
+    mandelbrotColourImage(mbrot);
+}
+
+//-------------------------------------------------------------------------
+
+void
+changeIterationsMandelbrot(
+    MANDELBROT_T *mbrot,
+    int32_t rounds)
+{
+    int32_t previous = mbrot->maxIterations;
+
+    mbrot->extraRounds += rounds;
+
+    int32_t maxIterations = mandelbrotMaxIterations(mbrot, mbrot->coords.side);
+
+    if (maxIterations == previous)
+    {
+        mbrot->extraRounds -= rounds;
+        return;
+    }
+
+    if (mbrot->complete == false)
+    {
+        mandelbrotColourImage(mbrot);
+        return;
+    }
+
+    mbrot->maxIterations = maxIterations;
+
+    if (maxIterations < previous)
+    {
+        mandelbrotColourImage(mbrot);
+        return;
+    }
+
+    //---------------------------------------------------------------------
+    // Everything that escaped before the old limit keeps its count.
+
+    if (mbrot->usePerturbation)
+    {
+        mandelbrotReferenceOrbit(mbrot);
+    }
+
+    mbrot->continueFrom = previous;
+    mbrot->numberOfRegions = 0;
+    mandelbrotSetRegion(mbrot, 0, mbrot->width, 0, mbrot->height);
+
+    clock_gettime(CLOCK_MONOTONIC, &(mbrot->renderStart));
+
+    mbrot->complete = false;
+    mbrot->rendering = true;
+    mbrot->step = 1;
+
+    mandelbrotStartPass(mbrot);
+}
+
+//-------------------------------------------------------------------------
+
+void
+mandelbrotImage(
+    MANDELBROT_T *mbrot,
+    MANDELBROT_COORDS_T *coords)
+{
+    startMandelbrotImage(mbrot, coords);
+
+    do
+    {
+        mandelbrotPassFinished(mbrot, true);
+    }
+    while (updateMandelbrotImage(mbrot) == false);
+}
@@ -28,68 +28,266 @@
 #ifndef MANDELBROT_H
 #define MANDELBROT_H
 
-#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
+#include "fixed.h"
 #include "imageLayer.h"
+#include "memoryAccount.h"
+#include "threadPool.h"
 
 //-------------------------------------------------------------------------
 
-#define MANDELBROT_MAX_THREADS 4
+#define MANDELBROT_TILE_SIZE 32
+#define MANDELBROT_COARSE_STEP 8
+#define MANDELBROT_MAX_REGIONS 2
+
+// Zooming stops here, well before the fixed point coordinates run out of
+// bits to tell neighbouring pixels apart.
+
+#define MANDELBROT_MINIMUM_SIDE 1.0e-50
+
+// The iteration limit goes up a round at a time as the zoom gets deeper,
+// and can be moved a round either way from there.
+
+#define MANDELBROT_ITERATIONS_PER_ROUND 256
+#define MANDELBROT_MAX_ITERATIONS 65535
+
+// Smooth colouring blends each colour into the next in this many steps,
+// as a power of two.
+
+#define MANDELBROT_SMOOTH_BITS 4
 
 //-------------------------------------------------------------------------
 
+typedef enum
+{
+    MANDELBROT_KERNEL_SCALAR,
+    MANDELBROT_KERNEL_VECTOR
+} MANDELBROT_KERNEL_T;
+
+//-------------------------------------------------------------------------
+
+// The corner is held in fixed point so that it can be placed more finely
+// than a double allows. The side only ever needs relative precision.
+
 typedef struct
 {
-    double x0;
-    double y0;
+    FIXED_T x0;
+    FIXED_T y0;
     double side;
 } MANDELBROT_COORDS_T;
 
 //-------------------------------------------------------------------------
 
+// How many iterations a pixel took to escape, and how far (in 1/65536ths)
+// it had got towards escaping at the next.
+
 typedef struct
 {
-    int32_t startHeight;
-    int32_t endHeight;
-} MANDELBROT_HEIGHT_RANGE_T;
+    uint16_t count;
+    uint16_t fraction;
+} MANDELBROT_ITERATION_T;
 
 //-------------------------------------------------------------------------
 
+typedef struct
+{
+    int32_t startX;
+    int32_t endX;
+    int32_t startY;
+    int32_t endY;
+} MANDELBROT_TILE_T;
+
+//-------------------------------------------------------------------------
+
+// Only the top left width x height of the image is rendered, and the
+// display scales it up to fill the layer.
+
 typedef struct
 {
     MANDELBROT_COORDS_T coords;
     IMAGE_LAYER_T *imageLayer;
+    int32_t width;
+    int32_t height;
 
     RGBA8_T colours[256];
     size_t numberOfColours;
 
+    // Every colour blended towards the next, and looked up by iteration
+    // count and the top bits of the fraction.
+
+    RGBA8_T lookup[256 << MANDELBROT_SMOOTH_BITS];
+    int32_t colourOffset;
+    bool smooth;
+
+    // The iterations of each pixel of the last render, so that it can be
+    // coloured again without iterating. Pixels at the limit when it is
+    // raised are the only ones iterated again, from continueFrom.
+
+    MANDELBROT_ITERATION_T *iterations;
+    int32_t continueFrom;
+    int32_t extraRounds;
+
+    MANDELBROT_KERNEL_T kernel;
+    bool useFloat;
+    bool usePerturbation;
+    int32_t maxIterations;
+    int64_t renderMicroseconds;
+
+    // The corner as a double, for the kernels that work from it.
+
+    double x0;
+    double y0;
+
+    // Once a double cannot separate neighbouring pixels, every pixel is
+    // iterated as an offset from the orbit of a single reference pixel,
+    // which is computed in fixed point.
+
+    double *referenceX;
+    double *referenceY;
+    int32_t referenceLength;
+    int32_t referenceCapacity;
+    int32_t referenceI;
+    int32_t referenceJ;
+
+    MANDELBROT_TILE_T regions[MANDELBROT_MAX_REGIONS];
+    int32_t numberOfRegions;
+    int32_t step;
+    bool rendering;
+    bool complete;
+    struct timespec renderStart;
+
+    THREAD_POOL_T *pool;
     int32_t numberOfThreads;
-    pthread_t threads[MANDELBROT_MAX_THREADS];
-    MANDELBROT_HEIGHT_RANGE_T heightRange[MANDELBROT_MAX_THREADS];
-    pthread_barrier_t startBarrier;
-    pthread_barrier_t finishedBarrier;
+    MANDELBROT_TILE_T *tiles;
+    int32_t maxTiles;
+    int32_t numberOfTiles;
+    volatile bool cancel;
+
+    MEMORY_ACCOUNT_T *account;
 } MANDELBROT_T;
 
 //-------------------------------------------------------------------------
 
+void
+initMandelbrotCoords(
+    MANDELBROT_COORDS_T *coords,
+    double x0,
+    double y0,
+    double side);
+
+// Move the corner by (dx, dy), which is exact however deep the zoom.
+
+void
+moveMandelbrotCoords(
+    MANDELBROT_COORDS_T *coords,
+    double dx,
+    double dy);
+
+//-------------------------------------------------------------------------
+
 void
 newMandelbrot(
     MANDELBROT_T *mbrot,
     IMAGE_LAYER_T *imageLayer);
+
 void
 destroyMandelbrot(
     MANDELBROT_T *mbrot);
 
-void *
-workerMandelbrot(
-    void *arg);
-
 void
 mandelbrotImageKernel(
     MANDELBROT_T *mbrot,
-    int32_t startHeight,
-    int32_t endHeight);
+    const MANDELBROT_TILE_T *tile);
+
+void
+mandelbrotImageKernelScalar(
+    MANDELBROT_T *mbrot,
+    const MANDELBROT_TILE_T *tile);
+
+void
+mandelbrotImageKernelVectorFloat(
+    MANDELBROT_T *mbrot,
+    const MANDELBROT_TILE_T *tile);
+
+void
+mandelbrotImageKernelVectorDouble(
+    MANDELBROT_T *mbrot,
+    const MANDELBROT_TILE_T *tile);
+
+void
+mandelbrotImageKernelPerturbation(
+    MANDELBROT_T *mbrot,
+    const MANDELBROT_TILE_T *tile);
+
+const char *
+mandelbrotKernelName(
+    MANDELBROT_T *mbrot);
+
+void
+setKernelMandelbrot(
+    MANDELBROT_T *mbrot,
+    MANDELBROT_KERNEL_T kernel);
+
+// Colouring changes are applied straight to a finished image, from the
+// iterations it has kept. An image still being rendered is started again.
+
+void
+setColoursMandelbrot(
+    MANDELBROT_T *mbrot,
+    const RGBA8_T *colours,
+    size_t numberOfColours);
+
+void
+setColourOffsetMandelbrot(
+    MANDELBROT_T *mbrot,
+    int32_t offset);
+
+void
+setSmoothMandelbrot(
+    MANDELBROT_T *mbrot,
+    bool smooth);
+
+// Raise or lower the iteration limit by a number of rounds. Lowering it
+// only colours the pixels again, and raising it iterates just those that
+// had reached the old limit.
+
+void
+changeIterationsMandelbrot(
+    MANDELBROT_T *mbrot,
+    int32_t rounds);
+
+// Render at width x height, no larger than the image, from the next
+// startMandelbrotImage() on. Cancels any render in progress.
+
+void
+setRenderSizeMandelbrot(
+    MANDELBROT_T *mbrot,
+    int32_t width,
+    int32_t height);
+
+// Start rendering coords in the background. A coarse pass is shown
+// first and then refined. Any render already in progress is cancelled,
+// and if coords is a whole pixel pan of a finished image only the newly
+// exposed part is computed.
+
+void
+startMandelbrotImage(
+    MANDELBROT_T *mbrot,
+    MANDELBROT_COORDS_T *coords);
+
+// Call regularly while rendering. Pushes each finished pass to the
+// image layer and returns true once the render is complete.
+
+bool
+updateMandelbrotImage(
+    MANDELBROT_T *mbrot);
+
+void
+cancelMandelbrotImage(
+    MANDELBROT_T *mbrot);
 
 void
 mandelbrotImage(
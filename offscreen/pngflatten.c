@@ -0,0 +1,235 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compositor.h"
+#include "image.h"
+#include "imageLayer.h"
+#include "loadpng.h"
+#include "savepng.h"
+
+#include "bcm_host.h"
+
+//-------------------------------------------------------------------------
+
+#define NDEBUG
+
+#ifndef ALIGN_TO_16
+#define ALIGN_TO_16(x)  ((x + 15) & ~15)
+#endif
+
+//-------------------------------------------------------------------------
+
+const char *program = NULL;
+
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    IMAGE_LAYER_T layer;
+    int32_t x;
+    int32_t y;
+} PNGFLATTEN_INPUT_T;
+
+//-------------------------------------------------------------------------
+
+void usage(void)
+{
+    fprintf(stderr,
+            "Usage: %s [-o <out.png>] <in.png>[@<x>,<y>] ...\n",
+            program);
+    fprintf(stderr, "    -o - write to out.png (default flat.png)\n");
+    fprintf(stderr, "    Each png is drawn over the ones before it, ");
+    fprintf(stderr, "with its top\n    left corner at (x, y).\n");
+
+    exit(EXIT_FAILURE);
+}
+
+//-------------------------------------------------------------------------
+
+// Split "path@x,y" into the path and the offset, which defaults to (0, 0).
+// The argument is left alone if what follows the @ is not an offset.
+
+static void
+parseInput(
+    char *argument,
+    PNGFLATTEN_INPUT_T *input)
+{
+    input->x = 0;
+    input->y = 0;
+
+    char *at = strrchr(argument, '@');
+
+    if (at != NULL)
+    {
+        int x = 0;
+        int y = 0;
+        int length = 0;
+
+        if ((sscanf(at + 1, "%d,%d%n", &x, &y, &length) == 2) &&
+            (at[1 + length] == '\0') &&
+            (x >= 0) &&
+            (y >= 0))
+        {
+            *at = '\0';
+            input->x = x;
+            input->y = y;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    program = basename(argv[0]);
+
+    const char *outputPath = "flat.png";
+
+    //---------------------------------------------------------------------
+
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'o':
+
+            outputPath = optarg;
+            break;
+
+        default:
+
+            usage();
+            break;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage();
+    }
+
+    //---------------------------------------------------------------------
+
+    bcm_host_init();
+
+    int32_t numberOfInputs = argc - optind;
+    PNGFLATTEN_INPUT_T *inputs = calloc(numberOfInputs,
+                                        sizeof(PNGFLATTEN_INPUT_T));
+
+    if (inputs == NULL)
+    {
+        fprintf(stderr, "%s: memory exhausted\n", program);
+        exit(EXIT_FAILURE);
+    }
+
+    int32_t width = 0;
+    int32_t height = 0;
+
+    int32_t i;
+    for (i = 0 ; i < numberOfInputs ; i++)
+    {
+        PNGFLATTEN_INPUT_T *input = &(inputs[i]);
+        char *path = argv[optind + i];
+
+        parseInput(path, input);
+
+        if (loadPng(&(input->layer.image), path) == false)
+        {
+            fprintf(stderr, "%s: unable to load %s\n", program, path);
+            exit(EXIT_FAILURE);
+        }
+
+        createResourceImageLayer(&(input->layer), i);
+
+        if (input->x + input->layer.image.width > width)
+        {
+            width = input->x + input->layer.image.width;
+        }
+
+        if (input->y + input->layer.image.height > height)
+        {
+            height = input->y + input->layer.image.height;
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    // All of the pngs are drawn in one go, and read back once.
+
+    COMPOSITOR_T compositor;
+    initCompositor(&compositor, VC_IMAGE_RGBA32, ALIGN_TO_16(width), height);
+
+    for (i = 0 ; i < numberOfInputs ; i++)
+    {
+        addImageLayerCompositor(&compositor,
+                                &(inputs[i].layer),
+                                inputs[i].x,
+                                inputs[i].y);
+    }
+
+    composeCompositor(&compositor);
+
+    IMAGE_T *flat = readCompositor(&compositor);
+
+    // Only the part covered by the pngs is written, not the padding.
+
+    int32_t alignedWidth = flat->width;
+    flat->width = width;
+
+    bool saved = savePng(flat, outputPath);
+
+    flat->width = alignedWidth;
+
+    if (saved == false)
+    {
+        fprintf(stderr, "%s: unable to write %s\n", program, outputPath);
+    }
+
+    //---------------------------------------------------------------------
+
+    destroyCompositor(&compositor);
+
+    for (i = 0 ; i < numberOfInputs ; i++)
+    {
+        destroyImageLayer(&(inputs[i].layer));
+    }
+
+    free(inputs);
+
+    return (saved) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
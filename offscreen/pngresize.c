@@ -28,11 +28,15 @@
 #define _GNU_SOURCE
 
 #include <assert.h>
+#include <dirent.h>
+#include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "image.h"
 #include "loadpng.h"
@@ -51,31 +55,355 @@ const char *program = NULL;
 
 //-------------------------------------------------------------------------
 
+// The most pngs that are written in the background at once.
+
+#define PNGRESIZE_MAX_SAVES 4
+
+//-------------------------------------------------------------------------
+
+// In batch mode the GPU scales one image while the next is decoded and
+// uploaded, and the pngs that have been scaled are written on other
+// threads. The resize state is kept until an image of a different size
+// or type comes along.
+
+typedef struct
+{
+    const char *outputDirectory;
+    int16_t width;
+    int16_t height;
+    bool initialised;
+    RESIZE_DISPMANX_T resize;
+    IMAGE_T dstImage;
+    bool pending;
+    char *pendingPath;
+    SAVE_PNG_ASYNC_T *saves[PNGRESIZE_MAX_SAVES];
+    int32_t nextSave;
+    int32_t failures;
+} BATCH_T;
+
+//-------------------------------------------------------------------------
+
 void usage(void)
 {
     fprintf(stderr,
             "Usage: %s -w <width> -h <height> <in.png> <out.png>\n",
             program);
+    fprintf(stderr,
+            "       %s -w <width> -h <height> -o <directory> <in> ...\n",
+            program);
     fprintf(stderr, "    -w - resize to width\n");
     fprintf(stderr, "    -h - resize to height\n");
+    fprintf(stderr, "    -o - resize each <in> into <directory>, where\n");
+    fprintf(stderr, "         <in> is a png, a directory of pngs, or -\n");
+    fprintf(stderr, "         to read a list of pngs from stdin\n");
 
     exit(EXIT_FAILURE);
 }
 
 //-------------------------------------------------------------------------
 
+static void
+waitForSave(
+    BATCH_T *batch,
+    int32_t index)
+{
+    SAVE_PNG_ASYNC_T *save = batch->saves[index];
+
+    if (save != NULL)
+    {
+        char *file = strdup(save->file);
+
+        if (waitForSavePng(save) == false)
+        {
+            fprintf(stderr, "%s: unable to save %s\n", program, file);
+            ++(batch->failures);
+        }
+
+        free(file);
+        batch->saves[index] = NULL;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+saveImage(
+    BATCH_T *batch,
+    const IMAGE_T *image,
+    const char *path)
+{
+    waitForSave(batch, batch->nextSave);
+
+    batch->saves[batch->nextSave] = savePngAsync(image, path);
+    batch->nextSave = (batch->nextSave + 1) % PNGRESIZE_MAX_SAVES;
+}
+
+//-------------------------------------------------------------------------
+
+static void
+finishPending(
+    BATCH_T *batch)
+{
+    if (batch->pending)
+    {
+        finishResizeDispmanX(&(batch->resize), &(batch->dstImage));
+        saveImage(batch, &(batch->dstImage), batch->pendingPath);
+
+        free(batch->pendingPath);
+        batch->pendingPath = NULL;
+        batch->pending = false;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static void
+resizeFile(
+    BATCH_T *batch,
+    const char *path)
+{
+    // basename() may modify its argument.
+
+    char *namePath = strdup(path);
+    char *outputPath = NULL;
+
+    if ((namePath == NULL) ||
+        (asprintf(&outputPath,
+                  "%s/%s",
+                  batch->outputDirectory,
+                  basename(namePath)) == -1))
+    {
+        fprintf(stderr, "%s: memory exhausted\n", program);
+        exit(EXIT_FAILURE);
+    }
+
+    free(namePath);
+
+    // Never write over the input.
+
+    struct stat in;
+    struct stat out;
+
+    if ((stat(path, &in) == 0) &&
+        (stat(outputPath, &out) == 0) &&
+        (in.st_dev == out.st_dev) &&
+        (in.st_ino == out.st_ino))
+    {
+        fprintf(stderr,
+                "%s: %s would overwrite %s\n",
+                program,
+                outputPath,
+                path);
+        ++(batch->failures);
+        free(outputPath);
+        return;
+    }
+
+    //---------------------------------------------------------------------
+
+    IMAGE_T srcImage;
+
+    if (loadPng(&srcImage, path) == false)
+    {
+        fprintf(stderr, "%s: unable to load %s\n", program, path);
+        ++(batch->failures);
+        free(outputPath);
+        return;
+    }
+
+    if ((batch->initialised == false) ||
+        (srcImage.type != batch->resize.type) ||
+        (srcImage.width != batch->resize.sourceWidth) ||
+        (srcImage.height != batch->resize.sourceHeight))
+    {
+        finishPending(batch);
+
+        if (batch->initialised)
+        {
+            destroyResizeDispmanX(&(batch->resize));
+            destroyImage(&(batch->dstImage));
+        }
+
+        initResizeDispmanX(&(batch->resize),
+                           srcImage.type,
+                           batch->width,
+                           batch->height,
+                           srcImage.width,
+                           srcImage.height,
+                           true);
+
+        initImage(&(batch->dstImage),
+                  srcImage.type,
+                  batch->resize.destinationWidth,
+                  batch->resize.destinationHeight,
+                  false);
+
+        batch->initialised = true;
+    }
+
+    // Upload into the spare source resource while the last image is
+    // still being scaled, then collect that one and start on this.
+
+    uploadResizeDispmanX(&(batch->resize), &srcImage);
+    destroyImage(&srcImage);
+
+    finishPending(batch);
+
+    startResizeDispmanX(&(batch->resize));
+    batch->pending = true;
+    batch->pendingPath = outputPath;
+}
+
+//-------------------------------------------------------------------------
+
+static int
+isPngFile(
+    const struct dirent *entry)
+{
+    size_t length = strlen(entry->d_name);
+
+    return (length > 4) &&
+           (strcasecmp(entry->d_name + length - 4, ".png") == 0);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+resizeDirectory(
+    BATCH_T *batch,
+    const char *directory)
+{
+    struct dirent **entries = NULL;
+    int numberOfEntries = scandir(directory, &entries, isPngFile, alphasort);
+
+    if (numberOfEntries == -1)
+    {
+        perror(directory);
+        ++(batch->failures);
+        return;
+    }
+
+    int i;
+    for (i = 0 ; i < numberOfEntries ; i++)
+    {
+        char *path = NULL;
+
+        if (asprintf(&path, "%s/%s", directory, entries[i]->d_name) == -1)
+        {
+            fprintf(stderr, "%s: memory exhausted\n", program);
+            exit(EXIT_FAILURE);
+        }
+
+        resizeFile(batch, path);
+
+        free(path);
+        free(entries[i]);
+    }
+
+    free(entries);
+}
+
+//-------------------------------------------------------------------------
+
+static void
+resizeList(
+    BATCH_T *batch,
+    FILE *list)
+{
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length = 0;
+
+    while ((length = getline(&line, &size, list)) != -1)
+    {
+        while ((length > 0) &&
+               ((line[length - 1] == '\n') || (line[length - 1] == '\r')))
+        {
+            line[--length] = '\0';
+        }
+
+        if (length > 0)
+        {
+            resizeFile(batch, line);
+        }
+    }
+
+    free(line);
+}
+
+//-------------------------------------------------------------------------
+
+static int
+resizeBatch(
+    const char *outputDirectory,
+    int16_t width,
+    int16_t height,
+    int numberOfInputs,
+    char *inputs[])
+{
+    if ((mkdir(outputDirectory, 0777) == -1) && (errno != EEXIST))
+    {
+        perror(outputDirectory);
+        return EXIT_FAILURE;
+    }
+
+    BATCH_T batch;
+    memset(&batch, 0, sizeof(batch));
+
+    batch.outputDirectory = outputDirectory;
+    batch.width = width;
+    batch.height = height;
+
+    int i;
+    for (i = 0 ; i < numberOfInputs ; i++)
+    {
+        struct stat info;
+
+        if (strcmp(inputs[i], "-") == 0)
+        {
+            resizeList(&batch, stdin);
+        }
+        else if ((stat(inputs[i], &info) == 0) && S_ISDIR(info.st_mode))
+        {
+            resizeDirectory(&batch, inputs[i]);
+        }
+        else
+        {
+            resizeFile(&batch, inputs[i]);
+        }
+    }
+
+    finishPending(&batch);
+
+    for (i = 0 ; i < PNGRESIZE_MAX_SAVES ; i++)
+    {
+        waitForSave(&batch, i);
+    }
+
+    if (batch.initialised)
+    {
+        destroyResizeDispmanX(&(batch.resize));
+        destroyImage(&(batch.dstImage));
+    }
+
+    return (batch.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//-------------------------------------------------------------------------
+
 int main(int argc, char *argv[])
 {
     program = basename(argv[0]);
 
     int16_t width = 0;
     int16_t height = 0;
+    const char *outputDirectory = NULL;
 
     //---------------------------------------------------------------------
 
     int opt = 0;
 
-    while ((opt = getopt(argc, argv, "w:h:")) != -1)
+    while ((opt = getopt(argc, argv, "w:h:o:")) != -1)
     {
         switch(opt)
         {
@@ -89,6 +417,11 @@ int main(int argc, char *argv[])
             height = atoi(optarg);
             break;
 
+        case 'o':
+
+            outputDirectory = optarg;
+            break;
+
         default:
 
             usage();
@@ -108,7 +441,8 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
-    if (optind >= argc)
+    if ((optind >= argc) ||
+        ((outputDirectory == NULL) && (optind + 1 >= argc)))
     {
         usage();
     }
@@ -117,6 +451,15 @@ int main(int argc, char *argv[])
 
     bcm_host_init();
 
+    if (outputDirectory != NULL)
+    {
+        return resizeBatch(outputDirectory,
+                           width,
+                           height,
+                           argc - optind,
+                           argv + optind);
+    }
+
     //---------------------------------------------------------------------
 
     IMAGE_T srcImage;
@@ -27,6 +27,8 @@
 
 #define _GNU_SOURCE
 
+#include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -35,6 +37,7 @@
 #include "bcm_host.h"
 
 #include "resizeDispmanX.h"
+#include "resourcePool.h"
 
 //-------------------------------------------------------------------------
 
@@ -85,19 +88,17 @@ initResizeDispmanX(
 
     rd->type = type;
 
-    uint32_t dstImageHandle;
+    // A batch of images of one size reuses the same resources, and so
+    // does the next batch of that size.
 
-    rd->dstRes = vc_dispmanx_resource_create(rd->type,
-                                             rd->destinationWidth,
-                                             rd->destinationHeight,
-                                             &dstImageHandle);
+    rd->dstRes = acquireResourcePool(rd->type,
+                                     rd->destinationWidth,
+                                     rd->destinationHeight,
+                                     0,
+                                     0);
 
-    uint32_t srcImageHandle;
-
-    rd->srcRes = vc_dispmanx_resource_create(rd->type,
-                                             sWidth,
-                                             sHeight,
-                                             &srcImageHandle);
+    rd->srcRes = acquireResourcePool(rd->type, sWidth, sHeight, 0, 0);
+    rd->nextSrcRes = acquireResourcePool(rd->type, sWidth, sHeight, 0, 0);
 
     rd->display = vc_dispmanx_display_open_offscreen(rd->dstRes,
                                                      DISPMANX_NO_ROTATE);
@@ -110,6 +111,14 @@ initResizeDispmanX(
                          0,
                          rd->destinationWidth,
                          rd->destinationHeight);
+
+    // The element is added by the first resize, then kept.
+
+    rd->element = 0;
+
+    pthread_mutex_init(&(rd->mutex), NULL);
+    pthread_cond_init(&(rd->condition), NULL);
+    rd->updatePending = false;
 }
 
 //-------------------------------------------------------------------------
@@ -118,9 +127,31 @@ void
 destroyResizeDispmanX(
     RESIZE_DISPMANX_T *rd)
 {
+    if (rd->element != 0)
+    {
+        pthread_mutex_lock(&(rd->mutex));
+
+        while (rd->updatePending)
+        {
+            pthread_cond_wait(&(rd->condition), &(rd->mutex));
+        }
+
+        pthread_mutex_unlock(&(rd->mutex));
+
+        DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+        assert(update != 0);
+
+        vc_dispmanx_element_remove(update, rd->element);
+        vc_dispmanx_update_submit_sync(update);
+    }
+
     vc_dispmanx_display_close(rd->display);
-    vc_dispmanx_resource_delete(rd->srcRes);
-    vc_dispmanx_resource_delete(rd->dstRes);
+    releaseResourcePool(rd->srcRes);
+    releaseResourcePool(rd->nextSrcRes);
+    releaseResourcePool(rd->dstRes);
+
+    pthread_cond_destroy(&(rd->condition));
+    pthread_mutex_destroy(&(rd->mutex));
 }
 
 //-------------------------------------------------------------------------
@@ -131,42 +162,107 @@ resizeDispmanX(
     IMAGE_T *dst,
     IMAGE_T *src)
 {
-    vc_dispmanx_resource_write_data(rd->srcRes,
+    uploadResizeDispmanX(rd, src);
+    startResizeDispmanX(rd);
+    finishResizeDispmanX(rd, dst);
+}
+
+//-------------------------------------------------------------------------
+
+void
+uploadResizeDispmanX(
+    RESIZE_DISPMANX_T *rd,
+    IMAGE_T *src)
+{
+    vc_dispmanx_resource_write_data(rd->nextSrcRes,
                                     rd->type,
                                     src->pitch,
                                     src->buffer,
                                     &(rd->bmpRect));
+}
 
-    VC_DISPMANX_ALPHA_T alpha;
+//-------------------------------------------------------------------------
 
-    alpha.mask = DISPMANX_NO_HANDLE;
-    alpha.flags = DISPMANX_FLAGS_ALPHA_FROM_SOURCE
-                | DISPMANX_FLAGS_ALPHA_MIX;
-    alpha.opacity = 255;
+static void
+updateCallbackResizeDispmanX(
+    DISPMANX_UPDATE_HANDLE_T update,
+    void *arg)
+{
+    RESIZE_DISPMANX_T *rd = arg;
+
+    pthread_mutex_lock(&(rd->mutex));
+    rd->updatePending = false;
+    pthread_cond_signal(&(rd->condition));
+    pthread_mutex_unlock(&(rd->mutex));
+}
+
+//-------------------------------------------------------------------------
+
+void
+startResizeDispmanX(
+    RESIZE_DISPMANX_T *rd)
+{
+    DISPMANX_RESOURCE_HANDLE_T resource = rd->nextSrcRes;
+    rd->nextSrcRes = rd->srcRes;
+    rd->srcRes = resource;
 
     DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    assert(update != 0);
 
-    DISPMANX_ELEMENT_HANDLE_T element;
-    element = vc_dispmanx_element_add(update,
-                                      rd->display,
-                                      0,
-                                      &(rd->dstRect),
-                                      rd->srcRes,
-                                      &(rd->srcRect),
-                                      DISPMANX_PROTECTION_NONE,
-                                      &alpha,
-                                      NULL,
-                                      DISPMANX_NO_ROTATE);
+    if (rd->element == 0)
+    {
+        VC_DISPMANX_ALPHA_T alpha;
+
+        alpha.mask = DISPMANX_NO_HANDLE;
+        alpha.flags = DISPMANX_FLAGS_ALPHA_FROM_SOURCE
+                    | DISPMANX_FLAGS_ALPHA_MIX;
+        alpha.opacity = 255;
+
+        rd->element = vc_dispmanx_element_add(update,
+                                              rd->display,
+                                              0,
+                                              &(rd->dstRect),
+                                              rd->srcRes,
+                                              &(rd->srcRect),
+                                              DISPMANX_PROTECTION_NONE,
+                                              &alpha,
+                                              NULL,
+                                              DISPMANX_NO_ROTATE);
+        assert(rd->element != 0);
+    }
+    else
+    {
+        vc_dispmanx_element_change_source(update, rd->element, rd->srcRes);
+    }
+
+    pthread_mutex_lock(&(rd->mutex));
+    assert(rd->updatePending == false);
+    rd->updatePending = true;
+    pthread_mutex_unlock(&(rd->mutex));
 
-    vc_dispmanx_update_submit_sync(update);
+    vc_dispmanx_update_submit(update, updateCallbackResizeDispmanX, rd);
+}
+
+//-------------------------------------------------------------------------
+
+void
+finishResizeDispmanX(
+    RESIZE_DISPMANX_T *rd,
+    IMAGE_T *dst)
+{
+    pthread_mutex_lock(&(rd->mutex));
+
+    while (rd->updatePending)
+    {
+        pthread_cond_wait(&(rd->condition), &(rd->mutex));
+    }
+
+    pthread_mutex_unlock(&(rd->mutex));
 
     vc_dispmanx_resource_read_data(rd->dstRes,
                                    &(rd->dstRect),
                                    dst->buffer,
                                    dst->pitch);
-
-    vc_dispmanx_element_remove(update, element);
 }
 
 //-------------------------------------------------------------------------
-
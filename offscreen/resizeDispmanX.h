@@ -30,6 +30,7 @@
 
 //-------------------------------------------------------------------------
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -39,6 +40,11 @@
 
 //-------------------------------------------------------------------------
 
+// The resources, the offscreen display and the element that scales one
+// onto the other are kept for as long as the images are all the same size
+// and type. There are two source resources, so the next image can be
+// uploaded while the GPU is still scaling the last one.
+
 typedef struct
 {
     int16_t destinationWidth;
@@ -50,10 +56,15 @@ typedef struct
     VC_IMAGE_TYPE_T type;
     DISPMANX_RESOURCE_HANDLE_T dstRes;
     DISPMANX_RESOURCE_HANDLE_T srcRes;
+    DISPMANX_RESOURCE_HANDLE_T nextSrcRes;
     DISPMANX_DISPLAY_HANDLE_T display;
+    DISPMANX_ELEMENT_HANDLE_T element;
     VC_RECT_T bmpRect;
     VC_RECT_T srcRect;
     VC_RECT_T dstRect;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    bool updatePending;
 } RESIZE_DISPMANX_T;
 
 //-------------------------------------------------------------------------
@@ -72,12 +83,37 @@ void
 destroyResizeDispmanX(
     RESIZE_DISPMANX_T *rd);
 
+// Resize src into dst and wait for the result. The same as calling the
+// three functions below in turn.
+
 void
 resizeDispmanX(
     RESIZE_DISPMANX_T *rd,
     IMAGE_T *dst,
     IMAGE_T *src);
 
+// Write src to the source resource that is not being scaled. This may be
+// called while the previous image is still being scaled.
+
+void
+uploadResizeDispmanX(
+    RESIZE_DISPMANX_T *rd,
+    IMAGE_T *src);
+
+// Start scaling the image that was uploaded last and return without
+// waiting. The previous resize must have been finished.
+
+void
+startResizeDispmanX(
+    RESIZE_DISPMANX_T *rd);
+
+// Wait for the image to be scaled and read it back into dst.
+
+void
+finishResizeDispmanX(
+    RESIZE_DISPMANX_T *rd,
+    IMAGE_T *dst);
+
 //-------------------------------------------------------------------------
 
 #endif
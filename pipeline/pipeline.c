@@ -0,0 +1,638 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <libgen.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "imageLayer.h"
+
+#include "bcm_host.h"
+
+//-------------------------------------------------------------------------
+
+#define NDEBUG
+
+#define PIPELINE_MAX_LAYERS 16
+#define PIPELINE_MAX_CHOICES 8
+
+// Each layer is offset from the one below it, so that they overlap but
+// can all be seen.
+
+#define PIPELINE_LAYER_OFFSET 24
+
+//-------------------------------------------------------------------------
+
+const char *program = NULL;
+
+volatile bool run = true;
+
+//-------------------------------------------------------------------------
+
+// The stages of a frame, each timed for every frame, and the whole frame
+// from the start of the fill to the return of the submit.
+
+typedef enum
+{
+    PIPELINE_FILL,
+    PIPELINE_WRITE,
+    PIPELINE_CHANGE,
+    PIPELINE_SUBMIT,
+    PIPELINE_FRAME,
+    PIPELINE_STAGES
+} PIPELINE_STAGE_T;
+
+static const char *stageNames[PIPELINE_STAGES] =
+{
+    "fill",
+    "write",
+    "change",
+    "submit",
+    "frame"
+};
+
+typedef struct
+{
+    int32_t width;
+    int32_t height;
+} PIPELINE_SIZE_T;
+
+typedef struct
+{
+    DISPMANX_DISPLAY_HANDLE_T display;
+    DISPMANX_MODEINFO_T info;
+    int32_t frames;
+    int32_t warmup;
+    int32_t *micros[PIPELINE_STAGES];
+} PIPELINE_T;
+
+//-------------------------------------------------------------------------
+
+static void
+signalHandler(
+    int signalNumber)
+{
+    switch (signalNumber)
+    {
+    case SIGINT:
+    case SIGTERM:
+
+        run = false;
+        break;
+    };
+}
+
+//-------------------------------------------------------------------------
+
+static int64_t
+nowMicros(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec * INT64_C(1000000)) + (now.tv_nsec / 1000);
+}
+
+//-------------------------------------------------------------------------
+
+static int
+compareMicros(
+    const void *a,
+    const void *b)
+{
+    int32_t left = *(const int32_t *)a;
+    int32_t right = *(const int32_t *)b;
+
+    return (left > right) - (left < right);
+}
+
+//-------------------------------------------------------------------------
+
+// The value below which percent of the sorted samples fall.
+
+static int32_t
+percentile(
+    const int32_t *sorted,
+    int32_t samples,
+    int32_t percent)
+{
+    return sorted[((samples - 1) * percent) / 100];
+}
+
+//-------------------------------------------------------------------------
+
+static void
+printHeader(
+    FILE *output)
+{
+    fprintf(output, "layers,type,width,height,frames,fps,mb_per_second");
+
+    int32_t s;
+    for (s = 0 ; s < PIPELINE_STAGES ; s++)
+    {
+        fprintf(output,
+                ",%s_p50_us,%s_p90_us,%s_p99_us,%s_max_us",
+                stageNames[s],
+                stageNames[s],
+                stageNames[s],
+                stageNames[s]);
+    }
+
+    fprintf(output, "\n");
+    fflush(output);
+}
+
+//-------------------------------------------------------------------------
+
+// Put numberOfLayers layers of the given type and size on the display and
+// time frames in which every layer is filled, written to its back
+// resource and swapped in, all in one update.
+
+static void
+runConfiguration(
+    FILE *output,
+    PIPELINE_T *pipeline,
+    int32_t numberOfLayers,
+    const IMAGE_TYPE_INFO_T *typeInfo,
+    const PIPELINE_SIZE_T *size)
+{
+    IMAGE_LAYER_T layers[PIPELINE_MAX_LAYERS];
+
+    int32_t i;
+    for (i = 0 ; i < numberOfLayers ; i++)
+    {
+        initImageLayer(&(layers[i]), size->width, size->height, typeInfo->type);
+        createDoubleBufferedResourceImageLayer(&(layers[i]), 1000 + i);
+    }
+
+    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    assert(update != 0);
+
+    for (i = 0 ; i < numberOfLayers ; i++)
+    {
+        int32_t offset = i * PIPELINE_LAYER_OFFSET;
+
+        addElementImageLayerOffset(&(layers[i]),
+                                   offset,
+                                   offset,
+                                   pipeline->display,
+                                   update);
+    }
+
+    int result = vc_dispmanx_update_submit_sync(update);
+    assert(result == 0);
+
+    //---------------------------------------------------------------------
+
+    int32_t totalFrames = pipeline->warmup + pipeline->frames;
+    int32_t recorded = 0;
+    int64_t firstFrame = 0;
+    int64_t lastFrame = 0;
+
+    int32_t frame;
+    for (frame = 0 ; (frame < totalFrames) && run ; frame++)
+    {
+        int32_t micros[PIPELINE_STAGES] = { 0 };
+        int64_t start = nowMicros();
+        int64_t stageStart = start;
+        int64_t now = 0;
+
+        // Draw something different each frame, so the display changes.
+
+        RGBA8_T rgb = { frame * 3, frame * 5, frame * 7, 0xFF };
+
+        for (i = 0 ; i < numberOfLayers ; i++)
+        {
+            if (typeInfo->isIndexed)
+            {
+                clearImageIndexed(&(layers[i].image), (frame + i) & 0x0F);
+            }
+            else
+            {
+                clearImageRGB(&(layers[i].image), &rgb);
+            }
+        }
+
+        now = nowMicros();
+        micros[PIPELINE_FILL] = now - stageStart;
+        stageStart = now;
+
+        for (i = 0 ; i < numberOfLayers ; i++)
+        {
+            writeRowsImageLayer(&(layers[i]),
+                                layers[i].image.buffer,
+                                0,
+                                layers[i].image.height);
+        }
+
+        now = nowMicros();
+        micros[PIPELINE_WRITE] = now - stageStart;
+        stageStart = now;
+
+        update = vc_dispmanx_update_start(0);
+        assert(update != 0);
+
+        for (i = 0 ; i < numberOfLayers ; i++)
+        {
+            swapResourceImageLayer(&(layers[i]), update);
+        }
+
+        now = nowMicros();
+        micros[PIPELINE_CHANGE] = now - stageStart;
+        stageStart = now;
+
+        result = vc_dispmanx_update_submit_sync(update);
+        assert(result == 0);
+
+        now = nowMicros();
+        micros[PIPELINE_SUBMIT] = now - stageStart;
+        micros[PIPELINE_FRAME] = now - start;
+
+        if (frame == pipeline->warmup)
+        {
+            firstFrame = start;
+        }
+
+        if (frame >= pipeline->warmup)
+        {
+            int32_t s;
+            for (s = 0 ; s < PIPELINE_STAGES ; s++)
+            {
+                pipeline->micros[s][recorded] = micros[s];
+            }
+
+            ++recorded;
+            lastFrame = now;
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    double bytesPerFrame = (double)numberOfLayers
+                         * size->height
+                         * layers[0].image.pitch;
+
+    update = vc_dispmanx_update_start(0);
+    assert(update != 0);
+
+    for (i = 0 ; i < numberOfLayers ; i++)
+    {
+        removeElementImageLayer(&(layers[i]), update);
+    }
+
+    result = vc_dispmanx_update_submit_sync(update);
+    assert(result == 0);
+
+    for (i = 0 ; i < numberOfLayers ; i++)
+    {
+        destroyImageLayer(&(layers[i]));
+    }
+
+    if (recorded == 0)
+    {
+        return;
+    }
+
+    //---------------------------------------------------------------------
+
+    double seconds = (lastFrame - firstFrame) / 1.0e6;
+    double fps = recorded / seconds;
+    double mbPerSecond = (bytesPerFrame * fps) / (1024.0 * 1024.0);
+
+    fprintf(output,
+            "%d,%s,%d,%d,%d,%.2f,%.1f",
+            numberOfLayers,
+            typeInfo->name,
+            size->width,
+            size->height,
+            recorded,
+            fps,
+            mbPerSecond);
+
+    int32_t s;
+    for (s = 0 ; s < PIPELINE_STAGES ; s++)
+    {
+        int32_t *sorted = pipeline->micros[s];
+        qsort(sorted, recorded, sizeof(int32_t), compareMicros);
+
+        fprintf(output,
+                ",%d,%d,%d,%d",
+                percentile(sorted, recorded, 50),
+                percentile(sorted, recorded, 90),
+                percentile(sorted, recorded, 99),
+                sorted[recorded - 1]);
+    }
+
+    fprintf(output, "\n");
+    fflush(output);
+}
+
+//-------------------------------------------------------------------------
+
+// Parse a comma separated list of at most PIPELINE_MAX_CHOICES numbers
+// between 1 and maximum. Returns the number of entries, or 0 on error.
+
+static int32_t
+parseNumbers(
+    const char *text,
+    int32_t *numbers,
+    int32_t maximum)
+{
+    int32_t count = 0;
+    char *end = NULL;
+
+    while ((count < PIPELINE_MAX_CHOICES) && (*text != '\0'))
+    {
+        long value = strtol(text, &end, 10);
+
+        if ((end == text) || (value < 1) || (value > maximum))
+        {
+            return 0;
+        }
+
+        numbers[count++] = value;
+
+        if (*end == ',')
+        {
+            ++end;
+        }
+        else if (*end != '\0')
+        {
+            return 0;
+        }
+
+        text = end;
+    }
+
+    return (*text == '\0') ? count : 0;
+}
+
+//-------------------------------------------------------------------------
+
+void usage(void)
+{
+    fprintf(stderr, "Usage: %s ", program);
+    fprintf(stderr, "[-d <number>] [-f <frames>] [-l <layers>] ");
+    fprintf(stderr, "[-o <file>] [-s <width>x<height>] [-t <type>]\n");
+    fprintf(stderr, "    -d - Raspberry Pi display number\n");
+    fprintf(stderr, "    -f - frames timed for each result (default 300)\n");
+    fprintf(stderr, "    -l - comma separated layer counts ");
+    fprintf(stderr, "(default 1,2,4,8)\n");
+    fprintf(stderr, "    -o - write results to a file instead of stdout\n");
+    fprintf(stderr, "    -s - layer size, may be repeated ");
+    fprintf(stderr, "(default 320x240, 640x480 and the display size)\n");
+    fprintf(stderr, "    -t - image type, may be repeated ");
+    fprintf(stderr, "(default RGB565, RGBA16 and RGBA32), one of:");
+    printImageTypes(stderr, " ", "", IMAGE_TYPES_ALL);
+    fprintf(stderr, "\n");
+
+    exit(EXIT_FAILURE);
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    int opt = 0;
+
+    uint32_t displayNumber = 0;
+    const char *outputPath = NULL;
+    int32_t frames = 300;
+    int32_t layerCounts[PIPELINE_MAX_CHOICES] = { 1, 2, 4, 8 };
+    int32_t numberOfLayerCounts = 4;
+    PIPELINE_SIZE_T sizes[PIPELINE_MAX_CHOICES];
+    int32_t numberOfSizes = 0;
+    IMAGE_TYPE_INFO_T types[PIPELINE_MAX_CHOICES];
+    int32_t numberOfTypes = 0;
+
+    program = basename(argv[0]);
+
+    //---------------------------------------------------------------------
+
+    while ((opt = getopt(argc, argv, "d:f:l:o:s:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+
+            displayNumber = strtol(optarg, NULL, 10);
+            break;
+
+        case 'f':
+
+            frames = strtol(optarg, NULL, 10);
+
+            if (frames < 1)
+            {
+                usage();
+            }
+
+            break;
+
+        case 'l':
+
+            numberOfLayerCounts = parseNumbers(optarg,
+                                               layerCounts,
+                                               PIPELINE_MAX_LAYERS);
+
+            if (numberOfLayerCounts == 0)
+            {
+                usage();
+            }
+
+            break;
+
+        case 'o':
+
+            outputPath = optarg;
+            break;
+
+        case 's':
+
+            if ((numberOfSizes == PIPELINE_MAX_CHOICES) ||
+                (sscanf(optarg,
+                        "%dx%d",
+                        &(sizes[numberOfSizes].width),
+                        &(sizes[numberOfSizes].height)) != 2) ||
+                (sizes[numberOfSizes].width < 1) ||
+                (sizes[numberOfSizes].height < 1))
+            {
+                usage();
+            }
+
+            ++numberOfSizes;
+            break;
+
+        case 't':
+
+            if ((numberOfTypes == PIPELINE_MAX_CHOICES) ||
+                (findImageType(&(types[numberOfTypes]),
+                               optarg,
+                               IMAGE_TYPES_ALL) == false))
+            {
+                fprintf(stderr,
+                        "%s: unknown image type %s\n",
+                        program,
+                        optarg);
+
+                exit(EXIT_FAILURE);
+            }
+
+            ++numberOfTypes;
+            break;
+
+        default:
+
+            usage();
+            break;
+        }
+    }
+
+    if (numberOfTypes == 0)
+    {
+        findImageType(&(types[numberOfTypes++]), "RGB565", IMAGE_TYPES_ALL);
+        findImageType(&(types[numberOfTypes++]), "RGBA16", IMAGE_TYPES_ALL);
+        findImageType(&(types[numberOfTypes++]), "RGBA32", IMAGE_TYPES_ALL);
+    }
+
+    //---------------------------------------------------------------------
+
+    FILE *output = stdout;
+
+    if (outputPath != NULL)
+    {
+        output = fopen(outputPath, "w");
+
+        if (output == NULL)
+        {
+            fprintf(stderr,
+                    "%s: unable to open %s\n",
+                    program,
+                    outputPath);
+
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    if (signal(SIGINT, signalHandler) == SIG_ERR)
+    {
+        perror("installing SIGINT signal handler");
+        exit(EXIT_FAILURE);
+    }
+
+    if (signal(SIGTERM, signalHandler) == SIG_ERR)
+    {
+        perror("installing SIGTERM signal handler");
+        exit(EXIT_FAILURE);
+    }
+
+    //---------------------------------------------------------------------
+
+    bcm_host_init();
+
+    PIPELINE_T pipeline;
+
+    pipeline.display = vc_dispmanx_display_open(displayNumber);
+    assert(pipeline.display != 0);
+
+    int result = vc_dispmanx_display_get_info(pipeline.display,
+                                              &(pipeline.info));
+    assert(result == 0);
+
+    pipeline.frames = frames;
+    pipeline.warmup = 10;
+
+    int32_t s;
+    for (s = 0 ; s < PIPELINE_STAGES ; s++)
+    {
+        pipeline.micros[s] = malloc(frames * sizeof(int32_t));
+
+        if (pipeline.micros[s] == NULL)
+        {
+            fprintf(stderr, "%s: memory exhausted\n", program);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (numberOfSizes == 0)
+    {
+        sizes[numberOfSizes++] = (PIPELINE_SIZE_T){ 320, 240 };
+        sizes[numberOfSizes++] = (PIPELINE_SIZE_T){ 640, 480 };
+        sizes[numberOfSizes++] = (PIPELINE_SIZE_T){ pipeline.info.width,
+                                                    pipeline.info.height };
+    }
+
+    //---------------------------------------------------------------------
+
+    printHeader(output);
+
+    int32_t t;
+    for (t = 0 ; (t < numberOfTypes) && run ; t++)
+    {
+        for (s = 0 ; (s < numberOfSizes) && run ; s++)
+        {
+            int32_t l;
+            for (l = 0 ; (l < numberOfLayerCounts) && run ; l++)
+            {
+                runConfiguration(output,
+                                 &pipeline,
+                                 layerCounts[l],
+                                 &(types[t]),
+                                 &(sizes[s]));
+            }
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    for (s = 0 ; s < PIPELINE_STAGES ; s++)
+    {
+        free(pipeline.micros[s]);
+    }
+
+    if (output != stdout)
+    {
+        fclose(output);
+    }
+
+    result = vc_dispmanx_display_close(pipeline.display);
+    assert(result == 0);
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "fileWatch.h"
+
+//-------------------------------------------------------------------------
+
+#define FILE_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+//-------------------------------------------------------------------------
+
+bool
+initFileWatch(
+    FILE_WATCH_T *fileWatch,
+    const char *path)
+{
+    fileWatch->fd = -1;
+    fileWatch->wd = -1;
+
+    // dirname() and basename() may both modify their argument.
+
+    char *directoryPath = strdup(path);
+    char *namePath = strdup(path);
+
+    if ((directoryPath == NULL) || (namePath == NULL))
+    {
+        fprintf(stderr, "fileWatch: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fileWatch->directory = strdup(dirname(directoryPath));
+    fileWatch->name = strdup(basename(namePath));
+
+    free(directoryPath);
+    free(namePath);
+
+    if ((fileWatch->directory == NULL) || (fileWatch->name == NULL))
+    {
+        fprintf(stderr, "fileWatch: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fileWatch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fileWatch->fd == -1)
+    {
+        perror("fileWatch: inotify_init1");
+        destroyFileWatch(fileWatch);
+        return false;
+    }
+
+    fileWatch->wd = inotify_add_watch(fileWatch->fd,
+                                      fileWatch->directory,
+                                      FILE_WATCH_EVENTS | IN_ONLYDIR);
+
+    if (fileWatch->wd == -1)
+    {
+        perror("fileWatch: inotify_add_watch");
+        destroyFileWatch(fileWatch);
+        return false;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+changedFileWatch(
+    FILE_WATCH_T *fileWatch)
+{
+    // Large enough for several events with names up to NAME_MAX, and
+    // aligned as the first event must be.
+
+    char buffer[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    bool changed = false;
+
+    for (;;)
+    {
+        ssize_t length = read(fileWatch->fd, buffer, sizeof(buffer));
+
+        if (length <= 0)
+        {
+            if ((length == -1) && (errno == EINTR))
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        char *next = buffer;
+
+        while (next < buffer + length)
+        {
+            const struct inotify_event *event
+                = (const struct inotify_event *)next;
+
+            if ((event->wd == fileWatch->wd) &&
+                (event->mask & FILE_WATCH_EVENTS) &&
+                (event->len > 0) &&
+                (strcmp(event->name, fileWatch->name) == 0))
+            {
+                changed = true;
+            }
+
+            next += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyFileWatch(
+    FILE_WATCH_T *fileWatch)
+{
+    if (fileWatch->fd != -1)
+    {
+        // Closing the inotify descriptor also removes the watch.
+
+        close(fileWatch->fd);
+        fileWatch->fd = -1;
+        fileWatch->wd = -1;
+    }
+
+    free(fileWatch->directory);
+    fileWatch->directory = NULL;
+
+    free(fileWatch->name);
+    fileWatch->name = NULL;
+}
@@ -0,0 +1,70 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+#include <stdbool.h>
+
+//-------------------------------------------------------------------------
+
+// Watches a single file with inotify. The directory is watched rather
+// than the file itself, so that a new file renamed over the old one (the
+// usual way to replace a file atomically) is seen as well as a file that
+// is rewritten in place. fd can be added to a poll or epoll set; it
+// becomes readable when there are events to collect.
+
+typedef struct
+{
+    int fd;
+    int wd;
+    char *directory;
+    char *name;
+} FILE_WATCH_T;
+
+//-------------------------------------------------------------------------
+
+bool
+initFileWatch(
+    FILE_WATCH_T *fileWatch,
+    const char *path);
+
+// Read all of the pending events without blocking. Returns true if any of
+// them show that the file was written and closed, or replaced.
+
+bool
+changedFileWatch(
+    FILE_WATCH_T *fileWatch);
+
+void
+destroyFileWatch(
+    FILE_WATCH_T *fileWatch);
+
+//-------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,316 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "frameStream.h"
+#include "image.h"
+#include "imageLayer.h"
+#include "loadpng.h"
+#include "resourcePool.h"
+
+#include "bcm_host.h"
+
+//-------------------------------------------------------------------------
+
+void
+initFrameStream(
+    FRAME_STREAM_T *stream,
+    FILE *file)
+{
+    setvbuf(file, NULL, _IONBF, 0);
+
+    stream->file = file;
+    stream->raw = false;
+    stream->rowBytes = 0;
+    stream->strip = NULL;
+    stream->stripHeight = LOADPNG_STRIP_HEIGHT;
+    stream->frames = 0;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+initRawFrameStream(
+    FRAME_STREAM_T *stream,
+    FILE *file,
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height)
+{
+    initFrameStream(stream, file);
+
+    if (initImageHeader(&(stream->format), type, width, height, false) == false)
+    {
+        return false;
+    }
+
+    stream->raw = true;
+    stream->rowBytes = ((width * stream->format.bitsPerPixel) + 7) / 8;
+
+    if (stream->stripHeight > height)
+    {
+        stream->stripHeight = height;
+    }
+
+    stream->strip = calloc(stream->stripHeight, stream->format.pitch);
+
+    if (stream->strip == NULL)
+    {
+        fprintf(stderr, "frameStream: memory exhausted\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// Read a raw frame a strip at a time, writing each strip to the layer.
+
+static FRAME_STREAM_RESULT_T
+readRawFrameStream(
+    FRAME_STREAM_T *stream,
+    IMAGE_LAYER_T *il)
+{
+    IMAGE_T *format = &(stream->format);
+
+    int32_t y;
+    for (y = 0 ; y < format->height ; y += stream->stripHeight)
+    {
+        int32_t rows = format->height - y;
+
+        if (rows > stream->stripHeight)
+        {
+            rows = stream->stripHeight;
+        }
+
+        size_t expected = rows * stream->rowBytes;
+        size_t length = 0;
+
+        if (stream->rowBytes == (size_t)(format->pitch))
+        {
+            length = fread(stream->strip, 1, expected, stream->file);
+        }
+        else
+        {
+            int32_t row;
+            for (row = 0 ; row < rows ; row++)
+            {
+                size_t rowLength = fread(stream->strip + (row * format->pitch),
+                                         1,
+                                         stream->rowBytes,
+                                         stream->file);
+                length += rowLength;
+
+                if (rowLength != stream->rowBytes)
+                {
+                    break;
+                }
+            }
+        }
+
+        if (length != expected)
+        {
+            if ((y > 0) || (length > 0))
+            {
+                fprintf(stderr,
+                        "frameStream: frame %u is truncated\n",
+                        stream->frames + 1);
+            }
+
+            return FRAME_STREAM_END;
+        }
+
+        writeRowsImageLayer(il, stream->strip, y, rows);
+    }
+
+    return FRAME_STREAM_FRAME;
+}
+
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    IMAGE_LAYER_T *il;
+    bool matches;
+} FRAME_STREAM_PNG_T;
+
+static void
+stripToFrameStream(
+    IMAGE_T *image,
+    const uint8_t *strip,
+    int32_t y,
+    int32_t rows,
+    void *arg)
+{
+    FRAME_STREAM_PNG_T *png = arg;
+    IMAGE_T *current = &(png->il->image);
+
+    png->matches = (image->type == current->type) &&
+                   (image->width == current->width) &&
+                   (image->height == current->height);
+
+    if (png->matches)
+    {
+        writeRowsImageLayer(png->il, strip, y, rows);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+static FRAME_STREAM_RESULT_T
+readPngFrameStream(
+    FRAME_STREAM_T *stream,
+    IMAGE_LAYER_T *il)
+{
+    // Look for the end of the file here, as libpng would report it as an
+    // error.
+
+    int c = getc(stream->file);
+
+    if (c == EOF)
+    {
+        return FRAME_STREAM_END;
+    }
+
+    ungetc(c, stream->file);
+
+    IMAGE_T image;
+    FRAME_STREAM_PNG_T png = { il, false };
+
+    if (loadPngFileStrips(&image,
+                          stream->file,
+                          stream->stripHeight,
+                          stripToFrameStream,
+                          &png) == false)
+    {
+        fprintf(stderr,
+                "frameStream: frame %u is not a valid png\n",
+                stream->frames + 1);
+
+        return FRAME_STREAM_END;
+    }
+
+    if (png.matches == false)
+    {
+        fprintf(stderr,
+                "frameStream: skipping frame %u, which is %dx%d\n",
+                stream->frames + 1,
+                image.width,
+                image.height);
+
+        return FRAME_STREAM_SKIPPED;
+    }
+
+    return FRAME_STREAM_FRAME;
+}
+
+//-------------------------------------------------------------------------
+
+bool
+firstFrameStream(
+    FRAME_STREAM_T *stream,
+    IMAGE_LAYER_T *il,
+    int32_t layer)
+{
+    if (stream->raw)
+    {
+        il->image = stream->format;
+        createEmptyResourceImageLayer(il, layer);
+
+        if (readRawFrameStream(stream, il) != FRAME_STREAM_FRAME)
+        {
+            releaseResourcePool(il->resource);
+            return false;
+        }
+    }
+    else if (loadPngFileImageLayer(il,
+                                   stream->file,
+                                   layer,
+                                   stream->stripHeight) == false)
+    {
+        return false;
+    }
+
+    createBackResourceImageLayer(il);
+    ++(stream->frames);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+FRAME_STREAM_RESULT_T
+nextFrameStream(
+    FRAME_STREAM_T *stream,
+    IMAGE_LAYER_T *il)
+{
+    FRAME_STREAM_RESULT_T frame;
+
+    if (stream->raw)
+    {
+        frame = readRawFrameStream(stream, il);
+    }
+    else
+    {
+        frame = readPngFrameStream(stream, il);
+    }
+
+    if (frame == FRAME_STREAM_FRAME)
+    {
+        DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+        assert(update != 0);
+
+        swapResourceImageLayer(il, update);
+
+        int result = vc_dispmanx_update_submit_sync(update);
+        assert(result == 0);
+    }
+
+    if (frame != FRAME_STREAM_END)
+    {
+        ++(stream->frames);
+    }
+
+    return frame;
+}
+
+//-------------------------------------------------------------------------
+
+void
+destroyFrameStream(
+    FRAME_STREAM_T *stream)
+{
+    free(stream->strip);
+    stream->strip = NULL;
+}
@@ -0,0 +1,109 @@
+//-------------------------------------------------------------------------
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2013 Andrew Duncan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//-------------------------------------------------------------------------
+
+
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "image.h"
+#include "imageLayer.h"
+
+//-------------------------------------------------------------------------
+
+// A sequence of frames read from a file or pipe, either pngs one after
+// the other or raw frames of a fixed type and size. A raw frame is its
+// rows one after the other with no padding. The layer showing the stream
+// has two resources; each frame is written to the one that is not on
+// screen, which is then swapped in, so nothing is allocated per frame.
+//
+// The file is unbuffered, so that when its descriptor is not readable
+// there is no part of a frame waiting in a stdio buffer either.
+
+typedef struct
+{
+    FILE *file;
+    bool raw;
+    IMAGE_T format;
+    size_t rowBytes;
+    uint8_t *strip;
+    int32_t stripHeight;
+    uint32_t frames;
+} FRAME_STREAM_T;
+
+typedef enum
+{
+    FRAME_STREAM_FRAME,
+    FRAME_STREAM_SKIPPED,
+    FRAME_STREAM_END
+} FRAME_STREAM_RESULT_T;
+
+//-------------------------------------------------------------------------
+
+void
+initFrameStream(
+    FRAME_STREAM_T *stream,
+    FILE *file);
+
+bool
+initRawFrameStream(
+    FRAME_STREAM_T *stream,
+    FILE *file,
+    VC_IMAGE_TYPE_T type,
+    int32_t width,
+    int32_t height);
+
+// Read the first frame into a new double buffered layer, which is then
+// ready for addElementImageLayer(). Every later frame must have the same
+// type and size.
+
+bool
+firstFrameStream(
+    FRAME_STREAM_T *stream,
+    IMAGE_LAYER_T *il,
+    int32_t layer);
+
+// Read the next frame into the back resource of il and put it on screen.
+// Blocks until the whole frame has been read. A png frame of the wrong
+// size is skipped; the end of the file, or a frame that cannot be read,
+// ends the stream.
+
+FRAME_STREAM_RESULT_T
+nextFrameStream(
+    FRAME_STREAM_T *stream,
+    IMAGE_LAYER_T *il);
+
+void
+destroyFrameStream(
+    FRAME_STREAM_T *stream);
+
+//-------------------------------------------------------------------------
+
+#endif
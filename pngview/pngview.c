@@ -29,17 +29,26 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/stat.h>
+#include <sys/epoll.h>
 
 #include "backgroundLayer.h"
+#include "fileWatch.h"
+#include "frameStream.h"
+#include "imageCache.h"
 #include "imageLayer.h"
+#include "input.h"
 #include "key.h"
 #include "loadpng.h"
+#include "memoryAccount.h"
+#include "resourcePool.h"
 
 #include "bcm_host.h"
 
@@ -75,11 +84,64 @@ signalHandler(
     };
 }
 
-time_t getFileModificationTime(const char *path) {
-    struct stat attr;
-    stat(path, &attr);
-    //printf("Last modified time: %s", ctime(&attr.st_mtime));
-    return attr.st_mtime;
+//-------------------------------------------------------------------------
+
+// A reload that fails (say the png was replaced by one that is truncated)
+// is tried again a few times before waiting for the next change.
+
+#define RELOAD_RETRY_MILLISECONDS 200
+#define RELOAD_RETRIES 5
+
+//-------------------------------------------------------------------------
+
+static int64_t
+millisecondsSince(
+    const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((int64_t)(now.tv_sec - start->tv_sec) * 1000)
+         + ((now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+//-------------------------------------------------------------------------
+
+// Stream the file into a new resource and swap it in for the one on
+// screen, so the old image stays up until the new one is complete.
+
+static bool
+reloadImageLayer(
+    IMAGE_LAYER_T *il,
+    const char *path)
+{
+    IMAGE_LAYER_T next;
+
+    if (loadPngImageLayerCached(&next,
+                                path,
+                                il->layer,
+                                LOADPNG_STRIP_HEIGHT) == false)
+    {
+        return false;
+    }
+
+    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    assert(update != 0);
+
+    int result = vc_dispmanx_element_change_source(update,
+                                                   il->element,
+                                                   next.resource);
+    assert(result == 0);
+
+    result = vc_dispmanx_update_submit_sync(update);
+    assert(result == 0);
+
+    releaseResourcePool(il->resource);
+
+    il->resource = next.resource;
+    il->image = next.image;
+
+    return true;
 }
 
 //-------------------------------------------------------------------------
@@ -88,7 +150,10 @@ void usage(void)
 {
     fprintf(stderr, "Usage: %s ", program);
     fprintf(stderr, "[-b <BGRA>] [-d <number>] [-l <layer>] ");
-    fprintf(stderr, "[-x <offset>] [-y <offset>] <file.png>\n");
+    fprintf(stderr, "[-x <offset>] [-y <offset>] [-s] ");
+    fprintf(stderr, "[-r <type>:<width>x<height>] ");
+    fprintf(stderr, "[-z <width>x<height>] [-R <degrees>] [-F <h|v|hv>] ");
+    fprintf(stderr, "[-u] <file.png>\n");
     fprintf(stderr, "    -b - set background colour 16 bit RGBA\n");
     fprintf(stderr, "         e.g. 0x000F is opaque black\n");
     fprintf(stderr, "    -d - Raspberry Pi display number\n");
@@ -98,6 +163,14 @@ void usage(void)
     fprintf(stderr, "    -t - timeout in ms\n");
     fprintf(stderr, "    -n - non-interactive mode\n");
     fprintf(stderr, "    -m - monitor <file.png> for changes\n");
+    fprintf(stderr, "    -s - show a stream of pngs read from <file.png>\n");
+    fprintf(stderr, "    -r - show a stream of raw frames of the given\n");
+    fprintf(stderr, "         type and size, e.g. RGB565:640x480\n");
+    fprintf(stderr, "    -z - scale the image to <width>x<height>\n");
+    fprintf(stderr, "    -R - rotate the image by 90, 180 or 270 degrees\n");
+    fprintf(stderr, "    -F - flip the image horizontally and/or vertically\n");
+    fprintf(stderr, "    -u - print the memory each part of the program\n");
+    fprintf(stderr, "         used, on exit\n");
     fprintf(stderr, "    Use 'killall -s SIGTSTP pngview' to refresh from <file.png>\n");
 
     exit(EXIT_FAILURE);
@@ -117,7 +190,12 @@ int main(int argc, char *argv[])
     bool yOffsetSet = false;
     bool interactive = true;
     bool monitorChanges = false;
-    time_t lastFileMod = 0;
+    bool streaming = false;
+    const char *rawFormat = NULL;
+    int32_t destWidth = 0;
+    int32_t destHeight = 0;
+    DISPMANX_TRANSFORM_T transform = DISPMANX_NO_ROTATE;
+    bool printMemory = false;
 
     program = basename(argv[0]);
 
@@ -125,7 +203,7 @@ int main(int argc, char *argv[])
 
     int opt = 0;
 
-    while ((opt = getopt(argc, argv, "b:d:l:x:y:t:nm")) != -1)
+    while ((opt = getopt(argc, argv, "b:d:l:x:y:t:nmsr:z:R:F:u")) != -1)
     {
         switch(opt)
         {
@@ -171,6 +249,75 @@ int main(int argc, char *argv[])
             monitorChanges = true;
             break;
 
+        case 's':
+
+            streaming = true;
+            break;
+
+        case 'r':
+
+            rawFormat = optarg;
+            streaming = true;
+            break;
+
+        case 'z':
+
+            if ((sscanf(optarg, "%dx%d", &destWidth, &destHeight) != 2) ||
+                (destWidth <= 0) ||
+                (destHeight <= 0))
+            {
+                usage();
+            }
+            break;
+
+        case 'R':
+
+            switch (strtol(optarg, NULL, 10))
+            {
+            case 0:
+
+                break;
+
+            case 90:
+
+                transform |= DISPMANX_ROTATE_90;
+                break;
+
+            case 180:
+
+                transform |= DISPMANX_ROTATE_180;
+                break;
+
+            case 270:
+
+                transform |= DISPMANX_ROTATE_270;
+                break;
+
+            default:
+
+                usage();
+                break;
+            }
+            break;
+
+        case 'F':
+
+            if (strchr(optarg, 'h') != NULL)
+            {
+                transform |= DISPMANX_FLIP_HRIZ;
+            }
+
+            if (strchr(optarg, 'v') != NULL)
+            {
+                transform |= DISPMANX_FLIP_VERT;
+            }
+            break;
+
+        case 'u':
+
+            printMemory = true;
+            break;
+
         default:
 
             usage();
@@ -187,14 +334,84 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
+    bcm_host_init();
+
+    //---------------------------------------------------------------------
+
+    // The image is decoded a strip at a time straight into its resource,
+    // so even a very large png never has to fit in memory as a whole.
+
     IMAGE_LAYER_T imageLayer;
+    FRAME_STREAM_T stream;
 
     const char *imagePath = argv[optind];
 
-    if(strcmp(imagePath, "-") == 0)
+    if (streaming)
+    {
+        FILE *file = stdin;
+
+        if (strcmp(imagePath, "-") == 0)
+        {
+            // The stream is on stdin, so there are no keys to read.
+            interactive = false;
+        }
+        else
+        {
+            file = fopen(imagePath, "rb");
+
+            if (file == NULL)
+            {
+                perror(imagePath);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        if (rawFormat != NULL)
+        {
+            char typeName[16];
+            int32_t width = 0;
+            int32_t height = 0;
+            IMAGE_TYPE_INFO_T typeInfo;
+
+            if ((sscanf(rawFormat,
+                        "%15[^:]:%dx%d",
+                        typeName,
+                        &width,
+                        &height) != 3) ||
+                (findImageType(&typeInfo,
+                               typeName,
+                               IMAGE_TYPES_ALL_DIRECT_COLOUR) == false) ||
+                (initRawFrameStream(&stream,
+                                    file,
+                                    typeInfo.type,
+                                    width,
+                                    height) == false))
+            {
+                fprintf(stderr, "%s: bad raw format %s, ", program, rawFormat);
+                fprintf(stderr, "the type can be one of the following:");
+                printImageTypes(stderr, " ", "", IMAGE_TYPES_ALL_DIRECT_COLOUR);
+                fprintf(stderr, "\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            initFrameStream(&stream, file);
+        }
+
+        if (firstFrameStream(&stream, &imageLayer, layer) == false)
+        {
+            fprintf(stderr, "unable to read a frame from %s\n", imagePath);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if(strcmp(imagePath, "-") == 0)
     {
         // Use stdin
-        if (loadPngFile(&(imageLayer.image), stdin) == false)
+        if (loadPngFileImageLayer(&imageLayer,
+                                  stdin,
+                                  layer,
+                                  LOADPNG_STRIP_HEIGHT) == false)
         {
             fprintf(stderr, "unable to load %s\n", imagePath);
             exit(EXIT_FAILURE);
@@ -203,15 +420,18 @@ int main(int argc, char *argv[])
     else
     {
         // Load image from path
-        if (loadPng(&(imageLayer.image), imagePath) == false)
+        if (loadPngImageLayerCached(&imageLayer,
+                                    imagePath,
+                                    layer,
+                                    LOADPNG_STRIP_HEIGHT) == false)
         {
             fprintf(stderr, "unable to load %s\n", imagePath);
             exit(EXIT_FAILURE);
         }
-        lastFileMod = getFileModificationTime(imagePath);
     }
 
     //---------------------------------------------------------------------
+
     if (signal(SIGTSTP, signalHandler) == SIG_ERR)
     {
         perror("installing SIGTSTP signal handler");
@@ -234,10 +454,6 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
-    bcm_host_init();
-
-    //---------------------------------------------------------------------
-
     DISPMANX_DISPLAY_HANDLE_T display
         = vc_dispmanx_display_open(displayNumber);
     assert(display != 0);
@@ -257,8 +473,6 @@ int main(int argc, char *argv[])
         initBackgroundLayer(&backgroundLayer, background, 0);
     }
 
-    createResourceImageLayer(&imageLayer, layer);
-
     //---------------------------------------------------------------------
 
     DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
@@ -269,14 +483,20 @@ int main(int argc, char *argv[])
         addElementBackgroundLayer(&backgroundLayer, display, update);
     }
 
+    // The display does any scaling and rotation, so the image is still
+    // decoded at its own size. Centring uses the size it ends up on screen.
+
+    setTransformImageLayer(&imageLayer, transform, 0);
+    setDestinationImageLayer(&imageLayer, 0, 0, destWidth, destHeight, 0);
+
     if (xOffsetSet == false)
     {
-        xOffset = (info.width - imageLayer.image.width) / 2;
+        xOffset = (info.width - imageLayer.dstRect.width) / 2;
     }
 
     if (yOffsetSet == false)
     {
-        yOffset = (info.height - imageLayer.image.height) / 2;
+        yOffset = (info.height - imageLayer.dstRect.height) / 2;
     }
 
     addElementImageLayerOffset(&imageLayer,
@@ -290,39 +510,116 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
+    // The main loop sleeps in epoll until the png changes, a key is
+    // pressed, a signal arrives or the timeout expires. The signals that
+    // the loop acts on are blocked except while it is waiting, so that one
+    // arriving just before the wait cannot be missed.
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTSTP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+
+    sigset_t waitSignals;
+    sigprocmask(SIG_BLOCK, &signals, &waitSignals);
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epollFd == -1)
+    {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+
+    struct epoll_event event;
+
+    FILE_WATCH_T fileWatch;
+    bool watching = false;
+
+    if (monitorChanges && (streaming == false) && (strcmp(imagePath, "-") != 0))
+    {
+        watching = initFileWatch(&fileWatch, imagePath);
+
+        if (watching)
+        {
+            event.events = EPOLLIN;
+            event.data.fd = fileWatch.fd;
+
+            result = epoll_ctl(epollFd, EPOLL_CTL_ADD, fileWatch.fd, &event);
+            assert(result == 0);
+        }
+        else
+        {
+            fprintf(stderr, "%s: not monitoring %s\n", program, imagePath);
+        }
+    }
+
+    // A regular file is always readable and cannot be added to the epoll
+    // set, so the loop just does not wait while reading one.
+
+    bool streamOpen = streaming;
+    bool streamAlwaysReady = false;
+
+    if (streaming)
+    {
+        event.events = EPOLLIN;
+        event.data.fd = fileno(stream.file);
+
+        result = epoll_ctl(epollFd, EPOLL_CTL_ADD, fileno(stream.file), &event);
+
+        if (result == -1)
+        {
+            assert(errno == EPERM);
+            streamAlwaysReady = true;
+        }
+    }
+
+    // Keys are read on the input thread, which keeps a file descriptor
+    // readable while there are any waiting for keyPressed().
+
+    if (interactive && startInput(INPUT_SOURCE_ALL))
+    {
+        event.events = EPOLLIN;
+        event.data.fd = fileDescriptorInput();
+
+        result = epoll_ctl(epollFd,
+                           EPOLL_CTL_ADD,
+                           fileDescriptorInput(),
+                           &event);
+        assert(result == 0);
+    }
+
+    //---------------------------------------------------------------------
+
     int32_t step = 1;
-    uint32_t currentTime = 0;
-    uint32_t lastModCheckTime = 0;
+    int32_t reloadRetries = 0;
 
-    // Sleep for 10 milliseconds every run-loop
-    const int sleepMilliseconds = 10;
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
 
     while (run)
     {
         int c = 0;
 
-        // Optionally check for changes to the png file
-        if (monitorChanges && ((currentTime-lastModCheckTime) >= 1000)) {
-            lastModCheckTime = currentTime;
-            time_t modTime = getFileModificationTime(imagePath);
-            if (lastFileMod != modTime) {
-                reload=true;
-            }
-            lastFileMod = modTime;
-        }
-
-        if (reload) {
+        if (reload)
+        {
             reload = false;
-            if(strcmp(imagePath, "-") != 0)
+
+            if ((streaming == false) && (strcmp(imagePath, "-") != 0))
             {
                 // Load image from path
-                if (loadPng(&(imageLayer.image), imagePath) == false)
+                if (reloadImageLayer(&imageLayer, imagePath))
+                {
+                    reloadRetries = 0;
+                }
+                else if (reloadRetries == 0)
                 {
-                    usleep(200*1000); // wait and try again
-                } else
+                    reloadRetries = RELOAD_RETRIES;
+                }
+                else
                 {
-                    reload = false;
-                    changeSourceAndUpdateImageLayer(&imageLayer);
+                    --reloadRetries;
                 }
             }
         }
@@ -411,11 +708,104 @@ int main(int argc, char *argv[])
 
         //---------------------------------------------------------------------
 
-        usleep(sleepMilliseconds * 1000);
+        int waitMilliseconds = -1;
+
+        if (timeout != 0)
+        {
+            int64_t remaining = timeout - millisecondsSince(&startTime);
+
+            if (remaining <= 0)
+            {
+                run = false;
+                break;
+            }
+
+            waitMilliseconds = remaining;
+        }
+
+        if (streamAlwaysReady)
+        {
+            waitMilliseconds = 0;
+        }
+        else if ((reloadRetries > 0) &&
+            ((waitMilliseconds == -1) ||
+             (waitMilliseconds > RELOAD_RETRY_MILLISECONDS)))
+        {
+            waitMilliseconds = RELOAD_RETRY_MILLISECONDS;
+        }
+
+        if (run == false)
+        {
+            break;
+        }
+
+        struct epoll_event events[2];
+
+        int ready = epoll_pwait(epollFd,
+                                events,
+                                2,
+                                waitMilliseconds,
+                                &waitSignals);
+
+        if ((ready == 0) && (reloadRetries > 0))
+        {
+            reload = true;
+        }
+
+        bool streamReady = streamAlwaysReady;
+
+        int32_t i;
+        for (i = 0 ; i < ready ; i++)
+        {
+            if (streamOpen && (events[i].data.fd == fileno(stream.file)))
+            {
+                streamReady = true;
+            }
+
+            if (watching &&
+                (events[i].data.fd == fileWatch.fd) &&
+                changedFileWatch(&fileWatch))
+            {
+                reloadRetries = 0;
+                reload = true;
+            }
+        }
+
+        // The last frame stays on screen once the stream ends.
 
-        currentTime += sleepMilliseconds;
-        if (timeout != 0 && currentTime >= timeout) {
-            run = false;
+        if (streamReady &&
+            (nextFrameStream(&stream, &imageLayer) == FRAME_STREAM_END))
+        {
+            if (streamAlwaysReady == false)
+            {
+                result = epoll_ctl(epollFd,
+                                   EPOLL_CTL_DEL,
+                                   fileno(stream.file),
+                                   NULL);
+                assert(result == 0);
+            }
+
+            streamAlwaysReady = false;
+            streamOpen = false;
+        }
+    }
+
+    //---------------------------------------------------------------------
+
+    if (watching)
+    {
+        destroyFileWatch(&fileWatch);
+    }
+
+    close(epollFd);
+
+    if (streaming)
+    {
+        destroyFrameStream(&stream);
+
+        if (stream.file != stdin)
+        {
+            fclose(stream.file);
         }
     }
 
@@ -437,6 +827,13 @@ int main(int argc, char *argv[])
     result = vc_dispmanx_display_close(display);
     assert(result == 0);
 
+    // Anything still charged once everything is destroyed has leaked.
+
+    if (printMemory)
+    {
+        printMemoryAccounts(stdout);
+    }
+
     //---------------------------------------------------------------------
 
     return 0;
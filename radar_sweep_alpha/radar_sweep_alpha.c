@@ -38,6 +38,8 @@
 
 #include "bcm_host.h"
 
+#include "backgroundLayer.h"
+#include "frameLoop.h"
 #include "image.h"
 #include "imagePalette.h"
 #include "key.h"
@@ -121,15 +123,8 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
-    uint32_t vc_image_ptr;
-    uint32_t background = 0;
-
-    DISPMANX_RESOURCE_HANDLE_T bgResource =
-        vc_dispmanx_resource_create(VC_IMAGE_RGB565,
-                                    1,
-                                    1,
-                                    &vc_image_ptr);
-    assert(bgResource != 0);
+    BACKGROUND_LAYER_T bg;
+    initBackgroundLayer(&bg, 0x000F, 1);
 
     //---------------------------------------------------------------------
 
@@ -174,8 +169,8 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
-    IMAGE_PALETTE32_T palette;
-    initImagePalette32(&palette, 512);
+    PALETTE_ANIMATION_T palette;
+    initPaletteAnimation(&palette, 256, 32);
 
     int p;
     for (p = 1 ; p < 64 ; p++)
@@ -187,24 +182,16 @@ int main(int argc, char *argv[])
         rgba.blue = 0;
         rgba.alpha = (p * 255) / 63;
 
-        setPalette32EntryRgba(&palette, p, &rgba);
-        setPalette32EntryRgba(&palette, p + 254, &rgba);
+        setEntryPaletteAnimation(&palette, p, &rgba);
     }
 
-    //---------------------------------------------------------------------
-
-    VC_RECT_T bmp_rect;
+    // Sweep the ramp round entries 1 to 255, one entry each frame.
 
-    vc_dispmanx_rect_set(&bmp_rect, 0, 0, 1, 1);
+    addCyclePaletteAnimation(&palette, 1, 255, 1, 0);
 
-    result = vc_dispmanx_resource_write_data(bgResource,
-                                             imageType,
-                                             sizeof(background),
-                                             &background,
-                                             &bmp_rect);
-    assert(result == 0);
+    //---------------------------------------------------------------------
 
-    //-------------------------------------------------------------------
+    VC_RECT_T bmp_rect;
 
     vc_dispmanx_rect_set(&bmp_rect, 0, 0, image.width, image.height);
 
@@ -217,7 +204,7 @@ int main(int argc, char *argv[])
 
     //-------------------------------------------------------------------
 
-    setResourcePalette32(&palette, 0, resource, 1, 256);
+    updatePaletteAnimation(&palette, resource);
 
     //-------------------------------------------------------------------
 
@@ -236,21 +223,7 @@ int main(int argc, char *argv[])
     VC_RECT_T src_rect;
     VC_RECT_T dst_rect;
 
-    vc_dispmanx_rect_set(&src_rect, 0, 0, 1, 1);
-    vc_dispmanx_rect_set(&dst_rect, 0, 0, 0, 0);
-
-    DISPMANX_ELEMENT_HANDLE_T bgElement = 
-        vc_dispmanx_element_add(update,
-                                displayHandle,
-                                1,
-                                &dst_rect,
-                                bgResource,
-                                &src_rect,
-                                DISPMANX_PROTECTION_NONE,
-                                &alpha,
-                                NULL,
-                                DISPMANX_NO_ROTATE);
-    assert(bgElement != 0);
+    addElementBackgroundLayer(&bg, displayHandle, update);
 
     //---------------------------------------------------------------------
 
@@ -284,20 +257,22 @@ int main(int argc, char *argv[])
     result = vc_dispmanx_update_submit_sync(update);
     assert(result == 0);
 
+    FRAME_LOOP_T frameLoop;
+    initFrameLoop(&frameLoop, displayHandle);
+
     int c = 0;
-    int offset = 255;
     while (c != 27)
     {
         keyPressed(&c);
 
         //-----------------------------------------------------------
 
-        setResourcePalette32(&palette, offset, resource, 1, 256);
+        waitForUpdateFrameLoop(&frameLoop);
 
-        offset--;
-        if (offset < 1)
+        if (updatePaletteAnimation(&palette, resource) == 0)
         {
-            offset = 255;
+            waitForVsyncFrameLoop(&frameLoop);
+            continue;
         }
 
         DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
@@ -307,16 +282,16 @@ int main(int argc, char *argv[])
                                                    element,
                                                    resource);
         assert(result == 0);
-        vc_dispmanx_update_submit_sync(update);
-        assert(result == 0);
+        submitUpdateFrameLoop(&frameLoop, update);
 
         //-----------------------------------------------------------
     }
 
+    destroyFrameLoop(&frameLoop);
+
     update = vc_dispmanx_update_start(0);
     assert(update != 0);
-    result = vc_dispmanx_element_remove(update, bgElement);
-    assert(result == 0);
+    removeElementBackgroundLayer(&bg, update);
     result = vc_dispmanx_element_remove(update, element);
     assert(result == 0);
     result = vc_dispmanx_update_submit_sync(update);
@@ -326,8 +301,7 @@ int main(int argc, char *argv[])
 
     result = vc_dispmanx_resource_delete(resource);
     assert(result == 0);
-    result = vc_dispmanx_resource_delete(bgResource);
-    assert(result == 0);
+    destroyBackgroundLayer(&bg);
 
     result = vc_dispmanx_display_close(displayHandle);
     assert(result == 0);
@@ -335,7 +309,7 @@ int main(int argc, char *argv[])
     //-------------------------------------------------------------------
 
     destroyImage(&image);
-    destroyImagePalette32(&palette);
+    destroyPaletteAnimation(&palette);
 
     //-------------------------------------------------------------------
 
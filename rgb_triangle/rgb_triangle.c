@@ -37,8 +37,11 @@
 
 #include "bcm_host.h"
 
+#include "backgroundLayer.h"
 #include "element_change.h"
+#include "frameLoop.h"
 #include "image.h"
+#include "imageGraphics.h"
 #include "key.h"
 
 //-----------------------------------------------------------------------
@@ -161,15 +164,8 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
-    uint32_t vc_image_ptr;
-    uint32_t background = 0;
-
-    DISPMANX_RESOURCE_HANDLE_T bgResource =
-        vc_dispmanx_resource_create(VC_IMAGE_RGB565,
-                                    1,
-                                    1,
-                                    &vc_image_ptr);
-    assert(bgResource != 0);
+    BACKGROUND_LAYER_T bg;
+    initBackgroundLayer(&bg, 0x000F, 1);
 
     //---------------------------------------------------------------------
 
@@ -215,51 +211,25 @@ int main(int argc, char *argv[])
     int32_t x_offset = (modeInfo.width - width) / 2;
     int32_t y_offset = (modeInfo.height - height) / 2;
 
-    int32_t y;
-    for (y = 0 ; y < 256 ; y++)
-    {
-        int32_t x;
-        for (x = 0 ; x < 256 ; x++)
-        {
-            RGBA8_T rgba;
+    // Red, green and blue at the corners, blending to grey in the centre.
 
-            if (((255 - x - (y/2)) >= 0)&& ((x - (y/2)) >= 0))
-            {
-                rgba.red = 255 - x - (y/2);
-                rgba.green = x - (y/2);
-                rgba.blue = 255 - rgba.red - rgba.green;
-                rgba.alpha = 255;
-            }
-            else
-            {
-                rgba.red = 0;
-                rgba.green = 0;
-                rgba.blue = 0;
-                rgba.alpha = 255;
-            }
+    static const RGBA8_T black = { 0, 0, 0, 255 };
 
-            setPixelRGB(&image, x, y, &rgba);
-        }
-    }
+    IMAGE_VERTEX_T vertices[3] =
+    {
+        { 0, 0, { 255, 0, 0, 255 } },
+        { 256, 0, { 0, 255, 0, 255 } },
+        { 128, 256, { 0, 0, 255, 255 } }
+    };
+
+    clearImageRGB(&image, &black);
+    imageTriangleRGB(&image, &(vertices[0]), &(vertices[1]), &(vertices[2]));
 
     //---------------------------------------------------------------------
 
-    VC_RECT_T bmp_rect;
     VC_RECT_T src_rect;
     VC_RECT_T dst_rect;
 
-
-    vc_dispmanx_rect_set(&bmp_rect, 0, 0, 1, 1);
-
-    result = vc_dispmanx_resource_write_data(bgResource,
-                                             imageType,
-                                             sizeof(background),
-                                             &background,
-                                             &bmp_rect);
-    assert(result == 0);
-
-    //-------------------------------------------------------------------
-
     vc_dispmanx_rect_set(&src_rect, 0, 0, image.width, image.height);
 
     result = vc_dispmanx_resource_write_data(frontResource,
@@ -290,21 +260,7 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
-    vc_dispmanx_rect_set(&src_rect, 0, 0, 1, 1);
-    vc_dispmanx_rect_set(&dst_rect, 0, 0, 0, 0);
-
-    DISPMANX_ELEMENT_HANDLE_T bgElement = 
-        vc_dispmanx_element_add(update,
-                                displayHandle,
-                                1,
-                                &dst_rect,
-                                bgResource,
-                                &src_rect,
-                                DISPMANX_PROTECTION_NONE,
-                                &alpha,
-                                NULL,
-                                DISPMANX_NO_ROTATE);
-    assert(bgElement != 0);
+    addElementBackgroundLayer(&bg, displayHandle, update);
 
     //---------------------------------------------------------------------
 
@@ -338,6 +294,9 @@ int main(int argc, char *argv[])
     result = vc_dispmanx_update_submit_sync(update);
     assert(result == 0);
 
+    FRAME_LOOP_T frameLoop;
+    initFrameLoop(&frameLoop, displayHandle);
+
     int32_t direction = 1;
     int c = 0;
     bool size_changed = false;
@@ -442,8 +401,7 @@ int main(int argc, char *argv[])
                                                        element,
                                                        backResource);
             assert(result == 0);
-            vc_dispmanx_update_submit_sync(update);
-            assert(result == 0);
+            submitUpdateFrameLoop(&frameLoop, update);
 
             //-----------------------------------------------------------
 
@@ -451,12 +409,17 @@ int main(int argc, char *argv[])
             frontResource = backResource;
             backResource = tmpResource;
         }
+        else
+        {
+            waitForVsyncFrameLoop(&frameLoop);
+        }
     }
 
+    destroyFrameLoop(&frameLoop);
+
     update = vc_dispmanx_update_start(0);
     assert(update != 0);
-    result = vc_dispmanx_element_remove(update, bgElement);
-    assert(result == 0);
+    removeElementBackgroundLayer(&bg, update);
     result = vc_dispmanx_element_remove(update, element);
     assert(result == 0);
     result = vc_dispmanx_update_submit_sync(update);
@@ -468,8 +431,7 @@ int main(int argc, char *argv[])
     assert(result == 0);
     result = vc_dispmanx_resource_delete(backResource);
     assert(result == 0);
-    result = vc_dispmanx_resource_delete(bgResource);
-    assert(result == 0);
+    destroyBackgroundLayer(&bg);
 
     result = vc_dispmanx_display_close(displayHandle);
     assert(result == 0);
@@ -29,15 +29,18 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "backgroundLayer.h"
 #include "element_change.h"
 #include "image.h"
 #include "key.h"
+#include "spriteBatch.h"
 #include "spriteLayer.h"
 
 #include "bcm_host.h"
@@ -56,7 +59,7 @@ void usage(void)
 {
     fprintf(stderr, "Usage: %s ", program);
     fprintf(stderr, "[-b <RGBA>] [-c <columns>] [-d <number>] ");
-    fprintf(stderr, "[-l <layer] [-r <row>] <file.png>\n");
+    fprintf(stderr, "[-l <layer] [-r <row>] [-s <sprites>] <file.png>\n");
     fprintf(stderr, "    -b - set background colour 16 bit RGBA\n");
     fprintf(stderr, "         e.g. 0x000F is opaque black\n");
     fprintf(stderr, "    -c - number of columns in sprite\n");
@@ -65,6 +68,7 @@ void usage(void)
     fprintf(stderr, "    -l - DispmanX layer number\n");
     fprintf(stderr, "    -n - non-interactive mode\n");
     fprintf(stderr, "    -r - number of rows in sprite\n");
+    fprintf(stderr, "    -s - show this many copies of the sprite\n");
     fprintf(stderr, "    -t - Timeout in ms\n");
     fprintf(stderr, "    -x - offset (pixels from the left)\n");
     fprintf(stderr, "    -y - offset (pixels from the top)\n");
@@ -88,6 +92,7 @@ int main(int argc, char *argv[])
     bool yOffsetSet = false;
     int columns = 1;
     int rows = 1;
+    int32_t numberOfSprites = 0;
     const char *file = NULL;
 
     program = basename(argv[0]);
@@ -96,7 +101,7 @@ int main(int argc, char *argv[])
 
     int opt = 0;
 
-    while ((opt = getopt(argc, argv, "b:c:d:i:l:r:t:x:y:n")) != -1)
+    while ((opt = getopt(argc, argv, "b:c:d:i:l:r:s:t:x:y:n")) != -1)
     {
         switch(opt)
         {
@@ -135,6 +140,11 @@ int main(int argc, char *argv[])
             rows = atoi(optarg);
             break;
 
+        case 's':
+
+            numberOfSprites = atoi(optarg);
+            break;
+
         case 't':
 
             timeout = atoi(optarg);
@@ -177,8 +187,20 @@ int main(int argc, char *argv[])
     BACKGROUND_LAYER_T bg;
     initBackgroundLayer(&bg, background, 0);
 
+    // Several copies of the sprite share one sprite sheet resource and
+    // are all animated by a single update.
+
     SPRITE_LAYER_T sprite;
-    initSpriteLayer(&sprite, columns, rows, file, layer);
+    SPRITE_BATCH_T batch;
+
+    if (numberOfSprites > 0)
+    {
+        initSpriteBatch(&batch, columns, rows, file, layer);
+    }
+    else
+    {
+        initSpriteLayer(&sprite, columns, rows, file, layer);
+    }
 
     //---------------------------------------------------------------------
 
@@ -202,33 +224,71 @@ int main(int argc, char *argv[])
         addElementBackgroundLayer(&bg, display, update);
     }
 
-    if (xOffsetSet == false)
+    if (numberOfSprites > 0)
     {
-        xOffset = (info.width - sprite.width) / 2;
-    }
+        int32_t xRange = info.width - batch.width;
+        int32_t yRange = info.height - batch.height;
 
-    if (yOffsetSet == false)
-    {
-        yOffset = (info.height - sprite.height) / 2;
+        int32_t i;
+        for (i = 0 ; i < numberOfSprites ; i++)
+        {
+            addInstanceSpriteBatch(&batch,
+                                   (xRange > 0) ? rand() % xRange : 0,
+                                   (yRange > 0) ? rand() % yRange : 0,
+                                   rand() % batch.frames,
+                                   display,
+                                   update);
+        }
     }
+    else
+    {
+        if (xOffsetSet == false)
+        {
+            xOffset = (info.width - sprite.width) / 2;
+        }
 
-    addElementSpriteLayerOffset(&sprite,
-                                xOffset,
-                                yOffset,
-                                display,
-                                update);
+        if (yOffsetSet == false)
+        {
+            yOffset = (info.height - sprite.height) / 2;
+        }
+
+        addElementSpriteLayerOffset(&sprite,
+                                    xOffset,
+                                    yOffset,
+                                    display,
+                                    update);
+    }
 
     result = vc_dispmanx_update_submit_sync(update);
     assert(result == 0);
 
     //---------------------------------------------------------------------
 
+    // The frame shown is picked from the clock, each frame lasting for the
+    // interval, and an update is only submitted when it changes. With no
+    // interval every update moves on a frame, so the animation runs at
+    // the display's refresh rate.
+
+    if (numberOfSprites > 0)
+    {
+        int32_t i;
+        for (i = 0 ; i < numberOfSprites ; i++)
+        {
+            startAnimationSpriteBatch(&batch, i, interval);
+        }
+    }
+    else
+    {
+        startAnimationSpriteLayer(&sprite, interval);
+    }
+
     int c = 0;
     bool paused = false;
     bool step = false;
     bool run = true;
 
-    uint32_t currentTime = 0;
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
 
     while (run)
     {
@@ -241,6 +301,24 @@ int main(int argc, char *argv[])
             case 'p':
 
                 paused = !paused;
+
+                if (paused == false)
+                {
+                    // Carry on from the frame that is showing.
+
+                    if (numberOfSprites > 0)
+                    {
+                        int32_t i;
+                        for (i = 0 ; i < numberOfSprites ; i++)
+                        {
+                            startAnimationSpriteBatch(&batch, i, interval);
+                        }
+                    }
+                    else
+                    {
+                        startAnimationSpriteLayer(&sprite, interval);
+                    }
+                }
                 break;
 
             case ' ':
@@ -260,25 +338,102 @@ int main(int argc, char *argv[])
 
         //-----------------------------------------------------------------
 
-        if ((paused == false) || step)
+        bool changed = false;
+
+        if (numberOfSprites > 0)
+        {
+            if (step || ((paused == false) && (interval == 0)))
+            {
+                nextFrameSpriteBatch(&batch);
+            }
+            else if (paused == false)
+            {
+                animateSpriteBatch(&batch);
+            }
+
+            changed = (batch.numberOfChangedInstances > 0);
+        }
+        else
+        {
+            changed = step ||
+                      ((paused == false) && frameDueSpriteLayer(&sprite));
+        }
+
+        if (changed)
         {
             DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
             assert(update != 0);
 
-            updatePositionSpriteLayer(&sprite, update);
+            if (numberOfSprites > 0)
+            {
+                updateSpriteBatch(&batch, update);
+            }
+            else if (step)
+            {
+                updatePositionSpriteLayer(&sprite, update);
+            }
+            else
+            {
+                animateSpriteLayer(&sprite, update);
+            }
 
             result = vc_dispmanx_update_submit_sync(update);
             assert(result == 0);
+        }
 
-            step = false;
+        step = false;
+
+        //-----------------------------------------------------------------
+
+        int32_t wait = -1;
+
+        if (paused == false)
+        {
+            if (interval == 0)
+            {
+                wait = 0;
+            }
+            else if (numberOfSprites > 0)
+            {
+                wait = timeToNextFrameSpriteBatch(&batch);
+            }
+            else
+            {
+                wait = timeToNextFrameSpriteLayer(&sprite);
+            }
         }
 
-        if (!interactive)
+        if ((interactive == false) && (timeout != 0))
         {
-            usleep(interval*1000);
-            currentTime += interval;
-            if (timeout != 0 && currentTime >= timeout)
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+
+            int64_t remaining = timeout
+                              - ((now.tv_sec - startTime.tv_sec) * 1000)
+                              - ((now.tv_nsec - startTime.tv_nsec) / 1000000);
+
+            if (remaining <= 0)
+            {
                 run = false;
+                continue;
+            }
+
+            if ((wait == -1) || (wait > remaining))
+            {
+                wait = remaining;
+            }
+        }
+
+        if (interactive && isatty(fileno(stdin)))
+        {
+            // Sleep until the next frame is due or a key is pressed.
+
+            struct pollfd keyboard = { fileno(stdin), POLLIN, 0 };
+            poll(&keyboard, 1, wait);
+        }
+        else if (wait > 0)
+        {
+            usleep(wait * 1000);
         }
     }
 
@@ -289,7 +444,15 @@ int main(int argc, char *argv[])
     //---------------------------------------------------------------------
 
     destroyBackgroundLayer(&bg);
-    destroySpriteLayer(&sprite);
+
+    if (numberOfSprites > 0)
+    {
+        destroySpriteBatch(&batch);
+    }
+    else
+    {
+        destroySpriteLayer(&sprite);
+    }
 
     //---------------------------------------------------------------------
 
@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "input.h"
 #include "key.h"
 
 #include "bcm_host.h"
@@ -202,7 +203,7 @@ int main(int argc, char *argv[])
 
     while (keyPressed(NULL) == false)
     {
-        usleep(100000);
+        waitForInput(-1);
     }
 
     //---------------------------------------------------------------------
@@ -37,8 +37,12 @@
 #include "bcm_host.h"
 
 #include "backgroundLayer.h"
+#include "frameLoop.h"
+#include "frameStats.h"
+#include "imageLayer.h"
 #include "image.h"
 #include "key.h"
+#include "threadPool.h"
 #include "worms.h"
 
 //-----------------------------------------------------------------------
@@ -59,12 +63,16 @@ int main(int argc, char *argv[])
     VC_IMAGE_TYPE_T imageType = VC_IMAGE_MIN;
     uint16_t  background = 0x0000;
     uint32_t displayNumber = 0;
+    bool showStats = false;
+    const char *csvPath = NULL;
+    uint32_t numberOfWorms = 36;
+    uint16_t wormLength = 25;
 
     program = basename(argv[0]);
 
     //-------------------------------------------------------------------
 
-    while ((opt = getopt(argc, argv, "b:d:t:")) != -1)
+    while ((opt = getopt(argc, argv, "b:c:d:l:n:st:")) != -1)
     {
         switch (opt)
         {
@@ -73,11 +81,44 @@ int main(int argc, char *argv[])
             background = strtol(optarg, NULL, 16);
             break;
 
+        case 'c':
+
+            csvPath = optarg;
+            break;
+
         case 'd':
 
             displayNumber = strtol(optarg, NULL, 10);
             break;
 
+        case 'l':
+        {
+            long length = strtol(optarg, NULL, 10);
+
+            if ((length < 1) || (length > WORMS_MAX_LENGTH))
+            {
+                fprintf(stderr,
+                        "%s: worm length must be 1 to %d\n",
+                        program,
+                        WORMS_MAX_LENGTH);
+
+                exit(EXIT_FAILURE);
+            }
+
+            wormLength = length;
+            break;
+        }
+
+        case 'n':
+
+            numberOfWorms = strtoul(optarg, NULL, 10);
+            break;
+
+        case 's':
+
+            showStats = true;
+            break;
+
         case 't':
 
             imageTypeName = optarg;
@@ -86,10 +127,16 @@ int main(int argc, char *argv[])
         default:
 
             fprintf(stderr, "Usage: %s \n", program);
-            fprintf(stderr, "[-b <RGBA>] [-d <number>] [-t <type>]\n");
+            fprintf(stderr, "[-b <RGBA>] [-c <file>] [-d <number>]");
+            fprintf(stderr, " [-l <length>] [-n <number>] [-s]");
+            fprintf(stderr, " [-t <type>]\n");
             fprintf(stderr, "    -b - set background colour 16 bit RGBA\n");
             fprintf(stderr, "         e.g. 0x000F is opaque black\n");
+            fprintf(stderr, "    -c - write frame timings to a CSV file\n");
             fprintf(stderr, "    -d - Raspberry Pi display number\n");
+            fprintf(stderr, "    -l - length of each worm (default 25)\n");
+            fprintf(stderr, "    -n - number of worms (default 36)\n");
+            fprintf(stderr, "    -s - show frame timings\n");
             fprintf(stderr, "    -t - type of image to create\n");
             fprintf(stderr, "         can be one of the following:");
             printImageTypes(stderr,
@@ -147,11 +194,26 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
-    uint16_t number_of_worms = 36;
-    uint16_t worm_length = 25;
+    if (numberOfWorms < 1 || wormLength < 1)
+    {
+        fprintf(stderr, "%s: need at least one worm of length 1\n", program);
+        exit(EXIT_FAILURE);
+    }
+
     WORMS_T worms;
 
-    initWorms(number_of_worms, worm_length, &worms, imageType, &info);
+    initWorms(numberOfWorms, wormLength, &worms, imageType, &info);
+
+    //---------------------------------------------------------------------
+
+    IMAGE_LAYER_T statsLayer;
+
+    if (showStats)
+    {
+        initImageLayer(&statsLayer, 168, 104, VC_IMAGE_RGBA16);
+        enableDirtyImageLayer(&statsLayer);
+        createResourceImageLayer(&statsLayer, 3000);
+    }
 
     //---------------------------------------------------------------------
 
@@ -161,11 +223,23 @@ int main(int argc, char *argv[])
     addElementWorms(&worms, display, update);
     addElementBackgroundLayer(&backgroundLayer, display, update);
 
+    if (showStats)
+    {
+        addElementImageLayerOffset(&statsLayer, 0, 0, display, update);
+    }
+
     result = vc_dispmanx_update_submit_sync(update);
     assert(result == 0);
 
     //---------------------------------------------------------------------
 
+    FRAME_STATS_T stats;
+    initFrameStats(&stats);
+
+    FRAME_LOOP_T frameLoop;
+    initFrameLoop(&frameLoop, display);
+    setStatsFrameLoop(&frameLoop, &stats);
+
     struct timeval start_time;
     gettimeofday(&start_time, NULL);
 
@@ -180,10 +254,25 @@ int main(int argc, char *argv[])
 
         //-----------------------------------------------------------------
 
-        undrawWorms(&worms);
+        startFrameStats(&stats, FRAME_STATS_RENDER);
         updateWorms(&worms);
-        drawWorms(&worms);
+        stopFrameStats(&stats, FRAME_STATS_RENDER);
+
+        // The back resource may still be on screen until the previous
+        // update has been applied.
+
+        waitForUpdateFrameLoop(&frameLoop);
+
+        startFrameStats(&stats, FRAME_STATS_UPLOAD);
         writeDataWorms(&worms);
+        stopFrameStats(&stats, FRAME_STATS_UPLOAD);
+
+        endFrameStats(&stats);
+
+        if (showStats && ((frame % 30) == 0))
+        {
+            drawFrameStats(&stats, &statsLayer);
+        }
 
         //-----------------------------------------------------------------
 
@@ -191,9 +280,7 @@ int main(int argc, char *argv[])
         assert(update != 0);
 
         changeSourceWorms(&worms, update);
-
-        result = vc_dispmanx_update_submit_sync(update);
-        assert(result == 0);
+        submitUpdateFrameLoop(&frameLoop, update);
 
         //-----------------------------------------------------------------
 
@@ -215,13 +302,26 @@ int main(int argc, char *argv[])
 
     //---------------------------------------------------------------------
 
+    destroyFrameLoop(&frameLoop);
     keyboardReset();
 
+    if ((csvPath != NULL) && (writeCsvFrameStats(&stats, csvPath) == false))
+    {
+        fprintf(stderr, "%s: cannot write %s\n", program, csvPath);
+    }
+
     //---------------------------------------------------------------------
 
     destroyBackgroundLayer(&backgroundLayer);
     destroyWorms(&worms);
 
+    if (showStats)
+    {
+        destroyImageLayer(&statsLayer);
+    }
+
+    shutdownDefaultThreadPool();
+
     //---------------------------------------------------------------------
 
     result = vc_dispmanx_display_close(display);
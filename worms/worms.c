@@ -29,164 +29,199 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "hsv2rgb.h"
 #include "image.h"
+#include "threadPool.h"
 #include "worms.h"
 
 #include "bcm_host.h"
 
 //-------------------------------------------------------------------------
 
-void
-initWorm(
-    uint16_t worm_number,
-    uint16_t number_of_worms,
-    uint16_t worm_length,
-    WORM_T *worm,
-    IMAGE_T *image)
+// A worm turns by up to 20 degrees either way each step.
+
+#define WORMS_TURN ((20 * WORMS_DIRECTIONS) / 360)
+
+// Below this many worms per thread, the threads cost more than they save.
+
+#define WORMS_MIN_PER_THREAD 2048
+
+//-------------------------------------------------------------------------
+
+// One step in each direction, in 16.16 fixed point.
+
+static int32_t dx[WORMS_DIRECTIONS];
+static int32_t dy[WORMS_DIRECTIONS];
+
+//-------------------------------------------------------------------------
+
+static void *
+allocateWorms(
+    size_t size)
 {
-    hsv2rgb((3600 * worm_number) / number_of_worms,
-            1000,
-            1000,
-            &(worm->colour));
-    
-    worm->colour.alpha = 255;
-    worm->direction = (rand() * 360.0) / RAND_MAX;
-    worm->head = worm_length - 1;
-    worm->size = worm_length;
-    worm->body = malloc(worm->size * sizeof(COORD_T));
-
-    if (worm->body == NULL)
+    void *memory = calloc(1, size);
+
+    if (memory == NULL)
     {
         fprintf(stderr, "worms: memory exhausted\n");
         exit(EXIT_FAILURE);
     }
 
-    double x = (double)rand() * image->width / RAND_MAX;
-    double y = (double)rand() * image->height / RAND_MAX;
-
-    uint16_t i = 0;
-    for (i = 0 ; i < worm->size ; i++)
-    {
-        worm->body[i].x = x;
-        worm->body[i].y = y;
-    }
+    return memory;
 }
 
 //-------------------------------------------------------------------------
 
-void
-updateWorm(
-    WORM_T *worm,
-    IMAGE_T *image)
+// xorshift32, one generator per worm, so the worms move the same however
+// they are split between threads.
+
+static inline uint32_t
+nextRandom(
+    uint32_t *state)
 {
-    uint16_t wasHead = worm->head;
-    worm->head = (worm->head + 1) % worm->size;
+    uint32_t x = *state;
 
-    double x = worm->body[wasHead].x;
-    double y = worm->body[wasHead].y;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
 
-    //---------------------------------------------------------------------
-    // randomly change direction
+    *state = x;
 
-    worm->direction += (40.0 * rand() / RAND_MAX) - 20.0;
+    return x;
+}
 
-    if (worm->direction > 360.0)
-    {
-        worm->direction -= 360.0;
-    }
-    else if (worm->direction < 0.0)
-    {
-        worm->direction += 360.0;
-    }
+//-------------------------------------------------------------------------
 
-    //---------------------------------------------------------------------
-    // calculate new head position
+static inline uint32_t
+packPosition(
+    int32_t x,
+    int32_t y)
+{
+    return ((uint32_t)(y >> 16) << 16) | (uint32_t)(x >> 16);
+}
 
-    x = x + cos(worm->direction * M_PI / 180.0);
+//-------------------------------------------------------------------------
 
-    if (x < 0.0)
-    {
-        x += image->width;
-    }
-    else if (x > image->width)
-    {
-        x -= image->width;
-    }
+static inline void
+putPixelWorms(
+    WORMS_T *worms,
+    uint32_t position,
+    uint32_t colour)
+{
+    int32_t x = position & 0xFFFF;
+    int32_t y = position >> 16;
 
-    y = y + sin(worm->direction * M_PI / 180.0);
+    uint8_t *pixel = (uint8_t *)(worms->image.buffer)
+                   + (y * worms->image.pitch)
+                   + (x * worms->bytesPerPixel);
 
-    if (y < 0.0)
-    {
-        y += image->height;
-    }
-    else if (y > image->height)
+    switch (worms->bytesPerPixel)
     {
-        y -= image->height;
-    }
+    case 4:
 
-    //---------------------------------------------------------------------
+        *(uint32_t *)pixel = colour;
+        break;
 
-    worm->body[worm->head].x = x;
-    worm->body[worm->head].y = y;
-}
+    case 2:
 
-//-------------------------------------------------------------------------
+        *(uint16_t *)pixel = colour;
+        break;
 
-void
-drawWorm(
-    WORM_T *worm,
-    IMAGE_T *image)
-{
-    uint16_t i = 0;
-    for (i = 0 ; i < worm->size ; i++)
-    {
-        setPixelRGB(image,
-                    (int32_t)floor(worm->body[i].x),
-                    (int32_t)floor(worm->body[i].y),
-                    &(worm->colour));
+    default:
+
+        memcpy(pixel, &colour, worms->bytesPerPixel);
+        break;
     }
 }
 
 //-------------------------------------------------------------------------
 
-void
-undrawWorm(
-    WORM_T *worm,
-    IMAGE_T *image)
+// Move worms first to last - 1 on a step. The tail segment becomes the
+// new head; erase and draw record the pixels to clear and set.
+
+static void
+stepWorms(
+    WORMS_T *worms,
+    uint32_t first,
+    uint32_t last)
 {
-    RGBA8_T colour = { 0, 0, 0, 0 };
+    int32_t width = worms->image.width << 16;
+    int32_t height = worms->image.height << 16;
+    uint16_t length = worms->length;
 
-    uint32_t i = 0;
-    for (i = 0 ; i < worm->size ; i++)
+    uint32_t w;
+    for (w = first ; w < last ; w++)
     {
-        setPixelRGB(image,
-                    (int32_t)floor(worm->body[i].x),
-                    (int32_t)floor(worm->body[i].y),
-                    &colour);
+        int32_t *x = worms->x + (w * length);
+        int32_t *y = worms->y + (w * length);
+
+        uint16_t wasHead = worms->head[w];
+        uint16_t head = (wasHead + 1 == length) ? 0 : wasHead + 1;
+
+        worms->erase[w] = packPosition(x[head], y[head]);
+
+        //-----------------------------------------------------------------
+        // randomly change direction
+
+        uint32_t turn = nextRandom(&(worms->random[w])) % (2 * WORMS_TURN + 1);
+
+        uint16_t direction = (worms->direction[w] + turn - WORMS_TURN)
+                           & (WORMS_DIRECTIONS - 1);
+        worms->direction[w] = direction;
+
+        //-----------------------------------------------------------------
+        // calculate new head position
+
+        int32_t nx = x[wasHead] + dx[direction];
+
+        if (nx < 0)
+        {
+            nx += width;
+        }
+        else if (nx >= width)
+        {
+            nx -= width;
+        }
+
+        int32_t ny = y[wasHead] + dy[direction];
+
+        if (ny < 0)
+        {
+            ny += height;
+        }
+        else if (ny >= height)
+        {
+            ny -= height;
+        }
+
+        //-----------------------------------------------------------------
+
+        x[head] = nx;
+        y[head] = ny;
+        worms->head[w] = head;
+        worms->draw[w] = packPosition(nx, ny);
     }
 }
 
 //-------------------------------------------------------------------------
 
-void
-destroyWorm(
-    WORM_T* worm)
+static void
+stepWormsTask(
+    void *arg,
+    int32_t start,
+    int32_t end)
 {
-    free(worm->body);
-
-    worm->head = 0;
-    worm->size = 0;
-    worm->body = NULL;
+    stepWorms(arg, start, end);
 }
 
 //-------------------------------------------------------------------------
 
 void
 initWorms(
-    uint16_t number,
+    uint32_t number,
     uint16_t length,
     WORMS_T *worms,
     VC_IMAGE_TYPE_T imageType,
@@ -195,20 +230,68 @@ initWorms(
     initImage(&(worms->image), imageType, info->width, info->height, false);
     srand(time(NULL));
 
-    worms->size = number;
-    worms->worms = malloc(worms->size * sizeof(WORM_T));
+    worms->bytesPerPixel = worms->image.bitsPerPixel / 8;
 
-    if (worms->worms == NULL)
+    int32_t i;
+    for (i = 0 ; i < WORMS_DIRECTIONS ; i++)
     {
-        fprintf(stderr, "worms: memory exhausted\n");
-        exit(EXIT_FAILURE);
+        double angle = (2.0 * M_PI * i) / WORMS_DIRECTIONS;
+
+        dx[i] = (int32_t)lround(cos(angle) * 65536.0);
+        dy[i] = (int32_t)lround(sin(angle) * 65536.0);
     }
 
-    uint16_t i = 0;
-    for (i = 0 ; i < worms->size ; i++)
+    //---------------------------------------------------------------------
+
+    size_t segments = (size_t)number * length;
+
+    worms->number = number;
+    worms->length = length;
+    worms->x = allocateWorms(segments * sizeof(int32_t));
+    worms->y = allocateWorms(segments * sizeof(int32_t));
+    worms->head = allocateWorms(number * sizeof(uint16_t));
+    worms->direction = allocateWorms(number * sizeof(uint16_t));
+    worms->random = allocateWorms(number * sizeof(uint32_t));
+    worms->colour = allocateWorms(number * sizeof(uint32_t));
+    worms->erase = allocateWorms(number * sizeof(uint32_t));
+    worms->draw = allocateWorms(number * sizeof(uint32_t));
+    worms->coverage = allocateWorms((size_t)(worms->image.width)
+                                    * worms->image.height
+                                    * sizeof(uint32_t));
+
+    // Each worm starts coiled up on a single pixel.
+
+    uint32_t w;
+    for (w = 0 ; w < number ; w++)
     {
-        WORM_T *worm = &(worms->worms[i]);
-        initWorm(i, number, length, worm, &(worms->image));
+        RGBA8_T colour;
+        hsv2rgb((3600 * (uint64_t)w) / number, 1000, 1000, &colour);
+        colour.alpha = 255;
+
+        worms->image.convertRow(&(worms->colour[w]), &colour, 0, 0, 1);
+
+        worms->direction[w] = rand() % WORMS_DIRECTIONS;
+        worms->random[w] = rand() | 1;
+        worms->head[w] = length - 1;
+
+        int32_t x = (int32_t)(((double)rand() / ((double)RAND_MAX + 1.0))
+                              * worms->image.width * 65536.0);
+        int32_t y = (int32_t)(((double)rand() / ((double)RAND_MAX + 1.0))
+                              * worms->image.height * 65536.0);
+
+        uint16_t j;
+        for (j = 0 ; j < length ; j++)
+        {
+            worms->x[(w * length) + j] = x;
+            worms->y[(w * length) + j] = y;
+        }
+
+        uint32_t position = packPosition(x, y);
+
+        worms->coverage[((position >> 16) * worms->image.width)
+                        + (position & 0xFFFF)] += length;
+
+        putPixelWorms(worms, position, worms->colour[w]);
     }
 
     //---------------------------------------------------------------------
@@ -332,39 +415,38 @@ void
 updateWorms(
     WORMS_T *worms)
 {
-    uint16_t i = 0;
-    for (i = 0 ; i < worms->size ; i++)
+    if (worms->number >= 2 * WORMS_MIN_PER_THREAD)
     {
-        WORM_T *worm = &(worms->worms[i]);
-        updateWorm(worm, &(worms->image));
+        forThreadPool(defaultThreadPool(),
+                      worms->number,
+                      WORMS_MIN_PER_THREAD,
+                      stepWormsTask,
+                      worms);
     }
-}
-
-//-------------------------------------------------------------------------
-
-void
-drawWorms(
-    WORMS_T *worms)
-{
-    uint16_t i = 0;
-    for (i = 0 ; i < worms->size ; i++)
+    else
     {
-        WORM_T *worm = &(worms->worms[i]);
-        drawWorm(worm, &(worms->image));
+        stepWorms(worms, 0, worms->number);
     }
-}
 
-//-------------------------------------------------------------------------
+    //---------------------------------------------------------------------
 
-void
-undrawWorms(
-    WORMS_T *worms)
-{
-    uint16_t i = 0;
-    for (i = 0 ; i < worms->size ; i++)
+    int32_t width = worms->image.width;
+
+    uint32_t w;
+    for (w = 0 ; w < worms->number ; w++)
     {
-        WORM_T *worm = &(worms->worms[i]);
-        undrawWorm(worm, &(worms->image));
+        uint32_t erase = worms->erase[w];
+
+        if (--(worms->coverage[((erase >> 16) * width) + (erase & 0xFFFF)])
+            == 0)
+        {
+            putPixelWorms(worms, erase, 0);
+        }
+
+        uint32_t draw = worms->draw[w];
+
+        ++(worms->coverage[((draw >> 16) * width) + (draw & 0xFFFF)]);
+        putPixelWorms(worms, draw, worms->colour[w]);
     }
 }
 
@@ -374,17 +456,20 @@ void
 destroyWorms(
     WORMS_T *worms)
 {
-    uint16_t i = 0;
-    for (i = 0 ; i < worms->size ; i++)
-    {
-        WORM_T *worm = &(worms->worms[i]);
-        destroyWorm(worm);
-    }
-
-    free(worms->worms);
-
-    worms->size = 0;
-    worms->worms = NULL;
+    free(worms->x);
+    free(worms->y);
+    free(worms->head);
+    free(worms->direction);
+    free(worms->random);
+    free(worms->colour);
+    free(worms->erase);
+    free(worms->draw);
+    free(worms->coverage);
+
+    worms->number = 0;
+    worms->x = NULL;
+    worms->y = NULL;
+    worms->coverage = NULL;
 
     destroyImage(&(worms->image));
 
@@ -30,32 +30,44 @@
 
 //-------------------------------------------------------------------------
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "image.h"
 
 #include "bcm_host.h"
 
 //-------------------------------------------------------------------------
 
-typedef struct
-{
-    double x;
-    double y;
-} COORD_T;
+// The worms are held as a structure of arrays. Segment i of worm w is at
+// (x, y)[w * length + i], in 16.16 fixed point, and head[w] is the index
+// of its newest segment. Directions are steps around a circle of
+// WORMS_DIRECTIONS, looked up in a table instead of calling cos and sin.
+//
+// Each step only the tail segment of a worm is erased and its new head
+// drawn. coverage counts the segments on each pixel, so that a pixel is
+// only cleared once the last segment on it has gone. The steps themselves
+// are shared out over the common thread pool; the pixels are then written
+// on the calling thread, two per worm.
 
-typedef struct
-{
-    RGBA8_T colour;
-    double direction;
-    uint16_t head;
-    uint16_t size;
-    COORD_T *body;
-} WORM_T;
+#define WORMS_DIRECTIONS 1024
+#define WORMS_MAX_LENGTH 10000
 
 typedef struct
 {
-    uint16_t size;
-    WORM_T *worms;
+    uint32_t number;
+    uint16_t length;
+    int32_t *x;
+    int32_t *y;
+    uint16_t *head;
+    uint16_t *direction;
+    uint32_t *random;
+    uint32_t *colour;
+    uint32_t *erase;
+    uint32_t *draw;
+    uint32_t *coverage;
     IMAGE_T image;
+    int32_t bytesPerPixel;
     DISPMANX_RESOURCE_HANDLE_T frontResource;
     DISPMANX_RESOURCE_HANDLE_T backResource;
     DISPMANX_ELEMENT_HANDLE_T element;
@@ -65,15 +77,15 @@ typedef struct
 
 void
 initWorms(
-    uint16_t number,
+    uint32_t number,
     uint16_t length,
     WORMS_T *worms,
     VC_IMAGE_TYPE_T imageType,
     DISPMANX_MODEINFO_T *info);
 
+// Move every worm on one step and redraw the pixels that changed.
+
 void updateWorms(WORMS_T *worms);
-void drawWorms(WORMS_T *worms);
-void undrawWorms(WORMS_T *worms);
 
 void
 addElementWorms(